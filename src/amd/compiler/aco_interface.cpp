@@ -27,6 +27,7 @@
 #include "aco_ir.h"
 
 #include "util/memstream.h"
+#include "util/os_time.h"
 
 #include <array>
 #include <iostream>
@@ -69,6 +70,21 @@ aco_get_codegen_flags()
    return aco::debug_flags & ~exclude;
 }
 
+/* Adds the time spent in its scope to aco::time_stats, if set. */
+struct pass_timer {
+   pass_timer(aco::compile_pass pass_) : pass(pass_), start(aco::time_stats ? os_time_get_nano() : 0)
+   {}
+
+   ~pass_timer()
+   {
+      if (aco::time_stats)
+         aco::time_stats->pass_time[pass] += os_time_get_nano() - start;
+   }
+
+   aco::compile_pass pass;
+   int64_t start;
+};
+
 static void
 validate(aco::Program* program)
 {
@@ -127,6 +143,7 @@ aco_postprocess_shader(const struct aco_compiler_options* options,
 
       /* Optimization */
       if (!options->optimisations_disabled) {
+         pass_timer timer(aco::pass_optimizer);
          if (!(aco::debug_flags & aco::DEBUG_NO_VN))
             aco::value_numbering(program.get());
          if (!(aco::debug_flags & aco::DEBUG_NO_OPT))
@@ -140,6 +157,7 @@ aco_postprocess_shader(const struct aco_compiler_options* options,
 
       /* spilling and scheduling */
       live_vars = aco::live_var_analysis(program.get());
+      pass_timer timer(aco::pass_spill);
       aco::spill(program.get(), live_vars);
    }
 
@@ -165,12 +183,17 @@ aco_postprocess_shader(const struct aco_compiler_options* options,
       aco_print_program(program.get(), stderr, live_vars, aco::print_live_vars | aco::print_kill);
 
    if (!info->is_trap_handler_shader) {
-      if (!options->optimisations_disabled && !(aco::debug_flags & aco::DEBUG_NO_SCHED))
+      if (!options->optimisations_disabled && !(aco::debug_flags & aco::DEBUG_NO_SCHED)) {
+         pass_timer timer(aco::pass_scheduler);
          aco::schedule_program(program.get(), live_vars);
+      }
       validate(program.get());
 
       /* Register Allocation */
-      aco::register_allocation(program.get(), live_vars.live_out);
+      {
+         pass_timer timer(aco::pass_register_allocation);
+         aco::register_allocation(program.get(), live_vars.live_out);
+      }
 
       if (aco::validate_ra(program.get())) {
          aco_print_program(program.get(), stderr);
@@ -183,7 +206,10 @@ aco_postprocess_shader(const struct aco_compiler_options* options,
 
       /* Optimization */
       if (!options->optimisations_disabled && !(aco::debug_flags & aco::DEBUG_NO_OPT)) {
-         aco::optimize_postRA(program.get());
+         {
+            pass_timer timer(aco::pass_optimizer);
+            aco::optimize_postRA(program.get());
+         }
          validate(program.get());
       }
 
@@ -194,7 +220,10 @@ aco_postprocess_shader(const struct aco_compiler_options* options,
    aco::lower_to_hw_instr(program.get());
 
    /* Insert Waitcnt */
-   aco::insert_wait_states(program.get());
+   {
+      pass_timer timer(aco::pass_insert_waitcnt);
+      aco::insert_wait_states(program.get());
+   }
    aco::insert_NOPs(program.get());
 
    if (program->gfx_level >= GFX10)
@@ -216,6 +245,8 @@ aco_compile_shader(const struct aco_compiler_options* options,
 {
    aco::init();
 
+   int64_t start_time = aco::time_stats ? os_time_get_nano() : 0;
+
    ac_shader_config config = {0};
    std::unique_ptr<aco::Program> program{new aco::Program};
 
@@ -227,16 +258,35 @@ aco_compile_shader(const struct aco_compiler_options* options,
    program->debug.private_data = options->debug.private_data;
 
    /* Instruction Selection */
-   if (info->is_trap_handler_shader)
-      aco::select_trap_handler_shader(program.get(), shaders[0], &config, options, info, args);
-   else
-      aco::select_program(program.get(), shader_count, shaders, &config, options, info, args);
+   {
+      pass_timer timer(aco::pass_isel);
+      if (info->is_trap_handler_shader)
+         aco::select_trap_handler_shader(program.get(), shaders[0], &config, options, info, args);
+      else
+         aco::select_program(program.get(), shader_count, shaders, &config, options, info, args);
+   }
+
+   if (aco::time_stats) {
+      for (aco::Block& block : program->blocks)
+         aco::time_stats->instructions += block.instructions.size();
+   }
 
    std::string llvm_ir = aco_postprocess_shader(options, info, program);
 
    /* assembly */
    std::vector<uint32_t> code;
-   unsigned exec_size = aco::emit_program(program.get(), code);
+   unsigned exec_size;
+   {
+      pass_timer timer(aco::pass_assembler);
+      exec_size = aco::emit_program(program.get(), code);
+   }
+
+   if (aco::time_stats) {
+      aco::time_stats->total_time += os_time_get_nano() - start_time;
+      aco::time_stats->peak_memory =
+         MAX2(aco::time_stats->peak_memory, program->m.allocated_size());
+      aco::time_stats->shaders++;
+   }
 
    if (program->collect_statistics)
       aco::collect_postasm_stats(program.get(), code);
@@ -34,6 +34,8 @@ namespace aco {
 
 thread_local aco::monotonic_buffer_resource* instruction_buffer = nullptr;
 
+thread_local compile_time_stats* time_stats = nullptr;
+
 uint64_t debug_flags = 0;
 
 static const struct debug_control aco_debug_options[] = {{"validateir", DEBUG_VALIDATE_IR},
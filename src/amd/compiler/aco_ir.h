@@ -58,6 +58,30 @@ enum {
    DEBUG_NO_VALIDATE_IR = 0x400,
 };
 
+enum compile_pass {
+   pass_isel,
+   pass_optimizer,
+   pass_spill,
+   pass_scheduler,
+   pass_register_allocation,
+   pass_insert_waitcnt,
+   pass_assembler,
+   num_compile_passes,
+};
+
+/* Compile-time statistics, used to benchmark ACO itself. */
+struct compile_time_stats {
+   uint64_t pass_time[num_compile_passes]; /* in nanoseconds */
+   uint64_t total_time;                    /* in nanoseconds, including the other passes */
+   uint64_t instructions;                  /* after instruction selection */
+   size_t peak_memory;                     /* largest Program::m of all shaders */
+   unsigned shaders;
+};
+
+/* If set, aco_compile_shader() adds the statistics of the shaders compiled by
+ * this thread to it. */
+extern thread_local compile_time_stats* time_stats;
+
 /**
  * Representation of the instruction's microcode encoding format
  * Note: Some Vector ALU Formats can be combined, such that:
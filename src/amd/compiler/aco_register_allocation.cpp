@@ -32,7 +32,6 @@
 #include <map>
 #include <optional>
 #include <set>
-#include <unordered_map>
 #include <vector>
 
 namespace aco {
@@ -73,12 +72,14 @@ struct ra_ctx {
 
    Program* program;
    Block* block = NULL;
+   monotonic_buffer_resource memory;
    std::vector<assignment> assignments;
-   std::vector<std::unordered_map<unsigned, Temp>> renames;
+   std::vector<aco::unordered_map<uint32_t, Temp>> renames;
    std::vector<uint32_t> loop_header;
-   std::unordered_map<unsigned, Temp> orig_names;
-   std::unordered_map<unsigned, Instruction*> vectors;
-   std::unordered_map<unsigned, Instruction*> split_vectors;
+   aco::unordered_map<uint32_t, Temp> orig_names;
+   /* indexed by temp id: only temps which exist before RA have entries */
+   std::vector<Instruction*> vectors;
+   std::vector<Instruction*> split_vectors;
    aco_ptr<Instruction> pseudo_dummy;
    aco_ptr<Instruction> phi_dummy;
    uint16_t max_used_sgpr = 0;
@@ -91,7 +92,9 @@ struct ra_ctx {
 
    ra_ctx(Program* program_, ra_test_policy policy_)
        : program(program_), assignments(program->peekAllocationId()),
-         renames(program->blocks.size()), policy(policy_)
+         renames(program->blocks.size(), aco::unordered_map<uint32_t, Temp>(memory)),
+         orig_names(memory), vectors(program->peekAllocationId()),
+         split_vectors(program->peekAllocationId()), policy(policy_)
    {
       pseudo_dummy.reset(
          create_instruction<Instruction>(aco_opcode::p_parallelcopy, Format::PSEUDO, 0, 0));
@@ -1568,10 +1571,16 @@ is_mimg_vaddr_intact(ra_ctx& ctx, RegisterFile& reg_file, Instruction* instr)
    return true;
 }
 
+Instruction*
+get_vector(ra_ctx& ctx, uint32_t id)
+{
+   return id < ctx.vectors.size() ? ctx.vectors[id] : NULL;
+}
+
 std::optional<PhysReg>
 get_reg_vector(ra_ctx& ctx, RegisterFile& reg_file, Temp temp, aco_ptr<Instruction>& instr)
 {
-   Instruction* vec = ctx.vectors[temp.id()];
+   Instruction* vec = get_vector(ctx, temp.id());
    unsigned first_operand = vec->format == Format::MIMG ? 3 : 0;
    unsigned our_offset = 0;
    for (unsigned i = first_operand; i < vec->operands.size(); i++) {
@@ -1625,10 +1634,11 @@ get_reg(ra_ctx& ctx, RegisterFile& reg_file, Temp temp,
         std::vector<std::pair<Operand, Definition>>& parallelcopies, aco_ptr<Instruction>& instr,
         int operand_index = -1)
 {
-   auto split_vec = ctx.split_vectors.find(temp.id());
-   if (split_vec != ctx.split_vectors.end()) {
+   Instruction* split_vec =
+      temp.id() < ctx.split_vectors.size() ? ctx.split_vectors[temp.id()] : NULL;
+   if (split_vec) {
       unsigned offset = 0;
-      for (Definition def : split_vec->second->definitions) {
+      for (Definition def : split_vec->definitions) {
          if (ctx.assignments[def.tempId()].affinity) {
             assignment& affinity = ctx.assignments[ctx.assignments[def.tempId()].affinity];
             if (affinity.assigned) {
@@ -1656,7 +1666,7 @@ get_reg(ra_ctx& ctx, RegisterFile& reg_file, Temp temp,
 
    std::optional<PhysReg> res;
 
-   if (ctx.vectors.find(temp.id()) != ctx.vectors.end()) {
+   if (get_vector(ctx, temp.id())) {
       res = get_reg_vector(ctx, reg_file, temp, instr);
       if (res)
          return *res;
@@ -2074,7 +2084,7 @@ get_reg_phi(ra_ctx& ctx, IDSet& live_in, RegisterFile& register_file,
       }
 
       /* rename */
-      std::unordered_map<unsigned, Temp>::iterator orig_it = ctx.orig_names.find(pc.first.tempId());
+      auto orig_it = ctx.orig_names.find(pc.first.tempId());
       Temp orig = orig_it != ctx.orig_names.end() ? orig_it->second : pc.first.getTemp();
       ctx.orig_names[pc.second.tempId()] = orig;
       ctx.renames[block.index][orig.id()] = pc.second.getTemp();
@@ -2192,7 +2202,7 @@ get_regs_for_phis(ra_ctx& ctx, Block& block, RegisterFile& register_file,
 Temp
 read_variable(ra_ctx& ctx, Temp val, unsigned block_idx)
 {
-   std::unordered_map<unsigned, Temp>::iterator it = ctx.renames[block_idx].find(val.id());
+   auto it = ctx.renames[block_idx].find(val.id());
    if (it == ctx.renames[block_idx].end())
       return val;
    else
@@ -2254,7 +2264,7 @@ handle_loop_phis(ra_ctx& ctx, const IDSet& live_in, uint32_t loop_header_idx,
                  uint32_t loop_exit_idx)
 {
    Block& loop_header = ctx.program->blocks[loop_header_idx];
-   std::unordered_map<unsigned, Temp> renames;
+   aco::unordered_map<uint32_t, Temp> renames(ctx.memory);
 
    /* create phis for variables renamed during the loop */
    for (unsigned t : live_in) {
@@ -2302,7 +2312,7 @@ handle_loop_phis(ra_ctx& ctx, const IDSet& live_in, uint32_t loop_header_idx,
          /* Find the original name, since this operand might not use the original name if the phi
           * was created after init_reg_file().
           */
-         std::unordered_map<unsigned, Temp>::iterator it = ctx.orig_names.find(op.tempId());
+         auto it = ctx.orig_names.find(op.tempId());
          Temp orig = it != ctx.orig_names.end() ? it->second : op.getTemp();
 
          op.setTemp(read_variable(ctx, orig, preds[j]));
@@ -2416,7 +2426,7 @@ void
 get_affinities(ra_ctx& ctx, std::vector<IDSet>& live_out_per_block)
 {
    std::vector<std::vector<Temp>> phi_resources;
-   std::unordered_map<unsigned, unsigned> temp_to_phi_resources;
+   aco::unordered_map<uint32_t, uint32_t> temp_to_phi_resources(ctx.memory);
 
    for (auto block_rit = ctx.program->blocks.rbegin(); block_rit != ctx.program->blocks.rend();
         block_rit++) {
@@ -2476,8 +2486,7 @@ get_affinities(ra_ctx& ctx, std::vector<IDSet>& live_out_per_block)
                continue;
             live.erase(def.tempId());
             /* mark last-seen phi operand */
-            std::unordered_map<unsigned, unsigned>::iterator it =
-               temp_to_phi_resources.find(def.tempId());
+            auto it = temp_to_phi_resources.find(def.tempId());
             if (it != temp_to_phi_resources.end() &&
                 def.regClass() == phi_resources[it->second][0].regClass()) {
                phi_resources[it->second][0] = def.getTemp();
@@ -2531,8 +2540,7 @@ get_affinities(ra_ctx& ctx, std::vector<IDSet>& live_out_per_block)
             continue;
 
          assert(instr->definitions[0].isTemp());
-         std::unordered_map<unsigned, unsigned>::iterator it =
-            temp_to_phi_resources.find(instr->definitions[0].tempId());
+         auto it = temp_to_phi_resources.find(instr->definitions[0].tempId());
          unsigned index = phi_resources.size();
          std::vector<Temp>* affinity_related;
          if (it != temp_to_phi_resources.end()) {
@@ -3034,8 +3042,7 @@ register_allocation(Program* program, std::vector<IDSet>& live_out_per_block, ra
 
                /* it might happen that the operand is already renamed. we have to restore the
                 * original name. */
-               std::unordered_map<unsigned, Temp>::iterator it =
-                  ctx.orig_names.find(pc->operands[i].tempId());
+               auto it = ctx.orig_names.find(pc->operands[i].tempId());
                Temp orig = it != ctx.orig_names.end() ? it->second : pc->operands[i].getTemp();
                ctx.orig_names[pc->definitions[i].tempId()] = orig;
                ctx.renames[block.index][orig.id()] = pc->definitions[i].getTemp();
@@ -496,6 +496,15 @@ public:
       buffer->current_idx = 0;
    }
 
+   /* Returns the total size of the buffers allocated so far. */
+   size_t allocated_size() const
+   {
+      size_t size = 0;
+      for (Buffer* b = buffer; b; b = b->next)
+         size += sizeof(Buffer) + b->data_size;
+      return size;
+   }
+
    bool operator==(const monotonic_buffer_resource& other) { return buffer == other.buffer; }
 
 private:
@@ -0,0 +1,327 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include "helpers.h"
+#include "spirv/spirv.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace aco;
+
+static const char* pass_names[num_compile_passes] = {
+   "isel",
+   "optimizer",
+   "spill",
+   "scheduler",
+   "register_allocation",
+   "insert_waitcnt",
+   "assembler",
+};
+
+static void
+print_time_stats(const compile_time_stats& stats)
+{
+   printf("%u shaders, %" PRIu64 " instructions, peak memory %zu KiB\n", stats.shaders,
+          stats.instructions, stats.peak_memory / 1024);
+
+   uint64_t other = stats.total_time;
+   for (unsigned i = 0; i < num_compile_passes; i++) {
+      printf("   %-20s %10.3f ms %5.1f%%\n", pass_names[i], stats.pass_time[i] / 1000000.0,
+             stats.pass_time[i] * 100.0 / MAX2(stats.total_time, 1));
+      other -= MIN2(other, stats.pass_time[i]);
+   }
+   printf("   %-20s %10.3f ms %5.1f%%\n", "other", other / 1000000.0,
+          other * 100.0 / MAX2(stats.total_time, 1));
+   printf("   %-20s %10.3f ms\n", "total", stats.total_time / 1000000.0);
+   printf("   %.0f instructions/s\n", stats.instructions * 1000000000.0 / MAX2(stats.total_time, 1));
+}
+
+struct corpus_binding {
+   uint32_t set;
+   uint32_t binding;
+   VkDescriptorType type;
+   uint32_t count;
+};
+
+struct corpus_shader {
+   std::vector<uint32_t> spirv;
+   std::string entrypoint;
+   std::vector<corpus_binding> bindings;
+};
+
+static bool
+get_descriptor_type(const std::map<uint32_t, const uint32_t*>& types,
+                    const std::set<uint32_t>& buffer_blocks,
+                    const std::map<uint32_t, uint32_t>& constants, uint32_t storage,
+                    uint32_t type, corpus_binding& binding)
+{
+   binding.count = 1;
+
+   auto it = types.find(type);
+   while (it != types.end() &&
+          ((it->second[0] & SpvOpCodeMask) == SpvOpTypeArray ||
+           (it->second[0] & SpvOpCodeMask) == SpvOpTypeRuntimeArray)) {
+      if ((it->second[0] & SpvOpCodeMask) == SpvOpTypeArray) {
+         auto length = constants.find(it->second[3]);
+         if (length == constants.end())
+            return false;
+         binding.count *= length->second;
+      }
+      type = it->second[2];
+      it = types.find(type);
+   }
+
+   switch (storage) {
+   case SpvStorageClassStorageBuffer:
+      binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      return true;
+   case SpvStorageClassUniform:
+      binding.type = buffer_blocks.count(type) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                               : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      return true;
+   case SpvStorageClassUniformConstant:
+      break;
+   default:
+      return false;
+   }
+
+   if (it == types.end())
+      return false;
+
+   const uint32_t* w = it->second;
+   switch (w[0] & SpvOpCodeMask) {
+   case SpvOpTypeSampler:
+      binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+      return true;
+   case SpvOpTypeSampledImage:
+      it = types.find(w[2]);
+      if (it == types.end())
+         return false;
+      binding.type = it->second[3] == SpvDimBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER
+                                                   : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      return true;
+   case SpvOpTypeImage:
+      /* w[3] is the dimensionality, w[7] is 2 for storage images */
+      if (w[3] == SpvDimBuffer)
+         binding.type = w[7] == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                                  : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      else
+         binding.type = w[7] == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                                  : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+      return true;
+   default:
+      /* acceleration structures and the like aren't supported */
+      return false;
+   }
+}
+
+/* Finds the compute entrypoint and the descriptors the pipeline layout needs,
+ * which the GLSL scraper provides for the other tests.
+ */
+static bool
+reflect_compute_shader(corpus_shader& shader)
+{
+   const std::vector<uint32_t>& words = shader.spirv;
+   if (words.size() < 5 || words[0] != SpvMagicNumber)
+      return false;
+
+   std::map<uint32_t, const uint32_t*> types;
+   std::map<uint32_t, uint32_t> constants, sets, bindings;
+   std::set<uint32_t> buffer_blocks;
+   std::vector<std::pair<uint32_t, uint32_t>> variables;
+
+   for (size_t i = 5; i < words.size();) {
+      const uint32_t* w = &words[i];
+      unsigned count = w[0] >> SpvWordCountShift;
+      if (!count || count > words.size() - i)
+         return false;
+
+      switch (w[0] & SpvOpCodeMask) {
+      case SpvOpEntryPoint:
+         if (count > 3 && w[1] == SpvExecutionModelGLCompute && shader.entrypoint.empty())
+            shader.entrypoint = std::string((const char*)&w[3], strnlen((const char*)&w[3],
+                                                                        (count - 3) * 4));
+         break;
+      case SpvOpDecorate:
+         if (count > 3 && w[2] == SpvDecorationBinding)
+            bindings[w[1]] = w[3];
+         else if (count > 3 && w[2] == SpvDecorationDescriptorSet)
+            sets[w[1]] = w[3];
+         else if (w[2] == SpvDecorationBufferBlock)
+            buffer_blocks.insert(w[1]);
+         break;
+      case SpvOpConstant:
+         if (count > 3)
+            constants[w[2]] = w[3];
+         break;
+      case SpvOpTypeImage:
+         if (count > 8)
+            types[w[1]] = w;
+         break;
+      case SpvOpTypeSampler:
+      case SpvOpTypeSampledImage:
+      case SpvOpTypeArray:
+      case SpvOpTypeRuntimeArray:
+      case SpvOpTypePointer:
+         if (count > 2)
+            types[w[1]] = w;
+         break;
+      case SpvOpVariable:
+         if (count > 3)
+            variables.emplace_back(w[2], w[1]);
+         break;
+      default:
+         break;
+      }
+
+      i += count;
+   }
+
+   if (shader.entrypoint.empty())
+      return false;
+
+   for (const std::pair<uint32_t, uint32_t>& var : variables) {
+      auto binding = bindings.find(var.first);
+      auto pointer = types.find(var.second);
+      if (binding == bindings.end() || pointer == types.end() ||
+          (pointer->second[0] & SpvOpCodeMask) != SpvOpTypePointer)
+         continue;
+
+      corpus_binding desc;
+      desc.set = sets.count(var.first) ? sets[var.first] : 0;
+      desc.binding = binding->second;
+      if (!get_descriptor_type(types, buffer_blocks, constants, pointer->second[2],
+                               pointer->second[3], desc))
+         return false;
+
+      /* the limits of PipelineBuilder */
+      if (desc.set >= 64 ||
+          std::count_if(shader.bindings.begin(), shader.bindings.end(),
+                        [&](const corpus_binding& b) { return b.set == desc.set; }) >= 64)
+         return false;
+
+      shader.bindings.push_back(desc);
+   }
+
+   return true;
+}
+
+/* Loads the compute shaders among the SPIR-V binaries (*.spv) in a directory,
+ * sorted by name so that runs are comparable.
+ */
+static std::vector<corpus_shader>
+load_corpus(const char* dir_name, unsigned* num_files)
+{
+   std::vector<corpus_shader> corpus;
+   std::vector<std::string> names;
+
+   *num_files = 0;
+
+   DIR* dir = opendir(dir_name);
+   if (!dir)
+      return corpus;
+
+   while (struct dirent* entry = readdir(dir)) {
+      size_t len = strlen(entry->d_name);
+      if (len > 4 && !strcmp(entry->d_name + len - 4, ".spv"))
+         names.push_back(entry->d_name);
+   }
+   closedir(dir);
+
+   std::sort(names.begin(), names.end());
+   *num_files = names.size();
+
+   for (const std::string& name : names) {
+      std::string path = std::string(dir_name) + "/" + name;
+      FILE* f = fopen(path.c_str(), "rb");
+      if (!f)
+         continue;
+
+      corpus_shader shader;
+      fseek(f, 0, SEEK_END);
+      long size = ftell(f);
+      fseek(f, 0, SEEK_SET);
+      if (size > 0 && size % 4 == 0) {
+         shader.spirv.resize(size / 4);
+         if (fread(shader.spirv.data(), 4, shader.spirv.size(), f) != shader.spirv.size())
+            shader.spirv.clear();
+      }
+      fclose(f);
+
+      if (reflect_compute_shader(shader))
+         corpus.push_back(std::move(shader));
+   }
+
+   return corpus;
+}
+
+/* Compiles a corpus of compute shaders with each GFX level and reports the
+ * time spent in each pass.  Only runs when ACO_BENCHMARK_CORPUS names a
+ * directory with SPIR-V binaries, ACO_BENCHMARK_ITERATIONS sets how many times
+ * the corpus is compiled, for example:
+ * ACO_BENCHMARK_CORPUS=~/corpus ACO_BENCHMARK_ITERATIONS=100 \
+ *    aco_tests --no-check bench.compile/gfx10_3
+ */
+BEGIN_TEST(bench.compile)
+   /* Without a variant nothing is reported, like for filtered out variants */
+   const char* corpus_dir = getenv("ACO_BENCHMARK_CORPUS");
+   if (!corpus_dir)
+      return;
+
+   const char* iterations_str = getenv("ACO_BENCHMARK_ITERATIONS");
+   unsigned iterations = iterations_str ? MAX2(atoi(iterations_str), 1) : 1;
+
+   unsigned num_files;
+   std::vector<corpus_shader> corpus = load_corpus(corpus_dir, &num_files);
+   if (corpus.empty()) {
+      fail_test("No compute shaders in '%s'", corpus_dir);
+      return;
+   }
+   printf("%zu of %u SPIR-V files in '%s' are usable compute shaders\n", corpus.size(), num_files,
+          corpus_dir);
+
+   for (unsigned i = GFX9; i <= GFX11; i++) {
+      if (!set_variant((amd_gfx_level)i))
+         continue;
+
+      VkDevice device = get_vk_device((amd_gfx_level)i);
+
+      compile_time_stats stats = {};
+      time_stats = &stats;
+      for (unsigned j = 0; j < iterations; j++) {
+         for (const corpus_shader& shader : corpus) {
+            PipelineBuilder pbld(device);
+            pbld.push_constant_range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, 128};
+
+            /* PipelineBuilder only creates the used sets, keep the numbering */
+            uint32_t num_sets = 0;
+            for (const corpus_binding& b : shader.bindings) {
+               pbld.add_desc_binding(VK_SHADER_STAGE_COMPUTE_BIT, b.set, b.binding, b.type,
+                                     b.count);
+               num_sets = MAX2(num_sets, b.set + 1);
+            }
+            pbld.desc_layouts_used |= BITFIELD64_MASK(num_sets);
+
+            QoShaderModuleCreateInfo module = {};
+            module.spirvSize = shader.spirv.size() * 4;
+            module.pSpirv = shader.spirv.data();
+            module.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            pbld.add_stage(VK_SHADER_STAGE_COMPUTE_BIT, module, shader.entrypoint.c_str());
+            pbld.create_pipeline();
+         }
+      }
+      time_stats = nullptr;
+
+      print_time_stats(stats);
+
+      //! success
+      if (stats.shaders && stats.instructions)
+         fprintf(output, "success\n");
+   }
+END_TEST
@@ -0,0 +1,192 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include "helpers.h"
+
+#include "util/os_time.h"
+#include "util/u_debug.h"
+
+#include <algorithm>
+
+using namespace aco;
+
+static void
+add_edge(unsigned from, unsigned to)
+{
+   program->blocks[to].logical_preds.push_back(from);
+   program->blocks[to].linear_preds.push_back(from);
+}
+
+static void
+emit_branch(aco_opcode opcode, Temp cond = Temp())
+{
+   aco_ptr<Pseudo_branch_instruction> branch{create_instruction<Pseudo_branch_instruction>(
+      opcode, Format::PSEUDO_BRANCH, cond.id() ? 1 : 0, 1)};
+   branch->definitions[0] = bld.def(s2);
+   if (cond.id())
+      branch->operands[0] = bld.scc(cond);
+   bld.insert(std::move(branch));
+}
+
+/* A sequence of uniform loops, each with num_values VGPR phis and a body
+ * which mixes them and passes them through vectors, so that RA has affinities
+ * to follow and values to move.
+ */
+static void
+build_loops(unsigned num_loops, unsigned num_values, unsigned rounds)
+{
+   /* Blocks are referenced by pointer while they are created */
+   program->blocks.reserve(1 + num_loops * 4);
+   bld.reset(&program->blocks[0]);
+
+   bld.pseudo(aco_opcode::p_logical_start);
+
+   std::vector<Temp> values;
+   for (unsigned i = 0; i < num_values; i++)
+      values.push_back(bld.vop2(aco_opcode::v_add_f32, bld.def(v1), Operand::c32(i), inputs[0]));
+
+   for (unsigned l = 0; l < num_loops; l++) {
+      Block* preheader = &program->blocks.back();
+      bld.pseudo(aco_opcode::p_logical_end);
+      emit_branch(aco_opcode::p_branch);
+      preheader->kind |= block_kind_loop_preheader | block_kind_uniform;
+
+      Block* header = program->create_and_insert_block();
+      header->kind |= block_kind_loop_header | block_kind_uniform;
+      header->loop_nest_depth = 1;
+      add_edge(preheader->index, header->index);
+      bld.reset(header);
+
+      std::vector<Instruction*> phis;
+      for (unsigned i = 0; i < num_values; i++) {
+         aco_ptr<Pseudo_instruction> phi{
+            create_instruction<Pseudo_instruction>(aco_opcode::p_phi, Format::PSEUDO, 2, 1)};
+         phi->operands[0] = Operand(values[i]);
+         values[i] = bld.tmp(v1);
+         phi->definitions[0] = Definition(values[i]);
+         phis.push_back(phi.get());
+         bld.insert(std::move(phi));
+      }
+      Temp counter = bld.tmp(s1);
+      aco_ptr<Pseudo_instruction> counter_phi{
+         create_instruction<Pseudo_instruction>(aco_opcode::p_linear_phi, Format::PSEUDO, 2, 1)};
+      counter_phi->operands[0] = Operand::zero();
+      counter_phi->definitions[0] = Definition(counter);
+      Instruction* counter_phi_instr = counter_phi.get();
+      bld.insert(std::move(counter_phi));
+
+      bld.pseudo(aco_opcode::p_logical_start);
+      for (unsigned r = 0; r < rounds; r++) {
+         for (unsigned i = 0; i < num_values; i++) {
+            Temp other = values[(i * 7 + r + 3) % num_values];
+            values[i] = bld.vop2((i + r) & 1 ? aco_opcode::v_mul_f32 : aco_opcode::v_add_f32,
+                                 bld.def(v1), values[i], other);
+         }
+         for (unsigned i = 0; i + 4 <= num_values; i += 4 + (r & 1) * 4) {
+            Temp vec = bld.pseudo(aco_opcode::p_create_vector, bld.def(v4), values[i],
+                                  values[i + 1], values[i + 2], values[i + 3]);
+            Temp x = bld.tmp(v1), y = bld.tmp(v1), z = bld.tmp(v1), w = bld.tmp(v1);
+            bld.pseudo(aco_opcode::p_split_vector, Definition(x), Definition(y), Definition(z),
+                       Definition(w), vec);
+            values[i] = y;
+            values[i + 1] = x;
+            values[i + 2] = w;
+            values[i + 3] = bld.vop2(aco_opcode::v_add_f32, bld.def(v1), z, values[i]);
+         }
+         for (unsigned i = 1; i + 2 <= num_values; i += 6) {
+            Temp vec =
+               bld.pseudo(aco_opcode::p_create_vector, bld.def(v2), values[i + 1], values[i]);
+            Temp x = bld.tmp(v1), y = bld.tmp(v1);
+            bld.pseudo(aco_opcode::p_split_vector, Definition(x), Definition(y), vec);
+            values[i] = x;
+            values[i + 1] = y;
+         }
+      }
+      Temp next =
+         bld.sop2(aco_opcode::s_add_u32, bld.def(s1), bld.def(s1, scc), counter, Operand::c32(1u));
+      Temp cond = bld.sopc(aco_opcode::s_cmp_lg_u32, bld.def(s1, scc), next, inputs[1]);
+      bld.pseudo(aco_opcode::p_logical_end);
+      emit_branch(aco_opcode::p_cbranch_z, cond);
+
+      Block* break_block = program->create_and_insert_block();
+      break_block->kind |= block_kind_break | block_kind_uniform;
+      break_block->loop_nest_depth = 1;
+      add_edge(header->index, break_block->index);
+      bld.reset(break_block);
+      bld.pseudo(aco_opcode::p_logical_start);
+      bld.pseudo(aco_opcode::p_logical_end);
+      emit_branch(aco_opcode::p_branch);
+
+      Block* continue_block = program->create_and_insert_block();
+      continue_block->kind |= block_kind_continue | block_kind_uniform;
+      continue_block->loop_nest_depth = 1;
+      add_edge(header->index, continue_block->index);
+      bld.reset(continue_block);
+      bld.pseudo(aco_opcode::p_logical_start);
+      bld.pseudo(aco_opcode::p_logical_end);
+      emit_branch(aco_opcode::p_branch);
+      add_edge(continue_block->index, header->index);
+
+      for (unsigned i = 0; i < num_values; i++)
+         phis[i]->operands[1] = Operand(values[i]);
+      counter_phi_instr->operands[1] = Operand(next);
+
+      Block* loop_exit = program->create_and_insert_block();
+      loop_exit->kind |= block_kind_loop_exit | block_kind_top_level;
+      add_edge(break_block->index, loop_exit->index);
+      bld.reset(loop_exit);
+      bld.pseudo(aco_opcode::p_logical_start);
+   }
+
+   for (unsigned i = 0; i < num_values; i++)
+      writeout(i, values[i]);
+   bld.pseudo(aco_opcode::p_logical_end);
+}
+
+/* Times register allocation of a large program, about 160k instructions in
+ * 800 blocks.  Only runs with ACO_BENCHMARK_REGALLOC=true,
+ * ACO_BENCHMARK_ITERATIONS sets how many times it is allocated, for example:
+ * ACO_BENCHMARK_REGALLOC=true ACO_BENCHMARK_ITERATIONS=11 \
+ *    aco_tests --no-check bench.regalloc
+ */
+BEGIN_TEST(bench.regalloc)
+   if (!debug_get_bool_option("ACO_BENCHMARK_REGALLOC", false))
+      return;
+
+   const char* iterations_str = getenv("ACO_BENCHMARK_ITERATIONS");
+   unsigned iterations = iterations_str ? MAX2(atoi(iterations_str), 1) : 1;
+
+   if (!set_variant(GFX10_3))
+      return;
+
+   std::vector<int64_t> times;
+   for (unsigned i = 0; i < iterations; i++) {
+      create_program(GFX10_3, compute_cs, 64, CHIP_NAVI21);
+      inputs[0] = bld.tmp(v1);
+      inputs[1] = bld.tmp(s1);
+      bld.pseudo(aco_opcode::p_startpgm, Definition(inputs[0]), Definition(inputs[1]));
+      build_loops(200, 48, 8);
+      finish_program(program.get());
+      if (!i && !validate_ir(program.get())) {
+         fail_test("Validation before register allocation failed");
+         return;
+      }
+
+      live live_vars = live_var_analysis(program.get());
+      int64_t start = os_time_get_nano();
+      register_allocation(program.get(), live_vars.live_out);
+      times.push_back(os_time_get_nano() - start);
+
+      if (!i && validate_ra(program.get())) {
+         fail_test("Validation after register allocation failed");
+         return;
+      }
+   }
+
+   std::sort(times.begin(), times.end());
+   printf("register_allocation: median %.3f ms, min %.3f ms, max %.3f ms\n",
+          times[times.size() / 2] / 1000000.0, times[0] / 1000000.0, times.back() / 1000000.0);
+
+   //! success
+   fprintf(output, "success\n");
+END_TEST
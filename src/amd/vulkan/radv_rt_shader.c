@@ -1615,7 +1615,8 @@ move_rt_instructions(nir_shader *shader)
    }
 
    nir_metadata_preserve(nir_shader_get_entrypoint(shader),
-                         nir_metadata_all & (~nir_metadata_instr_index));
+                         nir_metadata_all &
+                            ~(nir_metadata_instr_index | nir_metadata_range_analysis));
 }
 
 nir_shader *
@@ -211,9 +211,8 @@ shader_cache_read_program_metadata(struct gl_context *ctx,
    disk_cache_compute_key(cache, buf, strlen(buf), prog->data->sha1);
    ralloc_free(buf);
 
-   size_t size;
-   uint8_t *buffer = (uint8_t *) disk_cache_get(cache, prog->data->sha1,
-                                                &size);
+   struct disk_cache_blob *buffer = disk_cache_get_blob(cache,
+                                                        prog->data->sha1);
    if (buffer == NULL) {
       /* Cached program not found. We may have seen the individual shaders
        * before and skipped compiling but they may not have been used together
@@ -236,7 +235,7 @@ shader_cache_read_program_metadata(struct gl_context *ctx,
    }
 
    struct blob_reader metadata;
-   blob_reader_init(&metadata, buffer, size);
+   blob_reader_init(&metadata, buffer->data, buffer->size);
 
    bool deserialized = deserialize_glsl_program(&metadata, ctx, prog);
 
@@ -253,14 +252,14 @@ shader_cache_read_program_metadata(struct gl_context *ctx,
 
       disk_cache_remove(cache, prog->data->sha1);
       compile_shaders(ctx, prog);
-      free(buffer);
+      disk_cache_blob_unref(buffer);
       return false;
    }
 
    /* This is used to flag a shader retrieved from cache */
    prog->data->LinkStatus = LINKING_SKIPPED;
 
-   free (buffer);
+   disk_cache_blob_unref(buffer);
 
    return true;
 }
@@ -89,6 +89,8 @@ static const struct debug_named_value nir_debug_control[] = {
      "Print const value near each use of const SSA variable" },
    { "print_internal", NIR_DEBUG_PRINT_INTERNAL,
      "Print shaders even if they are marked as internal" },
+   { "algebraic_all_comm", NIR_DEBUG_ALGEBRAIC_ALL_COMM,
+     "Try every commutative source order in nir_opt_algebraic, even the ones that can't match" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -197,6 +199,7 @@ nir_shader_create(void *mem_ctx,
 #ifndef NDEBUG
    nir_process_debug_variable();
 #endif
+   nir_pass_profile_init();
 
    exec_list_make_empty(&shader->variables);
 
@@ -545,6 +548,7 @@ nir_function_impl_create_bare(nir_shader *shader)
    impl->ssa_alloc = 0;
    impl->num_blocks = 0;
    impl->valid_metadata = nir_metadata_none;
+   impl->range_ht = NULL;
    impl->structured = true;
 
    /* create start & end blocks */
@@ -2143,7 +2147,9 @@ nir_index_ssa_defs(nir_function_impl *impl)
 {
    unsigned index = 0;
 
-   impl->valid_metadata &= ~nir_metadata_live_ssa_defs;
+   /* The unsigned upper bounds are cached by SSA index */
+   impl->valid_metadata &= ~(nir_metadata_live_ssa_defs |
+                             nir_metadata_range_analysis);
 
    nir_foreach_block_unstructured(block, impl) {
       nir_foreach_instr(instr, block)
@@ -89,6 +89,7 @@ extern bool nir_debug_print_shader[MESA_SHADER_KERNEL + 1];
 #define NIR_DEBUG_PRINT_KS               (1u << 19)
 #define NIR_DEBUG_PRINT_CONSTS           (1u << 20)
 #define NIR_DEBUG_PRINT_INTERNAL         (1u << 21)
+#define NIR_DEBUG_ALGEBRAIC_ALL_COMM     (1u << 22)
 
 #define NIR_DEBUG_PRINT (NIR_DEBUG_PRINT_VS  | \
                          NIR_DEBUG_PRINT_TCS | \
@@ -3104,6 +3105,20 @@ typedef enum {
     */
    nir_metadata_instr_index = 0x20,
 
+   /** Indicates that the results cached in nir_function_impl::range_ht are
+    * valid.
+    *
+    * The table can be passed to nir_analyze_range() and, with the default
+    * config, to nir_unsigned_upper_bound().  It also caches the results of
+    * nir_ssa_def_bits_used().
+    *
+    * A pass can preserve this metadata type if it never changes an SSA
+    * value or its uses, or if it keeps the cache up to date itself with
+    * nir_invalidate_range_analysis() and nir_invalidate_bits_used(), as
+    * nir_algebraic_impl() does.  Most passes shouldn't preserve it.
+    */
+   nir_metadata_range_analysis = 0x40,
+
    /** All metadata
     *
     * This includes all nir_metadata flags except not_properly_reset.  Passes
@@ -3154,6 +3169,9 @@ typedef struct {
    bool structured;
 
    nir_metadata valid_metadata;
+
+   /** Cached range analysis results, see nir_metadata_range_analysis */
+   struct hash_table *range_ht;
 } nir_function_impl;
 
 #define nir_foreach_function_temp_variable(var, impl) \
@@ -4561,6 +4579,31 @@ static inline bool should_skip_nir(UNUSED const char *pass_name) { return false;
 static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
 #endif /* NDEBUG */
 
+extern bool nir_pass_profile_enabled;
+
+void nir_pass_profile_init(void);
+uint64_t _nir_pass_profile_begin(const char *pass);
+void _nir_pass_profile_end(const nir_shader *shader, const char *pass,
+                           const char *file, uint64_t start, bool progress);
+
+/* Pass profiling hooks of NIR_PASS / NIR_PASS_V, see nir_pass_profile.c */
+static inline uint64_t
+nir_pass_profile_begin(const char *pass)
+{
+   if (unlikely(nir_pass_profile_enabled))
+      return _nir_pass_profile_begin(pass);
+
+   return 0;
+}
+
+static inline void
+nir_pass_profile_end(const nir_shader *shader, const char *pass,
+                     const char *file, uint64_t start, bool progress)
+{
+   if (unlikely(nir_pass_profile_enabled))
+      _nir_pass_profile_end(shader, pass, file, start, progress);
+}
+
 #define _PASS(pass, nir, do_pass) do {                               \
    if (should_skip_nir(#pass)) {                                     \
       printf("skipping %s\n", #pass);                                \
@@ -4580,7 +4623,11 @@ static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir(nir))                                        \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   uint64_t _pass_start = nir_pass_profile_begin(#pass);             \
+   bool _pass_progress = pass(nir, ##__VA_ARGS__);                   \
+   nir_pass_profile_end(nir, #pass, __FILE__, _pass_start,           \
+                        _pass_progress);                             \
+   if (_pass_progress) {                                             \
       nir_validate_shader(nir, "after " #pass " in " __FILE__);      \
       UNUSED bool _;                                                 \
       progress = true;                                               \
@@ -4593,7 +4640,9 @@ static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir,                  \
    if (should_print_nir(nir))                                        \
       printf("%s\n", #pass);                                         \
+   uint64_t _pass_start = nir_pass_profile_begin(#pass);             \
    pass(nir, ##__VA_ARGS__);                                         \
+   nir_pass_profile_end(nir, #pass, __FILE__, _pass_start, false);   \
    nir_validate_shader(nir, "after " #pass " in " __FILE__);         \
    if (should_print_nir(nir))                                        \
       nir_print_shader(nir, stdout);                                 \
@@ -5750,6 +5799,7 @@ bool nir_opt_algebraic_before_ffma(nir_shader *shader);
 bool nir_opt_algebraic_late(nir_shader *shader);
 bool nir_opt_algebraic_distribute_src_mods(nir_shader *shader);
 bool nir_opt_constant_folding(nir_shader *shader);
+bool nir_opt_constant_folding_instr(struct nir_builder *b, nir_instr *instr);
 
 /* Try to combine a and b into a.  Return true if combination was possible,
  * which will result in b being removed by the pass.  Return false if
@@ -5764,6 +5814,9 @@ bool nir_opt_combine_barriers(nir_shader *shader,
 
 bool nir_opt_combine_stores(nir_shader *shader, nir_variable_mode modes);
 
+bool nir_opt_combined(nir_shader *shader);
+
+bool nir_copy_prop_src(nir_function_impl *impl, nir_src *src);
 bool nir_copy_prop_impl(nir_function_impl *impl);
 bool nir_copy_prop(nir_shader *shader);
 
@@ -5868,6 +5921,7 @@ bool nir_opt_ray_queries(nir_shader *shader);
 bool nir_opt_ray_query_ranges(nir_shader *shader);
 
 void nir_sweep(nir_shader *shader);
+bool nir_compact(nir_shader *shader);
 
 void nir_remap_dual_slot_attributes(nir_shader *shader,
                                     uint64_t *dual_slot_inputs);
@@ -5917,6 +5971,8 @@ nir_addition_might_overflow(nir_shader *shader, struct hash_table *range_ht,
                             nir_ssa_scalar ssa, unsigned const_val,
                             const nir_unsigned_upper_bound_config *config);
 
+void nir_reset_range_analysis_impl(nir_function_impl *impl);
+
 typedef struct {
    /* True if gl_DrawID is considered uniform, i.e. if the preamble is run
     * at least once per "internal" draw rather than per user-visible draw.
@@ -68,8 +68,21 @@ instr_can_rewrite(const nir_instr *instr)
    case nir_instr_type_load_const:
    case nir_instr_type_phi:
       return true;
-   case nir_instr_type_intrinsic:
-      return nir_intrinsic_can_reorder(nir_instr_as_intrinsic(instr));
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+      if (nir_intrinsic_can_reorder(intrin))
+         return true;
+
+      /* Other memory loads, such as load_global, which nir_opt_access() or
+       * the driver found to read memory that doesn't change. Only the later
+       * of two such loads is removed, so this doesn't make any load execute
+       * where it didn't before.
+       */
+      return (nir_intrinsic_infos[intrin->intrinsic].flags &
+              NIR_INTRINSIC_CAN_ELIMINATE) &&
+             nir_intrinsic_has_access(intrin) &&
+             (nir_intrinsic_access(intrin) & ACCESS_CAN_REORDER);
+   }
    case nir_instr_type_call:
    case nir_instr_type_jump:
    case nir_instr_type_ssa_undef:
@@ -106,6 +119,153 @@ hash_alu_src(uint32_t hash, const nir_alu_src *src, unsigned num_components)
    return hash;
 }
 
+/* Trees of the same associative and commutative integer operation are
+ * compared by the values they combine, so that (a + b) + c and a + (c + b)
+ * are found to be the same. Only the first few levels of the tree are looked
+ * at, which keeps hashing constant time.
+ */
+#define MAX_ASSOC_LEAVES 8
+
+struct assoc_leaf {
+   const nir_ssa_def *def;
+   uint8_t swizzle[NIR_MAX_VEC_COMPONENTS];
+};
+
+struct assoc_leaves {
+   unsigned count;
+   struct assoc_leaf leaf[MAX_ASSOC_LEAVES];
+};
+
+static bool
+is_reassociable_op(nir_op op)
+{
+   switch (op) {
+   case nir_op_iadd:
+   case nir_op_imul:
+   case nir_op_iand:
+   case nir_op_ior:
+   case nir_op_ixor:
+   case nir_op_imin:
+   case nir_op_imax:
+   case nir_op_umin:
+   case nir_op_umax:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/* Whether the sources of the instruction are the operands of a tree of the
+ * given operation. The wrapping flags are only known to hold for the order
+ * the operations are done in, so those trees aren't reassociated.
+ */
+static bool
+is_assoc_node(const nir_alu_instr *alu, nir_op op)
+{
+   return alu->op == op && !alu->no_signed_wrap && !alu->no_unsigned_wrap &&
+          !alu->src[0].abs && !alu->src[0].negate &&
+          !alu->src[1].abs && !alu->src[1].negate;
+}
+
+static void
+set_assoc_leaf(struct assoc_leaf *leaf, const nir_alu_src *src,
+               const uint8_t *swizzle, unsigned num_components)
+{
+   leaf->def = src->src.ssa;
+   memset(leaf->swizzle, 0, sizeof(leaf->swizzle));
+   for (unsigned i = 0; i < num_components; i++)
+      leaf->swizzle[i] = src->swizzle[swizzle[i]];
+}
+
+static int
+cmp_assoc_leaf(const struct assoc_leaf *a, const struct assoc_leaf *b)
+{
+   if (a->def != b->def)
+      return a->def < b->def ? -1 : 1;
+
+   return memcmp(a->swizzle, b->swizzle, sizeof(a->swizzle));
+}
+
+/* Collects the leaves of the tree rooted at the instruction in a canonical
+ * order. Returns false if the instruction isn't such a tree.
+ */
+static bool
+get_assoc_leaves(const nir_alu_instr *alu, struct assoc_leaves *leaves)
+{
+   if (!is_reassociable_op(alu->op) || !is_assoc_node(alu, alu->op))
+      return false;
+
+   static const uint8_t identity[NIR_MAX_VEC_COMPONENTS] = {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+   };
+   unsigned num_components = alu->dest.dest.ssa.num_components;
+
+   leaves->count = 2;
+   set_assoc_leaf(&leaves->leaf[0], &alu->src[0], identity, num_components);
+   set_assoc_leaf(&leaves->leaf[1], &alu->src[1], identity, num_components);
+
+   /* Expand the leaves that are themselves nodes of the tree. Trees bigger
+    * than that are only found to be equal if they have the same shape.
+    */
+   for (unsigned i = 0; i < leaves->count &&
+                        leaves->count < MAX_ASSOC_LEAVES;) {
+      struct assoc_leaf *leaf = &leaves->leaf[i];
+      nir_instr *parent = leaf->def->parent_instr;
+
+      if (parent->type != nir_instr_type_alu ||
+          !is_assoc_node(nir_instr_as_alu(parent), alu->op)) {
+         i++;
+         continue;
+      }
+
+      const nir_alu_instr *node = nir_instr_as_alu(parent);
+      uint8_t swizzle[NIR_MAX_VEC_COMPONENTS];
+      memcpy(swizzle, leaf->swizzle, sizeof(swizzle));
+
+      set_assoc_leaf(leaf, &node->src[0], swizzle, num_components);
+      set_assoc_leaf(&leaves->leaf[leaves->count++], &node->src[1], swizzle,
+                     num_components);
+   }
+
+   /* Insertion sort, there are only a few of them */
+   for (unsigned i = 1; i < leaves->count; i++) {
+      struct assoc_leaf tmp = leaves->leaf[i];
+      unsigned j = i;
+      for (; j > 0 && cmp_assoc_leaf(&leaves->leaf[j - 1], &tmp) > 0; j--)
+         leaves->leaf[j] = leaves->leaf[j - 1];
+      leaves->leaf[j] = tmp;
+   }
+
+   return true;
+}
+
+static uint32_t
+hash_assoc_leaves(uint32_t hash, const struct assoc_leaves *leaves,
+                  unsigned num_components)
+{
+   for (unsigned i = 0; i < leaves->count; i++) {
+      hash = HASH(hash, leaves->leaf[i].def);
+      hash = XXH32(leaves->leaf[i].swizzle, num_components, hash);
+   }
+
+   return hash;
+}
+
+static bool
+assoc_leaves_equal(const struct assoc_leaves *leaves1,
+                   const struct assoc_leaves *leaves2)
+{
+   if (leaves1->count != leaves2->count)
+      return false;
+
+   for (unsigned i = 0; i < leaves1->count; i++) {
+      if (cmp_assoc_leaf(&leaves1->leaf[i], &leaves2->leaf[i]) != 0)
+         return false;
+   }
+
+   return true;
+}
+
 static uint32_t
 hash_alu(uint32_t hash, const nir_alu_instr *instr)
 {
@@ -119,7 +279,11 @@ hash_alu(uint32_t hash, const nir_alu_instr *instr)
    hash = HASH(hash, instr->dest.dest.ssa.num_components);
    hash = HASH(hash, instr->dest.dest.ssa.bit_size);
 
-   if (nir_op_infos[instr->op].algebraic_properties & NIR_OP_IS_2SRC_COMMUTATIVE) {
+   struct assoc_leaves leaves;
+   if (get_assoc_leaves(instr, &leaves)) {
+      hash = hash_assoc_leaves(hash, &leaves,
+                               instr->dest.dest.ssa.num_components);
+   } else if (nir_op_infos[instr->op].algebraic_properties & NIR_OP_IS_2SRC_COMMUTATIVE) {
       assert(nir_op_infos[instr->op].num_inputs >= 2);
 
       uint32_t hash0 = hash_alu_src(hash, &instr->src[0],
@@ -580,6 +744,14 @@ nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2)
       if (alu1->dest.dest.ssa.bit_size != alu2->dest.dest.ssa.bit_size)
          return false;
 
+      struct assoc_leaves leaves1, leaves2;
+      bool is_assoc1 = get_assoc_leaves(alu1, &leaves1);
+      bool is_assoc2 = get_assoc_leaves(alu2, &leaves2);
+      if (is_assoc1 || is_assoc2) {
+         return is_assoc1 && is_assoc2 &&
+                assoc_leaves_equal(&leaves1, &leaves2);
+      }
+
       if (nir_op_infos[alu1->op].algebraic_properties & NIR_OP_IS_2SRC_COMMUTATIVE) {
          if ((!nir_alu_srcs_equal(alu1, alu2, 0, 0) ||
               !nir_alu_srcs_equal(alu1, alu2, 1, 1)) &&
@@ -813,18 +985,18 @@ nir_instr_set_destroy(struct set *instr_set)
    _mesa_set_destroy(instr_set, NULL);
 }
 
-bool
-nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
-                             bool (*cond_function) (const nir_instr *a,
-                                                    const nir_instr *b))
+nir_instr *
+nir_instr_set_add_or_rewrite_match(struct set *instr_set, nir_instr *instr,
+                                   bool (*cond_function) (const nir_instr *a,
+                                                          const nir_instr *b))
 {
    if (!instr_can_rewrite(instr))
-      return false;
+      return NULL;
 
    struct set_entry *e = _mesa_set_search_or_add(instr_set, instr, NULL);
    nir_instr *match = (nir_instr *) e->key;
    if (match == instr)
-      return false;
+      return NULL;
 
    if (!cond_function || cond_function(match, instr)) {
       /* rewrite instruction if condition is matched */
@@ -843,14 +1015,23 @@ nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
 
       nir_instr_remove(instr);
 
-      return true;
+      return match;
    } else {
       /* otherwise, replace hashed instruction */
       e->key = instr;
-      return false;
+      return NULL;
    }
 }
 
+bool
+nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
+                             bool (*cond_function) (const nir_instr *a,
+                                                    const nir_instr *b))
+{
+   return nir_instr_set_add_or_rewrite_match(instr_set, instr,
+                                             cond_function) != NULL;
+}
+
 void
 nir_instr_set_remove(struct set *instr_set, nir_instr *instr)
 {
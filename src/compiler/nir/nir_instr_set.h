@@ -59,6 +59,15 @@ bool nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
                                   bool (*cond_function)(const nir_instr *a,
                                                         const nir_instr *b));
 
+/**
+ * Same as nir_instr_set_add_or_rewrite(), but returns the instruction the
+ * uses were rewritten to, or NULL if they weren't.
+ */
+nir_instr *
+nir_instr_set_add_or_rewrite_match(struct set *instr_set, nir_instr *instr,
+                                   bool (*cond_function)(const nir_instr *a,
+                                                         const nir_instr *b));
+
 /**
  * Removes an instruction from an instruction set, so that other instructions
  * won't be merged with it.
@@ -0,0 +1,333 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_worklist.h"
+#include "util/u_dynarray.h"
+
+/*
+ * A worklist-driven combination of copy propagation, constant folding and
+ * dead code elimination.
+ *
+ * Optimization loops usually run nir_copy_prop, nir_opt_dce and
+ * nir_opt_constant_folding until none of them makes progress, which walks
+ * every instruction of the shader in each iteration even though only few of
+ * them changed. Here every instruction is visited once up front and then
+ * only the instructions affected by a change are visited again: the users
+ * of a value that was folded or turned out to be a copy, and the sources of
+ * a removed instruction, which may be dead now. The result is a fixed point
+ * of the loop
+ *
+ *    do {
+ *       progress = false;
+ *       NIR_PASS(progress, shader, nir_copy_prop);
+ *       NIR_PASS(progress, shader, nir_opt_dce);
+ *       NIR_PASS(progress, shader, nir_opt_constant_folding);
+ *    } while (progress);
+ *
+ * and usually identical to its result, but the cost is linear in the size of
+ * the shader rather than in the size times the number of iterations.
+ *
+ * It isn't a drop-in replacement for a nir_copy_prop + nir_opt_dce pair in
+ * the middle of a driver loop: it also folds constants, so the passes after
+ * it see a different shader.  Drivers have to opt in, with shader-db numbers
+ * to back the switch.
+ */
+
+#define IN_WORKLIST 0x1
+
+struct combined_state {
+   nir_function_impl *impl;
+   nir_builder b;
+
+   nir_instr_worklist *worklist;
+
+   /* Removed instructions, freed at the end as they may still be queued */
+   struct util_dynarray dead_instrs;
+
+   /* Scratch space for the instructions to revisit after folding */
+   struct util_dynarray revisit;
+
+   /* load_constant intrinsics that couldn't be folded */
+   struct util_dynarray load_consts;
+   bool has_load_constant;
+   bool has_indirect_load_const;
+
+   bool progress;
+};
+
+static inline bool
+instr_is_removed(nir_instr *instr)
+{
+   return instr->node.next == NULL;
+}
+
+static void
+push_instr(struct combined_state *state, nir_instr *instr)
+{
+   if (instr_is_removed(instr) || (instr->pass_flags & IN_WORKLIST))
+      return;
+
+   instr->pass_flags |= IN_WORKLIST;
+   nir_instr_worklist_push_tail(state->worklist, instr);
+}
+
+static bool
+push_src_parent_cb(nir_src *src, void *_state)
+{
+   if (src->is_ssa)
+      push_instr(_state, src->ssa->parent_instr);
+
+   return true;
+}
+
+static bool
+add_users_cb(nir_ssa_def *def, void *_state)
+{
+   struct combined_state *state = _state;
+
+   nir_foreach_use(src, def)
+      util_dynarray_append(&state->revisit, nir_instr *, src->parent_instr);
+
+   return true;
+}
+
+static bool
+add_src_parent_cb(nir_src *src, void *_state)
+{
+   struct combined_state *state = _state;
+
+   if (src->is_ssa)
+      util_dynarray_append(&state->revisit, nir_instr *,
+                           src->ssa->parent_instr);
+
+   return true;
+}
+
+static bool
+dest_is_unused_cb(nir_dest *dest, void *_unused)
+{
+   return dest->is_ssa && nir_ssa_def_is_unused(&dest->ssa);
+}
+
+/* Same as the liveness rules of nir_opt_dce(), except that cycles of dead
+ * phis aren't detected.
+ */
+static bool
+instr_is_dead(nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu:
+   case nir_instr_type_deref:
+   case nir_instr_type_tex:
+   case nir_instr_type_phi:
+      return nir_foreach_dest(instr, dest_is_unused_cb, NULL);
+
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+      const nir_intrinsic_info *info = &nir_intrinsic_infos[intrin->intrinsic];
+
+      if (!(info->flags & NIR_INTRINSIC_CAN_ELIMINATE))
+         return false;
+
+      return !info->has_dest || dest_is_unused_cb(&intrin->dest, NULL);
+   }
+
+   case nir_instr_type_load_const:
+      return nir_ssa_def_is_unused(&nir_instr_as_load_const(instr)->def);
+
+   case nir_instr_type_ssa_undef:
+      return nir_ssa_def_is_unused(&nir_instr_as_ssa_undef(instr)->def);
+
+   default:
+      return false;
+   }
+}
+
+/* Removes the instruction and queues its sources, which may be dead now */
+static void
+remove_instr(struct combined_state *state, nir_instr *instr)
+{
+   if (!instr_is_removed(instr))
+      nir_instr_remove(instr);
+
+   /* The sources still point to their values after removal */
+   nir_foreach_src(instr, push_src_parent_cb, state);
+
+   util_dynarray_append(&state->dead_instrs, nir_instr *, instr);
+   state->progress = true;
+}
+
+/* Let the users of a mov or vecN read the copied value instead, the same as
+ * nir_copy_prop() does.
+ */
+static void
+copy_prop_uses(struct combined_state *state, nir_alu_instr *copy)
+{
+   nir_ssa_def *def = &copy->dest.dest.ssa;
+
+   nir_foreach_use_including_if_safe(src, def) {
+      if (!nir_copy_prop_src(state->impl, src))
+         continue;
+
+      state->progress = true;
+
+      if (!src->is_if)
+         push_instr(state, src->parent_instr);
+
+      if (src->ssa == def) {
+         /* The mov reading the copy was replaced by a vecN inserted right
+          * after it, see nir_copy_prop_src(). Visit the vecN as well.
+          */
+         nir_instr *vec = nir_instr_next(src->parent_instr);
+         vec->pass_flags = 0;
+         push_instr(state, vec);
+      } else {
+         /* The copied value may be a copy that couldn't be propagated into
+          * its previous users but can be propagated into this one.
+          */
+         push_instr(state, src->ssa->parent_instr);
+      }
+   }
+}
+
+static void
+process_instr(struct combined_state *state, nir_instr *instr)
+{
+   if (instr_is_dead(instr)) {
+      remove_instr(state, instr);
+      return;
+   }
+
+   /* Copies are propagated before they are folded, so their users don't end
+    * up reading a new constant per swizzle.
+    */
+   if (instr->type == nir_instr_type_alu) {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+
+      if (alu->dest.dest.is_ssa && nir_alu_instr_is_copy(alu)) {
+         copy_prop_uses(state, alu);
+
+         if (instr_is_dead(instr)) {
+            remove_instr(state, instr);
+            return;
+         }
+      }
+   }
+
+   bool is_load_constant =
+      instr->type == nir_instr_type_intrinsic &&
+      nir_instr_as_intrinsic(instr)->intrinsic == nir_intrinsic_load_constant;
+   if (is_load_constant)
+      state->has_load_constant = true;
+
+   /* Folding rewrites the users of the instruction and may remove some of
+    * the texture sources, so remember what to revisit.
+    */
+   util_dynarray_clear(&state->revisit);
+   nir_foreach_ssa_def(instr, add_users_cb, state);
+   if (instr->type == nir_instr_type_tex)
+      nir_foreach_src(instr, add_src_parent_cb, state);
+
+   if (nir_opt_constant_folding_instr(&state->b, instr)) {
+      state->progress = true;
+
+      util_dynarray_foreach(&state->revisit, nir_instr *, revisit)
+         push_instr(state, *revisit);
+
+      if (instr_is_removed(instr))
+         remove_instr(state, instr);
+      else
+         push_instr(state, instr);
+
+      return;
+   }
+
+   if (is_load_constant)
+      util_dynarray_append(&state->load_consts, nir_instr *, instr);
+}
+
+static bool
+nir_opt_combined_impl(nir_function_impl *impl, struct combined_state *state)
+{
+   state->impl = impl;
+   state->progress = false;
+   nir_builder_init(&state->b, impl);
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         instr->pass_flags = 0;
+         push_instr(state, instr);
+      }
+   }
+
+   nir_instr *instr;
+   while ((instr = nir_instr_worklist_pop_head(state->worklist))) {
+      instr->pass_flags &= ~IN_WORKLIST;
+
+      if (!instr_is_removed(instr))
+         process_instr(state, instr);
+   }
+
+   /* Some of the loads may have been folded after all */
+   util_dynarray_foreach(&state->load_consts, nir_instr *, load)
+      state->has_indirect_load_const |= !instr_is_removed(*load);
+   util_dynarray_clear(&state->load_consts);
+
+   util_dynarray_foreach(&state->dead_instrs, nir_instr *, dead)
+      nir_instr_free(*dead);
+   util_dynarray_clear(&state->dead_instrs);
+
+   if (state->progress) {
+      nir_metadata_preserve(impl, nir_metadata_block_index |
+                                  nir_metadata_dominance);
+   } else {
+      nir_metadata_preserve(impl, nir_metadata_all);
+   }
+
+   return state->progress;
+}
+
+bool
+nir_opt_combined(nir_shader *shader)
+{
+   struct combined_state state;
+   bool progress = false;
+
+   state.worklist = nir_instr_worklist_create();
+   if (!state.worklist)
+      return false;
+
+   util_dynarray_init(&state.dead_instrs, NULL);
+   util_dynarray_init(&state.revisit, NULL);
+   util_dynarray_init(&state.load_consts, NULL);
+   state.has_load_constant = false;
+   state.has_indirect_load_const = false;
+
+   nir_foreach_function(function, shader) {
+      if (function->impl && nir_opt_combined_impl(function->impl, &state))
+         progress = true;
+   }
+
+   /* Cycles of dead phis aren't found by looking at the uses */
+   progress |= nir_opt_dce(shader);
+
+   /* Same as nir_opt_constant_folding(), the constant data can go once all
+    * the loads of it were folded.
+    */
+   if (state.has_load_constant && !state.has_indirect_load_const &&
+       shader->constant_data_size) {
+      ralloc_free(shader->constant_data);
+      shader->constant_data = NULL;
+      shader->constant_data_size = 0;
+   }
+
+   util_dynarray_fini(&state.load_consts);
+   util_dynarray_fini(&state.revisit);
+   util_dynarray_fini(&state.dead_instrs);
+   nir_instr_worklist_destroy(state.worklist);
+
+   return progress;
+}
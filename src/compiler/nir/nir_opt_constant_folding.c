@@ -101,7 +101,6 @@ try_fold_alu(nir_builder *b, nir_alu_instr *alu)
                                        dest);
    nir_ssa_def_rewrite_uses(&alu->dest.dest.ssa, imm);
    nir_instr_remove(&alu->instr);
-   nir_instr_free(&alu->instr);
 
    return true;
 }
@@ -175,8 +174,7 @@ fail:
 }
 
 static bool
-try_fold_intrinsic(nir_builder *b, nir_intrinsic_instr *intrin,
-                   struct constant_fold_state *state)
+try_fold_intrinsic(nir_builder *b, nir_intrinsic_instr *intrin)
 {
    switch (intrin->intrinsic) {
    case nir_intrinsic_demote_if:
@@ -223,12 +221,8 @@ try_fold_intrinsic(nir_builder *b, nir_intrinsic_instr *intrin,
    }
 
    case nir_intrinsic_load_constant: {
-      state->has_load_constant = true;
-
-      if (!nir_src_is_const(intrin->src[0])) {
-         state->has_indirect_load_const = true;
+      if (!nir_src_is_const(intrin->src[0]))
          return false;
-      }
 
       unsigned offset = nir_src_as_uint(intrin->src[0]);
       unsigned base = nir_intrinsic_base(intrin);
@@ -359,14 +353,20 @@ try_fold_tex(nir_builder *b, nir_tex_instr *tex)
    return progress;
 }
 
-static bool
-try_fold_instr(nir_builder *b, nir_instr *instr, void *_state)
+/**
+ * Constant fold a single instruction.
+ *
+ * Folded ALU and intrinsic instructions are removed from the shader, but
+ * not freed, which is left to the caller.
+ */
+bool
+nir_opt_constant_folding_instr(nir_builder *b, nir_instr *instr)
 {
    switch (instr->type) {
    case nir_instr_type_alu:
       return try_fold_alu(b, nir_instr_as_alu(instr));
    case nir_instr_type_intrinsic:
-      return try_fold_intrinsic(b, nir_instr_as_intrinsic(instr), _state);
+      return try_fold_intrinsic(b, nir_instr_as_intrinsic(instr));
    case nir_instr_type_tex:
       return try_fold_tex(b, nir_instr_as_tex(instr));
    default:
@@ -375,6 +375,28 @@ try_fold_instr(nir_builder *b, nir_instr *instr, void *_state)
    }
 }
 
+static bool
+try_fold_instr(nir_builder *b, nir_instr *instr, void *_state)
+{
+   struct constant_fold_state *state = _state;
+
+   if (instr->type == nir_instr_type_intrinsic &&
+       nir_instr_as_intrinsic(instr)->intrinsic == nir_intrinsic_load_constant) {
+      state->has_load_constant = true;
+
+      if (!nir_src_is_const(nir_instr_as_intrinsic(instr)->src[0]))
+         state->has_indirect_load_const = true;
+   }
+
+   if (!nir_opt_constant_folding_instr(b, instr))
+      return false;
+
+   if (instr->type == nir_instr_type_alu)
+      nir_instr_free(instr);
+
+   return true;
+}
+
 bool
 nir_opt_constant_folding(nir_shader *shader)
 {
@@ -122,6 +122,37 @@ copy_propagate(nir_src *src, nir_alu_instr *copy)
    return true;
 }
 
+static bool
+copy_propagate_src(nir_function_impl *impl, nir_src *src, nir_alu_instr *copy)
+{
+   if (!src->is_if && src->parent_instr->type == nir_instr_type_alu)
+      return copy_propagate_alu(impl, container_of(src, nir_alu_src, src), copy);
+   else
+      return copy_propagate(src, copy);
+}
+
+/**
+ * Replace a source that reads the result of a mov or vecN by the value that
+ * is copied.
+ *
+ * If the source is read by a mov that can't be rewritten to read a single
+ * value, the mov is replaced by a vecN inserted right after it instead and
+ * the source is left alone.
+ */
+bool
+nir_copy_prop_src(nir_function_impl *impl, nir_src *src)
+{
+   if (!src->is_ssa || src->ssa->parent_instr->type != nir_instr_type_alu)
+      return false;
+
+   nir_alu_instr *copy = nir_instr_as_alu(src->ssa->parent_instr);
+
+   if (!copy->dest.dest.is_ssa || !nir_alu_instr_is_copy(copy))
+      return false;
+
+   return copy_propagate_src(impl, src, copy);
+}
+
 static bool
 copy_prop_instr(nir_function_impl *impl, nir_instr *instr)
 {
@@ -135,12 +166,8 @@ copy_prop_instr(nir_function_impl *impl, nir_instr *instr)
 
    bool progress = false;
 
-   nir_foreach_use_including_if_safe(src, &mov->dest.dest.ssa) {
-      if (!src->is_if && src->parent_instr->type == nir_instr_type_alu)
-         progress |= copy_propagate_alu(impl, container_of(src, nir_alu_src, src), mov);
-      else
-         progress |= copy_propagate(src, mov);
-   }
+   nir_foreach_use_including_if_safe(src, &mov->dest.dest.ssa)
+      progress |= copy_propagate_src(impl, src, mov);
 
    if (progress && nir_ssa_def_is_unused(&mov->dest.dest.ssa))
       nir_instr_remove(&mov->instr);
@@ -25,12 +25,63 @@
 
 /*
  * Implements common subexpression elimination
+ *
+ * Instructions are visited in the order of the blocks, which is compatible
+ * with dominance, and replaced by an equal instruction found earlier if that
+ * one dominates them. This is value numbering across the whole impl, with
+ * nir_instr_set doing the hash-consing, which also finds commutative and
+ * reassociated forms of the same expression.
+ *
+ * Values computed in both branches of an if are computed once before the if
+ * instead.
+ */
+
+static bool
+src_dominates_block(nir_src *src, void *block)
+{
+   return nir_block_dominates(src->ssa->parent_instr->block, block);
+}
+
+/* Whether the two instructions are at the top level of the two branches of
+ * the same if, and the first one can be moved to the block before the if, so
+ * that it dominates both. Only ALU instructions and constants are moved,
+ * which have no side effects and are cheap, should the branch jump before
+ * reaching them.
  */
+static bool
+can_hoist_out_of_if(const nir_instr *old_instr, const nir_instr *new_instr)
+{
+   if (old_instr->type != nir_instr_type_alu &&
+       old_instr->type != nir_instr_type_load_const)
+      return false;
+
+   nir_cf_node *parent = old_instr->block->cf_node.parent;
+   if (parent->type != nir_cf_node_if ||
+       new_instr->block->cf_node.parent != parent)
+      return false;
+
+   nir_if *nif = nir_cf_node_as_if(parent);
+   nir_block *then_block = nir_if_first_then_block(nif);
+   nir_block *else_block = nir_if_first_else_block(nif);
+   if (!(nir_block_dominates(then_block, old_instr->block) &&
+         nir_block_dominates(else_block, new_instr->block)) &&
+       !(nir_block_dominates(else_block, old_instr->block) &&
+         nir_block_dominates(then_block, new_instr->block)))
+      return false;
 
+   nir_block *block = nir_cf_node_as_block(nir_cf_node_prev(parent));
+   return !nir_block_ends_in_jump(block) &&
+          nir_foreach_src((nir_instr *)old_instr, src_dominates_block, block);
+}
+
+/* The instruction already in the set may have to be moved before it
+ * dominates the new one, see can_hoist_out_of_if()
+ */
 static bool
 dominates(const nir_instr *old_instr, const nir_instr *new_instr)
 {
-   return nir_block_dominates(old_instr->block, new_instr->block);
+   return nir_block_dominates(old_instr->block, new_instr->block) ||
+          can_hoist_out_of_if(old_instr, new_instr);
 }
 
 static bool
@@ -44,8 +95,20 @@ nir_opt_cse_impl(nir_function_impl *impl)
 
    bool progress = false;
    nir_foreach_block(block, impl) {
-      nir_foreach_instr_safe(instr, block)
-         progress |= nir_instr_set_add_or_rewrite(instr_set, instr, dominates);
+      nir_foreach_instr_safe(instr, block) {
+         nir_instr *match =
+            nir_instr_set_add_or_rewrite_match(instr_set, instr, dominates);
+         if (!match)
+            continue;
+
+         /* The uses of instr are now uses of match, see dominates() */
+         if (!nir_block_dominates(match->block, block)) {
+            nir_cf_node *nif = match->block->cf_node.parent;
+            nir_block *prev = nir_cf_node_as_block(nir_cf_node_prev(nif));
+            nir_instr_move(nir_after_block(prev), match);
+         }
+         progress = true;
+      }
    }
 
    if (progress) {
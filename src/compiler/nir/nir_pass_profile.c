@@ -0,0 +1,255 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Per-pass profiler for NIR_PASS / NIR_PASS_V.
+ *
+ * Enabled with NIR_PASS_PROFILE=true. Every pass run through the NIR_PASS
+ * macros records its wall time, whether it made progress and where it was
+ * called from. The statistics are aggregated per pass, shader stage and
+ * calling source file (which tells the drivers apart) and a report sorted
+ * by the total time is printed to stderr at exit. The passes also show up
+ * as slices in Perfetto traces.
+ *
+ * The times are inclusive, i.e. passes that run other passes through
+ * NIR_PASS also account for the time of the nested passes.
+ */
+
+#include "nir.h"
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
+#include "util/simple_mtx.h"
+#include "util/u_call_once.h"
+#include "util/u_debug.h"
+#include "util/u_process.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool nir_pass_profile_enabled = false;
+
+struct pass_profile_key {
+   const char *pass;
+   const char *file;
+   gl_shader_stage stage;
+};
+
+struct pass_profile_entry {
+   struct pass_profile_key key;
+   uint64_t calls;
+   uint64_t progress;
+   uint64_t time_ns;
+};
+
+static simple_mtx_t profile_mtx = SIMPLE_MTX_INITIALIZER;
+static struct hash_table *profile_ht;
+
+static uint32_t
+pass_profile_key_hash(const void *data)
+{
+   const struct pass_profile_key *key = data;
+   uint32_t hash = _mesa_hash_string(key->pass);
+
+   hash = hash * 31 + _mesa_hash_string(key->file);
+   return hash * 31 + key->stage;
+}
+
+static bool
+pass_profile_key_equal(const void *a, const void *b)
+{
+   const struct pass_profile_key *ka = a;
+   const struct pass_profile_key *kb = b;
+
+   return ka->stage == kb->stage &&
+          !strcmp(ka->pass, kb->pass) &&
+          !strcmp(ka->file, kb->file);
+}
+
+/* Strip everything up to the source directory to keep the report short */
+static const char *
+short_file_name(const char *file)
+{
+   const char *src = strstr(file, "src/");
+
+   return src ? src + 4 : file;
+}
+
+static int
+entry_compare_time(const void *_a, const void *_b)
+{
+   const struct pass_profile_entry *a = *(const struct pass_profile_entry **)_a;
+   const struct pass_profile_entry *b = *(const struct pass_profile_entry **)_b;
+
+   if (a->time_ns == b->time_ns)
+      return 0;
+
+   return a->time_ns < b->time_ns ? 1 : -1;
+}
+
+static void
+print_entries(struct pass_profile_entry **entries, unsigned num_entries,
+              uint64_t total_ns, bool details)
+{
+   qsort(entries, num_entries, sizeof(*entries), entry_compare_time);
+
+   fprintf(stderr, "%12s %6s %10s %10s %6s  %s\n",
+           "time (ms)", "%", "calls", "progress", "hit %",
+           details ? "stage  pass (caller)" : "pass");
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      const struct pass_profile_entry *e = entries[i];
+
+      fprintf(stderr, "%12.3f %6.2f %10"PRIu64" %10"PRIu64" %6.1f  ",
+              e->time_ns / 1000000.0,
+              total_ns ? e->time_ns * 100.0 / total_ns : 0.0,
+              e->calls, e->progress,
+              e->calls ? e->progress * 100.0 / e->calls : 0.0);
+
+      if (details) {
+         fprintf(stderr, "%-5s  %s (%s)\n",
+                 _mesa_shader_stage_to_abbrev(e->key.stage), e->key.pass,
+                 short_file_name(e->key.file));
+      } else {
+         fprintf(stderr, "%s\n", e->key.pass);
+      }
+   }
+}
+
+static void
+nir_pass_profile_report(void)
+{
+   struct pass_profile_entry **entries, **totals;
+   struct hash_table *pass_ht;
+   unsigned num_entries, num_totals = 0, i = 0;
+   uint64_t total_ns = 0;
+
+   simple_mtx_lock(&profile_mtx);
+
+   num_entries = _mesa_hash_table_num_entries(profile_ht);
+   if (!num_entries)
+      goto out;
+
+   entries = malloc(num_entries * sizeof(*entries));
+   totals = calloc(num_entries, sizeof(*totals));
+   pass_ht = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                     _mesa_key_string_equal);
+   if (!entries || !totals || !pass_ht)
+      goto cleanup;
+
+   /* Sum up the time of each pass over all the stages and callers */
+   hash_table_foreach(profile_ht, he) {
+      struct pass_profile_entry *e = he->data, *total;
+
+      entries[i++] = e;
+
+      struct hash_entry *pass_he = _mesa_hash_table_search(pass_ht,
+                                                           e->key.pass);
+      if (pass_he) {
+         total = pass_he->data;
+      } else {
+         total = calloc(1, sizeof(*total));
+         if (!total)
+            goto cleanup;
+
+         total->key.pass = e->key.pass;
+         totals[num_totals++] = total;
+         _mesa_hash_table_insert(pass_ht, e->key.pass, total);
+      }
+
+      total->calls += e->calls;
+      total->progress += e->progress;
+      total->time_ns += e->time_ns;
+   }
+
+   /* Nested passes are counted twice, hence this is only an approximation
+    * of the total time spent in the passes.
+    */
+   for (i = 0; i < num_entries; i++)
+      total_ns += entries[i]->time_ns;
+
+   fprintf(stderr, "NIR pass profile of %s\n", util_get_process_name());
+
+   fprintf(stderr, "\nPer pass:\n");
+   print_entries(totals, num_totals, total_ns, false);
+
+   fprintf(stderr, "\nPer pass, stage and caller:\n");
+   print_entries(entries, num_entries, total_ns, true);
+
+cleanup:
+   for (i = 0; i < num_totals; i++)
+      free(totals[i]);
+   free(totals);
+   free(entries);
+   _mesa_hash_table_destroy(pass_ht, NULL);
+out:
+   simple_mtx_unlock(&profile_mtx);
+}
+
+static void
+nir_pass_profile_init_once(void)
+{
+   if (!debug_get_bool_option("NIR_PASS_PROFILE", false))
+      return;
+
+   profile_ht = _mesa_hash_table_create(NULL, pass_profile_key_hash,
+                                        pass_profile_key_equal);
+   if (!profile_ht)
+      return;
+
+   atexit(nir_pass_profile_report);
+   nir_pass_profile_enabled = true;
+}
+
+void
+nir_pass_profile_init(void)
+{
+   static once_flag flag = ONCE_FLAG_INIT;
+   call_once(&flag, nir_pass_profile_init_once);
+}
+
+uint64_t
+_nir_pass_profile_begin(const char *pass)
+{
+   MESA_TRACE_BEGIN(pass);
+
+   return os_time_get_nano();
+}
+
+void
+_nir_pass_profile_end(const nir_shader *shader, const char *pass,
+                      const char *file, uint64_t start, bool progress)
+{
+   uint64_t time_ns = os_time_get_nano() - start;
+   struct pass_profile_key key = {
+      .pass = pass,
+      .file = file,
+      .stage = shader->info.stage,
+   };
+   struct pass_profile_entry *entry;
+
+   MESA_TRACE_END();
+
+   simple_mtx_lock(&profile_mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(profile_ht, &key);
+   if (he) {
+      entry = he->data;
+   } else {
+      entry = calloc(1, sizeof(*entry));
+      if (!entry) {
+         simple_mtx_unlock(&profile_mtx);
+         return;
+      }
+
+      entry->key = key;
+      _mesa_hash_table_insert(profile_ht, &entry->key, entry);
+   }
+
+   entry->calls++;
+   entry->progress += progress;
+   entry->time_ns += time_ns;
+
+   simple_mtx_unlock(&profile_mtx);
+}
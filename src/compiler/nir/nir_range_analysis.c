@@ -1926,6 +1926,93 @@ nir_unsigned_upper_bound(nir_shader *shader, struct hash_table *range_ht,
    return perform_analysis(&state);
 }
 
+static bool
+remove_range_results(struct hash_table *range_ht, const nir_ssa_def *def)
+{
+   bool removed = false;
+
+   if (def->parent_instr->type == nir_instr_type_alu) {
+      uintptr_t ptr = (uintptr_t)nir_instr_as_alu(def->parent_instr);
+
+      /* See get_fp_key() */
+      for (uintptr_t type_encoding = 0; type_encoding < 4; type_encoding++) {
+         struct hash_entry *he =
+            _mesa_hash_table_search(range_ht, (void *)(ptr | type_encoding));
+         if (he) {
+            _mesa_hash_table_remove(range_ht, he);
+            removed = true;
+         }
+      }
+   }
+
+   for (unsigned i = 0; i < def->num_components; i++) {
+      struct uub_query q;
+      q.scalar = nir_get_ssa_scalar((nir_ssa_def *)def, i);
+
+      uintptr_t key = get_uub_key(&q.head);
+      struct hash_entry *he =
+         key ? _mesa_hash_table_search(range_ht, (void *)key) : NULL;
+      if (he) {
+         _mesa_hash_table_remove(range_ht, he);
+         removed = true;
+      }
+   }
+
+   return removed;
+}
+
+/**
+ * Removes the results in range_ht that were derived from the value, which
+ * has to be done before the value is replaced by one that isn't exactly the
+ * same.
+ *
+ * The analyses store the result for every value they look at, so only the
+ * users of values that have results need to be looked at.
+ */
+void
+nir_invalidate_range_analysis(struct hash_table *range_ht, nir_ssa_def *def)
+{
+   if (range_ht->entries == 0 || !remove_range_results(range_ht, def))
+      return;
+
+   struct util_dynarray stack;
+   util_dynarray_init(&stack, NULL);
+   util_dynarray_append(&stack, nir_ssa_def *, def);
+
+   while (stack.size) {
+      nir_ssa_def *cur = util_dynarray_pop(&stack, nir_ssa_def *);
+
+      nir_foreach_use(src, cur) {
+         nir_instr *user = src->parent_instr;
+         nir_ssa_def *user_def;
+         bool is_copy = false;
+
+         if (user->type == nir_instr_type_alu) {
+            nir_alu_instr *alu = nir_instr_as_alu(user);
+            if (!alu->dest.dest.is_ssa)
+               continue;
+
+            user_def = &alu->dest.dest.ssa;
+            is_copy = nir_alu_instr_is_copy(alu);
+         } else if (user->type == nir_instr_type_phi) {
+            nir_phi_instr *phi = nir_instr_as_phi(user);
+            if (!phi->dest.is_ssa)
+               continue;
+
+            user_def = &phi->dest.ssa;
+         } else {
+            continue;
+         }
+
+         /* Callers may look through copies before querying a value */
+         if (remove_range_results(range_ht, user_def) || is_copy)
+            util_dynarray_append(&stack, nir_ssa_def *, user_def);
+      }
+   }
+
+   util_dynarray_fini(&stack);
+}
+
 bool
 nir_addition_might_overflow(nir_shader *shader, struct hash_table *range_ht,
                             nir_ssa_scalar ssa, unsigned const_val,
@@ -2162,8 +2249,98 @@ ssa_def_bits_used(const nir_ssa_def *def, int recur)
    return bits_used;
 }
 
+/* The results of nir_ssa_def_bits_used() are keyed by the nir_ssa_def, which
+ * lies inside of its instruction and so can't be mistaken for the
+ * nir_alu_instr keys of get_fp_key().
+ */
+static inline const void *
+get_bits_used_key(const nir_ssa_def *def)
+{
+   return def;
+}
+
 uint64_t
 nir_ssa_def_bits_used(const nir_ssa_def *def)
 {
-   return ssa_def_bits_used(def, 2);
+   if (def->num_components > 1 || def->parent_instr->block == NULL)
+      return ssa_def_bits_used(def, 2);
+
+   nir_function_impl *impl =
+      nir_cf_node_get_function(&def->parent_instr->block->cf_node);
+   if (!(impl->valid_metadata & nir_metadata_range_analysis))
+      return ssa_def_bits_used(def, 2);
+
+   struct hash_entry *he =
+      _mesa_hash_table_search(impl->range_ht, get_bits_used_key(def));
+   if (he)
+      return (uintptr_t)he->data;
+
+   uint64_t bits_used = ssa_def_bits_used(def, 2);
+
+   /* Only 32 bits fit into the table on 32-bit hosts */
+   if (bits_used <= UINTPTR_MAX) {
+      _mesa_hash_table_insert(impl->range_ht, get_bits_used_key(def),
+                              (void *)(uintptr_t)bits_used);
+   }
+
+   return bits_used;
+}
+
+/**
+ * Removes the results of nir_ssa_def_bits_used() that depend on the uses of
+ * the value, which has to be done whenever it gains or loses a use.
+ *
+ * ssa_def_bits_used() looks through the uses of the value and, for phis and
+ * the subgroup intrinsics, through the uses of their result, so this covers
+ * the sources of the phi or intrinsic that produced the value as well.
+ */
+void
+nir_invalidate_bits_used(struct hash_table *range_ht, nir_ssa_def *def)
+{
+   if (range_ht->entries == 0)
+      return;
+
+   struct hash_entry *he =
+      _mesa_hash_table_search(range_ht, get_bits_used_key(def));
+   if (he)
+      _mesa_hash_table_remove(range_ht, he);
+
+   nir_instr *parent = def->parent_instr;
+   if (parent->type == nir_instr_type_phi) {
+      nir_foreach_phi_src(src, nir_instr_as_phi(parent)) {
+         if (!src->src.is_ssa)
+            continue;
+
+         he = _mesa_hash_table_search(range_ht,
+                                      get_bits_used_key(src->src.ssa));
+         if (he)
+            _mesa_hash_table_remove(range_ht, he);
+      }
+   } else if (parent->type == nir_instr_type_intrinsic) {
+      nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(parent);
+      unsigned num_srcs = nir_intrinsic_infos[intrin->intrinsic].num_srcs;
+
+      for (unsigned i = 0; i < num_srcs; i++) {
+         if (!intrin->src[i].is_ssa)
+            continue;
+
+         he = _mesa_hash_table_search(range_ht,
+                                      get_bits_used_key(intrin->src[i].ssa));
+         if (he)
+            _mesa_hash_table_remove(range_ht, he);
+      }
+   }
+}
+
+/**
+ * Creates the table for nir_metadata_range_analysis, or drops the results
+ * in it, which may refer to instructions that are long gone.
+ */
+void
+nir_reset_range_analysis_impl(nir_function_impl *impl)
+{
+   if (impl->range_ht)
+      _mesa_hash_table_clear(impl->range_ht, NULL);
+   else
+      impl->range_ht = _mesa_pointer_hash_table_create(impl);
 }
@@ -57,6 +57,12 @@ extern struct ssa_result_range
 nir_analyze_range(struct hash_table *range_ht,
                   const nir_alu_instr *instr, unsigned src);
 
+void
+nir_invalidate_range_analysis(struct hash_table *range_ht, nir_ssa_def *def);
+
+void
+nir_invalidate_bits_used(struct hash_table *range_ht, nir_ssa_def *def);
+
 uint64_t nir_ssa_def_bits_used(const nir_ssa_def *def);
 
 #ifdef __cplusplus
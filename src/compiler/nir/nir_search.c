@@ -24,6 +24,7 @@
 #include <inttypes.h>
 #include "nir_search.h"
 #include "nir_builder.h"
+#include "nir_range_analysis.h"
 #include "nir_worklist.h"
 #include "util/half_float.h"
 
@@ -34,6 +35,9 @@ struct match_state {
    bool inexact_match;
    bool has_exact_alu;
    uint8_t comm_op_direction;
+
+   /* Commutative expressions whose direction the match depended on */
+   uint8_t comm_ops_used;
    unsigned variables_seen;
 
    /* Used for running the automaton on newly-constructed instructions. */
@@ -401,10 +405,12 @@ match_expression(const nir_algebraic_table *table, const nir_search_expression *
     * up its direction for the current search operation.  We'll use that value
     * to possibly flip the sources for the match.
     */
-   unsigned comm_op_flip =
-      (expr->comm_expr_idx >= 0 &&
-       expr->comm_expr_idx < NIR_SEARCH_MAX_COMM_OPS) ?
-      ((state->comm_op_direction >> expr->comm_expr_idx) & 1) : 0;
+   unsigned comm_op_flip = 0;
+   if (expr->comm_expr_idx >= 0 &&
+       expr->comm_expr_idx < NIR_SEARCH_MAX_COMM_OPS) {
+      comm_op_flip = (state->comm_op_direction >> expr->comm_expr_idx) & 1;
+      state->comm_ops_used |= 1 << expr->comm_expr_idx;
+   }
 
    bool matched = true;
    for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++) {
@@ -681,12 +687,35 @@ nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
    unsigned comm_expr_combinations =
       1 << MIN2(search->comm_exprs, NIR_SEARCH_MAX_COMM_OPS);
 
+   /* A failed match only depends on the directions of the commutative
+    * expressions it got to, so the combinations that have the same
+    * directions for those are skipped. Most matches fail at the root or
+    * right below it.
+    */
+   struct {
+      uint8_t used;
+      uint8_t direction;
+   } failed[1 << NIR_SEARCH_MAX_COMM_OPS];
+   unsigned num_failed = 0;
+   const bool skip_failed = !NIR_DEBUG(ALGEBRAIC_ALL_COMM);
+
    bool found = false;
    for (unsigned comb = 0; comb < comm_expr_combinations; comb++) {
+      bool skip = false;
+      for (unsigned i = 0; i < num_failed; i++) {
+         if ((comb & failed[i].used) == failed[i].direction) {
+            skip = true;
+            break;
+         }
+      }
+      if (skip)
+         continue;
+
       /* The bitfield of directions is just the current iteration.  Hooray for
        * binary.
        */
       state.comm_op_direction = comb;
+      state.comm_ops_used = 0;
       state.variables_seen = 0;
 
       if (match_expression(table, search, instr,
@@ -695,6 +724,17 @@ nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
          found = true;
          break;
       }
+
+      if (!skip_failed)
+         continue;
+
+      /* Nothing else to try if the directions didn't matter */
+      if (state.comm_ops_used == 0)
+         break;
+
+      failed[num_failed].used = state.comm_ops_used;
+      failed[num_failed].direction = comb & state.comm_ops_used;
+      num_failed++;
    }
    if (!found)
       return NULL;
@@ -760,6 +800,24 @@ nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
       nir_algebraic_automaton(ssa_val->parent_instr, states, table->pass_op_table);
    }
 
+   /* The replacement may not be exact, so forget the ranges of anything
+    * computed from the old value. Only those, rather than all the ranges
+    * found so far, otherwise the analysis ends up being quadratic.
+    */
+   nir_invalidate_range_analysis(range_ht, &instr->dest.dest.ssa);
+
+   /* The variables and the value replacing the old one gained uses and the
+    * sources of the old value are about to lose one. The old value itself
+    * is freed at the end of the pass, and the address of its result may be
+    * reused by a later pass while the metadata is still valid.
+    */
+   nir_invalidate_bits_used(range_ht, &instr->dest.dest.ssa);
+   u_foreach_bit(i, state.variables_seen)
+      nir_invalidate_bits_used(range_ht, state.variables[i].src.ssa);
+   for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++)
+      nir_invalidate_bits_used(range_ht, instr->src[i].src.ssa);
+   nir_invalidate_bits_used(range_ht, ssa_val);
+
    /* Rewrite the uses of the old SSA value to the new one, and recurse
     * through the uses updating the automaton's state.
     */
@@ -864,7 +922,6 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
           nir_replace_instr(build, alu, range_ht, states, table,
                             &table->values[xform->search].expression,
                             &table->values[xform->replace].value, worklist, dead_instrs)) {
-         _mesa_hash_table_clear(range_ht, NULL);
          return true;
       }
    }
@@ -893,7 +950,11 @@ nir_algebraic_impl(nir_function_impl *impl,
    }
    memset(states.data, 0, states.size);
 
-   struct hash_table *range_ht = _mesa_pointer_hash_table_create(NULL);
+   /* The range analysis results are kept up to date below, so they can be
+    * shared with the next algebraic pass.
+    */
+   nir_metadata_require(impl, nir_metadata_range_analysis);
+   struct hash_table *range_ht = impl->range_ht;
 
    nir_instr_worklist *worklist = nir_instr_worklist_create();
 
@@ -936,12 +997,12 @@ nir_algebraic_impl(nir_function_impl *impl,
    nir_instr_free_list(&dead_instrs);
 
    nir_instr_worklist_destroy(worklist);
-   ralloc_free(range_ht);
    util_dynarray_fini(&states);
 
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
-                                  nir_metadata_dominance);
+                                  nir_metadata_dominance |
+                                  nir_metadata_range_analysis);
    } else {
       nir_metadata_preserve(impl, nir_metadata_all);
    }
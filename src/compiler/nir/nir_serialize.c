@@ -27,11 +27,26 @@
 #include "util/u_dynarray.h"
 #include "util/u_math.h"
 
+#ifdef HAVE_COMPRESSION
+#include "util/compress.h"
+#endif
+
 #define NIR_SERIALIZE_FUNC_HAS_IMPL ((void *)(intptr_t)1)
 #define MAX_OBJECT_IDS (1 << 20)
 
+/* Set in the first dword, which is otherwise the number of objects, if the
+ * rest of the blob is compressed.
+ */
+#define NIR_SERIALIZE_COMPRESSED (1u << 31)
+
+/* The number of recent ALU headers that can be referred to by a single byte,
+ * see write_dest().
+ */
+#define ALU_HEADER_CACHE_SIZE 16
+#define ALU_HEADER_CACHE_REF 0xf
+
 typedef struct {
-   size_t blob_offset;
+   uint32_t phi_idx;
    nir_ssa_def *src;
    nir_block *block;
 } write_phi_fixup;
@@ -57,11 +72,27 @@ typedef struct {
    const struct glsl_type *last_interface_type;
    struct nir_variable_data last_var_data;
 
+   /* Maps serialized types to their index in the type table, starting at 1.
+    * The types written by a function impl are removed at its end.
+    */
+   struct hash_table *type_table;
+   uint32_t num_types;
+   uint32_t num_global_types;
+
+   /* Maps the values of the load_const instructions written with all of
+    * their components to the index of their def, within an impl.
+    */
+   struct hash_table *load_const_table;
+
    /* For skipping equal ALU headers (typical after scalarization). */
    nir_instr_type last_instr_type;
    uintptr_t last_alu_header_offset;
    uint32_t last_alu_header;
 
+   /* The last ALU headers written in full, within an impl. */
+   uint32_t alu_headers[ALU_HEADER_CACHE_SIZE];
+   unsigned next_alu_header;
+
    /* Don't write optional data such as variable names. */
    bool strip;
 } write_ctx;
@@ -87,6 +118,14 @@ typedef struct {
    const struct glsl_type *last_type;
    const struct glsl_type *last_interface_type;
    struct nir_variable_data last_var_data;
+
+   /* The type table, see write_ctx::type_table. */
+   struct util_dynarray types;
+   uint32_t num_global_types;
+
+   /* See write_ctx::alu_headers. */
+   uint32_t alu_headers[ALU_HEADER_CACHE_SIZE];
+   unsigned next_alu_header;
 } read_ctx;
 
 static void
@@ -122,7 +161,102 @@ read_lookup_object(read_ctx *ctx, uint32_t idx)
 static void *
 read_object(read_ctx *ctx)
 {
-   return read_lookup_object(ctx, blob_read_uint32(ctx->blob));
+   return read_lookup_object(ctx, blob_read_varint32(ctx->blob));
+}
+
+/* Counts and indices are written as varints and everything else is written
+ * without alignment too, so that the blob doesn't need any padding between
+ * them. Only the types are still aligned, see write_type().
+ *
+ * Dwords are little-endian, so that the instruction type is always in the
+ * first byte of an instruction header, see read_instr().
+ */
+static void
+encode_uint32(uint8_t bytes[4], uint32_t value)
+{
+   for (unsigned i = 0; i < 4; i++)
+      bytes[i] = value >> (i * 8);
+}
+
+static void
+write_uint32(write_ctx *ctx, uint32_t value)
+{
+   uint8_t bytes[4];
+   encode_uint32(bytes, value);
+   blob_write_bytes(ctx->blob, bytes, sizeof(bytes));
+}
+
+static void
+overwrite_uint32(write_ctx *ctx, size_t offset, uint32_t value)
+{
+   uint8_t bytes[4];
+   encode_uint32(bytes, value);
+   blob_overwrite_bytes(ctx->blob, offset, bytes, sizeof(bytes));
+}
+
+static uint32_t
+read_uint32(read_ctx *ctx)
+{
+   uint8_t bytes[4] = {0};
+   blob_copy_bytes(ctx->blob, bytes, sizeof(bytes));
+   return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static void
+write_uint16(write_ctx *ctx, uint16_t value)
+{
+   blob_write_bytes(ctx->blob, &value, sizeof(value));
+}
+
+static uint16_t
+read_uint16(read_ctx *ctx)
+{
+   uint16_t value = 0;
+   blob_copy_bytes(ctx->blob, &value, sizeof(value));
+   return value;
+}
+
+/* Types are written in full the first time only and referred to by their
+ * index in the type table afterwards. Struct and interface types in
+ * particular are big and usually shared by several variables.
+ */
+static void
+write_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   struct hash_entry *entry =
+      type ? _mesa_hash_table_search(ctx->type_table, type) : NULL;
+
+   if (entry) {
+      blob_write_varint32(ctx->blob, (uintptr_t)entry->data);
+      return;
+   }
+
+   blob_write_varint32(ctx->blob, 0);
+   encode_type_to_blob(ctx->blob, type);
+
+   if (type) {
+      _mesa_hash_table_insert(ctx->type_table, type,
+                              (void *)(uintptr_t)++ctx->num_types);
+   }
+}
+
+static const struct glsl_type *
+read_type(read_ctx *ctx)
+{
+   uint32_t idx = blob_read_varint32(ctx->blob);
+
+   if (idx) {
+      assert(idx <= util_dynarray_num_elements(&ctx->types,
+                                               const struct glsl_type *));
+      return *util_dynarray_element(&ctx->types, const struct glsl_type *,
+                                    idx - 1);
+   }
+
+   const struct glsl_type *type = decode_type_from_blob(ctx->blob);
+   if (type)
+      util_dynarray_append(&ctx->types, const struct glsl_type *, type);
+
+   return type;
 }
 
 static uint32_t
@@ -177,7 +311,7 @@ static void
 write_constant(write_ctx *ctx, const nir_constant *c)
 {
    blob_write_bytes(ctx->blob, c->values, sizeof(c->values));
-   blob_write_uint32(ctx->blob, c->num_elements);
+   blob_write_varint32(ctx->blob, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       write_constant(ctx, c->elements[i]);
 }
@@ -188,7 +322,7 @@ read_constant(read_ctx *ctx, nir_variable *nvar)
    nir_constant *c = ralloc(nvar, nir_constant);
 
    blob_copy_bytes(ctx->blob, (uint8_t *)c->values, sizeof(c->values));
-   c->num_elements = blob_read_uint32(ctx->blob);
+   c->num_elements = blob_read_varint32(ctx->blob);
    c->elements = ralloc_array(nvar, nir_constant *, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       c->elements[i] = read_constant(ctx, nvar);
@@ -287,15 +421,15 @@ write_variable(write_ctx *ctx, const nir_variable *var)
 
    flags.u.ray_query = var->data.ray_query;
 
-   blob_write_uint32(ctx->blob, flags.u32);
+   write_uint32(ctx, flags.u32);
 
    if (!flags.u.type_same_as_last) {
-      encode_type_to_blob(ctx->blob, var->type);
+      write_type(ctx, var->type);
       ctx->last_type = var->type;
    }
 
    if (var->interface_type && !flags.u.interface_type_same_as_last) {
-      encode_type_to_blob(ctx->blob, var->interface_type);
+      write_type(ctx, var->interface_type);
       ctx->last_interface_type = var->interface_type;
    }
 
@@ -317,7 +451,7 @@ write_variable(write_ctx *ctx, const nir_variable *var)
          diff.u.driver_location = data.driver_location -
                                   ctx->last_var_data.driver_location;
 
-         blob_write_uint32(ctx->blob, diff.u32);
+         write_uint32(ctx, diff.u32);
       }
 
       ctx->last_var_data = data;
@@ -344,12 +478,12 @@ read_variable(read_ctx *ctx)
    read_add_object(ctx, var);
 
    union packed_var flags;
-   flags.u32 = blob_read_uint32(ctx->blob);
+   flags.u32 = read_uint32(ctx);
 
    if (flags.u.type_same_as_last) {
       var->type = ctx->last_type;
    } else {
-      var->type = decode_type_from_blob(ctx->blob);
+      var->type = read_type(ctx);
       ctx->last_type = var->type;
    }
 
@@ -357,7 +491,7 @@ read_variable(read_ctx *ctx)
       if (flags.u.interface_type_same_as_last) {
          var->interface_type = ctx->last_interface_type;
       } else {
-         var->interface_type = decode_type_from_blob(ctx->blob);
+         var->interface_type = read_type(ctx);
          ctx->last_interface_type = var->interface_type;
       }
    }
@@ -378,7 +512,7 @@ read_variable(read_ctx *ctx)
       ctx->last_var_data = var->data;
    } else { /* var_encode_location_diff */
       union packed_var_data_diff diff;
-      diff.u32 = blob_read_uint32(ctx->blob);
+      diff.u32 = read_uint32(ctx);
 
       var->data = ctx->last_var_data;
       var->data.location += diff.u.location;
@@ -423,7 +557,7 @@ read_variable(read_ctx *ctx)
 static void
 write_var_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint32(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_variable, var, node, src) {
       write_variable(ctx, var);
    }
@@ -433,7 +567,7 @@ static void
 read_var_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_vars = blob_read_uint32(ctx->blob);
+   unsigned num_vars = blob_read_varint32(ctx->blob);
    for (unsigned i = 0; i < num_vars; i++) {
       nir_variable *var = read_variable(ctx);
       exec_list_push_tail(dst, &var->node);
@@ -444,10 +578,10 @@ static void
 write_register(write_ctx *ctx, const nir_register *reg)
 {
    write_add_object(ctx, reg);
-   blob_write_uint32(ctx->blob, reg->num_components);
-   blob_write_uint32(ctx->blob, reg->bit_size);
-   blob_write_uint32(ctx->blob, reg->num_array_elems);
-   blob_write_uint32(ctx->blob, reg->index);
+   blob_write_varint32(ctx->blob, reg->num_components);
+   blob_write_varint32(ctx->blob, reg->bit_size);
+   blob_write_varint32(ctx->blob, reg->num_array_elems);
+   blob_write_varint32(ctx->blob, reg->index);
    blob_write_uint8(ctx->blob, reg->divergent);
 }
 
@@ -456,10 +590,10 @@ read_register(read_ctx *ctx)
 {
    nir_register *reg = ralloc(ctx->nir, nir_register);
    read_add_object(ctx, reg);
-   reg->num_components = blob_read_uint32(ctx->blob);
-   reg->bit_size = blob_read_uint32(ctx->blob);
-   reg->num_array_elems = blob_read_uint32(ctx->blob);
-   reg->index = blob_read_uint32(ctx->blob);
+   reg->num_components = blob_read_varint32(ctx->blob);
+   reg->bit_size = blob_read_varint32(ctx->blob);
+   reg->num_array_elems = blob_read_varint32(ctx->blob);
+   reg->index = blob_read_varint32(ctx->blob);
    reg->divergent = blob_read_uint8(ctx->blob);
 
    list_inithead(&reg->uses);
@@ -471,7 +605,7 @@ read_register(read_ctx *ctx)
 static void
 write_reg_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint32(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_register, reg, node, src)
       write_register(ctx, reg);
 }
@@ -480,7 +614,7 @@ static void
 read_reg_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_regs = blob_read_uint32(ctx->blob);
+   unsigned num_regs = blob_read_varint32(ctx->blob);
    for (unsigned i = 0; i < num_regs; i++) {
       nir_register *reg = read_register(ctx);
       exec_list_push_tail(dst, &reg->node);
@@ -511,6 +645,68 @@ union packed_src {
    } tex;
 };
 
+/* Packed SSA sources are written as the distance from the next object index
+ * to the index of the source, which is small for the usual sources defined
+ * shortly before and fits in a byte or two as a varint. Phis are the only
+ * instructions whose sources may be defined later, and they don't use this.
+ */
+static void
+write_ssa_src_delta(write_ctx *ctx, const nir_ssa_def *def, unsigned low_bits,
+                    unsigned num_low_bits)
+{
+   uint32_t delta = ctx->next_idx - write_lookup_object(ctx, def);
+   assert(delta > 0 && util_last_bit(delta) + num_low_bits <= 32);
+   blob_write_varint32(ctx->blob, delta << num_low_bits | low_bits);
+}
+
+static nir_ssa_def *
+read_ssa_src_delta(read_ctx *ctx, unsigned *low_bits, unsigned num_low_bits)
+{
+   uint32_t value = blob_read_varint32(ctx->blob);
+
+   if (low_bits)
+      *low_bits = value & BITFIELD_MASK(num_low_bits);
+
+   return read_lookup_object(ctx, ctx->next_idx - (value >> num_low_bits));
+}
+
+static void
+write_src(write_ctx *ctx, const nir_src *src)
+{
+   /* Sources without a footer are a single varint in the common SSA case,
+    * with the low bit telling them apart from registers.
+    */
+   if (src->is_ssa) {
+      write_ssa_src_delta(ctx, src->ssa, 1, 1);
+   } else {
+      uint32_t idx = write_lookup_object(ctx, src->reg.reg);
+      blob_write_varint32(ctx->blob, idx << 2 | !!src->reg.indirect << 1);
+      blob_write_varint32(ctx->blob, src->reg.base_offset);
+      if (src->reg.indirect)
+         write_src(ctx, src->reg.indirect);
+   }
+}
+
+static void
+read_src(read_ctx *ctx, nir_src *src)
+{
+   uint32_t value = blob_read_varint32(ctx->blob);
+
+   src->is_ssa = value & 0x1;
+   if (src->is_ssa) {
+      src->ssa = read_lookup_object(ctx, ctx->next_idx - (value >> 1));
+   } else {
+      src->reg.reg = read_lookup_object(ctx, value >> 2);
+      src->reg.base_offset = blob_read_varint32(ctx->blob);
+      if (value & 0x2) {
+         src->reg.indirect = gc_alloc(ctx->nir->gctx, nir_src, 1);
+         read_src(ctx, src->reg.indirect);
+      } else {
+         src->reg.indirect = NULL;
+      }
+   }
+}
+
 static void
 write_src_full(write_ctx *ctx, const nir_src *src, union packed_src header)
 {
@@ -523,39 +719,30 @@ write_src_full(write_ctx *ctx, const nir_src *src, union packed_src header)
    header.any.is_ssa = src->is_ssa;
    if (src->is_ssa) {
       header.any.object_idx = write_lookup_object(ctx, src->ssa);
-      blob_write_uint32(ctx->blob, header.u32);
+      write_uint32(ctx, header.u32);
    } else {
       header.any.object_idx = write_lookup_object(ctx, src->reg.reg);
       header.any.is_indirect = !!src->reg.indirect;
-      blob_write_uint32(ctx->blob, header.u32);
-      blob_write_uint32(ctx->blob, src->reg.base_offset);
-      if (src->reg.indirect) {
-         union packed_src header = {0};
-         write_src_full(ctx, src->reg.indirect, header);
-      }
+      write_uint32(ctx, header.u32);
+      blob_write_varint32(ctx->blob, src->reg.base_offset);
+      if (src->reg.indirect)
+         write_src(ctx, src->reg.indirect);
    }
 }
 
-static void
-write_src(write_ctx *ctx, const nir_src *src)
-{
-   union packed_src header = {0};
-   write_src_full(ctx, src, header);
-}
-
 static union packed_src
-read_src(read_ctx *ctx, nir_src *src)
+read_src_full(read_ctx *ctx, nir_src *src)
 {
    STATIC_ASSERT(sizeof(union packed_src) == 4);
    union packed_src header;
-   header.u32 = blob_read_uint32(ctx->blob);
+   header.u32 = read_uint32(ctx);
 
    src->is_ssa = header.any.is_ssa;
    if (src->is_ssa) {
       src->ssa = read_lookup_object(ctx, header.any.object_idx);
    } else {
       src->reg.reg = read_lookup_object(ctx, header.any.object_idx);
-      src->reg.base_offset = blob_read_uint32(ctx->blob);
+      src->reg.base_offset = blob_read_varint32(ctx->blob);
       if (header.any.is_indirect) {
          src->reg.indirect = gc_alloc(ctx->nir->gctx, nir_src, 1);
          read_src(ctx, src->reg.indirect);
@@ -566,6 +753,39 @@ read_src(read_ctx *ctx, nir_src *src)
    return header;
 }
 
+/* The footer of an SSA source with a packed swizzle fits in a varint with
+ * the source, with the low bit set. Other ALU sources are a zero byte
+ * followed by the full source.
+ */
+static void
+write_alu_src(write_ctx *ctx, const nir_src *src, union packed_src header,
+              bool packed)
+{
+   if (src->is_ssa && packed) {
+      unsigned footer = header.u32 >> 22;
+      write_ssa_src_delta(ctx, src->ssa, footer << 1 | 0x1, 11);
+   } else {
+      blob_write_uint8(ctx->blob, 0);
+      write_src_full(ctx, src, header);
+   }
+}
+
+static union packed_src
+read_alu_src(read_ctx *ctx, nir_src *src)
+{
+   uint32_t value = blob_read_varint32(ctx->blob);
+
+   if (!(value & 0x1))
+      return read_src_full(ctx, src);
+
+   union packed_src header;
+   header.u32 = ((value >> 1) & 0x3ff) << 22;
+
+   src->is_ssa = true;
+   src->ssa = read_lookup_object(ctx, ctx->next_idx - (value >> 11));
+   return header;
+}
+
 union packed_dest {
    uint8_t u8;
    struct {
@@ -605,6 +825,11 @@ enum load_const_packing {
 
    /* packed_value contains low 19 bits, high bits are sign-extended */
    load_const_scalar_lo_19bits_sext,
+
+   /* The values are the same as those of an earlier load_const of the same
+    * impl, packed_value is the distance to its object index.
+    */
+   load_const_same_as_earlier,
 };
 
 union packed_instr {
@@ -623,7 +848,7 @@ union packed_instr {
       /* Reg: writemask; SSA: swizzles for 2 srcs */
       unsigned writemask_or_two_swizzles:4;
       unsigned op:9;
-      unsigned packed_src_ssa_16bit:1;
+      unsigned packed_src_ssa:1;
       /* Scalarized ALUs always have the same header. */
       unsigned num_followup_alu_sharing_header:2;
       unsigned dest:8;
@@ -635,7 +860,7 @@ union packed_instr {
       unsigned modes:5; /* See (de|en)code_deref_modes() */
       unsigned _pad:9;
       unsigned in_bounds:1;
-      unsigned packed_src_ssa_16bit:1; /* deref_var redefines this */
+      unsigned packed_src_ssa:1; /* deref_var redefines this */
       unsigned dest:8;
    } deref;
    struct {
@@ -669,7 +894,8 @@ union packed_instr {
       unsigned instr_type:4;
       unsigned num_srcs:4;
       unsigned op:5;
-      unsigned _pad:11;
+      unsigned packed_src_ssa:1;
+      unsigned _pad:10;
       unsigned dest:8;
    } tex;
    struct {
@@ -711,8 +937,11 @@ write_dest(write_ctx *ctx, const nir_dest *dst, union packed_instr header,
    if (instr_type == nir_instr_type_alu) {
       bool equal_header = false;
 
-      if (ctx->last_instr_type == nir_instr_type_alu) {
-         assert(ctx->last_alu_header_offset);
+      /* The last header may have been a reference to an earlier one, which
+       * can't count the following ALUs.
+       */
+      if (ctx->last_instr_type == nir_instr_type_alu &&
+          ctx->last_alu_header_offset) {
          union packed_instr last_header;
          last_header.u32 = ctx->last_alu_header;
 
@@ -727,31 +956,50 @@ write_dest(write_ctx *ctx, const nir_dest *dst, union packed_instr header,
          if (last_header.alu.num_followup_alu_sharing_header < 3 &&
              header.u32 == clean_header.u32) {
             last_header.alu.num_followup_alu_sharing_header++;
-            blob_overwrite_uint32(ctx->blob, ctx->last_alu_header_offset,
-                                  last_header.u32);
+            overwrite_uint32(ctx, ctx->last_alu_header_offset,
+                             last_header.u32);
             ctx->last_alu_header = last_header.u32;
             equal_header = true;
          }
       }
 
+      /* Otherwise, refer to one of the last headers written in full with a
+       * single byte, whose instruction type bits are invalid.
+       */
+      if (!equal_header) {
+         for (unsigned i = 0; i < ALU_HEADER_CACHE_SIZE; i++) {
+            if (ctx->alu_headers[i] == header.u32) {
+               blob_write_uint8(ctx->blob, i << 4 | ALU_HEADER_CACHE_REF);
+               ctx->last_alu_header_offset = 0;
+               equal_header = true;
+               break;
+            }
+         }
+      }
+
       if (!equal_header) {
-         ctx->last_alu_header_offset = blob_reserve_uint32(ctx->blob);
-         blob_overwrite_uint32(ctx->blob, ctx->last_alu_header_offset, header.u32);
+         ctx->last_alu_header_offset = blob_reserve_bytes(ctx->blob,
+                                                          sizeof(header.u32));
+         overwrite_uint32(ctx, ctx->last_alu_header_offset, header.u32);
          ctx->last_alu_header = header.u32;
+
+         ctx->alu_headers[ctx->next_alu_header] = header.u32;
+         ctx->next_alu_header =
+            (ctx->next_alu_header + 1) % ALU_HEADER_CACHE_SIZE;
       }
    } else {
-      blob_write_uint32(ctx->blob, header.u32);
+      write_uint32(ctx, header.u32);
    }
 
    if (dest.ssa.is_ssa &&
        dest.ssa.num_components == NUM_COMPONENTS_IS_SEPARATE_7)
-      blob_write_uint32(ctx->blob, dst->ssa.num_components);
+      blob_write_varint32(ctx->blob, dst->ssa.num_components);
 
    if (dst->is_ssa) {
       write_add_object(ctx, &dst->ssa);
    } else {
-      blob_write_uint32(ctx->blob, write_lookup_object(ctx, dst->reg.reg));
-      blob_write_uint32(ctx->blob, dst->reg.base_offset);
+      blob_write_varint32(ctx->blob, write_lookup_object(ctx, dst->reg.reg));
+      blob_write_varint32(ctx->blob, dst->reg.base_offset);
       if (dst->reg.indirect)
          write_src(ctx, dst->reg.indirect);
    }
@@ -768,7 +1016,7 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
       unsigned bit_size = decode_bit_size_3bits(dest.ssa.bit_size);
       unsigned num_components;
       if (dest.ssa.num_components == NUM_COMPONENTS_IS_SEPARATE_7)
-         num_components = blob_read_uint32(ctx->blob);
+         num_components = blob_read_varint32(ctx->blob);
       else
          num_components = decode_num_components_in_3bits(dest.ssa.num_components);
       nir_ssa_dest_init(instr, dst, num_components, bit_size, NULL);
@@ -776,7 +1024,7 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
       read_add_object(ctx, &dst->ssa);
    } else {
       dst->reg.reg = read_object(ctx);
-      dst->reg.base_offset = blob_read_uint32(ctx->blob);
+      dst->reg.base_offset = blob_read_varint32(ctx->blob);
       if (dest.reg.is_indirect) {
          dst->reg.indirect = gc_alloc(ctx->nir->gctx, nir_src, 1);
          read_src(ctx, dst->reg.indirect);
@@ -785,14 +1033,7 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
 }
 
 static bool
-are_object_ids_16bit(write_ctx *ctx)
-{
-   /* Check the highest object ID, because they are monotonic. */
-   return ctx->next_idx < (1 << 16);
-}
-
-static bool
-is_alu_src_ssa_16bit(write_ctx *ctx, const nir_alu_instr *alu)
+is_alu_src_ssa_packed(const nir_alu_instr *alu)
 {
    unsigned num_srcs = nir_op_infos[alu->op].num_inputs;
 
@@ -815,7 +1056,7 @@ is_alu_src_ssa_16bit(write_ctx *ctx, const nir_alu_instr *alu)
       }
    }
 
-   return are_object_ids_16bit(ctx);
+   return true;
 }
 
 static void
@@ -835,9 +1076,9 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
    header.alu.no_unsigned_wrap = alu->no_unsigned_wrap;
    header.alu.saturate = alu->dest.saturate;
    header.alu.op = alu->op;
-   header.alu.packed_src_ssa_16bit = is_alu_src_ssa_16bit(ctx, alu);
+   header.alu.packed_src_ssa = is_alu_src_ssa_packed(alu);
 
-   if (header.alu.packed_src_ssa_16bit &&
+   if (header.alu.packed_src_ssa &&
        alu->dest.dest.is_ssa) {
       /* For packed srcs of SSA ALUs, this field stores the swizzles. */
       header.alu.writemask_or_two_swizzles = alu->src[0].swizzle[0];
@@ -851,14 +1092,12 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
    write_dest(ctx, &alu->dest.dest, header, alu->instr.type);
 
    if (!alu->dest.dest.is_ssa && dst_components > 4)
-      blob_write_uint32(ctx->blob, alu->dest.write_mask);
+      blob_write_varint32(ctx->blob, alu->dest.write_mask);
 
-   if (header.alu.packed_src_ssa_16bit) {
+   if (header.alu.packed_src_ssa) {
       for (unsigned i = 0; i < num_srcs; i++) {
          assert(alu->src[i].src.is_ssa);
-         unsigned idx = write_lookup_object(ctx, alu->src[i].src.ssa);
-         assert(idx < (1 << 16));
-         blob_write_uint16(ctx->blob, idx);
+         write_ssa_src_delta(ctx, alu->src[i].src.ssa, 0, 0);
       }
    } else {
       for (unsigned i = 0; i < num_srcs; i++) {
@@ -878,7 +1117,7 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
             src.alu.swizzle_w = alu->src[i].swizzle[3];
          }
 
-         write_src_full(ctx, &alu->src[i].src, src);
+         write_alu_src(ctx, &alu->src[i].src, src, packed);
 
          /* Store swizzles for vec8 and vec16. */
          if (!packed) {
@@ -890,7 +1129,7 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
                            (4 * j); /* 4 bits per swizzle */
                }
 
-               blob_write_uint32(ctx->blob, value);
+               write_uint32(ctx, value);
             }
          }
       }
@@ -917,14 +1156,14 @@ read_alu(read_ctx *ctx, union packed_instr header)
    } else if (dst_components <= 4) {
       alu->dest.write_mask = header.alu.writemask_or_two_swizzles;
    } else {
-      alu->dest.write_mask = blob_read_uint32(ctx->blob);
+      alu->dest.write_mask = blob_read_varint32(ctx->blob);
    }
 
-   if (header.alu.packed_src_ssa_16bit) {
+   if (header.alu.packed_src_ssa) {
       for (unsigned i = 0; i < num_srcs; i++) {
          nir_alu_src *src = &alu->src[i];
          src->src.is_ssa = true;
-         src->src.ssa = read_lookup_object(ctx, blob_read_uint16(ctx->blob));
+         src->src.ssa = read_ssa_src_delta(ctx, NULL, 0);
 
          memset(&src->swizzle, 0, sizeof(src->swizzle));
 
@@ -935,7 +1174,7 @@ read_alu(read_ctx *ctx, union packed_instr header)
       }
    } else {
       for (unsigned i = 0; i < num_srcs; i++) {
-         union packed_src src = read_src(ctx, &alu->src[i].src);
+         union packed_src src = read_alu_src(ctx, &alu->src[i].src);
          unsigned src_channels = nir_ssa_alu_instr_src_components(alu, i);
          unsigned src_components = nir_src_num_components(alu->src[i].src);
          bool packed = src_components <= 4 && src_channels <= 4;
@@ -953,7 +1192,7 @@ read_alu(read_ctx *ctx, union packed_instr header)
          } else {
             /* Load swizzles for vec8 and vec16. */
             for (unsigned o = 0; o < src_channels; o += 8) {
-               unsigned value = blob_read_uint32(ctx->blob);
+               unsigned value = read_uint32(ctx);
 
                for (unsigned j = 0; j < 8 && o + j < src_channels; j++) {
                   alu->src[i].swizzle[o + j] =
@@ -964,7 +1203,7 @@ read_alu(read_ctx *ctx, union packed_instr header)
       }
    }
 
-   if (header.alu.packed_src_ssa_16bit &&
+   if (header.alu.packed_src_ssa &&
        alu->dest.dest.is_ssa) {
       alu->src[0].swizzle[0] = header.alu.writemask_or_two_swizzles & 0x3;
       if (num_srcs > 1)
@@ -1040,9 +1279,8 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 
    if (deref->deref_type == nir_deref_type_array ||
        deref->deref_type == nir_deref_type_ptr_as_array) {
-      header.deref.packed_src_ssa_16bit =
-         deref->parent.is_ssa && deref->arr.index.is_ssa &&
-         are_object_ids_16bit(ctx);
+      header.deref.packed_src_ssa =
+         deref->parent.is_ssa && deref->arr.index.is_ssa;
 
       header.deref.in_bounds = deref->arr.in_bounds;
    }
@@ -1052,21 +1290,19 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
    switch (deref->deref_type) {
    case nir_deref_type_var:
       if (!header.deref_var.object_idx)
-         blob_write_uint32(ctx->blob, var_idx);
+         blob_write_varint32(ctx->blob, var_idx);
       break;
 
    case nir_deref_type_struct:
       write_src(ctx, &deref->parent);
-      blob_write_uint32(ctx->blob, deref->strct.index);
+      blob_write_varint32(ctx->blob, deref->strct.index);
       break;
 
    case nir_deref_type_array:
    case nir_deref_type_ptr_as_array:
-      if (header.deref.packed_src_ssa_16bit) {
-         blob_write_uint16(ctx->blob,
-                           write_lookup_object(ctx, deref->parent.ssa));
-         blob_write_uint16(ctx->blob,
-                           write_lookup_object(ctx, deref->arr.index.ssa));
+      if (header.deref.packed_src_ssa) {
+         write_ssa_src_delta(ctx, deref->parent.ssa, 0, 0);
+         write_ssa_src_delta(ctx, deref->arr.index.ssa, 0, 0);
       } else {
          write_src(ctx, &deref->parent);
          write_src(ctx, &deref->arr.index);
@@ -1075,11 +1311,11 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 
    case nir_deref_type_cast:
       write_src(ctx, &deref->parent);
-      blob_write_uint32(ctx->blob, deref->cast.ptr_stride);
-      blob_write_uint32(ctx->blob, deref->cast.align_mul);
-      blob_write_uint32(ctx->blob, deref->cast.align_offset);
+      blob_write_varint32(ctx->blob, deref->cast.ptr_stride);
+      blob_write_varint32(ctx->blob, deref->cast.align_mul);
+      blob_write_varint32(ctx->blob, deref->cast.align_offset);
       if (!header.deref.cast_type_same_as_last) {
-         encode_type_to_blob(ctx->blob, deref->type);
+         write_type(ctx, deref->type);
          ctx->last_type = deref->type;
       }
       break;
@@ -1116,17 +1352,17 @@ read_deref(read_ctx *ctx, union packed_instr header)
    case nir_deref_type_struct:
       read_src(ctx, &deref->parent);
       parent = nir_src_as_deref(deref->parent);
-      deref->strct.index = blob_read_uint32(ctx->blob);
+      deref->strct.index = blob_read_varint32(ctx->blob);
       deref->type = glsl_get_struct_field(parent->type, deref->strct.index);
       break;
 
    case nir_deref_type_array:
    case nir_deref_type_ptr_as_array:
-      if (header.deref.packed_src_ssa_16bit) {
+      if (header.deref.packed_src_ssa) {
          deref->parent.is_ssa = true;
-         deref->parent.ssa = read_lookup_object(ctx, blob_read_uint16(ctx->blob));
+         deref->parent.ssa = read_ssa_src_delta(ctx, NULL, 0);
          deref->arr.index.is_ssa = true;
-         deref->arr.index.ssa = read_lookup_object(ctx, blob_read_uint16(ctx->blob));
+         deref->arr.index.ssa = read_ssa_src_delta(ctx, NULL, 0);
       } else {
          read_src(ctx, &deref->parent);
          read_src(ctx, &deref->arr.index);
@@ -1143,13 +1379,13 @@ read_deref(read_ctx *ctx, union packed_instr header)
 
    case nir_deref_type_cast:
       read_src(ctx, &deref->parent);
-      deref->cast.ptr_stride = blob_read_uint32(ctx->blob);
-      deref->cast.align_mul = blob_read_uint32(ctx->blob);
-      deref->cast.align_offset = blob_read_uint32(ctx->blob);
+      deref->cast.ptr_stride = blob_read_varint32(ctx->blob);
+      deref->cast.align_mul = blob_read_varint32(ctx->blob);
+      deref->cast.align_offset = blob_read_varint32(ctx->blob);
       if (header.deref.cast_type_same_as_last) {
          deref->type = ctx->last_type;
       } else {
-         deref->type = decode_type_from_blob(ctx->blob);
+         deref->type = read_type(ctx);
          ctx->last_type = deref->type;
       }
       break;
@@ -1219,7 +1455,7 @@ write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
    if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
       write_dest(ctx, &intrin->dest, header, intrin->instr.type);
    else
-      blob_write_uint32(ctx->blob, header.u32);
+      write_uint32(ctx, header.u32);
 
    for (unsigned i = 0; i < num_srcs; i++)
       write_src(ctx, &intrin->src[i]);
@@ -1232,11 +1468,11 @@ write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
          break;
       case const_indices_16bit:
          for (unsigned i = 0; i < num_indices; i++)
-            blob_write_uint16(ctx->blob, intrin->const_index[i]);
+            write_uint16(ctx, intrin->const_index[i]);
          break;
       case const_indices_32bit:
          for (unsigned i = 0; i < num_indices; i++)
-            blob_write_uint32(ctx->blob, intrin->const_index[i]);
+            write_uint32(ctx, intrin->const_index[i]);
          break;
       }
    }
@@ -1290,11 +1526,11 @@ read_intrinsic(read_ctx *ctx, union packed_instr header)
          break;
       case const_indices_16bit:
          for (unsigned i = 0; i < num_indices; i++)
-            intrin->const_index[i] = blob_read_uint16(ctx->blob);
+            intrin->const_index[i] = read_uint16(ctx);
          break;
       case const_indices_32bit:
          for (unsigned i = 0; i < num_indices; i++)
-            intrin->const_index[i] = blob_read_uint32(ctx->blob);
+            intrin->const_index[i] = read_uint32(ctx);
          break;
       }
    }
@@ -1302,6 +1538,39 @@ read_intrinsic(read_ctx *ctx, union packed_instr header)
    return intrin;
 }
 
+static uint32_t
+hash_load_const(const void *data)
+{
+   const nir_load_const_instr *lc = data;
+   uint32_t hash = XXH32(&lc->def.bit_size, sizeof(lc->def.bit_size), 0);
+
+   hash = XXH32(&lc->def.num_components, sizeof(lc->def.num_components), hash);
+   for (unsigned i = 0; i < lc->def.num_components; i++) {
+      uint64_t value = nir_const_value_as_uint(lc->value[i], lc->def.bit_size);
+      hash = XXH32(&value, sizeof(value), hash);
+   }
+
+   return hash;
+}
+
+static bool
+load_consts_equal(const void *a, const void *b)
+{
+   const nir_load_const_instr *lc1 = a, *lc2 = b;
+
+   if (lc1->def.bit_size != lc2->def.bit_size ||
+       lc1->def.num_components != lc2->def.num_components)
+      return false;
+
+   for (unsigned i = 0; i < lc1->def.num_components; i++) {
+      if (nir_const_value_as_uint(lc1->value[i], lc1->def.bit_size) !=
+          nir_const_value_as_uint(lc2->value[i], lc2->def.bit_size))
+         return false;
+   }
+
+   return true;
+}
+
 static void
 write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
 {
@@ -1356,7 +1625,26 @@ write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
       }
    }
 
-   blob_write_uint32(ctx->blob, header.u32);
+   /* Vectors and big scalars are often repeated, e.g. after scalarization or
+    * unrolling, and cost a dword per component.
+    */
+   if (header.load_const.packing == load_const_full) {
+      struct hash_entry *entry =
+         _mesa_hash_table_search(ctx->load_const_table, lc);
+
+      if (entry) {
+         uint32_t delta = ctx->next_idx - (uint32_t)(uintptr_t)entry->data;
+         if (delta < (1 << 19)) {
+            header.load_const.packing = load_const_same_as_earlier;
+            header.load_const.packed_value = delta;
+         }
+      } else {
+         _mesa_hash_table_insert(ctx->load_const_table, lc,
+                                 (void *)(uintptr_t)ctx->next_idx);
+      }
+   }
+
+   write_uint32(ctx, header.u32);
 
    if (header.load_const.packing == load_const_full) {
       switch (lc->def.bit_size) {
@@ -1367,12 +1655,12 @@ write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
 
       case 32:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            blob_write_uint32(ctx->blob, lc->value[i].u32);
+            write_uint32(ctx, lc->value[i].u32);
          break;
 
       case 16:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            blob_write_uint16(ctx->blob, lc->value[i].u16);
+            write_uint16(ctx, lc->value[i].u16);
          break;
 
       default:
@@ -1430,6 +1718,17 @@ read_load_const(read_ctx *ctx, union packed_instr header)
       }
       break;
 
+   case load_const_same_as_earlier: {
+      nir_ssa_def *def =
+         read_lookup_object(ctx, ctx->next_idx -
+                                 header.load_const.packed_value);
+      nir_load_const_instr *earlier = nir_instr_as_load_const(def->parent_instr);
+
+      memcpy(lc->value, earlier->value,
+             sizeof(*lc->value) * lc->def.num_components);
+      break;
+   }
+
    case load_const_full:
       switch (lc->def.bit_size) {
       case 64:
@@ -1438,12 +1737,12 @@ read_load_const(read_ctx *ctx, union packed_instr header)
 
       case 32:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            lc->value[i].u32 = blob_read_uint32(ctx->blob);
+            lc->value[i].u32 = read_uint32(ctx);
          break;
 
       case 16:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            lc->value[i].u16 = blob_read_uint16(ctx->blob);
+            lc->value[i].u16 = read_uint16(ctx);
          break;
 
       default:
@@ -1471,7 +1770,7 @@ write_ssa_undef(write_ctx *ctx, const nir_ssa_undef_instr *undef)
    header.undef.last_component = undef->def.num_components - 1;
    header.undef.bit_size = encode_bit_size_3bits(undef->def.bit_size);
 
-   blob_write_uint32(ctx->blob, header.u32);
+   write_uint32(ctx, header.u32);
    write_add_object(ctx, &undef->def);
 }
 
@@ -1519,11 +1818,16 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
    header.tex.instr_type = tex->instr.type;
    header.tex.num_srcs = tex->num_srcs;
    header.tex.op = tex->op;
+   /* Packed sources keep the source type in the low 5 bits. */
+   STATIC_ASSERT(nir_num_tex_src_types <= 32);
+   header.tex.packed_src_ssa = true;
+   for (unsigned i = 0; i < tex->num_srcs; i++)
+      header.tex.packed_src_ssa &= tex->src[i].src.is_ssa;
 
    write_dest(ctx, &tex->dest, header, tex->instr.type);
 
-   blob_write_uint32(ctx->blob, tex->texture_index);
-   blob_write_uint32(ctx->blob, tex->sampler_index);
+   blob_write_varint32(ctx->blob, tex->texture_index);
+   blob_write_varint32(ctx->blob, tex->sampler_index);
    if (tex->op == nir_texop_tg4)
       blob_write_bytes(ctx->blob, tex->tg4_offsets, sizeof(tex->tg4_offsets));
 
@@ -1542,13 +1846,18 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
       .u.array_is_lowered_cube = tex->array_is_lowered_cube,
       .u.is_gather_implicit_lod = tex->is_gather_implicit_lod,
    };
-   blob_write_uint32(ctx->blob, packed.u32);
+   write_uint32(ctx, packed.u32);
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
-      union packed_src src;
-      src.u32 = 0;
-      src.tex.src_type = tex->src[i].src_type;
-      write_src_full(ctx, &tex->src[i].src, src);
+      if (header.tex.packed_src_ssa) {
+         write_ssa_src_delta(ctx, tex->src[i].src.ssa,
+                             tex->src[i].src_type, 5);
+      } else {
+         union packed_src src;
+         src.u32 = 0;
+         src.tex.src_type = tex->src[i].src_type;
+         write_src_full(ctx, &tex->src[i].src, src);
+      }
    }
 }
 
@@ -1560,13 +1869,13 @@ read_tex(read_ctx *ctx, union packed_instr header)
    read_dest(ctx, &tex->dest, &tex->instr, header);
 
    tex->op = header.tex.op;
-   tex->texture_index = blob_read_uint32(ctx->blob);
-   tex->sampler_index = blob_read_uint32(ctx->blob);
+   tex->texture_index = blob_read_varint32(ctx->blob);
+   tex->sampler_index = blob_read_varint32(ctx->blob);
    if (tex->op == nir_texop_tg4)
       blob_copy_bytes(ctx->blob, tex->tg4_offsets, sizeof(tex->tg4_offsets));
 
    union packed_tex_data packed;
-   packed.u32 = blob_read_uint32(ctx->blob);
+   packed.u32 = read_uint32(ctx);
    tex->sampler_dim = packed.u.sampler_dim;
    tex->dest_type = packed.u.dest_type;
    tex->coord_components = packed.u.coord_components;
@@ -1581,8 +1890,15 @@ read_tex(read_ctx *ctx, union packed_instr header)
    tex->is_gather_implicit_lod = packed.u.is_gather_implicit_lod;
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
-      union packed_src src = read_src(ctx, &tex->src[i].src);
-      tex->src[i].src_type = src.tex.src_type;
+      if (header.tex.packed_src_ssa) {
+         unsigned src_type;
+         tex->src[i].src.is_ssa = true;
+         tex->src[i].src.ssa = read_ssa_src_delta(ctx, &src_type, 5);
+         tex->src[i].src_type = src_type;
+      } else {
+         union packed_src src = read_src_full(ctx, &tex->src[i].src);
+         tex->src[i].src_type = src.tex.src_type;
+      }
    }
 
    return tex;
@@ -1598,19 +1914,16 @@ write_phi(write_ctx *ctx, const nir_phi_instr *phi)
    header.phi.num_srcs = exec_list_length(&phi->srcs);
 
    /* Phi nodes are special, since they may reference SSA definitions and
-    * basic blocks that don't exist yet. We leave two empty uint32_t's here,
-    * and then store enough information so that a later fixup pass can fill
-    * them in correctly.
+    * basic blocks that don't exist yet. Their sources are written after the
+    * body of the impl by a later fixup pass.
     */
    write_dest(ctx, &phi->dest, header, phi->instr.type);
 
+   uint32_t phi_idx = write_lookup_object(ctx, &phi->dest.ssa);
    nir_foreach_phi_src(src, phi) {
       assert(src->src.is_ssa);
-      size_t blob_offset = blob_reserve_uint32(ctx->blob);
-      ASSERTED size_t blob_offset2 = blob_reserve_uint32(ctx->blob);
-      assert(blob_offset + sizeof(uint32_t) == blob_offset2);
       write_phi_fixup fixup = {
-         .blob_offset = blob_offset,
+         .phi_idx = phi_idx,
          .src = src->src.ssa,
          .block = src->pred,
       };
@@ -1618,14 +1931,32 @@ write_phi(write_ctx *ctx, const nir_phi_instr *phi)
    }
 }
 
+/* The sources and predecessors of phis are usually close to the phi, so
+ * they are written as the signed distance to the index of the phi.
+ */
+static void
+write_phi_src_idx(write_ctx *ctx, uint32_t phi_idx, uint32_t idx)
+{
+   int32_t delta = (int32_t)(idx - phi_idx);
+   blob_write_varint32(ctx->blob, (uint32_t)delta << 1 ^ (delta >> 31));
+}
+
+static uint32_t
+read_phi_src_idx(read_ctx *ctx, uint32_t phi_idx)
+{
+   uint32_t value = blob_read_varint32(ctx->blob);
+   int32_t delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 0x1);
+   return phi_idx + delta;
+}
+
 static void
 write_fixup_phis(write_ctx *ctx)
 {
    util_dynarray_foreach(&ctx->phi_fixups, write_phi_fixup, fixup) {
-      blob_overwrite_uint32(ctx->blob, fixup->blob_offset,
-                            write_lookup_object(ctx, fixup->src));
-      blob_overwrite_uint32(ctx->blob, fixup->blob_offset + sizeof(uint32_t),
-                            write_lookup_object(ctx, fixup->block));
+      write_phi_src_idx(ctx, fixup->phi_idx,
+                        write_lookup_object(ctx, fixup->src));
+      write_phi_src_idx(ctx, fixup->phi_idx,
+                        write_lookup_object(ctx, fixup->block));
    }
 
    util_dynarray_clear(&ctx->phi_fixups);
@@ -1637,9 +1968,10 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
    nir_phi_instr *phi = nir_phi_instr_create(ctx->nir);
 
    read_dest(ctx, &phi->dest, &phi->instr, header);
+   uintptr_t phi_idx = ctx->next_idx - 1;
 
-   /* For similar reasons as before, we just store the index directly into the
-    * pointer, and let a later pass resolve the phi sources.
+   /* For similar reasons as before, we just store the index of the phi into
+    * the pointers, and let a later pass resolve the phi sources.
     *
     * In order to ensure that the copied sources (which are just the indices
     * from the blob for now) don't get inserted into the old shader's use-def
@@ -1649,8 +1981,8 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
    nir_instr_insert_after_block(blk, &phi->instr);
 
    for (unsigned i = 0; i < header.phi.num_srcs; i++) {
-      nir_ssa_def *def = (nir_ssa_def *)(uintptr_t) blob_read_uint32(ctx->blob);
-      nir_block *pred = (nir_block *)(uintptr_t) blob_read_uint32(ctx->blob);
+      nir_ssa_def *def = (nir_ssa_def *)phi_idx;
+      nir_block *pred = (nir_block *)phi_idx;
       nir_phi_src *src = nir_phi_instr_add_src(phi, pred, nir_src_for_ssa(def));
 
       /* Since we're not letting nir_insert_instr handle use/def stuff for us,
@@ -1660,9 +1992,10 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
       src->src.parent_instr = &phi->instr;
 
       /* Stash it in the list of phi sources.  We'll walk this list and fix up
-       * sources at the very end of read_function_impl.
+       * sources at the very end of read_function_impl, in the order they
+       * were written.
        */
-      list_add(&src->src.use_link, &ctx->phi_srcs);
+      list_addtail(&src->src.use_link, &ctx->phi_srcs);
    }
 
    return phi;
@@ -1672,8 +2005,9 @@ static void
 read_fixup_phis(read_ctx *ctx)
 {
    list_for_each_entry_safe(nir_phi_src, src, &ctx->phi_srcs, src.use_link) {
-      src->pred = read_lookup_object(ctx, (uintptr_t)src->pred);
-      src->src.ssa = read_lookup_object(ctx, (uintptr_t)src->src.ssa);
+      uint32_t phi_idx = (uintptr_t)src->src.ssa;
+      src->src.ssa = read_lookup_object(ctx, read_phi_src_idx(ctx, phi_idx));
+      src->pred = read_lookup_object(ctx, read_phi_src_idx(ctx, phi_idx));
 
       /* Remove from this list */
       list_del(&src->src.use_link);
@@ -1697,7 +2031,7 @@ write_jump(write_ctx *ctx, const nir_jump_instr *jmp)
    header.jump.instr_type = jmp->instr.type;
    header.jump.type = jmp->type;
 
-   blob_write_uint32(ctx->blob, header.u32);
+   write_uint32(ctx, header.u32);
 }
 
 static nir_jump_instr *
@@ -1714,7 +2048,7 @@ read_jump(read_ctx *ctx, union packed_instr header)
 static void
 write_call(write_ctx *ctx, const nir_call_instr *call)
 {
-   blob_write_uint32(ctx->blob, write_lookup_object(ctx, call->callee));
+   blob_write_varint32(ctx->blob, write_lookup_object(ctx, call->callee));
 
    for (unsigned i = 0; i < call->num_params; i++)
       write_src(ctx, &call->params[i]);
@@ -1764,7 +2098,7 @@ write_instr(write_ctx *ctx, const nir_instr *instr)
       write_jump(ctx, nir_instr_as_jump(instr));
       break;
    case nir_instr_type_call:
-      blob_write_uint32(ctx->blob, instr->type);
+      write_uint32(ctx, instr->type);
       write_call(ctx, nir_instr_as_call(instr));
       break;
    case nir_instr_type_parallel_copy:
@@ -1779,10 +2113,34 @@ static unsigned
 read_instr(read_ctx *ctx, nir_block *block)
 {
    STATIC_ASSERT(sizeof(union packed_instr) == 4);
+   STATIC_ASSERT(nir_instr_type_parallel_copy < ALU_HEADER_CACHE_REF);
    union packed_instr header;
-   header.u32 = blob_read_uint32(ctx->blob);
    nir_instr *instr;
 
+   /* The first byte has the instruction type in the low bits, or refers to
+    * a recent ALU header, see write_dest().
+    */
+   uint8_t first_byte = blob_read_uint8(ctx->blob);
+   if ((first_byte & 0xf) == ALU_HEADER_CACHE_REF) {
+      header.u32 = ctx->alu_headers[first_byte >> 4];
+      nir_instr_insert_after_block(block, &read_alu(ctx, header)->instr);
+      return 1;
+   }
+
+   uint8_t bytes[3] = {0};
+   blob_copy_bytes(ctx->blob, bytes, sizeof(bytes));
+   header.u32 = first_byte | bytes[0] << 8 | bytes[1] << 16 |
+                (uint32_t)bytes[2] << 24;
+
+   if (header.any.instr_type == nir_instr_type_alu) {
+      union packed_instr clean_header = header;
+      clean_header.alu.num_followup_alu_sharing_header = 0;
+
+      ctx->alu_headers[ctx->next_alu_header] = clean_header.u32;
+      ctx->next_alu_header =
+         (ctx->next_alu_header + 1) % ALU_HEADER_CACHE_SIZE;
+   }
+
    switch (header.any.instr_type) {
    case nir_instr_type_alu:
       for (unsigned i = 0; i <= header.alu.num_followup_alu_sharing_header; i++)
@@ -1831,7 +2189,7 @@ static void
 write_block(write_ctx *ctx, const nir_block *block)
 {
    write_add_object(ctx, block);
-   blob_write_uint32(ctx->blob, exec_list_length(&block->instr_list));
+   blob_write_varint32(ctx->blob, exec_list_length(&block->instr_list));
 
    ctx->last_instr_type = ~0;
    ctx->last_alu_header_offset = 0;
@@ -1853,7 +2211,7 @@ read_block(read_ctx *ctx, struct exec_list *cf_list)
       exec_node_data(nir_block, exec_list_get_tail(cf_list), cf_node.node);
 
    read_add_object(ctx, block);
-   unsigned num_instrs = blob_read_uint32(ctx->blob);
+   unsigned num_instrs = blob_read_varint32(ctx->blob);
    for (unsigned i = 0; i < num_instrs;) {
       i += read_instr(ctx, block);
    }
@@ -1924,7 +2282,7 @@ read_loop(read_ctx *ctx, struct exec_list *cf_list)
 static void
 write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 {
-   blob_write_uint32(ctx->blob, cf->type);
+   blob_write_varint32(ctx->blob, cf->type);
 
    switch (cf->type) {
    case nir_cf_node_block:
@@ -1944,7 +2302,7 @@ write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 static void
 read_cf_node(read_ctx *ctx, struct exec_list *list)
 {
-   nir_cf_node_type type = blob_read_uint32(ctx->blob);
+   nir_cf_node_type type = blob_read_varint32(ctx->blob);
 
    switch (type) {
    case nir_cf_node_block:
@@ -1964,7 +2322,7 @@ read_cf_node(read_ctx *ctx, struct exec_list *list)
 static void
 write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(cf_list));
+   blob_write_varint32(ctx->blob, exec_list_length(cf_list));
    foreach_list_typed(nir_cf_node, cf, node, cf_list) {
       write_cf_node(ctx, cf);
    }
@@ -1973,26 +2331,114 @@ write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 static void
 read_cf_list(read_ctx *ctx, struct exec_list *cf_list)
 {
-   uint32_t num_cf_nodes = blob_read_uint32(ctx->blob);
+   uint32_t num_cf_nodes = blob_read_varint32(ctx->blob);
    for (unsigned i = 0; i < num_cf_nodes; i++)
       read_cf_node(ctx, cf_list);
 }
 
+/* Writes the functions that the impl calls, for the reader to find the
+ * impls reachable from the entrypoints without reading them.
+ */
+static void
+write_callees(write_ctx *ctx, const nir_function_impl *fi)
+{
+   struct util_dynarray callees;
+   struct set *visited = _mesa_pointer_set_create(NULL);
+   util_dynarray_init(&callees, NULL);
+
+   if (fi->preamble) {
+      _mesa_set_add(visited, fi->preamble);
+      util_dynarray_append(&callees, const nir_function *, fi->preamble);
+   }
+
+   nir_foreach_block(block, (nir_function_impl *)fi) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type != nir_instr_type_call)
+            continue;
+
+         const nir_function *callee = nir_instr_as_call(instr)->callee;
+         bool found;
+         _mesa_set_search_or_add(visited, callee, &found);
+         if (!found)
+            util_dynarray_append(&callees, const nir_function *, callee);
+      }
+   }
+
+   blob_write_varint32(ctx->blob, util_dynarray_num_elements(&callees,
+                                                             const nir_function *));
+   util_dynarray_foreach(&callees, const nir_function *, callee)
+      blob_write_varint32(ctx->blob, write_lookup_object(ctx, *callee));
+
+   util_dynarray_fini(&callees);
+   _mesa_set_destroy(visited, NULL);
+}
+
+/* Impls may be skipped by the reader, so they can't refer to anything that
+ * an earlier impl wrote.
+ */
+static void
+write_reset_impl_state(write_ctx *ctx)
+{
+   ctx->last_type = NULL;
+   ctx->last_interface_type = NULL;
+   memset(&ctx->last_var_data, 0, sizeof(ctx->last_var_data));
+
+   hash_table_foreach(ctx->type_table, entry) {
+      if ((uintptr_t)entry->data > ctx->num_global_types)
+         _mesa_hash_table_remove(ctx->type_table, entry);
+   }
+   ctx->num_types = ctx->num_global_types;
+
+   _mesa_hash_table_clear(ctx->load_const_table, NULL);
+
+   memset(ctx->alu_headers, 0, sizeof(ctx->alu_headers));
+   ctx->next_alu_header = 0;
+}
+
+static void
+read_reset_impl_state(read_ctx *ctx)
+{
+   ctx->last_type = NULL;
+   ctx->last_interface_type = NULL;
+   memset(&ctx->last_var_data, 0, sizeof(ctx->last_var_data));
+
+   util_dynarray_resize(&ctx->types, const struct glsl_type *,
+                        ctx->num_global_types);
+
+   memset(ctx->alu_headers, 0, sizeof(ctx->alu_headers));
+   ctx->next_alu_header = 0;
+}
+
 static void
 write_function_impl(write_ctx *ctx, const nir_function_impl *fi)
 {
+   /* The size of the body and the number of objects in it, which are filled
+    * in at the end, so that the reader can skip the impl.
+    */
+   intptr_t sizes_offset = blob_reserve_bytes(ctx->blob, 2 * sizeof(uint32_t));
+   uint32_t first_idx = ctx->next_idx;
+
+   write_callees(ctx, fi);
+
+   size_t body_offset = ctx->blob->size;
+   write_reset_impl_state(ctx);
+
    blob_write_uint8(ctx->blob, fi->structured);
    blob_write_uint8(ctx->blob, !!fi->preamble);
 
    if (fi->preamble)
-      blob_write_uint32(ctx->blob, write_lookup_object(ctx, fi->preamble));
+      blob_write_varint32(ctx->blob, write_lookup_object(ctx, fi->preamble));
 
    write_var_list(ctx, &fi->locals);
    write_reg_list(ctx, &fi->registers);
-   blob_write_uint32(ctx->blob, fi->reg_alloc);
+   blob_write_varint32(ctx->blob, fi->reg_alloc);
 
    write_cf_list(ctx, &fi->body);
    write_fixup_phis(ctx);
+
+   overwrite_uint32(ctx, sizes_offset, ctx->blob->size - body_offset);
+   overwrite_uint32(ctx, sizes_offset + sizeof(uint32_t),
+                    ctx->next_idx - first_idx);
 }
 
 static nir_function_impl *
@@ -2001,6 +2447,8 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
    nir_function_impl *fi = nir_function_impl_create_bare(ctx->nir);
    fi->function = fxn;
 
+   read_reset_impl_state(ctx);
+
    fi->structured = blob_read_uint8(ctx->blob);
    bool preamble = blob_read_uint8(ctx->blob);
 
@@ -2009,7 +2457,7 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 
    read_var_list(ctx, &fi->locals);
    read_reg_list(ctx, &fi->registers);
-   fi->reg_alloc = blob_read_uint32(ctx->blob);
+   fi->reg_alloc = blob_read_varint32(ctx->blob);
 
    read_cf_list(ctx, &fi->body);
    read_fixup_phis(ctx);
@@ -2019,6 +2467,115 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
    return fi;
 }
 
+typedef struct {
+   nir_function *fxn;
+
+   /* The list of called functions and the body in the blob */
+   const uint8_t *callees;
+   const uint8_t *body;
+
+   uint32_t first_idx;
+   bool reachable;
+} read_impl_info;
+
+static void
+mark_impl_reachable(read_ctx *ctx, read_impl_info *info)
+{
+   if (info->reachable)
+      return;
+
+   info->reachable = true;
+
+   struct blob_reader callees;
+   blob_reader_init(&callees, info->callees, info->body - info->callees);
+
+   unsigned num_callees = blob_read_varint32(&callees);
+   for (unsigned i = 0; i < num_callees; i++) {
+      nir_function *callee =
+         read_lookup_object(ctx, blob_read_varint32(&callees));
+
+      if (callee && callee->impl)
+         mark_impl_reachable(ctx, (read_impl_info *)callee->impl);
+   }
+}
+
+/* Reads the impls of the functions, or only those reachable from an
+ * entrypoint. Unreachable impls are skipped without looking at their body.
+ */
+static void
+read_function_impls(read_ctx *ctx, bool only_reachable)
+{
+   unsigned num_impls = 0;
+   bool has_entrypoint = false;
+   nir_foreach_function(fxn, ctx->nir) {
+      if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
+         num_impls++;
+      has_entrypoint |= fxn->is_entrypoint;
+   }
+
+   if (num_impls == 0)
+      return;
+
+   read_impl_info *infos = calloc(num_impls, sizeof(*infos));
+   if (!infos) {
+      ctx->blob->overrun = true;
+      return;
+   }
+
+   /* Find the impls in the blob first, they are stored as pointers to their
+    * info in the functions for now.
+    */
+   unsigned i = 0;
+   nir_foreach_function(fxn, ctx->nir) {
+      if (fxn->impl != NIR_SERIALIZE_FUNC_HAS_IMPL)
+         continue;
+
+      read_impl_info *info = &infos[i++];
+      uint32_t body_size = read_uint32(ctx);
+      uint32_t num_objects = read_uint32(ctx);
+
+      info->fxn = fxn;
+      info->first_idx = ctx->next_idx;
+      info->callees = ctx->blob->current;
+
+      unsigned num_callees = blob_read_varint32(ctx->blob);
+      for (unsigned j = 0; j < num_callees; j++)
+         blob_read_varint32(ctx->blob);
+
+      info->body = ctx->blob->current;
+      blob_skip_bytes(ctx->blob, body_size);
+      ctx->next_idx += num_objects;
+
+      fxn->impl = (nir_function_impl *)info;
+   }
+
+   const uint8_t *end = ctx->blob->current;
+   uint32_t end_idx = ctx->next_idx;
+
+   for (i = 0; i < num_impls; i++) {
+      if (!only_reachable || !has_entrypoint || infos[i].fxn->is_entrypoint)
+         mark_impl_reachable(ctx, &infos[i]);
+   }
+
+   for (i = 0; i < num_impls; i++) {
+      read_impl_info *info = &infos[i];
+
+      if (!info->reachable) {
+         info->fxn->impl = NULL;
+         continue;
+      }
+
+      ctx->blob->current = info->body;
+      ctx->next_idx = info->first_idx;
+      info->fxn->impl = read_function_impl(ctx, info->fxn);
+   }
+
+   ctx->blob->current = end;
+   ctx->next_idx = end_idx;
+
+   free(infos);
+}
+
 static void
 write_function(write_ctx *ctx, const nir_function *fxn)
 {
@@ -2031,18 +2588,18 @@ write_function(write_ctx *ctx, const nir_function *fxn)
       flags |= 0x4;
    if (fxn->impl)
       flags |= 0x8;
-   blob_write_uint32(ctx->blob, flags);
+   blob_write_varint32(ctx->blob, flags);
    if (fxn->name)
       blob_write_string(ctx->blob, fxn->name);
 
    write_add_object(ctx, fxn);
 
-   blob_write_uint32(ctx->blob, fxn->num_params);
+   blob_write_varint32(ctx->blob, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
       uint32_t val =
          ((uint32_t)fxn->params[i].num_components) |
          ((uint32_t)fxn->params[i].bit_size) << 8;
-      blob_write_uint32(ctx->blob, val);
+      blob_write_varint32(ctx->blob, val);
    }
 
    /* At first glance, it looks like we should write the function_impl here.
@@ -2055,7 +2612,7 @@ write_function(write_ctx *ctx, const nir_function *fxn)
 static void
 read_function(read_ctx *ctx)
 {
-   uint32_t flags = blob_read_uint32(ctx->blob);
+   uint32_t flags = blob_read_varint32(ctx->blob);
    bool has_name = flags & 0x4;
    char *name = has_name ? blob_read_string(ctx->blob) : NULL;
 
@@ -2063,10 +2620,10 @@ read_function(read_ctx *ctx)
 
    read_add_object(ctx, fxn);
 
-   fxn->num_params = blob_read_uint32(ctx->blob);
+   fxn->num_params = blob_read_varint32(ctx->blob);
    fxn->params = ralloc_array(fxn, nir_parameter, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
-      uint32_t val = blob_read_uint32(ctx->blob);
+      uint32_t val = blob_read_varint32(ctx->blob);
       fxn->params[i].num_components = val & 0xff;
       fxn->params[i].bit_size = (val >> 8) & 0xff;
    }
@@ -2081,11 +2638,11 @@ static void
 write_xfb_info(write_ctx *ctx, const nir_xfb_info *xfb)
 {
    if (xfb == NULL) {
-      blob_write_uint32(ctx->blob, 0);
+      blob_write_varint32(ctx->blob, 0);
    } else {
       size_t size = nir_xfb_info_size(xfb->output_count);
       assert(size <= UINT32_MAX);
-      blob_write_uint32(ctx->blob, size);
+      blob_write_varint32(ctx->blob, size);
       blob_write_bytes(ctx->blob, xfb, size);
    }
 }
@@ -2093,7 +2650,7 @@ write_xfb_info(write_ctx *ctx, const nir_xfb_info *xfb)
 static nir_xfb_info *
 read_xfb_info(read_ctx *ctx)
 {
-   uint32_t size = blob_read_uint32(ctx->blob);
+   uint32_t size = blob_read_varint32(ctx->blob);
    if (size == 0)
       return NULL;
 
@@ -2115,6 +2672,9 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
 {
    write_ctx ctx = {0};
    ctx.remap_table = _mesa_pointer_hash_table_create(NULL);
+   ctx.type_table = _mesa_pointer_hash_table_create(NULL);
+   ctx.load_const_table = _mesa_hash_table_create(NULL, hash_load_const,
+                                                  load_consts_equal);
    ctx.blob = blob;
    ctx.nir = nir;
    ctx.strip = strip;
@@ -2128,7 +2688,7 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
       strings |= 0x1;
    if (!strip && info.label)
       strings |= 0x2;
-   blob_write_uint32(blob, strings);
+   blob_write_varint32(blob, strings);
    if (!strip && info.name)
       blob_write_string(blob, info.name);
    if (!strip && info.label)
@@ -2138,33 +2698,34 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
 
    write_var_list(&ctx, &nir->variables);
 
-   blob_write_uint32(blob, nir->num_inputs);
-   blob_write_uint32(blob, nir->num_uniforms);
-   blob_write_uint32(blob, nir->num_outputs);
-   blob_write_uint32(blob, nir->scratch_size);
+   blob_write_varint32(blob, nir->num_inputs);
+   blob_write_varint32(blob, nir->num_uniforms);
+   blob_write_varint32(blob, nir->num_outputs);
+   blob_write_varint32(blob, nir->scratch_size);
 
-   blob_write_uint32(blob, exec_list_length(&nir->functions));
+   blob_write_varint32(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
       write_function(&ctx, fxn);
    }
 
+   ctx.num_global_types = ctx.num_types;
    nir_foreach_function(fxn, nir) {
       if (fxn->impl)
          write_function_impl(&ctx, fxn->impl);
    }
 
-   blob_write_uint32(blob, nir->constant_data_size);
+   blob_write_varint32(blob, nir->constant_data_size);
    if (nir->constant_data_size > 0)
       blob_write_bytes(blob, nir->constant_data, nir->constant_data_size);
 
    write_xfb_info(&ctx, nir->xfb_info);
 
    if (nir->info.stage == MESA_SHADER_KERNEL) {
-      blob_write_uint32(blob, nir->printf_info_count);
+      blob_write_varint32(blob, nir->printf_info_count);
       for (int i = 0; i < nir->printf_info_count; i++) {
          u_printf_info *info = &nir->printf_info[i];
-         blob_write_uint32(blob, info->num_args);
-         blob_write_uint32(blob, info->string_size);
+         blob_write_varint32(blob, info->num_args);
+         blob_write_varint32(blob, info->string_size);
          blob_write_bytes(blob, info->arg_sizes,
                           info->num_args * sizeof(*info->arg_sizes));
          /* we can't use blob_write_string, because it contains multiple NULL
@@ -2176,22 +2737,96 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
 
    blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
 
+   _mesa_hash_table_destroy(ctx.load_const_table, NULL);
+   _mesa_hash_table_destroy(ctx.type_table, NULL);
    _mesa_hash_table_destroy(ctx.remap_table, NULL);
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
-nir_shader *
-nir_deserialize(void *mem_ctx,
-                const struct nir_shader_compiler_options *options,
-                struct blob_reader *blob)
+/**
+ * Same as nir_serialize(), but the blob is compressed if Mesa was built with
+ * compression support and that makes it smaller. This is meant for blobs
+ * that are kept in memory, the disk cache already compresses its entries.
+ */
+void
+nir_serialize_compressed(struct blob *blob, const nir_shader *nir, bool strip)
 {
+#ifdef HAVE_COMPRESSION
+   struct blob uncompressed;
+   blob_init(&uncompressed);
+   nir_serialize(&uncompressed, nir, strip);
+
+   size_t max_size = util_compress_max_compressed_len(uncompressed.size);
+   uint8_t *compressed = uncompressed.out_of_memory ? NULL : malloc(max_size);
+   size_t size = 0;
+
+   if (compressed) {
+      size = util_compress_deflate(uncompressed.data, uncompressed.size,
+                                   compressed, max_size);
+   }
+
+   if (size && size + 3 * sizeof(uint32_t) < uncompressed.size) {
+      blob_write_uint32(blob, NIR_SERIALIZE_COMPRESSED);
+      blob_write_varint32(blob, uncompressed.size);
+      blob_write_varint32(blob, size);
+      blob_write_bytes(blob, compressed, size);
+   } else {
+      /* Types are aligned relative to the start of the blob. */
+      blob_align(blob, sizeof(uint32_t));
+      blob_write_bytes(blob, uncompressed.data, uncompressed.size);
+      blob->out_of_memory |= uncompressed.out_of_memory;
+   }
+
+   free(compressed);
+   blob_finish(&uncompressed);
+#else
+   nir_serialize(blob, nir, strip);
+#endif
+}
+
+static nir_shader *
+deserialize(void *mem_ctx,
+            const struct nir_shader_compiler_options *options,
+            struct blob_reader *blob, bool only_reachable)
+{
+   uint32_t idx_table_len = blob_read_uint32(blob);
+
+   if (idx_table_len & NIR_SERIALIZE_COMPRESSED) {
+#ifdef HAVE_COMPRESSION
+      uint32_t uncompressed_size = blob_read_varint32(blob);
+      uint32_t compressed_size = blob_read_varint32(blob);
+      const void *compressed = blob_read_bytes(blob, compressed_size);
+      uint8_t *data = malloc(uncompressed_size);
+
+      if (blob->overrun || !data ||
+          !util_compress_inflate(compressed, compressed_size,
+                                 data, uncompressed_size)) {
+         free(data);
+         blob->overrun = true;
+         return NULL;
+      }
+
+      struct blob_reader reader;
+      blob_reader_init(&reader, data, uncompressed_size);
+      nir_shader *nir = deserialize(mem_ctx, options, &reader, only_reachable);
+      blob->overrun |= reader.overrun;
+      free(data);
+
+      return nir;
+#else
+      blob->overrun = true;
+      return NULL;
+#endif
+   }
+
    read_ctx ctx = {0};
    ctx.blob = blob;
    list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_uint32(blob);
+   util_dynarray_init(&ctx.types, NULL);
+   ctx.idx_table_len = idx_table_len;
    ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
 
-   uint32_t strings = blob_read_uint32(blob);
+   uint32_t strings = blob_read_varint32(blob);
    char *name = (strings & 0x1) ? blob_read_string(blob) : NULL;
    char *label = (strings & 0x2) ? blob_read_string(blob) : NULL;
 
@@ -2207,21 +2842,20 @@ nir_deserialize(void *mem_ctx,
 
    read_var_list(&ctx, &ctx.nir->variables);
 
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->scratch_size = blob_read_uint32(blob);
+   ctx.nir->num_inputs = blob_read_varint32(blob);
+   ctx.nir->num_uniforms = blob_read_varint32(blob);
+   ctx.nir->num_outputs = blob_read_varint32(blob);
+   ctx.nir->scratch_size = blob_read_varint32(blob);
 
-   unsigned num_functions = blob_read_uint32(blob);
+   unsigned num_functions = blob_read_varint32(blob);
    for (unsigned i = 0; i < num_functions; i++)
       read_function(&ctx);
 
-   nir_foreach_function(fxn, ctx.nir) {
-      if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
-         fxn->impl = read_function_impl(&ctx, fxn);
-   }
+   ctx.num_global_types =
+      util_dynarray_num_elements(&ctx.types, const struct glsl_type *);
+   read_function_impls(&ctx, only_reachable);
 
-   ctx.nir->constant_data_size = blob_read_uint32(blob);
+   ctx.nir->constant_data_size = blob_read_varint32(blob);
    if (ctx.nir->constant_data_size > 0) {
       ctx.nir->constant_data =
          ralloc_size(ctx.nir, ctx.nir->constant_data_size);
@@ -2232,14 +2866,14 @@ nir_deserialize(void *mem_ctx,
    ctx.nir->xfb_info = read_xfb_info(&ctx);
 
    if (ctx.nir->info.stage == MESA_SHADER_KERNEL) {
-      ctx.nir->printf_info_count = blob_read_uint32(blob);
+      ctx.nir->printf_info_count = blob_read_varint32(blob);
       ctx.nir->printf_info =
          ralloc_array(ctx.nir, u_printf_info, ctx.nir->printf_info_count);
 
       for (int i = 0; i < ctx.nir->printf_info_count; i++) {
          u_printf_info *info = &ctx.nir->printf_info[i];
-         info->num_args = blob_read_uint32(blob);
-         info->string_size = blob_read_uint32(blob);
+         info->num_args = blob_read_varint32(blob);
+         info->string_size = blob_read_varint32(blob);
          info->arg_sizes = ralloc_array(ctx.nir, unsigned, info->num_args);
          blob_copy_bytes(blob, info->arg_sizes,
                          info->num_args * sizeof(*info->arg_sizes));
@@ -2250,12 +2884,34 @@ nir_deserialize(void *mem_ctx,
    }
 
    free(ctx.idx_table);
+   util_dynarray_fini(&ctx.types);
 
    nir_validate_shader(ctx.nir, "after deserialize");
 
    return ctx.nir;
 }
 
+nir_shader *
+nir_deserialize(void *mem_ctx,
+                const struct nir_shader_compiler_options *options,
+                struct blob_reader *blob)
+{
+   return deserialize(mem_ctx, options, blob, false);
+}
+
+/**
+ * Same as nir_deserialize(), but only the functions reachable from an
+ * entrypoint get their impl, the other impls are skipped without being
+ * decoded. All of them are read if the shader has no entrypoint.
+ */
+nir_shader *
+nir_deserialize_reachable(void *mem_ctx,
+                          const struct nir_shader_compiler_options *options,
+                          struct blob_reader *blob)
+{
+   return deserialize(mem_ctx, options, blob, true);
+}
+
 void
 nir_shader_serialize_deserialize(nir_shader *shader)
 {
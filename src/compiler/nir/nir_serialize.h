@@ -32,9 +32,14 @@ extern "C" {
 #endif
 
 void nir_serialize(struct blob *blob, const nir_shader *nir, bool strip);
+void nir_serialize_compressed(struct blob *blob, const nir_shader *nir,
+                              bool strip);
 nir_shader *nir_deserialize(void *mem_ctx,
                             const struct nir_shader_compiler_options *options,
                             struct blob_reader *blob);
+nir_shader *nir_deserialize_reachable(void *mem_ctx,
+                                      const struct nir_shader_compiler_options *options,
+                                      struct blob_reader *blob);
 
 #ifdef __cplusplus
 } /* extern "C" */
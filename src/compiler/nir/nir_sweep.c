@@ -33,6 +33,12 @@
  * The expectation is that drivers should call this when finished compiling the shader
  * (after any optimization, lowering, and so on).  However, it's also fine to call it
  * earlier, and even many times, trading CPU cycles for memory savings.
+ *
+ * nir_compact() also sweeps the shader and then, if the instructions left only
+ * use a small part of their slabs, moves them to new slabs in program order,
+ * which gives the memory back and makes walking the shader more cache
+ * friendly. Pointers to instructions, sources and SSA values don't survive
+ * nir_compact(), so it must only be called where nobody holds any.
  */
 
 #define steal_list(mem_ctx, type, list) \
@@ -58,6 +64,192 @@ sweep_dest_indirect(nir_dest *dest, void *nir)
    return true;
 }
 
+/* Compact the instructions if less than this fraction of their slabs is used */
+#define COMPACT_USAGE_THRESHOLD 0.75
+
+/* Don't bother compacting small shaders */
+#define COMPACT_MIN_SIZE (64 * 1024)
+
+struct compact_state {
+   gc_ctx *ctx;
+   nir_instr *old_instr;
+   nir_instr *instr;
+
+   /* Indirect source already relocated along with its parent source */
+   nir_src *skip;
+};
+
+/* Returns the old copy of a source, dest or SSA def embedded in the
+ * instruction being relocated, which is still linked into the use-def lists.
+ */
+static void *
+old_address(struct compact_state *state, const void *ptr)
+{
+   return (char *)state->old_instr + ((char *)ptr - (char *)state->instr);
+}
+
+static void
+compact_src(struct compact_state *state, nir_src *old_src, nir_src *src)
+{
+   if (old_src->use_link.next)
+      list_replace(&old_src->use_link, &src->use_link);
+
+   src->parent_instr = state->instr;
+
+   if (!src->is_ssa && src->reg.indirect) {
+      src->reg.indirect = gc_relocate(state->ctx, old_src->reg.indirect);
+      compact_src(state, old_src->reg.indirect, src->reg.indirect);
+   }
+}
+
+static bool
+compact_src_cb(nir_src *src, void *_state)
+{
+   struct compact_state *state = _state;
+   nir_src *old_src;
+
+   if (src == state->skip)
+      return true;
+
+   if (state->instr->type == nir_instr_type_tex) {
+      nir_tex_instr *old_tex = nir_instr_as_tex(state->old_instr);
+      nir_tex_instr *tex = nir_instr_as_tex(state->instr);
+      unsigned i = container_of(src, nir_tex_src, src) - tex->src;
+
+      old_src = &old_tex->src[i].src;
+   } else {
+      old_src = old_address(state, src);
+   }
+
+   compact_src(state, old_src, src);
+   state->skip = src->is_ssa ? NULL : src->reg.indirect;
+
+   return true;
+}
+
+static bool
+compact_dest_cb(nir_dest *dest, void *_state)
+{
+   struct compact_state *state = _state;
+   nir_dest *old_dest = old_address(state, dest);
+
+   if (dest->is_ssa)
+      return true;
+
+   if (old_dest->reg.def_link.next)
+      list_replace(&old_dest->reg.def_link, &dest->reg.def_link);
+
+   dest->reg.parent_instr = state->instr;
+
+   if (dest->reg.indirect) {
+      dest->reg.indirect = gc_relocate(state->ctx, old_dest->reg.indirect);
+      compact_src(state, old_dest->reg.indirect, dest->reg.indirect);
+   }
+
+   return true;
+}
+
+static bool
+compact_ssa_def_cb(nir_ssa_def *def, void *_state)
+{
+   struct compact_state *state = _state;
+   nir_ssa_def *old_def = old_address(state, def);
+
+   list_replace(&old_def->uses, &def->uses);
+   def->parent_instr = state->instr;
+
+   nir_foreach_use_including_if(src, def)
+      src->ssa = def;
+
+   return true;
+}
+
+/* Moves the instruction and everything it owns to the new GC context and
+ * fixes up the links to it.
+ */
+static void
+compact_instr(struct compact_state *state, nir_instr *old_instr)
+{
+   nir_instr *instr = gc_relocate(state->ctx, old_instr);
+
+   state->old_instr = old_instr;
+   state->instr = instr;
+   state->skip = NULL;
+
+   exec_node_replace_with(&old_instr->node, &instr->node);
+
+   nir_foreach_ssa_def(instr, compact_ssa_def_cb, state);
+   nir_foreach_dest(instr, compact_dest_cb, state);
+
+   if (instr->type == nir_instr_type_phi) {
+      nir_phi_instr *old_phi = nir_instr_as_phi(old_instr);
+      nir_phi_instr *phi = nir_instr_as_phi(instr);
+
+      exec_list_move_nodes_to(&old_phi->srcs, &phi->srcs);
+
+      nir_foreach_phi_src_safe(old_src, phi) {
+         nir_phi_src *src = gc_relocate(state->ctx, old_src);
+
+         exec_node_replace_with(&old_src->node, &src->node);
+         compact_src(state, &old_src->src, &src->src);
+      }
+      return;
+   }
+
+   if (instr->type == nir_instr_type_tex) {
+      nir_tex_instr *tex = nir_instr_as_tex(instr);
+      tex->src = gc_relocate(state->ctx, tex->src);
+   }
+
+   nir_foreach_src(instr, compact_src_cb, state);
+}
+
+static bool
+can_compact_impl(nir_function_impl *impl)
+{
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_parallel_copy)
+            return false;
+      }
+   }
+
+   return true;
+}
+
+static bool
+compact_shader(nir_shader *nir)
+{
+   size_t total, used;
+
+   gc_get_slab_usage(nir->gctx, &total, &used);
+   if (total < COMPACT_MIN_SIZE || used >= total * COMPACT_USAGE_THRESHOLD)
+      return false;
+
+   nir_foreach_function(func, nir) {
+      if (func->impl && !can_compact_impl(func->impl))
+         return false;
+   }
+
+   struct compact_state state = {
+      .ctx = gc_context(nir),
+   };
+
+   nir_foreach_function(func, nir) {
+      if (!func->impl)
+         continue;
+
+      nir_foreach_block(block, func->impl) {
+         nir_foreach_instr_safe(instr, block)
+            compact_instr(&state, instr);
+      }
+   }
+
+   ralloc_free(nir->gctx);
+   nir->gctx = state.ctx;
+   return true;
+}
+
 static void
 sweep_block(nir_shader *nir, nir_block *block)
 {
@@ -202,3 +394,14 @@ nir_sweep(nir_shader *nir)
    gc_sweep_end(nir->gctx);
    ralloc_free(rubbish);
 }
+
+/**
+ * Sweeps the shader, and moves its instructions to new slabs if they only
+ * use a small part of the old ones. Returns true if the instructions moved.
+ */
+bool
+nir_compact(nir_shader *nir)
+{
+   nir_sweep(nir);
+   return compact_shader(nir);
+}
@@ -26,6 +26,8 @@
 
 #include "nir.h"
 #include "nir_builder.h"
+#include "nir_range_analysis.h"
+#include "random_shader.h"
 
 namespace {
 
@@ -183,4 +185,87 @@ TEST_F(nir_opt_idiv_const_test, irem)
    }
 }
 
+TEST_F(nir_opt_algebraic_test, range_analysis_metadata)
+{
+   nir_ssa_def *addr = nir_imm_int64(b, 0);
+   nir_ssa_def *x = nir_iadd_imm(b, nir_load_local_invocation_index(b), 1);
+   nir_store_global(b, addr, 1, nir_u2u8(b, x), 0x1);
+
+   nir_metadata_require(b->impl, nir_metadata_range_analysis);
+   EXPECT_EQ(nir_ssa_def_bits_used(x), 0xffull);
+
+   /* The result is cached until the new use is reported */
+   nir_store_global(b, addr, 2, nir_u2u16(b, x), 0x1);
+   EXPECT_EQ(nir_ssa_def_bits_used(x), 0xffull);
+   nir_invalidate_bits_used(b->impl->range_ht, x);
+   EXPECT_EQ(nir_ssa_def_bits_used(x), 0xffffull);
+
+   /* nir_opt_algebraic keeps the results up to date, most other passes
+    * don't.
+    */
+   nir_opt_algebraic(b->shader);
+   EXPECT_TRUE(b->impl->valid_metadata & nir_metadata_range_analysis);
+   EXPECT_GT(b->impl->range_ht->entries, 0);
+
+   nir_index_ssa_defs(b->impl);
+   EXPECT_FALSE(b->impl->valid_metadata & nir_metadata_range_analysis);
+}
+
+static void
+optimize(nir_shader *shader)
+{
+   bool progress;
+
+   do {
+      progress = false;
+      NIR_PASS(progress, shader, nir_opt_algebraic);
+      NIR_PASS(progress, shader, nir_copy_prop);
+      NIR_PASS(progress, shader, nir_opt_dce);
+      NIR_PASS(progress, shader, nir_opt_cse);
+      NIR_PASS(progress, shader, nir_opt_constant_folding);
+   } while (progress);
+}
+
+/* Skipping the commutative source orders that can't match must not change
+ * the result.
+ */
+TEST(nir_opt_algebraic_comm_ops_test, same_result_as_all_orders)
+{
+#ifdef NDEBUG
+   GTEST_SKIP() << "NIR_DEBUG is only available in debug builds.";
+#else
+   static const nir_shader_compiler_options options = { };
+
+   glsl_type_singleton_init_or_ref();
+
+   for (unsigned seed = 0; seed < 10; seed++) {
+      nir_builder b =
+         nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, &options,
+                                        "opt_algebraic comm ops");
+      nir_shader *shader = b.shader;
+
+      nir_random_shader random(&b, seed);
+      random.build_arithmetic(1000);
+
+      nir_shader *all_orders = nir_shader_clone(NULL, shader);
+
+      uint32_t saved_debug = nir_debug;
+      nir_debug |= NIR_DEBUG_ALGEBRAIC_ALL_COMM;
+      optimize(all_orders);
+      nir_debug = saved_debug;
+
+      optimize(shader);
+
+      char *expected = nir_shader_as_str(all_orders, all_orders);
+      char *result = nir_shader_as_str(shader, shader);
+      EXPECT_STREQ(result, expected) << "seed " << seed;
+
+      ralloc_free(all_orders);
+      ralloc_free(shader);
+   }
+
+   glsl_type_singleton_decref();
+#endif
+}
+
 }
@@ -0,0 +1,240 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <gtest/gtest.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "random_shader.h"
+#include "util/os_time.h"
+#include "util/u_debug.h"
+
+namespace {
+
+class nir_opt_combined_test : public ::testing::Test {
+protected:
+   nir_opt_combined_test();
+   ~nir_opt_combined_test();
+
+   void create_shader();
+   void reset_shader();
+   void build_random_shader(unsigned seed, unsigned size);
+
+   nir_builder bld;
+   nir_variable *in_var;
+   nir_variable *out_var[4];
+};
+
+nir_opt_combined_test::nir_opt_combined_test()
+{
+   glsl_type_singleton_init_or_ref();
+   create_shader();
+}
+
+nir_opt_combined_test::~nir_opt_combined_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+void
+nir_opt_combined_test::create_shader()
+{
+   static const nir_shader_compiler_options options = { };
+   bld = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, &options,
+                                        "combined test");
+
+   in_var = nir_variable_create(bld.shader, nir_var_shader_in,
+                                glsl_vec4_type(), "in");
+   for (unsigned i = 0; i < ARRAY_SIZE(out_var); i++) {
+      out_var[i] = nir_variable_create(bld.shader, nir_var_shader_out,
+                                       glsl_vec4_type(), "out");
+   }
+}
+
+void
+nir_opt_combined_test::reset_shader()
+{
+   ralloc_free(bld.shader);
+   create_shader();
+}
+
+void
+nir_opt_combined_test::build_random_shader(unsigned seed, unsigned size)
+{
+   nir_random_shader random(&bld, seed);
+   random.build_control_flow(in_var, out_var, ARRAY_SIZE(out_var), size);
+}
+
+static unsigned
+run_loop(nir_shader *shader)
+{
+   unsigned iterations = 0;
+   bool progress;
+
+   do {
+      progress = false;
+      NIR_PASS(progress, shader, nir_copy_prop);
+      NIR_PASS(progress, shader, nir_opt_dce);
+      NIR_PASS(progress, shader, nir_opt_constant_folding);
+      iterations++;
+   } while (progress);
+
+   return iterations;
+}
+
+/* The part of gl_nir_opts() and brw_nir_optimize() where the pass could
+ * replace the nir_copy_prop + nir_opt_dce pairs.  nir_opt_cse is left out, it would share the output derefs between blocks
+ * and nir_opt_dead_cf can't repair those when it removes a loop exit.
+ */
+static void
+run_driver_loop(nir_shader *shader, bool combined)
+{
+   bool progress;
+
+   do {
+      progress = false;
+      if (combined) {
+         NIR_PASS(progress, shader, nir_opt_combined);
+      } else {
+         NIR_PASS(progress, shader, nir_copy_prop);
+         NIR_PASS(progress, shader, nir_opt_dce);
+      }
+      NIR_PASS(progress, shader, nir_opt_remove_phis);
+      NIR_PASS(progress, shader, nir_opt_dce);
+      NIR_PASS(progress, shader, nir_opt_if, nir_opt_if_optimize_phi_true_false);
+      NIR_PASS(progress, shader, nir_opt_dead_cf);
+      NIR_PASS(progress, shader, nir_opt_peephole_select, 8, true, true);
+      NIR_PASS(progress, shader, nir_opt_algebraic);
+      NIR_PASS(progress, shader, nir_opt_constant_folding);
+   } while (progress);
+}
+
+static unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(func, shader) {
+      if (!func->impl)
+         continue;
+
+      nir_foreach_block(block, func->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+} /* namespace */
+
+TEST_F(nir_opt_combined_test, fold_through_copies)
+{
+   static const unsigned swizzle[] = { 3, 2 };
+   nir_ssa_def *a = nir_imm_vec4(&bld, 1.0, 2.0, 3.0, 4.0);
+   nir_ssa_def *b = nir_mov(&bld, nir_swizzle(&bld, a, swizzle, 2));
+   nir_ssa_def *c = nir_vec2(&bld, nir_channel(&bld, b, 1),
+                                   nir_channel(&bld, b, 0));
+   nir_ssa_def *d = nir_fadd(&bld, nir_channel(&bld, c, 0),
+                                   nir_channel(&bld, c, 1));
+   nir_store_var(&bld, out_var[0], nir_vec4(&bld, d, d, d, d), 0xf);
+
+   ASSERT_TRUE(nir_opt_combined(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   /* Only the deref, the stored constant and the store are left */
+   nir_block *block = nir_start_block(bld.impl);
+   unsigned num_instrs = 0;
+   nir_foreach_instr(instr, block) {
+      if (instr->type == nir_instr_type_intrinsic) {
+         nir_intrinsic_instr *store = nir_instr_as_intrinsic(instr);
+         ASSERT_TRUE(nir_src_is_const(store->src[1]));
+         EXPECT_EQ(nir_src_comp_as_float(store->src[1], 0), 7.0);
+      }
+      num_instrs++;
+   }
+   EXPECT_EQ(num_instrs, 3);
+
+   EXPECT_FALSE(nir_opt_combined(bld.shader));
+}
+
+TEST_F(nir_opt_combined_test, matches_loop)
+{
+   for (unsigned seed = 0; seed < 200; seed++) {
+      if (seed)
+         reset_shader();
+
+      build_random_shader(seed, 40);
+
+      nir_shader *clone = nir_shader_clone(NULL, bld.shader);
+      run_loop(clone);
+      nir_opt_combined(bld.shader);
+      nir_validate_shader(bld.shader, "after nir_opt_combined");
+
+      /* The loop has nothing left to do. The results aren't always
+       * identical, nir_copy_prop() only creates a vecN for a mov of a vecN
+       * if it visits them in the right order.
+       */
+      EXPECT_EQ(run_loop(bld.shader), 1) << "seed " << seed;
+      EXPECT_LE(count_instrs(bld.shader), count_instrs(clone))
+         << "seed " << seed;
+
+      ralloc_free(clone);
+   }
+}
+
+TEST_F(nir_opt_combined_test, driver_loop)
+{
+   unsigned old_instrs = 0, new_instrs = 0;
+
+   for (unsigned seed = 0; seed < 100; seed++) {
+      if (seed)
+         reset_shader();
+
+      build_random_shader(seed, 40);
+
+      nir_shader *clone = nir_shader_clone(NULL, bld.shader);
+      run_driver_loop(clone, false);
+      run_driver_loop(bld.shader, true);
+      nir_validate_shader(bld.shader, "after the driver loop");
+
+      old_instrs += count_instrs(clone);
+      new_instrs += count_instrs(bld.shader);
+
+      ralloc_free(clone);
+   }
+
+   /* The other passes see the shader in a different state, so single
+    * shaders can end up slightly larger, but not the whole set.
+    */
+   EXPECT_LE(new_instrs, old_instrs);
+}
+
+/* Only run with NIR_TEST_BENCHMARK=true, the timings aren't checked */
+TEST_F(nir_opt_combined_test, compile_time)
+{
+   if (!debug_get_bool_option("NIR_TEST_BENCHMARK", false))
+      GTEST_SKIP() << "NIR_TEST_BENCHMARK not set.";
+
+   build_random_shader(1, 20000);
+
+   nir_shader *clone = nir_shader_clone(NULL, bld.shader);
+
+   int64_t start = os_time_get_nano();
+   unsigned iterations = run_loop(clone);
+   int64_t loop_time = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   nir_opt_combined(bld.shader);
+   int64_t combined_time = os_time_get_nano() - start;
+
+   printf("copy_prop/dce/constant_folding loop: %.1f ms (%u iterations), "
+          "nir_opt_combined: %.1f ms\n", loop_time / 1000000.0, iterations,
+          combined_time / 1000000.0);
+
+   EXPECT_LE(count_instrs(bld.shader), count_instrs(clone));
+
+   ralloc_free(clone);
+}
@@ -0,0 +1,249 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <gtest/gtest.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+
+namespace {
+
+class nir_opt_cse_test : public ::testing::Test {
+protected:
+   nir_opt_cse_test();
+   ~nir_opt_cse_test();
+
+   nir_ssa_def *load_input(unsigned i);
+   void store_output(unsigned i, nir_ssa_def *def);
+   nir_ssa_def *stored_value(unsigned i);
+   unsigned count_alu(nir_op op);
+
+   nir_builder bld;
+   nir_variable *in_var[4];
+   nir_variable *out_var[4];
+   nir_intrinsic_instr *stores[4];
+};
+
+nir_opt_cse_test::nir_opt_cse_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   bld = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, &options,
+                                        "cse test");
+
+   for (unsigned i = 0; i < ARRAY_SIZE(in_var); i++) {
+      in_var[i] = nir_variable_create(bld.shader, nir_var_mem_ssbo,
+                                      glsl_uvec4_type(), "in");
+      out_var[i] = nir_variable_create(bld.shader, nir_var_mem_ssbo,
+                                       glsl_uvec4_type(), "out");
+   }
+   memset(stores, 0, sizeof(stores));
+}
+
+nir_opt_cse_test::~nir_opt_cse_test()
+{
+   if (HasFailure()) {
+      printf("\nShader from the failed test:\n\n");
+      nir_print_shader(bld.shader, stdout);
+   }
+
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+nir_ssa_def *
+nir_opt_cse_test::load_input(unsigned i)
+{
+   return nir_load_var(&bld, in_var[i]);
+}
+
+void
+nir_opt_cse_test::store_output(unsigned i, nir_ssa_def *def)
+{
+   nir_store_var(&bld, out_var[i], def, BITFIELD_MASK(def->num_components));
+   stores[i] = nir_instr_as_intrinsic(nir_builder_last_instr(&bld));
+}
+
+nir_ssa_def *
+nir_opt_cse_test::stored_value(unsigned i)
+{
+   return stores[i]->src[1].ssa;
+}
+
+unsigned
+nir_opt_cse_test::count_alu(nir_op op)
+{
+   unsigned count = 0;
+
+   nir_foreach_block(block, bld.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_alu &&
+             nir_instr_as_alu(instr)->op == op)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+} /* namespace */
+
+TEST_F(nir_opt_cse_test, commutative)
+{
+   nir_ssa_def *a = load_input(0);
+   nir_ssa_def *b = load_input(1);
+
+   store_output(0, nir_imul(&bld, a, b));
+   store_output(1, nir_imul(&bld, b, a));
+
+   ASSERT_TRUE(nir_opt_cse(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(stored_value(0), stored_value(1));
+}
+
+TEST_F(nir_opt_cse_test, reassociate)
+{
+   nir_ssa_def *a = load_input(0);
+   nir_ssa_def *b = load_input(1);
+   nir_ssa_def *c = load_input(2);
+   nir_ssa_def *d = load_input(3);
+
+   /* ((a + b) + c) + d and (d + c) + (b + a) */
+   store_output(0, nir_iadd(&bld, nir_iadd(&bld, nir_iadd(&bld, a, b), c),
+                            d));
+   store_output(1, nir_iadd(&bld, nir_iadd(&bld, d, c),
+                            nir_iadd(&bld, b, a)));
+
+   /* Different swizzles of the same values aren't the same */
+   static const unsigned yxzw[] = { 1, 0, 2, 3 };
+   nir_ssa_def *b_yxzw = nir_swizzle(&bld, b, yxzw, 4);
+   store_output(2, nir_iand(&bld, nir_iand(&bld, a, b_yxzw), c));
+   store_output(3, nir_iand(&bld, a, nir_iand(&bld, b, c)));
+
+   ASSERT_TRUE(nir_opt_cse(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(stored_value(0), stored_value(1));
+   EXPECT_NE(stored_value(2), stored_value(3));
+}
+
+TEST_F(nir_opt_cse_test, reassociate_swizzles)
+{
+   static const unsigned xxxx[] = { 0, 0, 0, 0 };
+   static const unsigned wzyx[] = { 3, 2, 1, 0 };
+   nir_ssa_def *a = load_input(0);
+   nir_ssa_def *b = load_input(1);
+   nir_ssa_def *c = load_input(2);
+
+   /* min(min(a, b.wzyx), c.xxxx) and min(c.xxxx, min(b, a.wzyx).wzyx) */
+   nir_ssa_def *c_xxxx = nir_swizzle(&bld, c, xxxx, 4);
+   nir_ssa_def *x = nir_umin(&bld, nir_umin(&bld, a,
+                                            nir_swizzle(&bld, b, wzyx, 4)),
+                             c_xxxx);
+   nir_ssa_def *t = nir_umin(&bld, b, nir_swizzle(&bld, a, wzyx, 4));
+   nir_ssa_def *y = nir_umin(&bld, c_xxxx, nir_swizzle(&bld, t, wzyx, 4));
+   store_output(0, x);
+   store_output(1, y);
+
+   nir_copy_prop(bld.shader);
+   ASSERT_TRUE(nir_opt_cse(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(stored_value(0), stored_value(1));
+}
+
+TEST_F(nir_opt_cse_test, no_wrap_not_reassociated)
+{
+   nir_ssa_def *a = load_input(0);
+   nir_ssa_def *b = load_input(1);
+   nir_ssa_def *c = load_input(2);
+
+   store_output(0, nir_iadd(&bld, nir_iadd(&bld, a, b), c));
+   nir_ssa_def *inner = nir_iadd(&bld, b, c);
+   nir_instr_as_alu(inner->parent_instr)->no_signed_wrap = true;
+   store_output(1, nir_iadd(&bld, a, inner));
+
+   nir_opt_cse(bld.shader);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_NE(stored_value(0), stored_value(1));
+}
+
+TEST_F(nir_opt_cse_test, hoist_out_of_if)
+{
+   nir_ssa_def *a = load_input(0);
+   nir_ssa_def *b = load_input(1);
+   nir_ssa_def *c = load_input(2);
+
+   nir_ssa_def *cond = nir_ieq_imm(&bld, nir_channel(&bld, a, 0), 0);
+   nir_if *nif = nir_push_if(&bld, cond);
+   store_output(0, nir_imul(&bld, nir_iadd(&bld, a, b), c));
+   nir_push_else(&bld, nif);
+   store_output(1, nir_imul(&bld, nir_iadd(&bld, b, a), c));
+   nir_pop_if(&bld, nif);
+
+   store_output(2, nir_iadd(&bld, a, b));
+
+   ASSERT_TRUE(nir_opt_cse(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(count_alu(nir_op_iadd), 1);
+   EXPECT_EQ(count_alu(nir_op_imul), 1);
+
+   nir_block *before_if =
+      nir_cf_node_as_block(nir_cf_node_prev(&nif->cf_node));
+   EXPECT_EQ(stored_value(0), stored_value(1));
+   EXPECT_EQ(stored_value(0)->parent_instr->block, before_if);
+   EXPECT_EQ(stored_value(2)->parent_instr->block, before_if);
+}
+
+TEST_F(nir_opt_cse_test, no_hoist_of_branch_values)
+{
+   nir_ssa_def *a = load_input(0);
+
+   /* The loads aren't moved out of the branches, so the adds can't be */
+   nir_if *nif = nir_push_if(&bld, nir_ieq_imm(&bld, nir_channel(&bld, a, 0),
+                                               0));
+   store_output(0, nir_iadd(&bld, a, load_input(1)));
+   nir_push_else(&bld, nif);
+   store_output(1, nir_iadd(&bld, a, load_input(1)));
+   nir_pop_if(&bld, nif);
+
+   /* Nor is anything in a nested if */
+   nif = nir_push_if(&bld, nir_ieq_imm(&bld, nir_channel(&bld, a, 1), 0));
+   store_output(2, nir_ishl(&bld, a, a));
+   nir_push_else(&bld, nif);
+   nir_if *inner = nir_push_if(&bld, nir_ieq_imm(&bld, nir_channel(&bld, a, 2),
+                                                 0));
+   store_output(3, nir_ishl(&bld, a, a));
+   nir_pop_if(&bld, inner);
+   nir_pop_if(&bld, nif);
+
+   nir_opt_cse(bld.shader);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(count_alu(nir_op_iadd), 2);
+   EXPECT_EQ(count_alu(nir_op_ishl), 2);
+}
+
+TEST_F(nir_opt_cse_test, reorderable_loads)
+{
+   nir_ssa_def *addr = nir_u2u64(&bld, nir_channel(&bld, load_input(0), 0));
+
+   for (unsigned i = 0; i < 4; i++) {
+      nir_ssa_def *load = nir_load_global(&bld, addr, 16, 4, 32);
+      if (i < 2) {
+         nir_intrinsic_set_access(nir_instr_as_intrinsic(load->parent_instr),
+                                  ACCESS_CAN_REORDER);
+      }
+      store_output(i, load);
+   }
+
+   ASSERT_TRUE(nir_opt_cse(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(stored_value(0), stored_value(1));
+   EXPECT_NE(stored_value(2), stored_value(3));
+}
@@ -0,0 +1,193 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include "random_shader.h"
+
+nir_random_shader::nir_random_shader(nir_builder *b, uint32_t seed)
+   : b(b), rand_state(seed), outs(NULL), num_outs(0)
+{
+}
+
+/* Pick a random value of the pool and swizzle it to the requested size */
+nir_ssa_def *
+nir_random_shader::random_value(unsigned num_components)
+{
+   nir_ssa_def *def = values[random(values.size())];
+   unsigned swizzle[NIR_MAX_VEC_COMPONENTS];
+
+   for (unsigned i = 0; i < num_components; i++)
+      swizzle[i] = random(def->num_components);
+
+   return nir_swizzle(b, def, swizzle, num_components);
+}
+
+nir_ssa_def *
+nir_random_shader::random_alu()
+{
+   static const unsigned sizes[] = { 1, 2, 4 };
+   unsigned num_components = sizes[random(ARRAY_SIZE(sizes))];
+
+   switch (random(8)) {
+   case 0:
+      return nir_imm_float(b, random(16));
+   case 1:
+      return nir_imm_vec4(b, random(4), random(4), random(4), random(4));
+   case 2:
+      return nir_fadd(b, random_value(num_components),
+                      random_value(num_components));
+   case 3:
+      return nir_fmul(b, random_value(num_components),
+                      random_value(num_components));
+   case 4:
+      return nir_iadd(b, random_value(num_components),
+                      random_value(num_components));
+   case 5:
+      return nir_mov(b, random_value(num_components));
+   case 6: {
+      nir_ssa_def *comps[NIR_MAX_VEC_COMPONENTS];
+      for (unsigned i = 0; i < num_components; i++)
+         comps[i] = random_value(1);
+      return nir_vec(b, comps, num_components);
+   }
+   default:
+      return random_value(num_components);
+   }
+}
+
+void
+nir_random_shader::random_instrs(unsigned count, unsigned depth)
+{
+   for (unsigned i = 0; i < count; i++) {
+      unsigned kind = random(depth < 2 ? 24 : 20);
+
+      if (kind < 18) {
+         values.push_back(random_alu());
+      } else if (kind < 20) {
+         nir_store_var(b, outs[random(num_outs)], random_value(4), 0xf);
+      } else if (kind < 22) {
+         /* Values defined inside the branches are only visible through the
+          * phi after the if.
+          */
+         size_t num_values = values.size();
+         nir_ssa_def *cond = nir_flt(b, random_value(1), random_value(1));
+
+         nir_if *nif = nir_push_if(b, cond);
+         random_instrs(4, depth + 1);
+         nir_ssa_def *then_def = random_value(4);
+         values.resize(num_values);
+
+         nir_push_else(b, nif);
+         random_instrs(4, depth + 1);
+         nir_ssa_def *else_def = random_value(4);
+         values.resize(num_values);
+
+         nir_pop_if(b, nif);
+         values.push_back(nir_if_phi(b, then_def, else_def));
+      } else {
+         size_t num_values = values.size();
+
+         nir_loop *loop = nir_push_loop(b);
+         random_instrs(4, depth + 1);
+
+         nir_ssa_def *cond = nir_flt(b, random_value(1), random_value(1));
+         nir_if *nif = nir_push_if(b, cond);
+         nir_jump(b, nir_jump_break);
+         nir_pop_if(b, nif);
+
+         random_instrs(2, depth + 1);
+         nir_pop_loop(b, loop);
+         values.resize(num_values);
+      }
+   }
+}
+
+void
+nir_random_shader::build_control_flow(nir_variable *in, nir_variable **outs,
+                                      unsigned num_outs, unsigned size)
+{
+   this->outs = outs;
+   this->num_outs = num_outs;
+
+   values.clear();
+   values.push_back(nir_load_var(b, in));
+   values.push_back(nir_imm_vec4(b, 1.0, 2.0, 3.0, 4.0));
+
+   random_instrs(size, 0);
+
+   for (unsigned i = 0; i < num_outs; i++)
+      nir_store_var(b, outs[i], random_value(4), 0xf);
+
+   nir_validate_shader(b->shader, "after building the random shader");
+}
+
+/* One of the recent values, so that the expressions get deep */
+nir_ssa_def *
+nir_random_shader::pick_recent(const std::vector<nir_ssa_def *> &pool)
+{
+   return pool[pool.size() - 1 - random(MIN2(pool.size(), 64))];
+}
+
+void
+nir_random_shader::build_arithmetic(unsigned size)
+{
+   static const float float_consts[] = { 0.0, 1.0, 2.0, -1.0, 0.5, 4.0 };
+   static const int int_consts[] = { 0, 1, 2, -1, 4, 8, 31, 0xff };
+   std::vector<nir_ssa_def *> f, i, bools;
+
+   nir_ssa_def *in = nir_load_push_constant(b, 4, 32, nir_imm_int(b, 0));
+   nir_intrinsic_set_range(nir_instr_as_intrinsic(in->parent_instr), 16);
+   for (unsigned c = 0; c < 4; c++) {
+      f.push_back(nir_channel(b, in, c));
+      i.push_back(nir_channel(b, in, c));
+   }
+   bools.push_back(nir_flt(b, f[0], f[1]));
+
+   for (unsigned n = 0; n < size; n++) {
+      nir_ssa_def *x = pick_recent(f), *y = pick_recent(f);
+      nir_ssa_def *u = pick_recent(i), *v = pick_recent(i);
+      nir_ssa_def *p = pick_recent(bools);
+
+      if (random(4) == 0)
+         y = nir_imm_float(b, float_consts[random(ARRAY_SIZE(float_consts))]);
+      if (random(4) == 0)
+         v = nir_imm_int(b, int_consts[random(ARRAY_SIZE(int_consts))]);
+
+      switch (random(22)) {
+      case 0:  f.push_back(nir_fadd(b, x, y)); break;
+      case 1:  f.push_back(nir_fmul(b, x, y)); break;
+      case 2:  f.push_back(nir_ffma(b, x, y, pick_recent(f))); break;
+      case 3:  f.push_back(nir_fneg(b, x)); break;
+      case 4:  f.push_back(nir_fabs(b, x)); break;
+      case 5:  f.push_back(nir_fsat(b, x)); break;
+      case 6:  f.push_back(nir_fmin(b, x, y)); break;
+      case 7:  f.push_back(nir_fmax(b, x, y)); break;
+      case 8:  f.push_back(nir_bcsel(b, p, x, y)); break;
+      case 9:  f.push_back(nir_b2f32(b, p)); break;
+      case 10: f.push_back(nir_i2f32(b, u)); break;
+      case 11: f.push_back(nir_frcp(b, x)); break;
+      case 12: bools.push_back(nir_flt(b, x, y)); break;
+      case 13: bools.push_back(nir_fge(b, x, y)); break;
+      case 14: bools.push_back(nir_iand(b, p, pick_recent(bools))); break;
+      case 15: bools.push_back(nir_inot(b, p)); break;
+      case 16: bools.push_back(nir_ilt(b, u, v)); break;
+      case 17: i.push_back(nir_iadd(b, u, v)); break;
+      case 18: i.push_back(nir_imul(b, u, v)); break;
+      case 19: i.push_back(nir_ishl(b, u, v)); break;
+      case 20: i.push_back(nir_iand(b, u, v)); break;
+      default: i.push_back(nir_f2i32(b, x)); break;
+      }
+
+      if (random(16) == 0) {
+         nir_store_global(b, nir_imm_int64(b, n * 4), 4,
+                          nir_fadd(b, f.back(), nir_i2f32(b, i.back())),
+                          0x1);
+      }
+   }
+
+   nir_store_global(b, nir_imm_int64(b, 0), 4, f.back(), 0x1);
+   nir_store_global(b, nir_imm_int64(b, 4), 4, i.back(), 0x1);
+   nir_store_global(b, nir_imm_int64(b, 8), 4, nir_b2i32(b, bools.back()),
+                    0x1);
+
+   nir_validate_shader(b->shader, "after building the random shader");
+}
@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef NIR_TESTS_RANDOM_SHADER_H
+#define NIR_TESTS_RANDOM_SHADER_H
+
+#include <vector>
+
+#include "nir.h"
+#include "nir_builder.h"
+
+/*
+ * Generates random but reproducible shader code with a nir_builder, for the
+ * tests that compare the results of optimization passes on shaders larger
+ * than the ones that are practical to write by hand.
+ */
+class nir_random_shader {
+public:
+   nir_random_shader(nir_builder *b, uint32_t seed);
+
+   /* A simple LCG, so that the shaders are the same on every platform */
+   unsigned random(unsigned max)
+   {
+      rand_state = rand_state * 1103515245 + 12345;
+      return (rand_state >> 16) % max;
+   }
+
+   /* Vector arithmetic, copies, ifs with phis and loops that read the vec4
+    * input and write the vec4 outputs.
+    */
+   void build_control_flow(nir_variable *in, nir_variable **outs,
+                           unsigned num_outs, unsigned size);
+
+   /* Long chains of scalar float, integer and boolean arithmetic, with the
+    * constants that the algebraic rules look for, reading push constants and
+    * writing the results with store_global.
+    */
+   void build_arithmetic(unsigned size);
+
+private:
+   nir_ssa_def *pick_recent(const std::vector<nir_ssa_def *> &pool);
+   nir_ssa_def *random_value(unsigned num_components);
+   nir_ssa_def *random_alu();
+   void random_instrs(unsigned count, unsigned depth);
+
+   nir_builder *b;
+   uint32_t rand_state;
+
+   std::vector<nir_ssa_def *> values;
+   nir_variable **outs;
+   unsigned num_outs;
+};
+
+#endif /* NIR_TESTS_RANDOM_SHADER_H */
@@ -100,6 +100,28 @@ nir_serialize_test::ASSERT_SWIZZLE_EQ(nir_alu_instr *a, nir_alu_instr *b, unsign
 
 class nir_serialize_all_test : public nir_serialize_test {};
 class nir_serialize_all_but_one_test : public nir_serialize_test {};
+class nir_serialize_format_test : public nir_serialize_test {};
+
+static bool
+shaders_equal(nir_shader *a, nir_shader *b)
+{
+   nir_foreach_function(func, a) {
+      if (func->impl)
+         nir_index_ssa_defs(func->impl);
+   }
+   nir_foreach_function(func, b) {
+      if (func->impl)
+         nir_index_ssa_defs(func->impl);
+   }
+
+   char *str_a = nir_shader_as_str(a, NULL);
+   char *str_b = nir_shader_as_str(b, NULL);
+   bool equal = strcmp(str_a, str_b) == 0;
+
+   ralloc_free(str_a);
+   ralloc_free(str_b);
+   return equal;
+}
 
 } // namespace
 
@@ -279,3 +301,128 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+TEST_F(nir_serialize_format_test, repeated_types_and_constants)
+{
+   const glsl_struct_field fields[] = {
+      glsl_struct_field(glsl_vec4_type(), "a"),
+      glsl_struct_field(glsl_array_type(glsl_float_type(), 4, 0), "b"),
+   };
+   const glsl_type *s_type = glsl_struct_type(fields, 2, "S", false);
+   const glsl_type *array_type = glsl_array_type(s_type, 4, 0);
+
+   /* Alternate the types so that they aren't the same as the last one. */
+   nir_variable *vars[8];
+   for (unsigned i = 0; i < ARRAY_SIZE(vars); i++) {
+      vars[i] = nir_variable_create(b->shader, nir_var_mem_ssbo,
+                                    i % 2 ? glsl_vec4_type() : array_type,
+                                    "v");
+      vars[i]->data.binding = i;
+   }
+
+   nir_variable *dvar = nir_variable_create(b->shader, nir_var_mem_ssbo,
+                                            glsl_double_type(), "d");
+
+   nir_ssa_def *sum = nir_imm_vec4(b, 1.5, 2.5, 3.5, 4.5);
+   nir_ssa_def *dsum = nir_imm_double(b, 0.0);
+   for (unsigned i = 0; i < ARRAY_SIZE(vars); i += 2) {
+      nir_deref_instr *deref = nir_build_deref_var(b, vars[i]);
+      deref = nir_build_deref_array_imm(b, deref, i / 2);
+      deref = nir_build_deref_struct(b, deref, 0);
+      nir_ssa_def *value = nir_load_deref(b, deref);
+
+      sum = nir_fadd(b, sum, nir_fmul(b, value,
+                                      nir_imm_vec4(b, 1.5, 2.5, 3.5, 4.5)));
+      dsum = nir_fadd(b, dsum, nir_imm_double(b, 0.1));
+   }
+   nir_store_deref(b, nir_build_deref_var(b, vars[1]), sum, 0xf);
+   nir_store_var(b, dvar, dsum, 0x1);
+
+   serialize();
+
+   EXPECT_TRUE(shaders_equal(b->shader, dup));
+}
+
+TEST_F(nir_serialize_format_test, compressed)
+{
+   nir_variable *out = nir_variable_create(b->shader, nir_var_mem_ssbo,
+                                           glsl_vec4_type(), "out");
+
+   nir_ssa_def *sum = nir_imm_vec4(b, 0.0, 1.0, 2.0, 3.0);
+   for (unsigned i = 0; i < 200; i++)
+      sum = nir_ffma(b, sum, sum, nir_imm_vec4(b, i % 8, 1.0, 2.0, 3.0));
+   nir_store_var(b, out, sum, 0xf);
+
+   struct blob blob, compressed;
+   blob_init(&blob);
+   blob_init(&compressed);
+
+   nir_serialize(&blob, b->shader, false);
+   nir_serialize_compressed(&compressed, b->shader, false);
+
+#ifdef HAVE_COMPRESSION
+   EXPECT_LT(compressed.size, blob.size);
+#endif
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, compressed.data, compressed.size);
+   dup = nir_deserialize(b->shader, &options, &reader);
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.current, reader.end);
+
+   EXPECT_TRUE(shaders_equal(b->shader, dup));
+
+   blob_finish(&compressed);
+   blob_finish(&blob);
+}
+
+TEST_F(nir_serialize_format_test, reachable_functions)
+{
+   nir_function *used = nir_function_create(b->shader, "used");
+   nir_function *used_by_used = nir_function_create(b->shader, "used_by_used");
+   nir_function *unused = nir_function_create(b->shader, "unused");
+
+   nir_function *funcs[] = { used, used_by_used, unused };
+   for (unsigned i = 0; i < ARRAY_SIZE(funcs); i++) {
+      nir_function_impl *impl = nir_function_impl_create(funcs[i]);
+      nir_builder fb;
+      nir_builder_init(&fb, impl);
+      fb.cursor = nir_after_cf_list(&impl->body);
+
+      if (funcs[i] == used) {
+         nir_builder_instr_insert(&fb, &nir_call_instr_create(b->shader,
+                                                              used_by_used)->instr);
+      }
+      nir_fadd(&fb, nir_imm_float(&fb, i), nir_imm_float(&fb, 1.0));
+   }
+
+   nir_builder_instr_insert(b, &nir_call_instr_create(b->shader, used)->instr);
+   nir_validate_shader(b->shader, "before serialize");
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b->shader, false);
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, blob.data, blob.size);
+   dup = nir_deserialize_reachable(b->shader, &options, &reader);
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.current, reader.end);
+
+   unsigned num_funcs = 0;
+   nir_foreach_function(func, dup) {
+      if (strcmp(func->name, "unused") == 0)
+         EXPECT_EQ(func->impl, nullptr);
+      else
+         EXPECT_NE(func->impl, nullptr) << func->name;
+      num_funcs++;
+   }
+   EXPECT_EQ(num_funcs, 4);
+
+   /* Everything is read by nir_deserialize() */
+   blob_reader_init(&reader, blob.data, blob.size);
+   nir_shader *all = nir_deserialize(b->shader, &options, &reader);
+   EXPECT_TRUE(shaders_equal(b->shader, all));
+
+   blob_finish(&blob);
+}
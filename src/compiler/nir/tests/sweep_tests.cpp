@@ -0,0 +1,179 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <gtest/gtest.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+
+namespace {
+
+class nir_sweep_test : public ::testing::Test {
+protected:
+   nir_sweep_test();
+   ~nir_sweep_test();
+
+   void build_fragmented_shader(unsigned num_loops);
+   double slab_usage();
+
+   nir_builder bld;
+};
+
+nir_sweep_test::nir_sweep_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   bld = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, &options,
+                                        "sweep test");
+}
+
+nir_sweep_test::~nir_sweep_test()
+{
+   if (HasFailure()) {
+      printf("\nShader from the failed test:\n\n");
+      nir_print_shader(bld.shader, stdout);
+   }
+
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+/* Builds a chain of loops with phis and texture instructions, and lots of
+ * dead instructions in between, which leave holes in the slabs once swept.
+ */
+void
+nir_sweep_test::build_fragmented_shader(unsigned num_loops)
+{
+   nir_variable *out = nir_variable_create(bld.shader, nir_var_shader_out,
+                                           glsl_vec4_type(), "out");
+   nir_variable *v = nir_local_variable_create(bld.impl, glsl_vec4_type(),
+                                               "v");
+
+   nir_store_var(&bld, v, nir_imm_vec4(&bld, 0.0, 1.0, 2.0, 3.0), 0xf);
+
+   for (unsigned i = 0; i < num_loops; i++) {
+      nir_loop *loop = nir_push_loop(&bld);
+
+      nir_ssa_def *x = nir_load_var(&bld, v);
+
+      for (unsigned j = 0; j < 8; j++)
+         nir_fmul(&bld, x, nir_imm_float(&bld, j));
+
+      nir_tex_instr *tex = nir_tex_instr_create(bld.shader, 1);
+      tex->op = nir_texop_tex;
+      tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+      tex->coord_components = 2;
+      tex->dest_type = nir_type_float32;
+      tex->src[0].src_type = nir_tex_src_coord;
+      tex->src[0].src = nir_src_for_ssa(nir_channels(&bld, x, 0x3));
+      nir_ssa_dest_init(&tex->instr, &tex->dest, 4, 32, NULL);
+      nir_builder_instr_insert(&bld, &tex->instr);
+
+      nir_if *nif = nir_push_if(&bld, nir_flt(&bld, nir_channel(&bld, x, 0),
+                                              nir_channel(&bld, &tex->dest.ssa, 1)));
+      nir_jump(&bld, nir_jump_break);
+      nir_pop_if(&bld, nif);
+
+      nir_store_var(&bld, v, nir_fadd(&bld, x, &tex->dest.ssa), 0xf);
+      nir_pop_loop(&bld, loop);
+   }
+
+   nir_store_var(&bld, out, nir_load_var(&bld, v), 0xf);
+
+   nir_lower_vars_to_ssa(bld.shader);
+
+   bool progress;
+   do {
+      progress = false;
+      progress |= nir_copy_prop(bld.shader);
+      progress |= nir_opt_dce(bld.shader);
+   } while (progress);
+
+   nir_validate_shader(bld.shader, "after building the shader");
+}
+
+double
+nir_sweep_test::slab_usage()
+{
+   size_t total, used;
+
+   gc_get_slab_usage(bld.shader->gctx, &total, &used);
+   return (double)used / total;
+}
+
+} /* namespace */
+
+TEST_F(nir_sweep_test, compact)
+{
+   build_fragmented_shader(1000);
+
+   nir_index_ssa_defs(bld.impl);
+   char *before = nir_shader_as_str(bld.shader, NULL);
+
+   size_t total_before, used_before;
+   gc_get_slab_usage(bld.shader->gctx, &total_before, &used_before);
+
+   EXPECT_TRUE(nir_compact(bld.shader));
+   nir_validate_shader(bld.shader, "after nir_compact");
+
+   size_t total_after, used_after;
+   gc_get_slab_usage(bld.shader->gctx, &total_after, &used_after);
+
+   EXPECT_LT(total_after, total_before);
+   EXPECT_GE(slab_usage(), 0.75);
+
+   nir_index_ssa_defs(bld.impl);
+   char *after = nir_shader_as_str(bld.shader, NULL);
+   EXPECT_TRUE(strcmp(before, after) == 0);
+
+   /* The relocated shader can still be changed and cloned */
+   nir_opt_dce(bld.shader);
+   nir_shader *clone = nir_shader_clone(NULL, bld.shader);
+   nir_validate_shader(clone, "after cloning");
+
+   ralloc_free(clone);
+   ralloc_free(after);
+   ralloc_free(before);
+}
+
+TEST_F(nir_sweep_test, compact_registers)
+{
+   build_fragmented_shader(1000);
+
+   /* Lots of garbage from going out of SSA. Only the phi webs are turned
+    * into registers, the derefs of the stores must stay SSA values.
+    */
+   nir_convert_from_ssa(bld.shader, true);
+   nir_validate_shader(bld.shader, "after nir_convert_from_ssa");
+
+   nir_index_ssa_defs(bld.impl);
+   char *before = nir_shader_as_str(bld.shader, NULL);
+
+   EXPECT_TRUE(nir_compact(bld.shader));
+   nir_validate_shader(bld.shader, "after nir_compact");
+   EXPECT_GE(slab_usage(), 0.75);
+
+   nir_index_ssa_defs(bld.impl);
+   char *after = nir_shader_as_str(bld.shader, NULL);
+   EXPECT_TRUE(strcmp(before, after) == 0);
+
+   ralloc_free(after);
+   ralloc_free(before);
+}
+
+TEST_F(nir_sweep_test, sweep_keeps_instructions)
+{
+   build_fragmented_shader(1000);
+
+   /* Callers of nir_sweep() may hold on to instructions across it */
+   nir_instr *first = nir_block_first_instr(nir_start_block(bld.impl));
+   nir_instr *last = nir_block_last_instr(nir_impl_last_block(bld.impl));
+
+   nir_sweep(bld.shader);
+   nir_validate_shader(bld.shader, "after nir_sweep");
+
+   EXPECT_EQ(nir_block_first_instr(nir_start_block(bld.impl)), first);
+   EXPECT_EQ(nir_block_last_instr(nir_impl_last_block(bld.impl)), last);
+   EXPECT_LT(slab_usage(), 0.75);
+}
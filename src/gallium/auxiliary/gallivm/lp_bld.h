@@ -94,6 +94,14 @@
 
 #define GALLIVM_COROUTINES (GALLIVM_HAVE_CORO || GALLIVM_USE_NEW_PASS)
 
+/* Use ORC LLJIT instead of MCJIT (-Dllvm-orcjit=true).  The parts of the
+ * ORC API we rely on only settled in LLVM 14.
+ */
+#if !defined(GALLIVM_USE_ORCJIT) || LLVM_VERSION_MAJOR < 14
+#undef GALLIVM_USE_ORCJIT
+#define GALLIVM_USE_ORCJIT 0
+#endif
+
 /* LLVM is transitioning to "opaque pointers", and as such deprecates
  * LLVMBuildGEP, LLVMBuildCall, LLVMBuildLoad, replacing them with
  * LLVMBuildGEP2, LLVMBuildCall2, LLVMBuildLoad2 respectivelly.
@@ -150,7 +150,7 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMAddCoroElidePass(gallivm->cgpassmgr);
 #endif
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   if (!gallivm->no_opt) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -213,12 +213,19 @@ gallivm_free_ir(struct gallivm_state *gallivm)
 #endif
 #endif
 
+#if GALLIVM_USE_ORCJIT
+   /* The JITDylib only holds objects, the module is still ours. */
+   if (gallivm->module) {
+      LLVMDisposeModule(gallivm->module);
+   }
+#else
    if (gallivm->engine) {
       /* This will already destroy any associated module */
       LLVMDisposeExecutionEngine(gallivm->engine);
    } else if (gallivm->module) {
       LLVMDisposeModule(gallivm->module);
    }
+#endif
 
    if (gallivm->cache) {
       lp_free_objcache(gallivm->cache->jit_obj_cache);
@@ -235,7 +242,9 @@ gallivm_free_ir(struct gallivm_state *gallivm)
 
    /* The LLVMContext should be owned by the parent of gallivm. */
 
+#if !GALLIVM_USE_ORCJIT
    gallivm->engine = NULL;
+#endif
    gallivm->target = NULL;
    gallivm->module = NULL;
    gallivm->module_name = NULL;
@@ -258,14 +267,43 @@ static void
 gallivm_free_code(struct gallivm_state *gallivm)
 {
    assert(!gallivm->module);
+#if GALLIVM_USE_ORCJIT
+   if (gallivm->dylib) {
+      lp_orc_destroy_dylib(gallivm->dylib);
+      gallivm->dylib = NULL;
+   }
+#else
    assert(!gallivm->engine);
    lp_free_generated_code(gallivm->code);
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
    gallivm->memorymgr = NULL;
+#endif
 }
 
 
+#if GALLIVM_USE_ORCJIT
+/**
+ * Compile the (optimized) module to an object and add it to our JITDylib.
+ * Codegen happens right here on the calling thread; symbols are resolved
+ * and the object linked on the first gallivm_jit_function() lookup.
+ */
+static boolean
+init_gallivm_engine(struct gallivm_state *gallivm)
+{
+   enum LLVM_CodeGenOpt_Level optlevel = gallivm->no_opt ? None : Default;
+   char *error = NULL;
+
+   if (lp_orc_add_module(gallivm->dylib, gallivm->cache, gallivm->module,
+                         (unsigned) optlevel, &error)) {
+      _debug_printf("%s\n", error);
+      free(error);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+#else
 static boolean
 init_gallivm_engine(struct gallivm_state *gallivm)
 {
@@ -274,7 +312,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if (gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -321,6 +359,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
 fail:
    return FALSE;
 }
+#endif
 
 
 /**
@@ -329,7 +368,8 @@ fail:
  */
 static boolean
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   LLVMContextRef context, struct lp_cached_code *cache)
+                   LLVMContextRef context, struct lp_cached_code *cache,
+                   boolean no_opt)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -339,6 +379,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
 
    gallivm->context = context;
    gallivm->cache = cache;
+   gallivm->no_opt = no_opt || (gallivm_perf & GALLIVM_PERF_NO_OPT);
    if (!gallivm->context)
       goto fail;
 
@@ -364,9 +405,15 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    if (!gallivm->builder)
       goto fail;
 
+#if GALLIVM_USE_ORCJIT
+   gallivm->dylib = lp_orc_create_dylib(name);
+   if (!gallivm->dylib)
+      goto fail;
+#else
    gallivm->memorymgr = lp_get_default_memory_manager();
    if (!gallivm->memorymgr)
       goto fail;
+#endif
 
    /* FIXME: MC-JIT only allows compiling one module at a time, and it must be
     * complete when MC-JIT is created. So defer the MC-JIT engine creation for
@@ -432,7 +479,9 @@ lp_build_init(void)
     * component is linked at buildtime, which is sufficient for its static
     * constructors to be called at load time.
     */
+#if !GALLIVM_USE_ORCJIT
    LLVMLinkInMCJIT();
+#endif
 
    gallivm_debug = debug_get_option_gallivm_debug();
 
@@ -486,7 +535,31 @@ gallivm_create(const char *name, LLVMContextRef context,
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context, cache)) {
+      if (!init_gallivm_state(gallivm, name, context, cache, FALSE)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   assert(gallivm != NULL);
+   return gallivm;
+}
+
+
+/**
+ * Like gallivm_create(), but for code which is only needed until a
+ * properly optimized version is available: the module gets no IR
+ * optimization and the fastest code generation, as with GALLIVM_PERF=nopt.
+ */
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context,
+                           struct lp_cached_code *cache)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      if (!init_gallivm_state(gallivm, name, context, cache, TRUE)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -542,6 +615,34 @@ void lp_init_clock_hook(struct gallivm_state *gallivm)
    gallivm->get_time_hook = LLVMAddFunction(gallivm->module, "get_time_hook", get_time_type);
 }
 
+static void *
+gallivm_get_pointer(struct gallivm_state *gallivm, LLVMValueRef global)
+{
+#if GALLIVM_USE_ORCJIT
+   return lp_orc_lookup(gallivm->dylib, LLVMGetValueName(global));
+#else
+   assert(gallivm->engine);
+   return LLVMGetPointerToGlobal(gallivm->engine, global);
+#endif
+}
+
+
+/**
+ * Make the external symbol \p sym resolve to \p addr in the generated code.
+ */
+void
+gallivm_add_global_mapping(struct gallivm_state *gallivm,
+                           LLVMValueRef sym, void *addr)
+{
+#if GALLIVM_USE_ORCJIT
+   lp_orc_add_global_mapping(gallivm->dylib, LLVMGetValueName(sym), addr);
+#else
+   assert(gallivm->engine);
+   LLVMAddGlobalMapping(gallivm->engine, sym, addr);
+#endif
+}
+
+
 /**
  * Compile a module.
  * This does IR optimization on all functions in the module.
@@ -558,12 +659,17 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+#if GALLIVM_USE_ORCJIT
+   /* The passes need the real data layout; codegen happens after them. */
+   lp_orc_set_module_target(gallivm->module);
+#else
    LLVMSetDataLayout(gallivm->module, "");
    assert(!gallivm->engine);
    if (!init_gallivm_engine(gallivm)) {
       assert(0);
    }
    assert(gallivm->engine);
+#endif
 
    if (gallivm->cache && gallivm->cache->data_size) {
       goto skip_cached;
@@ -577,10 +683,10 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       LLVMWriteBitcodeToFile(gallivm->module, filename);
       debug_printf("%s written\n", filename);
       debug_printf("Invoke as \"opt %s %s | llc -O%d %s%s\"\n",
-                   gallivm_perf & GALLIVM_PERF_NO_OPT ? "-mem2reg" :
+                   gallivm->no_opt ? "-mem2reg" :
                    "-sroa -early-cse -simplifycfg -reassociate "
                    "-mem2reg -constprop -instcombine -gvn",
-                   filename, gallivm_perf & GALLIVM_PERF_NO_OPT ? 0 : 2,
+                   filename, gallivm->no_opt ? 0 : 2,
                    "[-mcpu=<-mcpu option>] ",
                    "[-mattr=<-mattr option(s)>]");
    }
@@ -598,16 +704,27 @@ gallivm_compile_module(struct gallivm_state *gallivm)
     */
    strcpy(passes, "default<O0>");
 
+#if GALLIVM_USE_ORCJIT
+   /* TargetMachines can't be shared between compiling threads */
+   LLVMTargetMachineRef tm = lp_orc_create_target_machine();
+#else
+   LLVMTargetMachineRef tm = LLVMGetExecutionEngineTargetMachine(gallivm->engine);
+#endif
+
    LLVMPassBuilderOptionsRef opts = LLVMCreatePassBuilderOptions();
-   LLVMRunPasses(gallivm->module, passes, LLVMGetExecutionEngineTargetMachine(gallivm->engine), opts);
+   LLVMRunPasses(gallivm->module, passes, tm, opts);
 
-   if (!(gallivm_perf & GALLIVM_PERF_NO_OPT))
+   if (!gallivm->no_opt)
       strcpy(passes, "sroa,early-cse,simplifycfg,reassociate,mem2reg,instsimplify,instcombine");
    else
       strcpy(passes, "mem2reg");
 
-   LLVMRunPasses(gallivm->module, passes, LLVMGetExecutionEngineTargetMachine(gallivm->engine), opts);
+   LLVMRunPasses(gallivm->module, passes, tm, opts);
    LLVMDisposePassBuilderOptions(opts);
+#if GALLIVM_USE_ORCJIT
+   if (tm)
+      LLVMDisposeTargetMachine(tm);
+#endif
 #else
 #if GALLIVM_HAVE_CORO == 1
    LLVMRunPassManager(gallivm->cgpassmgr, gallivm->module);
@@ -660,13 +777,19 @@ gallivm_compile_module(struct gallivm_state *gallivm)
     */
  skip_cached:
 
+#if GALLIVM_USE_ORCJIT
+   if (!init_gallivm_engine(gallivm)) {
+      assert(0);
+   }
+#endif
+
    ++gallivm->compiled;
 
    lp_init_printf_hook(gallivm);
-   LLVMAddGlobalMapping(gallivm->engine, gallivm->debug_printf_hook, debug_printf);
+   gallivm_add_global_mapping(gallivm, gallivm->debug_printf_hook, debug_printf);
 
    lp_init_clock_hook(gallivm);
-   LLVMAddGlobalMapping(gallivm->engine, gallivm->get_time_hook, os_time_get_nano);
+   gallivm_add_global_mapping(gallivm, gallivm->get_time_hook, os_time_get_nano);
 
    lp_build_coro_add_malloc_hooks(gallivm);
 
@@ -680,7 +803,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
           * LLVMGetPointerToGlobal() will abort otherwise.
           */
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = gallivm_get_pointer(gallivm, llvm_func);
             lp_disassemble(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -693,7 +816,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
       while (llvm_func) {
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = gallivm_get_pointer(gallivm, llvm_func);
             lp_profile(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -713,12 +836,11 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    int64_t time_begin = 0;
 
    assert(gallivm->compiled);
-   assert(gallivm->engine);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   code = gallivm_get_pointer(gallivm, func);
    assert(code);
    jit_func = pointer_to_func(code);
 
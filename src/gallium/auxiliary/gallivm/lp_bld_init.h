@@ -44,7 +44,11 @@ struct gallivm_state
 {
    char *module_name;
    LLVMModuleRef module;
+#if GALLIVM_USE_ORCJIT
+   struct lp_orc_dylib *dylib;
+#else
    LLVMExecutionEngineRef engine;
+#endif
    LLVMTargetDataRef target;
 #if GALLIVM_USE_NEW_PASS == 0
    LLVMPassManagerRef passmgr;
@@ -54,10 +58,13 @@ struct gallivm_state
 #endif
    LLVMContextRef context;
    LLVMBuilderRef builder;
+#if !GALLIVM_USE_ORCJIT
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+#endif
    struct lp_cached_code *cache;
    unsigned compiled;
+   boolean no_opt;  /**< skip IR optimization, fastest codegen */
    LLVMValueRef coro_malloc_hook;
    LLVMValueRef coro_free_hook;
    LLVMValueRef debug_printf_hook;
@@ -77,6 +84,10 @@ struct gallivm_state *
 gallivm_create(const char *name, LLVMContextRef context,
                struct lp_cached_code *cache);
 
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context,
+                           struct lp_cached_code *cache);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -94,6 +105,10 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
 
+void
+gallivm_add_global_mapping(struct gallivm_state *gallivm,
+                           LLVMValueRef sym, void *addr);
+
 unsigned gallivm_get_perf_flags(void);
 
 void lp_init_clock_hook(struct gallivm_state *gallivm);
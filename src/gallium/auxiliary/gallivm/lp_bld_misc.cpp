@@ -41,6 +41,7 @@
 
 
 #include <stddef.h>
+#include <atomic>
 
 #include <llvm/Config/llvm-config.h>
 
@@ -85,6 +86,11 @@
 #if LLVM_USE_INTEL_JITEVENTS
 #include <llvm/ExecutionEngine/JITEventListener.h>
 #endif
+#if GALLIVM_USE_ORCJIT
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#endif
 
 #if LLVM_VERSION_MAJOR < 7
 // Workaround http://llvm.org/PR23628
@@ -99,6 +105,7 @@
 
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_init.h"
 
 namespace {
 
@@ -329,66 +336,14 @@ public:
 
 };
 
-/**
- * Same as LLVMCreateJITCompilerForModule, but:
- * - allows using MCJIT and enabling AVX feature where available.
- * - set target options
- *
- * See also:
- * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
- * - llvm/tools/lli/lli.cpp
- * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+/*
+ * Target features and CPU to generate code for.  Shared by the MCJIT and ORC
+ * paths so both produce the same code for the same host.
  */
-extern "C"
-LLVMBool
-lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
-                                        lp_generated_code **OutCode,
-                                        struct lp_cached_code *cache_out,
-                                        LLVMModuleRef M,
-                                        LLVMMCJITMemoryManagerRef CMM,
-                                        unsigned OptLevel,
-                                        char **OutError)
+static void
+lp_build_get_host_target(llvm::SmallVector<std::string, 16> &MAttrs,
+                         std::string &MCPU)
 {
-   using namespace llvm;
-
-   std::string Error;
-   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
-
-   /**
-    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
-    * friends for configuring code generation options, like stack alignment.
-    */
-   TargetOptions options;
-#if DETECT_ARCH_X86 && LLVM_VERSION_MAJOR < 13
-   options.StackAlignmentOverride = 4;
-#endif
-
-   builder.setEngineKind(EngineKind::JIT)
-          .setErrorStr(&Error)
-          .setTargetOptions(options)
-          .setOptLevel((CodeGenOpt::Level)OptLevel);
-
-#if DETECT_OS_WINDOWS
-    /*
-     * MCJIT works on Windows, but currently only through ELF object format.
-     *
-     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
-     * different strings for MinGW/MSVC, so better play it safe and be
-     * explicit.
-     */
-#  if DETECT_ARCH_X86_64
-    LLVMSetTarget(M, "x86_64-pc-win32-elf");
-#  elif DETECT_ARCH_X86
-    LLVMSetTarget(M, "i686-pc-win32-elf");
-#  elif DETECT_ARCH_AARCH64
-    LLVMSetTarget(M, "aarch64-pc-win32-elf");
-#  else
-#    error Unsupported architecture for MCJIT on Windows.
-#  endif
-#endif
-
-   llvm::SmallVector<std::string, 16> MAttrs;
-
 #if DETECT_ARCH_ARM
    /* llvm-3.3+ implements sys::getHostCPUFeatures for Arm,
     * which allows us to enable/disable code generation based
@@ -397,7 +352,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    llvm::StringMap<bool> features;
    llvm::sys::getHostCPUFeatures(features);
 
-   for (StringMapIterator<bool> f = features.begin();
+   for (llvm::StringMapIterator<bool> f = features.begin();
         f != features.end();
         ++f) {
       MAttrs.push_back(((*f).second ? "+" : "-") + (*f).first().str());
@@ -465,8 +420,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    MAttrs.push_back("+fp64");
 #endif
 
-   builder.setMAttrs(MAttrs);
-
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       int n = MAttrs.size();
       if (n > 0) {
@@ -477,7 +430,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       }
    }
 
-   StringRef MCPU = llvm::sys::getHostCPUName();
+   MCPU = llvm::sys::getHostCPUName().str();
    /*
     * The cpu bits are no longer set automatically, so need to set mcpu manually.
     * Note that the MAttrs set above will be sort of ignored (since we should
@@ -491,19 +444,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
     * can't handle. Not entirely sure if we really need to do anything yet.
     */
 
-#if DETECT_ARCH_PPC_64
-   /*
-    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
-    * of the Medium code model once dynamically generated JIT-compiled shader
-    * programs are linked in and relocated.  Yet the default code model as of
-    * LLVM 8 is Medium or even Small.
-    * The cost of changing from Medium to Large is negligible:
-    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
-    * - change an add-immediate (addis) instruction to a load (ld).
-    */
-   builder.setCodeModel(CodeModel::Large);
-
-#if UTIL_ARCH_LITTLE_ENDIAN
+#if DETECT_ARCH_PPC_64 && UTIL_ARCH_LITTLE_ENDIAN
    /*
     * Versions of LLVM prior to 4.0 lacked a table entry for "POWER8NVL",
     * resulting in (big-endian) "generic" being returned on
@@ -516,7 +457,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    if (MCPU == "generic")
       MCPU = "pwr8";
 #endif
-#endif
 
 #if DETECT_ARCH_MIPS64
       /*
@@ -530,10 +470,89 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MCPU = util_get_cpu_caps()->has_msa ? "mips64r5" : "mips64r2";
 #endif
 
-   builder.setMCPU(MCPU);
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
-      debug_printf("llc -mcpu option: %s\n", MCPU.str().c_str());
+      debug_printf("llc -mcpu option: %s\n", MCPU.c_str());
    }
+}
+
+/**
+ * Same as LLVMCreateJITCompilerForModule, but:
+ * - allows using MCJIT and enabling AVX feature where available.
+ * - set target options
+ *
+ * See also:
+ * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
+ * - llvm/tools/lli/lli.cpp
+ * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ */
+extern "C"
+LLVMBool
+lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
+                                        lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
+                                        LLVMModuleRef M,
+                                        LLVMMCJITMemoryManagerRef CMM,
+                                        unsigned OptLevel,
+                                        char **OutError)
+{
+   using namespace llvm;
+
+   std::string Error;
+   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+
+   /**
+    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
+    * friends for configuring code generation options, like stack alignment.
+    */
+   TargetOptions options;
+#if DETECT_ARCH_X86 && LLVM_VERSION_MAJOR < 13
+   options.StackAlignmentOverride = 4;
+#endif
+
+   builder.setEngineKind(EngineKind::JIT)
+          .setErrorStr(&Error)
+          .setTargetOptions(options)
+          .setOptLevel((CodeGenOpt::Level)OptLevel);
+
+#if DETECT_OS_WINDOWS
+    /*
+     * MCJIT works on Windows, but currently only through ELF object format.
+     *
+     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
+     * different strings for MinGW/MSVC, so better play it safe and be
+     * explicit.
+     */
+#  if DETECT_ARCH_X86_64
+    LLVMSetTarget(M, "x86_64-pc-win32-elf");
+#  elif DETECT_ARCH_X86
+    LLVMSetTarget(M, "i686-pc-win32-elf");
+#  elif DETECT_ARCH_AARCH64
+    LLVMSetTarget(M, "aarch64-pc-win32-elf");
+#  else
+#    error Unsupported architecture for MCJIT on Windows.
+#  endif
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string MCPU;
+
+   lp_build_get_host_target(MAttrs, MCPU);
+
+   builder.setMAttrs(MAttrs);
+   builder.setMCPU(MCPU);
+
+#if DETECT_ARCH_PPC_64
+   /*
+    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
+    * of the Medium code model once dynamically generated JIT-compiled shader
+    * programs are linked in and relocated.  Yet the default code model as of
+    * LLVM 8 is Medium or even Small.
+    * The cost of changing from Medium to Large is negligible:
+    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
+    * - change an add-immediate (addis) instruction to a load (ld).
+    */
+   builder.setCodeModel(CodeModel::Large);
+#endif
 
    ShaderMemoryManager *MM = NULL;
    BaseMemoryManager* JMM = reinterpret_cast<BaseMemoryManager*>(CMM);
@@ -619,3 +638,265 @@ lp_set_module_stack_alignment_override(LLVMModuleRef MRef, unsigned align)
    M->setOverrideStackAlignment(align);
 #endif
 }
+
+#if GALLIVM_USE_ORCJIT
+
+/*
+ * ORC LLJIT backend.
+ *
+ * There is a single LLJIT instance (and so a single ExecutionSession and
+ * object linking layer) for the whole process.  Each gallivm_state gets its
+ * own JITDylib, so its code can still be released independently of the
+ * others.  Modules are compiled to objects on the calling thread with a
+ * ConcurrentIRCompiler, which builds a fresh TargetMachine per module, so
+ * any number of gallivm_states can be compiled in parallel from different
+ * threads without further locking on our side.
+ */
+namespace {
+
+struct LPOrcJit {
+   std::unique_ptr<llvm::orc::LLJIT> lljit;
+   llvm::orc::JITTargetMachineBuilder jtmb;
+   std::atomic<unsigned> dylib_count;
+
+   LPOrcJit(llvm::orc::JITTargetMachineBuilder jtmb)
+      : jtmb(std::move(jtmb)), dylib_count(0) {}
+};
+
+}
+
+static LPOrcJit *lp_orc_jit = NULL;
+static once_flag lp_orc_jit_once_flag = ONCE_FLAG_INIT;
+
+static inline llvm::orc::JITDylib *
+unwrap(struct lp_orc_dylib *dylib)
+{
+   return reinterpret_cast<llvm::orc::JITDylib *>(dylib);
+}
+
+static void
+lp_orc_report_error(const char *what, llvm::Error err)
+{
+   _debug_printf("gallivm: %s: %s\n", what,
+                 llvm::toString(std::move(err)).c_str());
+}
+
+static void
+lp_orc_jit_init(void)
+{
+   using namespace llvm;
+
+   call_once(&init_native_targets_once_flag, init_native_targets);
+
+   Triple triple(sys::getProcessTriple());
+#if DETECT_OS_WINDOWS
+   /* Same as for MCJIT: only the ELF object format is supported here. */
+   triple.setObjectFormat(Triple::ELF);
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string MCPU;
+
+   lp_build_get_host_target(MAttrs, MCPU);
+
+   TargetOptions options;
+#if DETECT_ARCH_X86 && LLVM_VERSION_MAJOR < 13
+   options.StackAlignmentOverride = 4;
+#endif
+
+   orc::JITTargetMachineBuilder jtmb(triple);
+   jtmb.setCPU(MCPU);
+   jtmb.addFeatures(std::vector<std::string>(MAttrs.begin(), MAttrs.end()));
+   jtmb.setOptions(options);
+   jtmb.setCodeGenOptLevel((gallivm_get_perf_flags() & GALLIVM_PERF_NO_OPT) ?
+                           CodeGenOpt::None : CodeGenOpt::Default);
+#if DETECT_ARCH_PPC_64
+   /* See lp_build_create_jit_compiler_for_module(). */
+   jtmb.setCodeModel(CodeModel::Large);
+#endif
+
+   LPOrcJit *jit = new LPOrcJit(jtmb);
+
+   Expected<std::unique_ptr<orc::LLJIT>> lljit =
+      orc::LLJITBuilder().setJITTargetMachineBuilder(jtmb).create();
+   if (!lljit) {
+      lp_orc_report_error("failed to create LLJIT", lljit.takeError());
+      delete jit;
+      return;
+   }
+   jit->lljit = std::move(*lljit);
+
+   lp_orc_jit = jit;
+}
+
+static LPOrcJit *
+lp_orc_get_jit(void)
+{
+   call_once(&lp_orc_jit_once_flag, lp_orc_jit_init);
+   return lp_orc_jit;
+}
+
+/*
+ * TargetMachine caches its subtargets without any locking, so it can't be
+ * shared between threads that run passes at the same time.  Hand out a new
+ * one for every compile instead, like MCJIT does with one engine per
+ * gallivm_state.  The caller owns it and frees it with
+ * LLVMDisposeTargetMachine().
+ */
+extern "C" LLVMTargetMachineRef
+lp_orc_create_target_machine(void)
+{
+   LPOrcJit *jit = lp_orc_get_jit();
+   if (!jit)
+      return NULL;
+
+   llvm::orc::JITTargetMachineBuilder jtmb = jit->jtmb;
+   llvm::Expected<std::unique_ptr<llvm::TargetMachine>> tm =
+      jtmb.createTargetMachine();
+   if (!tm) {
+      lp_orc_report_error("failed to create target machine", tm.takeError());
+      return NULL;
+   }
+
+   return reinterpret_cast<LLVMTargetMachineRef>(tm->release());
+}
+
+extern "C" struct lp_orc_dylib *
+lp_orc_create_dylib(const char *name)
+{
+   using namespace llvm;
+
+   LPOrcJit *jit = lp_orc_get_jit();
+   if (!jit)
+      return NULL;
+
+   /* JITDylib names must be unique within the session. */
+   std::string dylib_name = std::string(name ? name : "gallivm") + "." +
+                            std::to_string(jit->dylib_count++);
+
+   orc::JITDylib &jd =
+      jit->lljit->getExecutionSession().createBareJITDylib(dylib_name);
+
+   /* Resolve anything the shaders call into (libm etc.) from the process. */
+   Expected<std::unique_ptr<orc::DynamicLibrarySearchGenerator>> gen =
+      orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+         jit->lljit->getDataLayout().getGlobalPrefix());
+   if (!gen) {
+      lp_orc_report_error("failed to create symbol generator", gen.takeError());
+      lp_orc_destroy_dylib(reinterpret_cast<struct lp_orc_dylib *>(&jd));
+      return NULL;
+   }
+   jd.addGenerator(std::move(*gen));
+
+   return reinterpret_cast<struct lp_orc_dylib *>(&jd);
+}
+
+extern "C" void
+lp_orc_destroy_dylib(struct lp_orc_dylib *dylib)
+{
+   LPOrcJit *jit = lp_orc_get_jit();
+
+   /* Releases the code and data memory of everything linked into it. */
+   if (llvm::Error err =
+          jit->lljit->getExecutionSession().removeJITDylib(*unwrap(dylib)))
+      lp_orc_report_error("failed to remove JITDylib", std::move(err));
+}
+
+extern "C" void
+lp_orc_set_module_target(LLVMModuleRef M)
+{
+   LPOrcJit *jit = lp_orc_get_jit();
+   llvm::Module *mod = llvm::unwrap(M);
+
+   mod->setDataLayout(jit->lljit->getDataLayout());
+   mod->setTargetTriple(jit->lljit->getTargetTriple().str());
+}
+
+extern "C" LLVMBool
+lp_orc_add_module(struct lp_orc_dylib *dylib,
+                  struct lp_cached_code *cache_out,
+                  LLVMModuleRef M,
+                  unsigned OptLevel,
+                  char **OutError)
+{
+   using namespace llvm;
+
+   LPOrcJit *jit = lp_orc_get_jit();
+   LPObjectCache *objcache = NULL;
+
+   if (cache_out) {
+      objcache = new LPObjectCache(cache_out);
+      cache_out->jit_obj_cache = (void *)objcache;
+   }
+
+   orc::JITTargetMachineBuilder jtmb = jit->jtmb;
+   jtmb.setCodeGenOptLevel((CodeGenOpt::Level)OptLevel);
+
+   /* Either compiles the module or hands back the object from the cache. */
+   orc::ConcurrentIRCompiler compiler(std::move(jtmb), objcache);
+   Expected<std::unique_ptr<MemoryBuffer>> obj = compiler(*unwrap(M));
+   if (!obj) {
+      *OutError = strdup(toString(obj.takeError()).c_str());
+      return 1;
+   }
+
+   /*
+    * Linking is deferred until the first lookup and a cached object buffer
+    * only references cache_out->data, which the caller may free before
+    * that; keep our own copy.
+    */
+   std::unique_ptr<MemoryBuffer> copy =
+      MemoryBuffer::getMemBufferCopy((*obj)->getBuffer(),
+                                     (*obj)->getBufferIdentifier());
+
+   if (Error err = jit->lljit->addObjectFile(*unwrap(dylib), std::move(copy))) {
+      *OutError = strdup(toString(std::move(err)).c_str());
+      return 1;
+   }
+
+   return 0;
+}
+
+extern "C" void
+lp_orc_add_global_mapping(struct lp_orc_dylib *dylib,
+                          const char *name, void *addr)
+{
+   using namespace llvm;
+
+   LPOrcJit *jit = lp_orc_get_jit();
+   orc::SymbolMap symbols;
+
+#if LLVM_VERSION_MAJOR >= 17
+   symbols[jit->lljit->mangleAndIntern(name)] =
+      orc::ExecutorSymbolDef(orc::ExecutorAddr::fromPtr(addr),
+                             JITSymbolFlags::Exported);
+#else
+   symbols[jit->lljit->mangleAndIntern(name)] =
+      JITEvaluatedSymbol(pointerToJITTargetAddress(addr),
+                         JITSymbolFlags::Exported);
+#endif
+
+   /* Mapping the same hook twice is harmless, the first one wins. */
+   if (Error err = unwrap(dylib)->define(orc::absoluteSymbols(std::move(symbols))))
+      consumeError(std::move(err));
+}
+
+extern "C" void *
+lp_orc_lookup(struct lp_orc_dylib *dylib, const char *name)
+{
+   LPOrcJit *jit = lp_orc_get_jit();
+
+   auto sym = jit->lljit->lookup(*unwrap(dylib), name);
+   if (!sym) {
+      lp_orc_report_error("symbol lookup failed", sym.takeError());
+      return NULL;
+   }
+
+#if LLVM_VERSION_MAJOR >= 15
+   return sym->toPtr<void *>();
+#else
+   return llvm::jitTargetAddressToPointer<void *>(sym->getAddress());
+#endif
+}
+
+#endif /* GALLIVM_USE_ORCJIT */
@@ -34,6 +34,7 @@
 #include <llvm/Config/llvm-config.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
 
 
 #ifdef __cplusplus
@@ -94,6 +95,36 @@ lp_free_objcache(void *objcache);
 
 void
 lp_set_module_stack_alignment_override(LLVMModuleRef M, unsigned align);
+
+#if GALLIVM_USE_ORCJIT
+struct lp_orc_dylib;
+
+extern LLVMTargetMachineRef
+lp_orc_create_target_machine(void);
+
+extern struct lp_orc_dylib *
+lp_orc_create_dylib(const char *name);
+
+extern void
+lp_orc_destroy_dylib(struct lp_orc_dylib *dylib);
+
+extern void
+lp_orc_set_module_target(LLVMModuleRef M);
+
+extern LLVMBool
+lp_orc_add_module(struct lp_orc_dylib *dylib,
+                  struct lp_cached_code *cache_out,
+                  LLVMModuleRef M,
+                  unsigned OptLevel,
+                  char **OutError);
+
+extern void
+lp_orc_add_global_mapping(struct lp_orc_dylib *dylib,
+                          const char *name, void *addr);
+
+extern void *
+lp_orc_lookup(struct lp_orc_dylib *dylib, const char *name);
+#endif
 #ifdef __cplusplus
 }
 #endif
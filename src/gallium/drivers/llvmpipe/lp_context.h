@@ -49,6 +49,7 @@ struct draw_context;
 struct draw_stage;
 struct draw_vertex_shader;
 struct lp_fragment_shader;
+struct lp_fragment_shader_variant;
 struct lp_compute_shader;
 struct lp_blend_state;
 struct lp_setup_context;
@@ -159,6 +160,9 @@ struct llvmpipe_context {
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Bound fs variant, if it is a fallback awaiting its optimized version */
+   struct lp_fragment_shader_variant *fs_fallback;
+
    boolean permit_linear_rasterizer;
    boolean single_vp;
 
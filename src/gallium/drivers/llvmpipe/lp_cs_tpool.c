@@ -30,8 +30,58 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
 #include "lp_cs_tpool.h"
 
+/*
+ * Claim the next chunk of iterations of a task.  Returns the number of
+ * iterations claimed, starting at *iter_start, or 0 once every iteration
+ * has been handed out.  This doesn't need the pool mutex, so the thread
+ * waiting on a task can help execute it.
+ *
+ * Chunks are sized from the iterations still left (guided scheduling):
+ * big chunks keep the claim overhead low early on, and the small chunks
+ * towards the end let threads that got cheap workgroups pick up the slack
+ * of those that got expensive ones.
+ */
+static unsigned
+lp_cs_tpool_claim_iters(struct lp_cs_tpool *pool,
+                        struct lp_cs_tpool_task *task,
+                        unsigned *iter_start)
+{
+   unsigned curr = p_atomic_read(&task->iter_start);
+
+   while (curr < task->iter_total) {
+      unsigned remaining = task->iter_total - curr;
+      unsigned count = MAX2(1, remaining / (2 * (pool->num_threads + 1)));
+      unsigned prev = p_atomic_cmpxchg(&task->iter_start, curr, curr + count);
+
+      if (prev == curr) {
+         *iter_start = curr;
+         return count;
+      }
+      curr = prev;
+   }
+   return 0;
+}
+
+/* Must be called with the pool mutex held. */
+static void
+lp_cs_tpool_finish_iters(struct lp_cs_tpool *pool,
+                         struct lp_cs_tpool_task *task,
+                         unsigned count)
+{
+   /* Once everything is handed out, no other thread should pick it up. */
+   if (list_is_linked(&task->list) &&
+       p_atomic_read(&task->iter_start) == task->iter_total)
+      list_del(&task->list);
+
+   task->iter_finished += count;
+   if (task->iter_finished == task->iter_total)
+      cnd_broadcast(&task->finish);
+}
+
 static int
 lp_cs_tpool_worker(void *data)
 {
@@ -43,7 +93,7 @@ lp_cs_tpool_worker(void *data)
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
+      unsigned iter_start, iter_count;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -54,29 +104,18 @@ lp_cs_tpool_worker(void *data)
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
 
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
+      iter_count = lp_cs_tpool_claim_iters(pool, task, &iter_start);
+      if (!iter_count) {
+         lp_cs_tpool_finish_iters(pool, task, 0);
+         continue;
       }
 
-      task->iter_start += iter_per_thread;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
-
       mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
+      for (unsigned i = 0; i < iter_count; i++)
+         task->work(task->data, iter_start + i, &lmem);
 
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
-         cnd_broadcast(&task->finish);
+      lp_cs_tpool_finish_iters(pool, task, iter_count);
    }
    mtx_unlock(&pool->m);
    FREE(lmem.local_mem_ptr);
@@ -96,6 +135,9 @@ lp_cs_tpool_create(unsigned num_threads)
 
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
+   pool->threads = CALLOC(MAX2(1, num_threads), sizeof(*pool->threads));
+   if (!pool->threads)
+      num_threads = 0;
    for (unsigned i = 0; i < num_threads; i++) {
       if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker, pool)) {
          num_threads = i;  /* previous thread is max */
@@ -123,6 +165,7 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
@@ -151,9 +194,6 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->data = data;
    task->iter_total = num_iters;
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
-
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
@@ -174,7 +214,26 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
    if (!pool || !task)
       return;
 
+   /* Rather than just sleeping, run whatever the workers haven't claimed
+    * yet.  This also means small dispatches mostly don't need a wakeup.
+    */
+   struct lp_cs_local_mem lmem;
+   unsigned iter_start, iter_count;
+
+   memset(&lmem, 0, sizeof(lmem));
+   while ((iter_count = lp_cs_tpool_claim_iters(pool, task, &iter_start))) {
+      for (unsigned i = 0; i < iter_count; i++)
+         task->work(task->data, iter_start + i, &lmem);
+
+      mtx_lock(&pool->m);
+      lp_cs_tpool_finish_iters(pool, task, iter_count);
+      mtx_unlock(&pool->m);
+   }
+   FREE(lmem.local_mem_ptr);
+
    mtx_lock(&pool->m);
+   if (list_is_linked(&task->list))
+      list_del(&task->list);
    while (task->iter_finished < task->iter_total)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
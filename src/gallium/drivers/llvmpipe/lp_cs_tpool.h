@@ -45,7 +45,7 @@ struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -64,10 +64,8 @@ struct lp_cs_tpool_task {
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+   unsigned iter_start;    /* next iteration to hand out, claimed atomically */
+   unsigned iter_finished; /* protected by the pool mutex */
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
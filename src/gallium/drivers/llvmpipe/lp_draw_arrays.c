@@ -39,6 +39,7 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_perf.h"
 
 #include "draw/draw_context.h"
 
@@ -73,9 +74,15 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       return;
    }
 
+   if (lp->fs_fallback)
+      llvmpipe_update_fs_fallback(lp);
+
    if (lp->dirty)
       llvmpipe_update_derived(lp);
 
+   if (lp->fs_fallback)
+      LP_COUNT(nr_fs_fallback_draws);
+
    /*
     * Map vertex buffers
     */
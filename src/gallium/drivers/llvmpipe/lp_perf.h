@@ -63,11 +63,14 @@ struct lp_counters
    unsigned nr_rect_partially_covered_4;
    unsigned nr_non_empty_4;
    unsigned nr_llvm_compiles;
+   unsigned nr_fs_fallback_draws;  /**< draws using an unoptimized fs variant */
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_bin_iter_contended;  /**< bin handouts lost to another thread */
 };
 
 
@@ -30,6 +30,7 @@
 #include "util/u_memory.h"
 #include "util/reallocarray.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
@@ -37,6 +38,7 @@
 #include "lp_context.h"
 #include "lp_state_fs.h"
 #include "lp_setup_context.h"
+#include "lp_perf.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -73,8 +75,6 @@ lp_scene_create(struct lp_setup_context *setup)
    scene->setup = setup;
    scene->data.head = &scene->data.first;
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -101,7 +101,6 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_scene_end_rasterization(scene);
-   mtx_destroy(&scene->mutex);
    free(scene->tiles);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
@@ -531,60 +530,41 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
-{
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
-}
-
-
 void
 lp_scene_bin_iter_begin(struct lp_scene *scene)
 {
-   scene->curr_x = scene->curr_y = -1;
+   scene->curr_bin = 0;
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * The lp_scene::curr_bin counter will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Bins are claimed with a compare-and-swap
+ * on curr_bin rather than under a lock; a failed swap means another
+ * thread claimed the bin first, which is counted as contention.
  */
 struct cmd_bin *
 lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
-
-   mtx_lock(&scene->mutex);
-
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   const unsigned num_bins = scene->tiles_x * scene->tiles_y;
+   unsigned curr = p_atomic_read(&scene->curr_bin);
+
+   while (curr < num_bins) {
+      unsigned prev = p_atomic_cmpxchg(&scene->curr_bin, curr, curr + 1);
+      if (prev == curr) {
+         *x = curr % scene->tiles_x;
+         *y = curr / scene->tiles_x;
+         /*printf("return bin %u at %d, %d\n", curr, *x, *y);*/
+         return lp_scene_get_bin(scene, *x, *y);
+      }
+      LP_COUNT(nr_bin_iter_contended);
+      curr = prev;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
-
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   /* no more bins left */
+   return NULL;
 }
 
 
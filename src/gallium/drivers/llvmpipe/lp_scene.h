@@ -195,8 +195,7 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   unsigned curr_bin;  /**< next bin to hand out, row-major; atomic */
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
@@ -40,6 +40,10 @@
 #include "gallivm/lp_bld_nir.h"
 #include "util/disk_cache.h"
 #include "util/hex.h"
+#include "util/hash_table.h"
+#include "util/set.h"
+#include "util/ralloc.h"
+#include "util/u_atomic.h"
 #include "util/os_misc.h"
 #include "util/os_time.h"
 #include "util/u_helpers.h"
@@ -58,6 +62,8 @@
 #include "frontend/sw_winsys.h"
 
 #include "nir.h"
+#include "nir_serialize.h"
+#include "tgsi/tgsi_parse.h"
 
 
 int LP_DEBUG = 0;
@@ -856,12 +862,19 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
 }
 
 
+static void
+lp_disk_cache_preload_fini(struct llvmpipe_screen *screen);
+
+
 static void
 llvmpipe_destroy_screen(struct pipe_screen *_screen)
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   if (screen->late_init_done && screen->async_fs)
+      util_queue_destroy(&screen->fs_compile_queue);
+
    if (screen->cs_tpool)
       lp_cs_tpool_destroy(screen->cs_tpool);
 
@@ -870,6 +883,8 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 
    lp_jit_screen_cleanup(screen);
 
+   if (screen->late_init_done && screen->cache_preload)
+      lp_disk_cache_preload_fini(screen);
    disk_cache_destroy(screen->disk_shader_cache);
    if (winsys->destroy)
       winsys->destroy(winsys);
@@ -878,6 +893,7 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 
    mtx_destroy(&screen->rast_mutex);
    mtx_destroy(&screen->cs_mutex);
+   mtx_destroy(&screen->cache_preload_mutex);
    FREE(screen);
 }
 
@@ -949,6 +965,10 @@ lp_disk_cache_create(struct llvmpipe_screen *screen)
       return;
 
    _mesa_sha1_update(&ctx, &gallivm_perf, sizeof(gallivm_perf));
+   /* LP_PERF options and the vector width change the generated code too */
+   _mesa_sha1_update(&ctx, &LP_PERF, sizeof(LP_PERF));
+   _mesa_sha1_update(&ctx, &lp_native_vector_width,
+                     sizeof(lp_native_vector_width));
    update_cache_sha1_cpu(&ctx);
    _mesa_sha1_final(&ctx, sha1);
    mesa_bytes_to_hex(cache_id, sha1, 20);
@@ -978,6 +998,217 @@ llvmpipe_screen_get_fd(struct pipe_screen *_screen)
 }
 
 
+/**
+ * Hash the IR of a shader, to be part of the disk cache keys of its
+ * variants.  This must be done when the shader is created, as generating
+ * a variant lowers the NIR in place.
+ */
+void
+lp_disk_cache_hash_shader(const struct pipe_shader_state *state,
+                          unsigned char ir_sha1[20])
+{
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+
+   if (state->type == PIPE_SHADER_IR_TGSI) {
+      _mesa_sha1_update(&ctx, state->tokens,
+                        tgsi_num_tokens(state->tokens) *
+                        sizeof(struct tgsi_token));
+   } else {
+      struct blob blob;
+      blob_init(&blob);
+      nir_serialize(&blob, state->ir.nir, true);
+      _mesa_sha1_update(&ctx, blob.data, blob.size);
+      blob_finish(&blob);
+   }
+
+   _mesa_sha1_final(&ctx, ir_sha1);
+}
+
+
+/*
+ * Disk cache preloading (LP_CACHE_PRELOAD).
+ *
+ * The keys of all variants looked up in or stored into the disk cache are
+ * recorded, and stored as a list in the cache itself when the screen is
+ * destroyed.  The next process reads the list at startup and fetches the
+ * objects in batches on a background thread, so that creating the variants
+ * finds them in memory instead of reading and decompressing cache files.
+ */
+
+#define LP_CACHE_PRELOAD_MAX_KEYS 4096
+
+/* Number of objects read with each disk_cache_get_batch() call */
+#define LP_CACHE_PRELOAD_BATCH 32
+
+struct lp_cache_blob
+{
+   cache_key key;
+   struct disk_cache_blob *blob;
+};
+
+
+static uint32_t
+lp_cache_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, CACHE_KEY_SIZE);
+}
+
+
+static bool
+lp_cache_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+
+static void
+lp_disk_cache_preload_list_key(struct llvmpipe_screen *screen,
+                               cache_key list_key)
+{
+   static const char name[] = "llvmpipe preload list";
+
+   disk_cache_compute_key(screen->disk_shader_cache, name, sizeof(name),
+                          list_key);
+}
+
+
+/* Called with cache_preload_mutex held. */
+static void
+lp_disk_cache_record_key(struct llvmpipe_screen *screen, const cache_key key)
+{
+   if (screen->num_cache_keys_used == LP_CACHE_PRELOAD_MAX_KEYS ||
+       _mesa_set_search(screen->cache_keys_used_set, key))
+      return;
+
+   uint8_t *used = screen->cache_keys_used[screen->num_cache_keys_used++];
+   memcpy(used, key, CACHE_KEY_SIZE);
+   _mesa_set_add(screen->cache_keys_used_set, used);
+}
+
+
+static int
+lp_disk_cache_preload_thread(void *data)
+{
+   struct llvmpipe_screen *screen = data;
+   struct disk_cache_blob *blobs[LP_CACHE_PRELOAD_BATCH];
+   cache_key keys[LP_CACHE_PRELOAD_BATCH];
+   cache_key list_key;
+   size_t list_size;
+
+   lp_disk_cache_preload_list_key(screen, list_key);
+   uint8_t *list = disk_cache_get(screen->disk_shader_cache, list_key,
+                                  &list_size);
+   if (!list)
+      return 0;
+
+   size_t i = 0;
+   while (i + CACHE_KEY_SIZE <= list_size &&
+          !p_atomic_read(&screen->cache_preload_cancel)) {
+      unsigned num_keys = 0;
+
+      /* Skip what a context has already fetched on its own */
+      mtx_lock(&screen->cache_preload_mutex);
+      for (; i + CACHE_KEY_SIZE <= list_size &&
+             num_keys < LP_CACHE_PRELOAD_BATCH; i += CACHE_KEY_SIZE) {
+         if (!_mesa_set_search(screen->cache_keys_used_set, list + i))
+            memcpy(keys[num_keys++], list + i, CACHE_KEY_SIZE);
+      }
+      mtx_unlock(&screen->cache_preload_mutex);
+
+      disk_cache_get_batch(screen->disk_shader_cache, keys, num_keys, blobs);
+
+      for (unsigned j = 0; j < num_keys; j++) {
+         if (!blobs[j])
+            continue;
+
+         struct lp_cache_blob *entry = MALLOC_STRUCT(lp_cache_blob);
+
+         mtx_lock(&screen->cache_preload_mutex);
+         if (entry &&
+             !_mesa_set_search(screen->cache_keys_used_set, keys[j]) &&
+             !_mesa_hash_table_search(screen->cache_preloaded, keys[j])) {
+            memcpy(entry->key, keys[j], CACHE_KEY_SIZE);
+            entry->blob = blobs[j];
+            _mesa_hash_table_insert(screen->cache_preloaded, entry->key,
+                                    entry);
+            entry = NULL;
+            blobs[j] = NULL;
+         }
+         mtx_unlock(&screen->cache_preload_mutex);
+
+         FREE(entry);
+         if (blobs[j])
+            disk_cache_blob_unref(blobs[j]);
+      }
+   }
+
+   free(list);
+   return 0;
+}
+
+
+static void
+lp_disk_cache_preload_init(struct llvmpipe_screen *screen)
+{
+   if (!screen->disk_shader_cache) {
+      screen->cache_preload = false;
+      return;
+   }
+
+   screen->cache_keys_used =
+      MALLOC(LP_CACHE_PRELOAD_MAX_KEYS * sizeof(*screen->cache_keys_used));
+   screen->cache_keys_used_set =
+      _mesa_set_create(NULL, lp_cache_key_hash, lp_cache_key_equal);
+   screen->cache_preloaded =
+      _mesa_hash_table_create(NULL, lp_cache_key_hash, lp_cache_key_equal);
+   if (!screen->cache_keys_used || !screen->cache_keys_used_set ||
+       !screen->cache_preloaded) {
+      FREE(screen->cache_keys_used);
+      ralloc_free(screen->cache_keys_used_set);
+      ralloc_free(screen->cache_preloaded);
+      screen->cache_preload = false;
+      return;
+   }
+
+   if (u_thread_create(&screen->cache_preload_thread,
+                       lp_disk_cache_preload_thread, screen) == thrd_success)
+      screen->cache_preload_thread_created = true;
+}
+
+
+static void
+lp_disk_cache_preload_fini(struct llvmpipe_screen *screen)
+{
+   if (screen->cache_preload_thread_created) {
+      p_atomic_set(&screen->cache_preload_cancel, true);
+      thrd_join(screen->cache_preload_thread, NULL);
+   }
+
+   /* Tell the next process what to preload.  The cache doesn't overwrite
+    * existing entries, so the list of the previous process has to be removed
+    * first or it would never be replaced.
+    */
+   if (screen->num_cache_keys_used) {
+      cache_key list_key;
+      lp_disk_cache_preload_list_key(screen, list_key);
+      disk_cache_remove(screen->disk_shader_cache, list_key);
+      disk_cache_put(screen->disk_shader_cache, list_key,
+                     screen->cache_keys_used,
+                     screen->num_cache_keys_used * CACHE_KEY_SIZE, NULL);
+   }
+
+   hash_table_foreach(screen->cache_preloaded, entry) {
+      struct lp_cache_blob *blob = entry->data;
+      disk_cache_blob_unref(blob->blob);
+      FREE(blob);
+   }
+   _mesa_hash_table_destroy(screen->cache_preloaded, NULL);
+   ralloc_free(screen->cache_keys_used_set);
+   FREE(screen->cache_keys_used);
+}
+
+
 void
 lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
                           struct lp_cached_code *cache,
@@ -990,6 +1221,33 @@ lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
    disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
                           20, sha1);
 
+   if (screen->cache_preload) {
+      struct lp_cache_blob *blob = NULL;
+
+      mtx_lock(&screen->cache_preload_mutex);
+      lp_disk_cache_record_key(screen, sha1);
+      struct hash_entry *entry =
+         _mesa_hash_table_search(screen->cache_preloaded, sha1);
+      if (entry) {
+         blob = entry->data;
+         _mesa_hash_table_remove(screen->cache_preloaded, entry);
+      }
+      mtx_unlock(&screen->cache_preload_mutex);
+
+      if (blob) {
+         /* The code is owned by the caller, which frees it */
+         cache->data = malloc(blob->blob->size);
+         if (cache->data) {
+            memcpy(cache->data, blob->blob->data, blob->blob->size);
+            cache->data_size = blob->blob->size;
+         }
+         disk_cache_blob_unref(blob->blob);
+         FREE(blob);
+         if (cache->data)
+            return;
+      }
+   }
+
    size_t binary_size;
    uint8_t *buffer = disk_cache_get(screen->disk_shader_cache,
                                     sha1, &binary_size);
@@ -1013,6 +1271,13 @@ lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
       return;
    disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
                           20, sha1);
+
+   if (screen->cache_preload) {
+      mtx_lock(&screen->cache_preload_mutex);
+      lp_disk_cache_record_key(screen, sha1);
+      mtx_unlock(&screen->cache_preload_mutex);
+   }
+
    disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
                   cache->data_size, NULL);
 }
@@ -1040,7 +1305,20 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
       goto out;
    }
 
+   /* Optimized fs variants are compiled at low priority next to the
+    * rasterizer threads; a couple of threads is enough to keep up with
+    * new state combinations.
+    */
+   if (screen->async_fs &&
+       !util_queue_init(&screen->fs_compile_queue, "lpfs", 64,
+                        CLAMP(screen->num_threads / 4, 1, 4),
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY, NULL))
+      screen->async_fs = false;
+
    lp_disk_cache_create(screen);
+   if (screen->cache_preload)
+      lp_disk_cache_preload_init(screen);
    screen->late_init_done = true;
 out:
    mtx_unlock(&screen->late_mutex);
@@ -1111,6 +1389,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS",
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
+   screen->async_fs = debug_get_bool_option("LP_ASYNC_FS", FALSE);
+   screen->cache_preload = debug_get_bool_option("LP_CACHE_PRELOAD", FALSE);
 
    lp_build_init(); /* get lp_native_vector_width initialised */
 
@@ -1124,6 +1404,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
    (void) mtx_init(&screen->late_mutex, mtx_plain);
+   (void) mtx_init(&screen->cache_preload_mutex, mtx_plain);
 
    return &screen->base;
 }
@@ -38,11 +38,15 @@
 #include "pipe/p_defines.h"
 #include "util/u_thread.h"
 #include "util/list.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
 
 struct sw_winsys;
 struct lp_cs_tpool;
+struct pipe_shader_state;
+struct set;
+struct hash_table;
 
 struct llvmpipe_screen
 {
@@ -74,9 +78,29 @@ struct llvmpipe_screen
    char renderer_string[100];
 
    struct disk_cache *disk_shader_cache;
+
+   /* Background compilation of optimized fs variants (LP_ASYNC_FS) */
+   bool async_fs;
+   struct util_queue fs_compile_queue;
+
+   /* Disk cache preloading (LP_CACHE_PRELOAD) */
+   bool cache_preload;
+   bool cache_preload_cancel;
+   mtx_t cache_preload_mutex;
+   thrd_t cache_preload_thread;
+   bool cache_preload_thread_created;
+   uint8_t (*cache_keys_used)[20];  /**< in order of first use */
+   unsigned num_cache_keys_used;
+   struct set *cache_keys_used_set;
+   struct hash_table *cache_preloaded;  /**< cache key -> lp_cache_blob */
 };
 
 
+void
+lp_disk_cache_hash_shader(const struct pipe_shader_state *state,
+                          unsigned char ir_sha1[20]);
+
+
 void
 lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
                           struct lp_cached_code *cache,
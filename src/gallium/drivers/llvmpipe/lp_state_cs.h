@@ -110,6 +110,9 @@ struct lp_compute_shader {
 
    uint32_t req_local_mem;
 
+   /* Hash of the IR as created, for the disk cache */
+   unsigned char ir_sha1[20];
+
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
    unsigned no;
@@ -632,6 +632,7 @@ fs_fb_fetch(const struct lp_build_fs_iface *iface,
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_fragment_shader *shader,
+                 struct nir_shader *nir,
                  const struct lp_fragment_shader_variant_key *key,
                  LLVMBuilderRef builder,
                  struct lp_type type,
@@ -1061,7 +1062,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
       lp_build_tgsi_soa(gallivm, tokens, &params,
                         outputs);
    else
-      lp_build_nir_soa(gallivm, shader->base.ir.nir, &params,
+      lp_build_nir_soa(gallivm, nir, &params,
                        outputs);
 
    /* Alpha test */
@@ -3087,8 +3088,8 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
+                  struct nir_shader *nir,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -3399,7 +3400,7 @@ generate_fragment(struct llvmpipe_context *lp,
       }
 
       generate_fs_loop(gallivm,
-                       shader, key,
+                       shader, nir, key,
                        builder,
                        fs_type,
                        variant->jit_context_type,
@@ -3693,33 +3694,39 @@ static void
 lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
                        unsigned char ir_sha1_cache_key[20])
 {
-   struct blob blob = { 0 };
-   unsigned ir_size;
-   void *ir_binary;
-
-   blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
-   ir_binary = blob.data;
-   ir_size = blob.size;
-
    struct mesa_sha1 ctx;
    _mesa_sha1_init(&ctx);
    _mesa_sha1_update(&ctx, &variant->key, variant->shader->variant_key_size);
-   _mesa_sha1_update(&ctx, ir_binary, ir_size);
+   _mesa_sha1_update(&ctx, variant->shader->ir_sha1,
+                     sizeof(variant->shader->ir_sha1));
    _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+}
+
+
+/**
+ * Look up the optimized code of a variant in the disk cache.  The code is
+ * left empty on a miss.
+ */
+static void
+find_cached_variant(struct llvmpipe_screen *screen,
+                    struct lp_fragment_shader_variant *variant,
+                    struct lp_cached_code *cached)
+{
+   unsigned char ir_sha1_cache_key[20];
 
-   blob_finish(&blob);
+   lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+   lp_disk_cache_find_shader(screen, cached, ir_sha1_cache_key);
 }
 
 
 /**
- * Generate a new fragment shader variant from the shader code and
- * other state indicated by the key.
+ * Allocate a new fragment shader variant for the given key.  The code is
+ * generated separately by compile_variant().
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+create_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key)
 {
    struct lp_fragment_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
@@ -3733,30 +3740,51 @@ generate_variant(struct llvmpipe_context *lp,
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-   struct lp_cached_code cached = { 0 };
-   unsigned char ir_sha1_cache_key[20];
-   bool needs_caching = false;
-   if (shader->base.ir.nir) {
-      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
 
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
-         needs_caching = true;
-   }
+   return variant;
+}
+
+
+/**
+ * Generate the code of a fragment shader variant from the shader code and
+ * other state indicated by the key.
+ *
+ * Only the variant, the given LLVM context and NIR, and read-only parts of
+ * the shader are touched, so this may run on the fs compile queue.
+ *
+ * \param cached  the result of find_cached_variant(), or NULL for
+ *                 unoptimized code, which is kept out of the disk cache
+ *                 as that is keyed on the IR and state only
+ */
+static boolean
+compile_variant(struct llvmpipe_screen *screen,
+                LLVMContextRef context,
+                struct lp_fragment_shader_variant *variant,
+                struct nir_shader *nir,
+                struct lp_cached_code *cached)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+
+   struct lp_cached_code no_cache = { 0 };
+   const boolean unoptimized = !cached;
+   const bool needs_caching = cached && !cached->data_size;
+   if (unoptimized)
+      cached = &no_cache;
 
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
+            shader->no, variant->no);
+   if (unoptimized)
+      variant->gallivm = gallivm_create_unoptimized(module_name, context,
+                                                    cached);
+   else
+      variant->gallivm = gallivm_create(module_name, context, cached);
+   if (!variant->gallivm)
+      return FALSE;
 
    /*
     * Determine whether we are touching all channels in the color buffer.
@@ -3854,8 +3882,6 @@ generate_variant(struct llvmpipe_context *lp,
          (key->cbuf_format[0] == PIPE_FORMAT_B8G8R8A8_UNORM ||
           key->cbuf_format[0] == PIPE_FORMAT_B8G8R8X8_UNORM);
 
-   memcpy(&variant->key, key, sizeof *key);
-
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
@@ -3865,12 +3891,12 @@ generate_variant(struct llvmpipe_context *lp,
    lp_jit_init_types(variant);
 
    if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+      generate_fragment(shader, nir, variant, RAST_EDGE_TEST);
 
    if (variant->jit_function[RAST_WHOLE] == NULL) {
       if (variant->opaque) {
          /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+         generate_fragment(shader, nir, variant, RAST_WHOLE);
       }
    }
 
@@ -3894,7 +3920,7 @@ generate_variant(struct llvmpipe_context *lp,
          if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
              shader->kind == LP_FS_KIND_BLIT_RGB1 ||
              shader->kind == LP_FS_KIND_LLVM_LINEAR) {
-            llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
+            llvmpipe_fs_variant_linear_llvm(shader, nir, variant);
          }
       }
    } else {
@@ -3941,11 +3967,163 @@ generate_variant(struct llvmpipe_context *lp,
    }
 
    if (needs_caching) {
-      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+      unsigned char ir_sha1_cache_key[20];
+      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+      lp_disk_cache_insert_shader(screen, cached, ir_sha1_cache_key);
    }
 
    gallivm_free_ir(variant->gallivm);
 
+   return TRUE;
+}
+
+
+/**
+ * Generate a new fragment shader variant from the shader code and
+ * other state indicated by the key.
+ */
+static struct lp_fragment_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 const struct lp_fragment_shader_variant_key *key,
+                 boolean unoptimized)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant =
+      create_variant(lp, shader, key);
+   if (!variant)
+      return NULL;
+
+   struct lp_cached_code cached = { 0 };
+   if (!unoptimized)
+      find_cached_variant(screen, variant, &cached);
+
+   if (!compile_variant(screen, lp->context, variant, shader->base.ir.nir,
+                        unoptimized ? NULL : &cached)) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return NULL;
+   }
+
+   return variant;
+}
+
+
+/**
+ * Optimized variant compiled on the fs compile queue, on behalf of the
+ * unoptimized fallback variant which is used in the meantime.
+ */
+struct lp_fs_variant_async
+{
+   struct util_queue_fence fence;
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+   /* Private copy, as translation lowers the shader's NIR in place */
+   struct nir_shader *nir;
+   boolean compiled;
+};
+
+
+static void
+compile_variant_async(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_variant_async *async = data;
+   struct lp_fragment_shader_variant *variant = async->variant;
+
+   variant->context = LLVMContextCreate();
+   if (!variant->context)
+      return;
+
+#if LLVM_VERSION_MAJOR == 15
+   LLVMContextSetOpaquePointers(variant->context, false);
+#endif
+
+   /* The disk cache was probed before queueing this */
+   struct lp_cached_code cached = { 0 };
+   async->compiled = compile_variant(async->screen, variant->context,
+                                     variant, async->nir, &cached);
+}
+
+
+/**
+ * Generate a fallback variant with unoptimized code, which is quick to
+ * compile, and queue the compilation of the optimized variant for the
+ * same key.  Optimized code found in the disk cache is used right away
+ * instead.
+ */
+static struct lp_fragment_shader_variant *
+generate_variant_async(struct llvmpipe_context *lp,
+                       struct lp_fragment_shader *shader,
+                       const struct lp_fragment_shader_variant_key *key)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   struct lp_fragment_shader_variant *optimized =
+      create_variant(lp, shader, key);
+   if (!optimized)
+      return NULL;
+
+   struct lp_cached_code cached = { 0 };
+   find_cached_variant(screen, optimized, &cached);
+
+   struct lp_fs_variant_async *async = NULL;
+   if (!cached.data_size)
+      async = CALLOC_STRUCT(lp_fs_variant_async);
+   if (!async) {
+      if (!compile_variant(screen, lp->context, optimized,
+                           shader->base.ir.nir, &cached))
+         lp_fs_variant_reference(lp, &optimized, NULL);
+      return optimized;
+   }
+
+   async->screen = screen;
+   async->variant = optimized;
+
+   /* Copy the NIR before the fallback gets translated from it, so that
+    * both see the same IR.
+    */
+   if (shader->base.ir.nir)
+      async->nir = nir_shader_clone(NULL, shader->base.ir.nir);
+
+   struct lp_fragment_shader_variant *variant =
+      generate_variant(lp, shader, key, TRUE);
+   if (!variant) {
+      lp_fs_variant_reference(lp, &async->variant, NULL);
+      ralloc_free(async->nir);
+      FREE(async);
+      return NULL;
+   }
+
+   util_queue_fence_init(&async->fence);
+   variant->async = async;
+   util_queue_add_job(&screen->fs_compile_queue, async, &async->fence,
+                      compile_variant_async, NULL, 0);
+
+   return variant;
+}
+
+
+/**
+ * Detach the background compilation from a fallback variant, cancelling
+ * or waiting for it as needed.
+ * \return the optimized variant, or NULL if its compilation failed
+ */
+static struct lp_fragment_shader_variant *
+take_variant_async(struct llvmpipe_context *lp,
+                   struct lp_fragment_shader_variant *fallback)
+{
+   struct lp_fs_variant_async *async = fallback->async;
+   struct lp_fragment_shader_variant *variant = async->variant;
+
+   util_queue_drop_job(&async->screen->fs_compile_queue, &async->fence);
+   util_queue_fence_destroy(&async->fence);
+
+   if (!async->compiled)
+      lp_fs_variant_reference(lp, &variant, NULL);
+
+   ralloc_free(async->nir);
+   FREE(async);
+   fallback->async = NULL;
+
    return variant;
 }
 
@@ -3981,6 +4159,8 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       nir_tgsi_scan_shader(nir, &shader->info.base, true);
    }
 
+   lp_disk_cache_hash_shader(&shader->base, shader->ir_sha1);
+
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
       FREE((void *) shader->base.tokens);
@@ -4106,6 +4286,24 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
    list_del(&variant->list_item_global.list);
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
+
+   if (lp->fs_fallback == variant)
+      lp->fs_fallback = NULL;
+}
+
+
+/**
+ * Add shader variant to the shader's and the context's variant lists.
+ */
+static void
+llvmpipe_add_shader_variant(struct llvmpipe_context *lp,
+                            struct lp_fragment_shader_variant *variant)
+{
+   list_add(&variant->list_item_local.list, &variant->shader->variants.list);
+   list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
+   lp->nr_fs_variants++;
+   lp->nr_fs_instrs += variant->nr_instrs;
+   variant->shader->variants_cached++;
 }
 
 
@@ -4113,7 +4311,16 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   if (variant->async) {
+      struct lp_fragment_shader_variant *optimized =
+         take_variant_async(lp, variant);
+      lp_fs_variant_reference(lp, &optimized, NULL);
+   }
+
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   if (variant->context)
+      LLVMContextDispose(variant->context);
    lp_fs_reference(lp, &variant->shader, NULL);
    FREE(variant);
 }
@@ -4608,6 +4815,23 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       }
    }
 
+   if (variant && variant->async &&
+       util_queue_fence_is_signalled(&variant->async->fence)) {
+      /* The optimized version of this fallback variant is ready, replace
+       * the fallback with it.  Scenes still referencing the fallback keep
+       * it alive until they are done.
+       */
+      struct lp_fragment_shader_variant *fallback = variant;
+      struct lp_fragment_shader_variant *optimized =
+         take_variant_async(lp, fallback);
+      if (optimized) {
+         llvmpipe_add_shader_variant(lp, optimized);
+         llvmpipe_remove_shader_variant(lp, fallback);
+         lp_fs_variant_reference(lp, &fallback, NULL);
+         variant = optimized;
+      }
+   }
+
    if (variant) {
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
@@ -4668,7 +4892,10 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
        * Generate the new variant.
        */
       int64_t t0 = os_time_get();
-      variant = generate_variant(lp, shader, key);
+      if (llvmpipe_screen(lp->pipe.screen)->async_fs)
+         variant = generate_variant_async(lp, shader, key);
+      else
+         variant = generate_variant(lp, shader, key, FALSE);
       int64_t t1 = os_time_get();
       int64_t dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
@@ -4676,19 +4903,30 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 
       /* Put the new variant into the list */
       if (variant) {
-         list_add(&variant->list_item_local.list, &shader->variants.list);
-         list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
-         lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
-         shader->variants_cached++;
+         llvmpipe_add_shader_variant(lp, variant);
       }
    }
 
    /* Bind this variant */
+   lp->fs_fallback = variant && variant->async ? variant : NULL;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
 
+/**
+ * Called before each draw while a fallback fragment shader variant is
+ * bound, to pick up the optimized variant as soon as it is ready.
+ */
+void
+llvmpipe_update_fs_fallback(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *variant = lp->fs_fallback;
+
+   if (util_queue_fence_is_signalled(&variant->async->fence))
+      lp->dirty |= LP_NEW_FS;
+}
+
+
 void
 llvmpipe_init_fs_funcs(struct llvmpipe_context *llvmpipe)
 {
@@ -41,7 +41,9 @@
 #include "lp_jit.h"
 
 struct tgsi_token;
+struct nir_shader;
 struct lp_fragment_shader;
+struct lp_fs_variant_async;
 
 
 /** Indexes into jit_function[] array */
@@ -173,6 +175,14 @@ struct lp_fragment_shader_variant
 
    struct gallivm_state *gallivm;
 
+   /* Private LLVM context, for variants compiled on the fs compile queue */
+   LLVMContextRef context;
+
+   /* For fallback variants: the optimized variant being compiled in the
+    * background, which replaces this one once it is ready.
+    */
+   struct lp_fs_variant_async *async;
+
    LLVMTypeRef jit_context_type;
    LLVMTypeRef jit_context_ptr_type;
    LLVMTypeRef jit_thread_data_type;
@@ -227,6 +237,9 @@ struct lp_fragment_shader
 
    struct draw_fragment_shader *draw_data;
 
+   /* Hash of the IR as created, for the disk cache */
+   unsigned char ir_sha1[20];
+
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
    unsigned no;
@@ -252,8 +265,8 @@ void
 llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant);
 
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
-                                struct lp_fragment_shader *shader,
+llvmpipe_fs_variant_linear_llvm(struct lp_fragment_shader *shader,
+                                const struct nir_shader *nir,
                                 struct lp_fragment_shader_variant *variant);
 
 void
@@ -129,6 +129,7 @@ emit_fetch_texel_linear(const struct lp_build_sampler_aos *base,
 static LLVMValueRef
 llvm_fragment_body(struct lp_build_context *bld,
                    struct lp_fragment_shader *shader,
+                   const struct nir_shader *nir,
                    struct lp_fragment_shader_variant *variant,
                    struct linear_sampler* sampler,
                    LLVMValueRef *inputs_ptrs,
@@ -171,7 +172,7 @@ llvm_fragment_body(struct lp_build_context *bld,
                         &sampler->base,
                         &shader->info.base);
    } else {
-      nir_shader *clone = nir_shader_clone(NULL, shader->base.ir.nir);
+      nir_shader *clone = nir_shader_clone(NULL, nir);
       lp_build_nir_aos(gallivm, clone, fs_type,
                        bgra_swizzles,
                        consts_ptr, inputs, outputs,
@@ -240,10 +241,13 @@ llvm_fragment_body(struct lp_build_context *bld,
  * Generate a function that executes the fragment shader in a linear fashion.
  * The shader operates on unorm8[16] vectors.
  * See lp_state_fs_analysis for the "linear" conditions.
+ *
+ * For NIR shaders, \p nir is the NIR to translate, which is not necessarily
+ * the shader's own copy when compiling off the context thread.
  */
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
-                                struct lp_fragment_shader *shader,
+llvmpipe_fs_variant_linear_llvm(struct lp_fragment_shader *shader,
+                                const struct nir_shader *nir,
                                 struct lp_fragment_shader_variant *variant)
 {
    assert(shader->kind == LP_FS_KIND_BLIT_RGBA ||
@@ -472,9 +476,9 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
                                               loop.counter, 4);
 
       /* Perform fragment shader body */
-      value = llvm_fragment_body(&bld, shader, variant, &sampler, inputs_ptrs,
-                                 consts_ptr, blend_color, alpha_ref, fs_type,
-                                 value);
+      value = llvm_fragment_body(&bld, shader, nir, variant, &sampler,
+                                 inputs_ptrs, consts_ptr, blend_color,
+                                 alpha_ref, fs_type, value);
 
       /* Write 4 pixels */
       lp_build_pointer_set_unaligned(builder, color0_ptr, loop.counter,
@@ -518,7 +522,7 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
       buf = LLVMBuildLoad2(gallivm->builder, pixelt, buf_ptr, "");
       buf = LLVMBuildBitCast(builder, buf, bld.vec_type, "");
 
-      result = llvm_fragment_body(&bld, shader, variant, &sampler,
+      result = llvm_fragment_body(&bld, shader, nir, variant, &sampler,
                                   inputs_ptrs, consts_ptr, blend_color,
                                   alpha_ref, fs_type, buf);
       result = LLVMBuildBitCast(builder, result, pixelt, "");
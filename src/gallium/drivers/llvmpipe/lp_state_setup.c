@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
 #include "gallivm/lp_bld_const.h"
@@ -627,6 +628,20 @@ init_args(struct gallivm_state *gallivm,
 }
 
 
+static void
+lp_setup_get_ir_cache_key(const struct lp_setup_variant_key *key,
+                          unsigned char ir_sha1_cache_key[20])
+{
+   static const char tag[] = "setup";
+
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, tag, sizeof(tag));
+   _mesa_sha1_update(&ctx, key, key->size);
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+}
+
+
 /**
  * Generate the runtime callable function for the coefficient calculation.
  *
@@ -635,6 +650,7 @@ static struct lp_setup_variant *
 generate_setup_variant(struct lp_setup_variant_key *key,
                        struct llvmpipe_context *lp)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    int64_t t0 = 0, t1;
 
    if (0)
@@ -646,12 +662,22 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   char func_name[64];
-   snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "setup_variant_%u",
             variant->no);
 
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
+   lp_setup_get_ir_cache_key(key, ir_sha1_cache_key);
+
+   lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+   if (!cached.data_size)
+      needs_caching = true;
+
    struct gallivm_state *gallivm;
-   variant->gallivm = gallivm = gallivm_create(func_name, lp->context, NULL);
+   variant->gallivm = gallivm = gallivm_create(module_name, lp->context,
+                                               &cached);
    if (!variant->gallivm) {
       goto fail;
    }
@@ -686,47 +712,54 @@ generate_setup_variant(struct lp_setup_variant_key *key,
       LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                        arg_types, ARRAY_SIZE(arg_types), 0);
 
-   variant->function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   /* The function name ends up in cached objects, so it must not depend
+    * on the variant number.
+    */
+   variant->function = LLVMAddFunction(gallivm->module, "setup_variant",
+                                       func_type);
    if (!variant->function)
       goto fail;
 
    LLVMSetFunctionCallConv(variant->function, LLVMCCallConv);
 
-   struct lp_setup_args args;
-   args.vec4f_type = vec4f_type;
-   args.v0       = LLVMGetParam(variant->function, 0);
-   args.v1       = LLVMGetParam(variant->function, 1);
-   args.v2       = LLVMGetParam(variant->function, 2);
-   args.facing   = LLVMGetParam(variant->function, 3);
-   args.a0       = LLVMGetParam(variant->function, 4);
-   args.dadx     = LLVMGetParam(variant->function, 5);
-   args.dady     = LLVMGetParam(variant->function, 6);
-   args.key      = LLVMGetParam(variant->function, 7);
-
-   lp_build_name(args.v0, "in_v0");
-   lp_build_name(args.v1, "in_v1");
-   lp_build_name(args.v2, "in_v2");
-   lp_build_name(args.facing, "in_facing");
-   lp_build_name(args.a0, "out_a0");
-   lp_build_name(args.dadx, "out_dadx");
-   lp_build_name(args.dady, "out_dady");
-   lp_build_name(args.key, "key");
+   if (!cached.data_size) {
+      struct lp_setup_args args;
+      args.vec4f_type = vec4f_type;
+      args.v0       = LLVMGetParam(variant->function, 0);
+      args.v1       = LLVMGetParam(variant->function, 1);
+      args.v2       = LLVMGetParam(variant->function, 2);
+      args.facing   = LLVMGetParam(variant->function, 3);
+      args.a0       = LLVMGetParam(variant->function, 4);
+      args.dadx     = LLVMGetParam(variant->function, 5);
+      args.dady     = LLVMGetParam(variant->function, 6);
+      args.key      = LLVMGetParam(variant->function, 7);
+
+      lp_build_name(args.v0, "in_v0");
+      lp_build_name(args.v1, "in_v1");
+      lp_build_name(args.v2, "in_v2");
+      lp_build_name(args.facing, "in_facing");
+      lp_build_name(args.a0, "out_a0");
+      lp_build_name(args.dadx, "out_dadx");
+      lp_build_name(args.dady, "out_dady");
+      lp_build_name(args.key, "key");
 
-   /*
-    * Function body
-    */
-   LLVMBasicBlockRef block =
-      LLVMAppendBasicBlockInContext(gallivm->context,
-                                    variant->function, "entry");
-   LLVMPositionBuilderAtEnd(builder, block);
+      /*
+       * Function body
+       */
+      LLVMBasicBlockRef block =
+         LLVMAppendBasicBlockInContext(gallivm->context,
+                                       variant->function, "entry");
+      LLVMPositionBuilderAtEnd(builder, block);
 
-   set_noalias(builder, variant->function, arg_types, ARRAY_SIZE(arg_types));
-   init_args(gallivm, &variant->key, &args);
-   emit_tri_coef(gallivm, &variant->key, &args);
+      set_noalias(builder, variant->function, arg_types,
+                  ARRAY_SIZE(arg_types));
+      init_args(gallivm, &variant->key, &args);
+      emit_tri_coef(gallivm, &variant->key, &args);
 
-   LLVMBuildRetVoid(builder);
+      LLVMBuildRetVoid(builder);
 
-   gallivm_verify_function(gallivm, variant->function);
+      gallivm_verify_function(gallivm, variant->function);
+   }
 
    gallivm_compile_module(gallivm);
 
@@ -735,6 +768,10 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   }
+
    gallivm_free_ir(variant->gallivm);
 
    /*
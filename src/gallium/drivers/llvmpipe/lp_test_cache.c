@@ -0,0 +1,237 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Tests of the disk cache preloading (LP_CACHE_PRELOAD) over several
+ * sessions, each of them with its own screen.
+ */
+
+#include <ftw.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/disk_cache.h"
+#include "util/hash_table.h"
+#include "util/mesa-sha1.h"
+#include "lp_public.h"
+#include "lp_screen.h"
+#include "frontend/sw_winsys.h"
+
+#include "lp_test.h"
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "backend\n");
+
+   fflush(fp);
+}
+
+
+static struct llvmpipe_screen *
+create_screen(void)
+{
+   /* Nothing is displayed, the winsys is never called */
+   static struct sw_winsys winsys;
+
+   struct pipe_screen *screen = llvmpipe_create_screen(&winsys);
+   if (!screen)
+      return NULL;
+
+   struct llvmpipe_screen *lp_screen = llvmpipe_screen(screen);
+   if (!llvmpipe_screen_late_init(lp_screen) ||
+       !lp_screen->disk_shader_cache) {
+      screen->destroy(screen);
+      return NULL;
+   }
+
+   return lp_screen;
+}
+
+
+/* What creating a variant does with the disk cache */
+static void
+compile_variant(struct llvmpipe_screen *screen, const char *name)
+{
+   unsigned char ir_sha1[20];
+   struct lp_cached_code cached;
+
+   memset(&cached, 0, sizeof(cached));
+   _mesa_sha1_compute(name, strlen(name), ir_sha1);
+
+   lp_disk_cache_find_shader(screen, &cached, ir_sha1);
+   if (cached.data_size) {
+      free(cached.data);
+      return;
+   }
+
+   cached.data = (void *)name;
+   cached.data_size = strlen(name) + 1;
+   lp_disk_cache_insert_shader(screen, &cached, ir_sha1);
+}
+
+
+/* Look a variant up and check the code that was stored for it */
+static boolean
+find_variant(struct llvmpipe_screen *screen, const char *name)
+{
+   unsigned char ir_sha1[20];
+   struct lp_cached_code cached;
+   boolean found;
+
+   memset(&cached, 0, sizeof(cached));
+   _mesa_sha1_compute(name, strlen(name), ir_sha1);
+
+   lp_disk_cache_find_shader(screen, &cached, ir_sha1);
+   found = cached.data_size == strlen(name) + 1 &&
+           memcmp(cached.data, name, cached.data_size) == 0;
+   free(cached.data);
+
+   return found;
+}
+
+
+static boolean
+is_preloaded(struct llvmpipe_screen *screen, const char *name)
+{
+   unsigned char ir_sha1[20];
+   cache_key key;
+
+   /* Wait for the preloading to be done */
+   if (screen->cache_preload_thread_created) {
+      thrd_join(screen->cache_preload_thread, NULL);
+      screen->cache_preload_thread_created = false;
+   }
+
+   _mesa_sha1_compute(name, strlen(name), ir_sha1);
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1, 20, key);
+
+   return _mesa_hash_table_search(screen->cache_preloaded, key) != NULL;
+}
+
+
+static int
+remove_file(const char *path, const struct stat *sb, int type,
+            struct FTW *ftw)
+{
+   return remove(path);
+}
+
+
+/*
+ * The second session uses other variants than the first one, the third one
+ * has to preload those of the second session.
+ */
+static boolean
+test_preload_sessions(unsigned verbose, FILE *fp, const char *backend_env)
+{
+   static const char *first[] = { "variant a", "variant b" };
+   static const char *second[] = { "variant c", "variant d" };
+   const char *backend = backend_env ? backend_env : "multi-file";
+   struct llvmpipe_screen *screen;
+   char dir[] = "/tmp/lp_test_cache_XXXXXX";
+   boolean success = TRUE;
+   unsigned i;
+
+   if (!mkdtemp(dir))
+      return FALSE;
+
+   setenv("MESA_SHADER_CACHE_DIR", dir, 1);
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+   setenv("LP_CACHE_PRELOAD", "true", 1);
+   if (backend_env)
+      setenv(backend_env, "true", 1);
+
+   screen = create_screen();
+   if (!screen) {
+      /* Built without the shader cache */
+      goto out;
+   }
+   for (i = 0; i < ARRAY_SIZE(first); i++)
+      compile_variant(screen, first[i]);
+   screen->base.destroy(&screen->base);
+
+   screen = create_screen();
+   if (!screen) {
+      success = FALSE;
+      goto out;
+   }
+   for (i = 0; i < ARRAY_SIZE(second); i++)
+      compile_variant(screen, second[i]);
+   screen->base.destroy(&screen->base);
+
+   screen = create_screen();
+   if (!screen) {
+      success = FALSE;
+      goto out;
+   }
+   for (i = 0; i < ARRAY_SIZE(first); i++) {
+      if (is_preloaded(screen, first[i])) {
+         if (verbose)
+            fprintf(stderr, "%s: %s preloaded\n", backend, first[i]);
+         success = FALSE;
+      }
+   }
+   for (i = 0; i < ARRAY_SIZE(second); i++) {
+      if (!is_preloaded(screen, second[i])) {
+         if (verbose)
+            fprintf(stderr, "%s: %s not preloaded\n", backend, second[i]);
+         success = FALSE;
+      }
+      if (!find_variant(screen, second[i])) {
+         if (verbose)
+            fprintf(stderr, "%s: %s not found\n", backend, second[i]);
+         success = FALSE;
+      }
+   }
+   screen->base.destroy(&screen->base);
+
+out:
+   if (backend_env)
+      unsetenv(backend_env);
+   nftw(dir, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\n", success ? "pass" : "fail", backend);
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+
+   if (!test_preload_sessions(verbose, fp, NULL))
+      success = FALSE;
+   if (!test_preload_sessions(verbose, fp, "MESA_DISK_CACHE_DATABASE"))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
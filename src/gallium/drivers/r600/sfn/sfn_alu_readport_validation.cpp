@@ -227,6 +227,18 @@ AluReadportReservation::add_literal(uint32_t value)
    return false;
 }
 
+int
+AluReadportReservation::used_readports() const
+{
+   int used = m_nliterals;
+   for (int i = 0; i < max_chan_channels; ++i) {
+      for (int j = 0; j < max_gpr_readports; ++j)
+         used += m_hw_gpr[j][i] != -1;
+      used += m_hw_const_addr[i] != -1;
+   }
+   return used;
+}
+
 int
 AluReadportReservation::cycle_vec(AluBankSwizzle swz, int src)
 {
@@ -47,6 +47,10 @@ public:
 
    bool add_literal(uint32_t value);
 
+   /* Number of GPR read ports, constant read ports and literal slots
+    * that are reserved */
+   int used_readports() const;
+
    static int cycle_vec(AluBankSwizzle swz, int src);
    static int cycle_trans(AluBankSwizzle swz, int src);
 
@@ -65,6 +65,8 @@ static const struct debug_named_value sfn_debug_options[] = {
    {"opt",      SfnLog::opt,         "Log optimization"                     },
    {"steps",    SfnLog::steps,       "Log shaders at transformation steps"  },
    {"noopt",    SfnLog::noopt,       "Don't run backend optimizations"      },
+   {"packalu",  SfnLog::packalu,     "Pack ALU groups by read port cost"    },
+   {"schedstats", SfnLog::schedstats, "Log ALU slot usage after scheduling"},
    DEBUG_NAMED_VALUE_END
 };
 
@@ -69,7 +69,9 @@ public:
       all = (1 << 15) - 1,
       nomerge = 1 << 16,
       steps = 1 << 17,
-      noopt = 1 << 18
+      noopt = 1 << 18,
+      packalu = 1 << 19,
+      schedstats = 1 << 20
    };
 
    SfnLog();
@@ -103,6 +105,15 @@ public:
 
    int has_debug_flag(uint64_t flag) { return (m_log_mask & flag) == flag; }
 
+   /* Override a flag of R600_NIR_DEBUG, used by the unit tests */
+   void set_debug_flag(uint64_t flag, bool enable)
+   {
+      if (enable)
+         m_log_mask |= flag;
+      else
+         m_log_mask &= ~flag;
+   }
+
 private:
    uint64_t m_active_log_flags;
    uint64_t m_log_mask;
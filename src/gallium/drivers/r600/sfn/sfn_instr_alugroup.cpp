@@ -251,6 +251,31 @@ AluGroup::add_vec_instructions(AluInstr *instr)
    return false;
 }
 
+int
+AluGroup::vec_readport_cost(const AluInstr& instr) const
+{
+   int used = m_readports_evaluator.used_readports();
+   int cost = -1;
+
+   AluBankSwizzle bs = alu_vec_012;
+   AluBankSwizzle end = alu_vec_unknown;
+   if (instr.bank_swizzle() != alu_vec_unknown) {
+      bs = instr.bank_swizzle();
+      end = bs;
+      ++end;
+   }
+
+   for (; bs != end; ++bs) {
+      AluReadportReservation readports_evaluator = m_readports_evaluator;
+      if (readports_evaluator.schedule_vec_instruction(instr, bs)) {
+         int c = readports_evaluator.used_readports() - used;
+         if (cost < 0 || c < cost)
+            cost = c;
+      }
+   }
+   return cost;
+}
+
 void AluGroup::update_readport_reserver()
 {
    AluReadportReservation readports_evaluator;
@@ -45,6 +45,11 @@ public:
    bool add_trans_instructions(AluInstr *instr);
    bool add_vec_instructions(AluInstr *instr);
 
+   /* Number of read ports and literal slots that scheduling instr to a
+    * vector slot would add to this group, or -1 if the read ports can't
+    * be reserved with any bank swizzle */
+   int vec_readport_cost(const AluInstr& instr) const;
+
    bool is_equal_to(const AluGroup& other) const;
 
    void accept(ConstInstrVisitor& visitor) const override;
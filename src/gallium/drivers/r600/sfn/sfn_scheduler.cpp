@@ -35,7 +35,11 @@
 #include "sfn_instr_mem.h"
 #include "sfn_instr_tex.h"
 
+#include "util/u_math.h"
+
 #include <algorithm>
+#include <array>
+#include <set>
 #include <sstream>
 
 namespace r600 {
@@ -167,6 +171,7 @@ private:
    void start_new_block(Shader::ShaderBlocks& out_blocks, Block::Type type);
 
    bool schedule_alu_to_group_vec(AluGroup *group);
+   bool pack_alu_to_group_vec(AluGroup *group);
    bool schedule_alu_to_group_trans(AluGroup *group, std::list<AluInstr *>& readylist);
 
    bool schedule_exports(Shader::ShaderBlocks& out_blocks,
@@ -208,6 +213,11 @@ private:
    int m_lds_addr_count{0};
    int m_alu_groups_scheduled{0};
    r600_chip_class m_chip_class;
+
+   bool m_pack_alu;
+
+   /* Number of scheduled ALU groups by number of filled slots */
+   std::array<int, 6> m_alu_group_fill{};
 };
 
 Shader *
@@ -247,7 +257,8 @@ BlockScheduler::BlockScheduler(r600_chip_class chip_class):
     m_last_pixel(nullptr),
     m_last_param(nullptr),
     m_current_block(nullptr),
-    m_chip_class(chip_class)
+    m_chip_class(chip_class),
+    m_pack_alu(sfn_log.has_debug_flag(SfnLog::packalu))
 {
 }
 
@@ -468,6 +479,22 @@ BlockScheduler::finalize()
       m_last_pixel->set_is_last_export(true);
    if (m_last_param)
       m_last_param->set_is_last_export(true);
+
+   if (sfn_log.has_debug_flag(SfnLog::schedstats)) {
+      int max_slots = AluGroup::has_t() ? 5 : 4;
+      int groups = 0;
+      int used_slots = 0;
+      for (int i = 1; i <= max_slots; ++i) {
+         groups += m_alu_group_fill[i];
+         used_slots += i * m_alu_group_fill[i];
+      }
+
+      sfn_log << SfnLog::schedstats << "ALU groups: " << groups
+              << " slots: " << used_slots << "/" << groups * max_slots << " fill:";
+      for (int i = 1; i <= max_slots; ++i)
+         sfn_log << " " << i << ":" << m_alu_group_fill[i];
+      sfn_log << "\n";
+   }
 }
 
 bool
@@ -516,8 +543,12 @@ BlockScheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
    int free_slots = group->free_slots();
 
    while (free_slots && has_alu_ready) {
-      if (!alu_vec_ready.empty())
-         success |= schedule_alu_to_group_vec(group);
+      if (!alu_vec_ready.empty()) {
+         if (m_pack_alu)
+            success |= pack_alu_to_group_vec(group);
+         else
+            success |= schedule_alu_to_group_vec(group);
+      }
 
       /* Apparently one can't schedule a t-slot if there is already
        * and LDS instruction scheduled.
@@ -549,6 +580,8 @@ BlockScheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
    }
 
    sfn_log << SfnLog::schedule << "Finalize ALU group\n";
+   int slot_mask = AluGroup::has_t() ? 0x1f : 0xf;
+   ++m_alu_group_fill[util_bitcount(~group->free_slots() & slot_mask)];
    group->set_scheduled();
    group->fix_last_flag();
    group->set_nesting_depth(m_current_block->nesting_depth());
@@ -680,6 +713,73 @@ BlockScheduler::schedule_alu_to_group_vec(AluGroup *group)
    return success;
 }
 
+/* Fill the vector slots of the group by picking, among the ready
+ * instructions that still fit, the one with the best ratio of priority to
+ * read port cost. Taking the first instruction that fits may use up the
+ * read ports that other ready instructions would need, and then the group
+ * is finalized with empty slots. */
+bool
+BlockScheduler::pack_alu_to_group_vec(AluGroup *group)
+{
+   assert(group);
+   assert(!alu_vec_ready.empty());
+
+   /* One read port is worth a quarter of a register priority step */
+   const int readport_weight = 25;
+
+   bool success = false;
+   std::set<AluInstr *> failed;
+
+   while (group->free_slots() & 0xf) {
+      auto best = alu_vec_ready.end();
+      int best_score = 0;
+
+      for (auto i = alu_vec_ready.begin(); i != alu_vec_ready.end(); ++i) {
+         if (failed.find(*i) != failed.end())
+            continue;
+
+         int cost = group->vec_readport_cost(**i);
+         if (cost < 0)
+            continue;
+
+         /* Instructions whose channel is already taken must be moved to
+          * another channel, and that might not be possible */
+         if (group->begin()[(*i)->dest_chan()])
+            ++cost;
+
+         int score = (*i)->priority() - readport_weight * cost;
+         if (best == alu_vec_ready.end() || score > best_score) {
+            best = i;
+            best_score = score;
+         }
+      }
+
+      if (best == alu_vec_ready.end())
+         break;
+
+      sfn_log << SfnLog::schedule << "Try pack to vec " << **best;
+
+      if (!m_current_block->try_reserve_kcache(**best)) {
+         sfn_log << SfnLog::schedule << " failed (kcache)\n";
+         failed.insert(*best);
+         continue;
+      }
+
+      if (group->add_vec_instructions(*best)) {
+         if ((*best)->has_alu_flag(alu_is_lds))
+            --m_lds_addr_count;
+
+         alu_vec_ready.erase(best);
+         success = true;
+         sfn_log << SfnLog::schedule << " success\n";
+      } else {
+         failed.insert(*best);
+         sfn_log << SfnLog::schedule << " failed\n";
+      }
+   }
+   return success;
+}
+
 bool
 BlockScheduler::schedule_alu_to_group_trans(AluGroup *group,
                                            std::list<AluInstr *>& readylist)
@@ -348,6 +348,60 @@ TEST_F(InstrTest, test_alu_dot4_grouped)
    EXPECT_EQ(i, group->end());
 };
 
+TEST_F(InstrTest, test_alu_group_readport_cost)
+{
+   auto R1x = new Register(1, 0, pin_chan);
+   auto R1y = new Register(1, 1, pin_chan);
+   auto R2x = new Register(2, 0, pin_chan);
+   auto R3y = new Register(3, 1, pin_chan);
+   auto R4z = new Register(4, 2, pin_chan);
+
+   AluGroup group;
+
+   /* Inline constants don't use a read port */
+   EXPECT_EQ(group.vec_readport_cost(
+                AluInstr(op1_mov, R4z, new InlineConstant(ALU_SRC_1), {alu_write})),
+             0);
+
+   /* One GPR read port and one literal slot */
+   EXPECT_EQ(group.vec_readport_cost(
+                AluInstr(op2_add, R3y, R1x, new LiteralConstant(0x40000000), {alu_write})),
+             2);
+
+   auto muladd = new AluInstr(op3_muladd_ieee,
+                              R2x,
+                              new LiteralConstant(0x3f800001),
+                              new LiteralConstant(0x3f800002),
+                              new LiteralConstant(0x3f800003),
+                              {alu_write});
+   EXPECT_EQ(group.vec_readport_cost(*muladd), 3);
+   ASSERT_TRUE(group.add_instruction(muladd));
+
+   /* Literals already in the group are free, but only one literal slot is
+    * left */
+   EXPECT_EQ(group.vec_readport_cost(AluInstr(op2_add,
+                                              R3y,
+                                              new LiteralConstant(0x3f800001),
+                                              new LiteralConstant(0x3f800002),
+                                              {alu_write})),
+             0);
+   EXPECT_EQ(group.vec_readport_cost(AluInstr(op2_add,
+                                              R3y,
+                                              new LiteralConstant(0x40000001),
+                                              new LiteralConstant(0x3f800003),
+                                              {alu_write})),
+             1);
+   EXPECT_EQ(group.vec_readport_cost(AluInstr(op2_add,
+                                              R3y,
+                                              new LiteralConstant(0x40000001),
+                                              new LiteralConstant(0x40000002),
+                                              {alu_write})),
+             -1);
+
+   /* The GPR read port is shared by the sources in the same channel */
+   EXPECT_EQ(group.vec_readport_cost(AluInstr(op2_add, R3y, R1y, R1y, {alu_write})), 1);
+}
+
 #ifdef __cpp_exceptions
 TEST_F(InstrTest, test_alu_wrong_source_count)
 {
@@ -1,4 +1,5 @@
 
+#include "../sfn_debug.h"
 #include "../sfn_optimizer.h"
 #include "../sfn_ra.h"
 #include "../sfn_scheduler.h"
@@ -15,6 +16,24 @@ protected:
    void ra_check(Shader *s, const char *expect_str);
 };
 
+/* Enables a debug flag while in scope, and restores it even if a test
+ * assertion returns early */
+class ScopedDebugFlag {
+public:
+   ScopedDebugFlag(uint64_t flag):
+       m_flag(flag),
+       m_was_set(sfn_log.has_debug_flag(flag))
+   {
+      sfn_log.set_debug_flag(m_flag, true);
+   }
+
+   ~ScopedDebugFlag() { sfn_log.set_debug_flag(m_flag, m_was_set); }
+
+private:
+   uint64_t m_flag;
+   bool m_was_set;
+};
+
 TEST_F(TestShaderFromNir, SimpleDCE)
 {
    auto sh = from_string(red_triangle_fs_expect_from_nir);
@@ -419,6 +438,179 @@ BLOCK_END
 };
 
 
+/* The MULADD takes three of the four literal slots of the group, and when
+ * it is scheduled first neither ADD fits in the same group. Packing by read
+ * port cost schedules the two ADDs first and fills their slots. */
+TEST_F(TestShaderFromNir, ScheduleALUPackByReadportCost)
+{
+   const char *input =
+R"(FS
+CHIPCLASS EVERGREEN
+PROP MAX_COLOR_EXPORTS:1
+PROP COLOR_EXPORTS:1
+PROP COLOR_EXPORT_MASK:15
+PROP WRITE_ALL_COLORS:1
+OUTPUT LOC:0 NAME:1 MASK:15
+SHADER
+ALU MULADD_IEEE S1.x : L[0x3f800001] L[0x3f800002] L[0x3f800003] {WL}
+ALU ADD S2.y : L[0x40000001] L[0x40000002] {WL}
+ALU ADD S3.z : L[0x40400001] L[0x40400002] {WL}
+ALU MOV S4.x@group : S1.x {W}
+ALU MOV S4.y@group : S2.y {W}
+ALU MOV S4.z@group : S3.z {W}
+ALU MOV S4.w@group : I[1.0] {WL}
+EXPORT_DONE PIXEL 0 S4.xyzw
+)";
+
+   const char *expect_greedy =
+R"(FS
+CHIPCLASS EVERGREEN
+PROP MAX_COLOR_EXPORTS:1
+PROP COLOR_EXPORTS:1
+PROP COLOR_EXPORT_MASK:15
+PROP WRITE_ALL_COLORS:1
+OUTPUT LOC:0 NAME:1 MASK:15
+SHADER
+BLOCK_START
+ALU_GROUP_BEGIN
+  ALU MULADD_IEEE S1.x{s} : L[0x3f800001] L[0x3f800002] L[0x3f800003] {W}
+  ALU MOV S4.w@chgr{s} : I[1.0] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU MOV S4.x@chgr{s} : S1.x{s} {W}
+  ALU ADD S2.y{s} : L[0x40000001] L[0x40000002] {W}
+  ALU ADD S3.z{s} : L[0x40400001] L[0x40400002] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU MOV S4.y@chgr{s} : S2.y{s} {W}
+  ALU MOV S4.z@chgr{s} : S3.z{s} {WL}
+ALU_GROUP_END
+BLOCK_END
+BLOCK_START
+EXPORT_DONE PIXEL 0 S4.xyzw
+BLOCK_END
+)";
+
+   const char *expect_packed =
+R"(FS
+CHIPCLASS EVERGREEN
+PROP MAX_COLOR_EXPORTS:1
+PROP COLOR_EXPORTS:1
+PROP COLOR_EXPORT_MASK:15
+PROP WRITE_ALL_COLORS:1
+OUTPUT LOC:0 NAME:1 MASK:15
+SHADER
+BLOCK_START
+ALU_GROUP_BEGIN
+  ALU ADD S2.y{s} : L[0x40000001] L[0x40000002] {W}
+  ALU ADD S3.z{s} : L[0x40400001] L[0x40400002] {W}
+  ALU MOV S4.w@chgr{s} : I[1.0] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU MULADD_IEEE S1.x{s} : L[0x3f800001] L[0x3f800002] L[0x3f800003] {W}
+  ALU MOV S4.y@chgr{s} : S2.y{s} {W}
+  ALU MOV S4.z@chgr{s} : S3.z{s} {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU MOV S4.x@chgr{s} : S1.x{s} {WL}
+ALU_GROUP_END
+BLOCK_END
+BLOCK_START
+EXPORT_DONE PIXEL 0 S4.xyzw
+BLOCK_END
+)";
+
+   ra_check(schedule(from_string(input)), expect_greedy);
+
+   ScopedDebugFlag pack_alu(SfnLog::packalu);
+   ra_check(schedule(from_string(input)), expect_packed);
+}
+
+/* Two sets of four ADDs, each set shares four literals. Taken in order, two
+ * ADDs of different sets use up the literal slots of a group, so that only
+ * two slots of each group are used. Packing by read port cost keeps the
+ * instructions of a set together and needs half the groups. */
+TEST_F(TestShaderFromNir, ScheduleALUPackByReadportCostFewerGroups)
+{
+   const char *input =
+R"(FS
+CHIPCLASS EVERGREEN
+PROP MAX_COLOR_EXPORTS:1
+PROP COLOR_EXPORTS:1
+PROP COLOR_EXPORT_MASK:15
+PROP WRITE_ALL_COLORS:1
+OUTPUT LOC:0 NAME:1 MASK:15
+SHADER
+ALU ADD S1.x@free : L[0x3f800001] L[0x3f800002] {WL}
+ALU ADD S2.x@free : L[0x40000001] L[0x40000002] {WL}
+ALU ADD S3.y@free : L[0x3f800003] L[0x3f800004] {WL}
+ALU ADD S4.y@free : L[0x40000003] L[0x40000004] {WL}
+ALU ADD S5.z@free : L[0x3f800001] L[0x3f800003] {WL}
+ALU ADD S6.z@free : L[0x40000001] L[0x40000003] {WL}
+ALU ADD S7.w@free : L[0x3f800002] L[0x3f800004] {WL}
+ALU ADD S8.w@free : L[0x40000002] L[0x40000004] {WL}
+)";
+
+   const char *expect_greedy =
+R"(FS
+CHIPCLASS EVERGREEN
+PROP MAX_COLOR_EXPORTS:1
+PROP COLOR_EXPORTS:1
+PROP COLOR_EXPORT_MASK:15
+PROP WRITE_ALL_COLORS:1
+OUTPUT LOC:0 NAME:1 MASK:15
+SHADER
+BLOCK_START
+ALU_GROUP_BEGIN
+  ALU ADD S1.x : L[0x3f800001] L[0x3f800002] {W}
+  ALU ADD S2.y : L[0x40000001] L[0x40000002] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU ADD S4.x : L[0x40000003] L[0x40000004] {W}
+  ALU ADD S3.y : L[0x3f800003] L[0x3f800004] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU ADD S6.x : L[0x40000001] L[0x40000003] {W}
+  ALU ADD S5.y : L[0x3f800001] L[0x3f800003] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU ADD S8.x : L[0x40000002] L[0x40000004] {W}
+  ALU ADD S7.y : L[0x3f800002] L[0x3f800004] {WL}
+ALU_GROUP_END
+BLOCK_END
+)";
+
+   const char *expect_packed =
+R"(FS
+CHIPCLASS EVERGREEN
+PROP MAX_COLOR_EXPORTS:1
+PROP COLOR_EXPORTS:1
+PROP COLOR_EXPORT_MASK:15
+PROP WRITE_ALL_COLORS:1
+OUTPUT LOC:0 NAME:1 MASK:15
+SHADER
+BLOCK_START
+ALU_GROUP_BEGIN
+  ALU ADD S1.x : L[0x3f800001] L[0x3f800002] {W}
+  ALU ADD S3.y : L[0x3f800003] L[0x3f800004] {W}
+  ALU ADD S5.z : L[0x3f800001] L[0x3f800003] {W}
+  ALU ADD S7.w : L[0x3f800002] L[0x3f800004] {WL}
+ALU_GROUP_END
+ALU_GROUP_BEGIN
+  ALU ADD S2.x : L[0x40000001] L[0x40000002] {W}
+  ALU ADD S4.y : L[0x40000003] L[0x40000004] {W}
+  ALU ADD S6.z : L[0x40000001] L[0x40000003] {W}
+  ALU ADD S8.w : L[0x40000002] L[0x40000004] {WL}
+ALU_GROUP_END
+BLOCK_END
+)";
+
+   ra_check(schedule(from_string(input)), expect_greedy);
+
+   ScopedDebugFlag pack_alu(SfnLog::packalu);
+   ra_check(schedule(from_string(input)), expect_packed);
+}
+
 void
 TestShaderFromNir::check(Shader *s, const char *expect_orig)
 {
@@ -248,6 +248,12 @@ lvp_physical_device_init(struct lvp_physical_device *device,
    for (unsigned i = 0; i < ARRAY_SIZE(device->drv_options); i++)
       device->drv_options[i] = device->pscreen->get_compiler_options(device->pscreen, PIPE_SHADER_IR_NIR, i);
 
+   /* the disk cache is owned by the screen: pipeline cache objects missing
+    * from the in-memory cache are looked up (and stored) there too
+    */
+   if (device->pscreen->get_disk_shader_cache)
+      device->vk.disk_cache = device->pscreen->get_disk_shader_cache(device->pscreen);
+
    device->sync_timeline_type = vk_sync_timeline_get_type(&lvp_pipe_sync_type);
    device->sync_types[0] = &lvp_pipe_sync_type;
    device->sync_types[1] = &device->sync_timeline_type.sync;
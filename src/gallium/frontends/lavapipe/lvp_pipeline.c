@@ -552,17 +552,35 @@ lvp_shader_lower(struct lvp_device *pdevice, nir_shader *nir, struct lvp_shader
 
 static VkResult
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct vk_pipeline_cache *cache,
                          const VkPipelineShaderStageCreateInfo *sinfo)
 {
    struct lvp_device *pdevice = pipeline->device;
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= MESA_SHADER_COMPUTE && stage != MESA_SHADER_NONE);
    struct lvp_shader *shader = &pipeline->shaders[stage];
-   nir_shader *nir;
-   VkResult result = compile_spirv(pdevice, sinfo, &nir);
-   if (result == VK_SUCCESS)
-      lvp_shader_lower(pdevice, nir, shader, pipeline->layout);
-   return result;
+   nir_shader *nir = NULL;
+   unsigned char sha1[SHA1_DIGEST_LENGTH];
+
+   /* Only the SPIR-V -> NIR translation is cached: everything that depends
+    * on the pipeline layout happens in lvp_shader_lower(), which also fills
+    * in the per-shader access and inlining info, so it is always rerun.
+    */
+   if (cache) {
+      vk_pipeline_hash_shader_stage(sinfo, NULL, sha1);
+      nir = vk_pipeline_cache_lookup_nir(cache, sha1, sizeof(sha1),
+                                         pdevice->physical_device->drv_options[stage],
+                                         NULL, NULL);
+   }
+   if (!nir) {
+      VkResult result = compile_spirv(pdevice, sinfo, &nir);
+      if (result != VK_SUCCESS)
+         return result;
+      if (cache)
+         vk_pipeline_cache_add_nir(cache, sha1, sizeof(sha1), nir);
+   }
+   lvp_shader_lower(pdevice, nir, shader, pipeline->layout);
+   return VK_SUCCESS;
 }
 
 static void
@@ -809,7 +827,7 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
+                           struct vk_pipeline_cache *cache,
                            const VkGraphicsPipelineCreateInfo *pCreateInfo)
 {
    VkResult result;
@@ -897,7 +915,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, sinfo);
+      result = lvp_shader_compile_to_ir(pipeline, cache, sinfo);
       if (result != VK_SUCCESS)
          goto fail;
 
@@ -993,7 +1011,7 @@ lvp_graphics_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1061,7 +1079,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
+                          struct vk_pipeline_cache *cache,
                           const VkComputePipelineCreateInfo *pCreateInfo)
 {
    pipeline->device = device;
@@ -1071,7 +1089,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->is_compute_pipeline = true;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, &pCreateInfo->stage);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1090,7 +1108,7 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1259,7 +1277,7 @@ create_shader_object(struct lvp_device *device, const VkShaderCreateInfoEXT *pCr
       vk_free2(&device->vk.alloc, pAllocator, shader);
       return VK_NULL_HANDLE;
    }
-   nir_serialize(&shader->blob, nir, true);
+   nir_serialize_compressed(&shader->blob, nir, true);
    shader->shader_cso = lvp_shader_compile(device, shader, nir_shader_clone(NULL, nir));
    return lvp_shader_to_handle(shader);
 fail:
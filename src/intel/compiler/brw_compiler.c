@@ -27,7 +27,9 @@
 #include "dev/intel_debug.h"
 #include "compiler/nir/nir.h"
 #include "main/errors.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
+#include "util/u_queue.h"
 
 #define COMMON_OPTIONS                                                        \
    .lower_fdiv = true,                                                        \
@@ -102,6 +104,38 @@ static const struct nir_shader_compiler_options vector_nir_options = {
    .max_unroll_iterations = 32,
 };
 
+static void
+brw_compiler_destroy_simd_queue(void *queue)
+{
+   util_queue_destroy(queue);
+}
+
+static void
+brw_compiler_init_simd_queue(struct brw_compiler *compiler)
+{
+   if (!debug_get_bool_option("INTEL_PARALLEL_SIMD", true))
+      return;
+
+   const unsigned nr_cpus = util_get_cpu_caps()->nr_cpus;
+   if (nr_cpus <= 1)
+      return;
+
+   /* At most the two widest SIMD variants of a shader are handed off to the
+    * queue, the narrowest one is compiled by the calling thread.  Allow a few
+    * more threads for drivers compiling several shaders at once.
+    */
+   struct util_queue *queue = rzalloc(compiler, struct util_queue);
+   if (!util_queue_init(queue, "brw_simd", 16, MIN2(nr_cpus - 1, 4),
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_SCALE_THREADS, NULL)) {
+      ralloc_free(queue);
+      return;
+   }
+
+   ralloc_set_destructor(queue, brw_compiler_destroy_simd_queue);
+   compiler->simd_queue = queue;
+}
+
 struct brw_compiler *
 brw_compiler_create(void *mem_ctx, const struct intel_device_info *devinfo)
 {
@@ -116,6 +150,10 @@ brw_compiler_create(void *mem_ctx, const struct intel_device_info *devinfo)
       brw_vec4_alloc_reg_set(compiler);
 
    compiler->precise_trig = debug_get_bool_option("INTEL_PRECISE_TRIG", false);
+   compiler->fs_simd_by_perf =
+      debug_get_bool_option("INTEL_FS_SIMD_BY_PERF", false);
+
+   brw_compiler_init_simd_queue(compiler);
 
    compiler->use_tcs_multi_patch = devinfo->ver >= 12;
 
@@ -233,6 +271,9 @@ brw_get_compiler_config_value(const struct brw_compiler *compiler)
    insert_u64_bit(&config, compiler->precise_trig);
    bits++;
 
+   insert_u64_bit(&config, compiler->fs_simd_by_perf);
+   bits++;
+
    uint64_t mask = DEBUG_DISK_CACHE_MASK;
    bits += util_bitcount64(mask);
    while (mask != 0) {
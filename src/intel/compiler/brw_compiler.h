@@ -38,6 +38,7 @@ extern "C" {
 #endif
 
 struct ra_regs;
+struct util_queue;
 struct nir_shader;
 struct brw_program;
 struct shader_info;
@@ -94,6 +95,13 @@ struct brw_compiler {
     */
    bool precise_trig;
 
+   /**
+    * Emit a single fragment shader SIMD width, chosen by comparing the
+    * static performance estimates of every width that compiled, instead of
+    * leaving the choice between them to the hardware.
+    */
+   bool fs_simd_by_perf;
+
    /**
     * Is 3DSTATE_CONSTANT_*'s Constant Buffer 0 relative to Dynamic State
     * Base Address?  (If not, it's a normal GPU address.)
@@ -115,6 +123,13 @@ struct brw_compiler {
    bool indirect_ubos_use_sampler;
 
    struct nir_shader *clc_shader;
+
+   /**
+    * Thread pool on which the SIMD variants of fragment and compute shaders
+    * are compiled in parallel.  NULL if there's a single CPU or
+    * INTEL_PARALLEL_SIMD=false.
+    */
+   struct util_queue *simd_queue;
 };
 
 #define brw_shader_debug_log(compiler, data, fmt, ... ) do {    \
@@ -43,6 +43,7 @@
 #include "compiler/nir/nir_builder.h"
 #include "program/prog_parameter.h"
 #include "util/u_math.h"
+#include "util/u_queue.h"
 
 #include <memory>
 
@@ -606,6 +607,52 @@ fs_visitor::fail(const char *format, ...)
    va_end(va);
 }
 
+struct fs_perf_log_msg {
+   unsigned *id;
+   const char *msg;
+};
+
+/**
+ * Pass a message to compiler->shader_perf_log, or hold it back if the
+ * visitor runs on another thread.  The driver's callback expects to be
+ * called on the thread of the API call, and \p id, which it assigns the
+ * first time, is shared by every compile.
+ */
+void
+fs_visitor::perf_log(unsigned *id, const char *format, ...)
+{
+   va_list va;
+
+   va_start(va, format);
+   char *msg = ralloc_vasprintf(mem_ctx, format, va);
+   va_end(va);
+
+   if (defer_perf_log) {
+      const struct fs_perf_log_msg m = { id, msg };
+      util_dynarray_append(&deferred_perf_log, struct fs_perf_log_msg, m);
+   } else {
+      compiler->shader_perf_log(log_data, id, "%s", msg);
+   }
+}
+
+/**
+ * Log the messages held back by perf_log(), and stop holding them back.
+ */
+void
+fs_visitor::flush_perf_log()
+{
+   util_dynarray_foreach(&deferred_perf_log, struct fs_perf_log_msg, m)
+      compiler->shader_perf_log(log_data, m->id, "%s", m->msg);
+
+   util_dynarray_clear(&deferred_perf_log);
+   defer_perf_log = false;
+}
+
+#define fs_perf_log(fmt, ...) do {                              \
+   static unsigned id = 0;                                      \
+   perf_log(&id, fmt, ##__VA_ARGS__);                           \
+} while (0)
+
 /**
  * Mark this program as impossible to compile with dispatch width greater
  * than n.
@@ -624,9 +671,7 @@ fs_visitor::limit_dispatch_width(unsigned n, const char *msg)
       fail("%s", msg);
    } else {
       max_dispatch_width = MIN2(max_dispatch_width, n);
-      brw_shader_perf_log(compiler, log_data,
-                          "Shader dispatch width limited to SIMD%d: %s\n",
-                          n, msg);
+      fs_perf_log("Shader dispatch width limited to SIMD%d: %s\n", n, msg);
    }
 }
 
@@ -1103,6 +1148,17 @@ fs_visitor::import_uniforms(fs_visitor *v)
    this->uniforms = v->uniforms;
 }
 
+/**
+ * Lay out the uniforms ahead of running the visitor, so that the visitors
+ * for other SIMD widths can import them before this one has run.
+ */
+void
+fs_visitor::setup_uniforms()
+{
+   nir_setup_uniforms();
+   assign_constant_locations();
+}
+
 void
 fs_visitor::emit_fragcoord_interpolation(fs_reg wpos)
 {
@@ -6491,6 +6547,56 @@ fs_visitor::compute_max_register_pressure()
    return max_pressure;
 }
 
+/**
+ * Account for \p last_scratch bytes of scratch space per thread used by a
+ * variant of the shader in prog_data->total_scratch.
+ */
+static void
+update_total_scratch(const struct intel_device_info *devinfo,
+                     gl_shader_stage stage,
+                     struct brw_stage_prog_data *prog_data,
+                     unsigned last_scratch)
+{
+   ASSERTED unsigned max_scratch_size = 2 * 1024 * 1024;
+
+   /* Take the max of any previously compiled variant of the shader. In the
+    * case of bindless shaders with return parts, this will also take the
+    * max of all parts.
+    */
+   prog_data->total_scratch = MAX2(brw_get_scratch_size(last_scratch),
+                                   prog_data->total_scratch);
+
+   if (gl_shader_stage_is_compute(stage)) {
+      if (devinfo->platform == INTEL_PLATFORM_HSW) {
+         /* According to the MEDIA_VFE_STATE's "Per Thread Scratch Space"
+          * field documentation, Haswell supports a minimum of 2kB of
+          * scratch space for compute shaders, unlike every other stage
+          * and platform.
+          */
+         prog_data->total_scratch = MAX2(prog_data->total_scratch, 2048);
+      } else if (devinfo->ver <= 7) {
+         /* According to the MEDIA_VFE_STATE's "Per Thread Scratch Space"
+          * field documentation, platforms prior to Haswell measure scratch
+          * size linearly with a range of [1kB, 12kB] and 1kB granularity.
+          */
+         prog_data->total_scratch = ALIGN(last_scratch, 1024);
+         max_scratch_size = 12 * 1024;
+      }
+   }
+
+   /* We currently only support up to 2MB of scratch space.  If we
+    * need to support more eventually, the documentation suggests
+    * that we could allocate a larger buffer, and partition it out
+    * ourselves.  We'd just have to undo the hardware's address
+    * calculation by subtracting (FFTID * Per Thread Scratch Space)
+    * and then add FFTID * (Larger Per Thread Scratch Space).
+    *
+    * See 3D-Media-GPGPU Engine > Media GPGPU Pipeline >
+    * Thread Group Tracking > Local Memory/Scratch Space.
+    */
+   assert(prog_data->total_scratch < max_scratch_size);
+}
+
 void
 fs_visitor::allocate_registers(bool allow_spilling)
 {
@@ -6576,11 +6682,10 @@ fs_visitor::allocate_registers(bool allow_spilling)
       fail("Failure to register allocate.  Reduce number of "
            "live scalar values to avoid this.");
    } else if (spilled_any_registers) {
-      brw_shader_perf_log(compiler, log_data,
-                          "%s shader triggered register spilling.  "
-                          "Try reducing the number of live scalar "
-                          "values to improve performance.\n",
-                          stage_name);
+      fs_perf_log("%s shader triggered register spilling.  "
+                  "Try reducing the number of live scalar "
+                  "values to improve performance.\n",
+                  stage_name);
    }
 
    /* This must come after all optimization and register allocation, since
@@ -6596,46 +6701,8 @@ fs_visitor::allocate_registers(bool allow_spilling)
 
    schedule_instructions(SCHEDULE_POST);
 
-   if (last_scratch > 0) {
-      ASSERTED unsigned max_scratch_size = 2 * 1024 * 1024;
-
-      /* Take the max of any previously compiled variant of the shader. In the
-       * case of bindless shaders with return parts, this will also take the
-       * max of all parts.
-       */
-      prog_data->total_scratch = MAX2(brw_get_scratch_size(last_scratch),
-                                      prog_data->total_scratch);
-
-      if (gl_shader_stage_is_compute(stage)) {
-         if (devinfo->platform == INTEL_PLATFORM_HSW) {
-            /* According to the MEDIA_VFE_STATE's "Per Thread Scratch Space"
-             * field documentation, Haswell supports a minimum of 2kB of
-             * scratch space for compute shaders, unlike every other stage
-             * and platform.
-             */
-            prog_data->total_scratch = MAX2(prog_data->total_scratch, 2048);
-         } else if (devinfo->ver <= 7) {
-            /* According to the MEDIA_VFE_STATE's "Per Thread Scratch Space"
-             * field documentation, platforms prior to Haswell measure scratch
-             * size linearly with a range of [1kB, 12kB] and 1kB granularity.
-             */
-            prog_data->total_scratch = ALIGN(last_scratch, 1024);
-            max_scratch_size = 12 * 1024;
-         }
-      }
-
-      /* We currently only support up to 2MB of scratch space.  If we
-       * need to support more eventually, the documentation suggests
-       * that we could allocate a larger buffer, and partition it out
-       * ourselves.  We'd just have to undo the hardware's address
-       * calculation by subtracting (FFTID * Per Thread Scratch Space)
-       * and then add FFTID * (Larger Per Thread Scratch Space).
-       *
-       * See 3D-Media-GPGPU Engine > Media GPGPU Pipeline >
-       * Thread Group Tracking > Local Memory/Scratch Space.
-       */
-      assert(prog_data->total_scratch < max_scratch_size);
-   }
+   if (last_scratch > 0)
+      update_total_scratch(devinfo, stage, prog_data, last_scratch);
 
    lower_scoreboard();
 }
@@ -7433,6 +7500,238 @@ brw_nir_populate_wm_prog_data(const nir_shader *shader,
    brw_compute_flat_inputs(prog_data, shader);
 }
 
+/**
+ * Clone the compute shader and lower it for the given dispatch width.
+ */
+static nir_shader *
+brw_nir_for_cs_simd(const struct brw_compiler *compiler, void *mem_ctx,
+                    const nir_shader *nir,
+                    const struct brw_base_prog_key *key,
+                    unsigned dispatch_width, bool debug_enabled)
+{
+   nir_shader *shader = nir_shader_clone(mem_ctx, nir);
+   brw_nir_apply_key(shader, compiler, key, dispatch_width,
+                     true /* is_scalar */);
+
+   NIR_PASS(_, shader, brw_nir_lower_simd, dispatch_width);
+
+   /* Clean up after the local index and ID calculations. */
+   NIR_PASS(_, shader, nir_opt_constant_folding);
+   NIR_PASS(_, shader, nir_opt_dce);
+
+   brw_postprocess_nir(shader, compiler, true, debug_enabled,
+                       key->robust_buffer_access);
+
+   return shader;
+}
+
+namespace {
+
+/**
+ * A SIMD variant of a fragment or compute shader, compiled on
+ * compiler->simd_queue while the calling thread compiles another width.
+ *
+ * Which widths get compiled, and with which settings, depends on how the
+ * narrower ones went, so the variants are started on a guess.  The usual
+ * SIMD selection logic then runs unchanged and claims a variant only if it
+ * would have compiled the same thing, otherwise it compiles it again in
+ * place.  The NIR, the key and the uniform layout are shared read-only, but
+ * each variant gets its own memory context and its own copy of the
+ * prog_data, which claim() folds back into the real one.  The same goes for
+ * the perf log messages, which unclaimed variants never log.
+ */
+struct simd_variant {
+   simd_variant(const struct brw_compiler *compiler, void *log_data,
+                void *mem_ctx, const brw_base_prog_key *key,
+                const struct brw_stage_prog_data *prog_data,
+                const nir_shader *nir, fs_visitor *uniforms,
+                unsigned dispatch_width, bool allow_spilling,
+                bool use_rep_send, bool needs_register_pressure,
+                bool debug_enabled);
+   ~simd_variant();
+
+   void start();
+   void run();
+   bool claim(bool allow_spilling, struct brw_stage_prog_data *dst,
+              std::unique_ptr<fs_visitor> &out);
+
+   struct util_queue_fence fence;
+
+   const struct brw_compiler *compiler;
+   void *log_data;
+   void *parent_mem_ctx;
+   void *mem_ctx;
+   const brw_base_prog_key *key;
+   const nir_shader *nir;
+   fs_visitor *uniforms;
+   unsigned dispatch_width;
+   bool allow_spilling;
+   bool use_rep_send;
+   bool needs_register_pressure;
+   bool debug_enabled;
+
+   union {
+      struct brw_stage_prog_data base;
+      struct brw_wm_prog_data wm;
+      struct brw_cs_prog_data cs;
+   } prog_data;
+
+   std::unique_ptr<fs_visitor> v;
+   bool compiled;
+
+private:
+   bool started;
+
+   void stop();
+   void merge_prog_data(struct brw_stage_prog_data *dst) const;
+};
+
+simd_variant::simd_variant(const struct brw_compiler *compiler,
+                           void *log_data, void *mem_ctx,
+                           const brw_base_prog_key *key,
+                           const struct brw_stage_prog_data *prog_data,
+                           const nir_shader *nir, fs_visitor *uniforms,
+                           unsigned dispatch_width, bool allow_spilling,
+                           bool use_rep_send, bool needs_register_pressure,
+                           bool debug_enabled)
+   : compiler(compiler), log_data(log_data), parent_mem_ctx(mem_ctx),
+     mem_ctx(ralloc_context(NULL)), key(key), nir(nir), uniforms(uniforms),
+     dispatch_width(dispatch_width), allow_spilling(allow_spilling),
+     use_rep_send(use_rep_send),
+     needs_register_pressure(needs_register_pressure),
+     debug_enabled(debug_enabled), compiled(false), started(false)
+{
+   util_queue_fence_init(&fence);
+
+   if (nir->info.stage == MESA_SHADER_FRAGMENT)
+      this->prog_data.wm = *brw_wm_prog_data_const(prog_data);
+   else
+      this->prog_data.cs = *brw_cs_prog_data_const(prog_data);
+}
+
+simd_variant::~simd_variant()
+{
+   /* Don't bother compiling a variant nobody claimed. */
+   stop();
+   util_queue_fence_destroy(&fence);
+
+   /* The visitor's instructions have to live as long as the ones of the
+    * variants compiled in place.
+    */
+   ralloc_steal(parent_mem_ctx, mem_ctx);
+}
+
+static void
+run_simd_variant(void *job, void *gdata, int thread_index)
+{
+   ((simd_variant *) job)->run();
+}
+
+void
+simd_variant::start()
+{
+   util_queue_add_job(compiler->simd_queue, this, &fence, run_simd_variant,
+                      NULL, 0);
+   started = true;
+}
+
+void
+simd_variant::run()
+{
+   const nir_shader *shader = nir;
+
+   if (gl_shader_stage_is_compute(nir->info.stage)) {
+      shader = brw_nir_for_cs_simd(compiler, mem_ctx, nir, key,
+                                   dispatch_width, debug_enabled);
+   }
+
+   v = std::make_unique<fs_visitor>(compiler, log_data, mem_ctx, key,
+                                    &prog_data.base, shader, dispatch_width,
+                                    needs_register_pressure, debug_enabled);
+   v->import_uniforms(uniforms);
+
+   /* Only log for the variants that get claimed, on the calling thread. */
+   v->defer_perf_log = true;
+
+   if (nir->info.stage == MESA_SHADER_FRAGMENT)
+      compiled = v->run_fs(allow_spilling, use_rep_send);
+   else
+      compiled = v->run_cs(allow_spilling);
+}
+
+/**
+ * Take the variant off the queue if it hasn't started yet, otherwise wait
+ * for it to finish.
+ */
+void
+simd_variant::stop()
+{
+   if (started) {
+      util_queue_drop_job(compiler->simd_queue, &fence);
+      started = false;
+   }
+}
+
+/**
+ * Apply what the visitor wrote to its copy of the prog_data to \p dst, the
+ * same way as if it had been compiled in place.  What only depends on the
+ * NIR and the uniform layout is the same for every width and already set by
+ * the variants that were.
+ */
+void
+simd_variant::merge_prog_data(struct brw_stage_prog_data *dst) const
+{
+   dst->has_ubo_pull |= prog_data.base.has_ubo_pull;
+
+   if (compiled) {
+      dst->curb_read_length = prog_data.base.curb_read_length;
+
+      if (v->last_scratch > 0) {
+         update_total_scratch(compiler->devinfo, nir->info.stage, dst,
+                              v->last_scratch);
+      }
+   }
+
+   if (nir->info.stage == MESA_SHADER_FRAGMENT) {
+      struct brw_wm_prog_data *wm_dst = brw_wm_prog_data(dst);
+
+      wm_dst->has_side_effects |= prog_data.wm.has_side_effects;
+      wm_dst->uses_nonperspective_interp_modes |=
+         prog_data.wm.uses_nonperspective_interp_modes;
+      wm_dst->pulls_bary |= prog_data.wm.pulls_bary;
+   } else {
+      struct brw_cs_prog_data *cs_dst = brw_cs_prog_data(dst);
+
+      cs_dst->uses_barrier |= prog_data.cs.uses_barrier;
+      cs_dst->uses_num_work_groups |= prog_data.cs.uses_num_work_groups;
+   }
+}
+
+/**
+ * Take over the variant if it was compiled the way the caller would compile
+ * it now.  On success \p out holds the visitor and \p dst is updated.
+ */
+bool
+simd_variant::claim(bool allow_spilling, struct brw_stage_prog_data *dst,
+                    std::unique_ptr<fs_visitor> &out)
+{
+   if (allow_spilling != this->allow_spilling)
+      return false;
+
+   /* Compile it here if no thread got to it yet. */
+   stop();
+   if (!v)
+      run();
+
+   merge_prog_data(dst);
+   v->flush_perf_log();
+   out = std::move(v);
+
+   return true;
+}
+
+} /* anonymous namespace */
+
 /**
  * Pre-gfx6, the register file of the EUs was shared between threads,
  * and each thread used some subset allocated on a 16-register block
@@ -7444,6 +7743,23 @@ brw_register_blocks(int reg_count)
    return ALIGN(reg_count, 16) / 16 - 1;
 }
 
+/**
+ * Estimate the invocations-per-cycle an EU gets out of a fragment shader
+ * with all of its hardware threads busy: the latency of each thread overlaps
+ * with the others until one of the units they share saturates.  Every thread
+ * gets its own register file regardless of the dispatch width, so the
+ * occupancy is the same for all widths, but a wider variant needs fewer
+ * threads in flight to saturate the EU.
+ */
+static float
+brw_fs_eu_throughput(const struct intel_device_info *devinfo,
+                     const performance &perf, unsigned dispatch_width)
+{
+   return MIN2(devinfo->num_thread_per_eu * dispatch_width /
+               float(MAX2(perf.latency, 1u)),
+               perf.saturated_throughput);
+}
+
 const unsigned *
 brw_compile_fs(const struct brw_compiler *compiler,
                void *mem_ctx,
@@ -7499,6 +7815,34 @@ brw_compile_fs(const struct brw_compiler *compiler,
                                      &prog_data->base, nir, 8,
                                      params->stats != NULL,
                                      debug_enabled);
+
+   /* Compile SIMD16 and SIMD32 on the thread pool while SIMD8 compiles
+    * here, guessing that the narrower widths compile without spilling.
+    */
+   std::unique_ptr<simd_variant> s16, s32;
+   if (compiler->simd_queue && !debug_enabled) {
+      v8->setup_uniforms();
+
+      if (INTEL_SIMD(FS, 16) || params->use_rep_send) {
+         s16 = std::make_unique<simd_variant>(
+            compiler, params->log_data, mem_ctx, &key->base, &prog_data->base,
+            nir, v8.get(), 16, allow_spilling && !INTEL_SIMD(FS, 8),
+            params->use_rep_send, params->stats != NULL, debug_enabled);
+         s16->start();
+      }
+
+      if (!params->use_rep_send && devinfo->ver >= 6 &&
+          !key->coarse_pixel && nir->info.ray_queries == 0 &&
+          INTEL_SIMD(FS, 32)) {
+         s32 = std::make_unique<simd_variant>(
+            compiler, params->log_data, mem_ctx, &key->base, &prog_data->base,
+            nir, v8.get(), 32,
+            allow_spilling && !INTEL_SIMD(FS, 8) && !INTEL_SIMD(FS, 16),
+            false, params->stats != NULL, debug_enabled);
+         s32->start();
+      }
+   }
+
    if (!v8->run_fs(allow_spilling, false /* do_rep_send */)) {
       params->error_str = ralloc_strdup(mem_ctx, v8->fail_msg);
       return NULL;
@@ -7538,12 +7882,18 @@ brw_compile_fs(const struct brw_compiler *compiler,
        v8->max_dispatch_width >= 16 &&
        (INTEL_SIMD(FS, 16) || params->use_rep_send)) {
       /* Try a SIMD16 compile */
-      v16 = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx, &key->base,
-                                         &prog_data->base, nir, 16,
-                                         params->stats != NULL,
-                                         debug_enabled);
-      v16->import_uniforms(v8.get());
-      if (!v16->run_fs(allow_spilling, params->use_rep_send)) {
+      bool compiled;
+      if (s16 && s16->claim(allow_spilling, &prog_data->base, v16)) {
+         compiled = s16->compiled;
+      } else {
+         v16 = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx, &key->base,
+                                            &prog_data->base, nir, 16,
+                                            params->stats != NULL,
+                                            debug_enabled);
+         v16->import_uniforms(v8.get());
+         compiled = v16->run_fs(allow_spilling, params->use_rep_send);
+      }
+      if (!compiled) {
          brw_shader_perf_log(compiler, params->log_data,
                              "SIMD16 shader failed to compile: %s\n",
                              v16->fail_msg);
@@ -7566,19 +7916,26 @@ brw_compile_fs(const struct brw_compiler *compiler,
        devinfo->ver >= 6 && !simd16_failed &&
        INTEL_SIMD(FS, 32)) {
       /* Try a SIMD32 compile */
-      v32 = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx, &key->base,
-                                         &prog_data->base, nir, 32,
-                                         params->stats != NULL,
-                                         debug_enabled);
-      v32->import_uniforms(v8.get());
-      if (!v32->run_fs(allow_spilling, false)) {
+      bool compiled;
+      if (s32 && s32->claim(allow_spilling, &prog_data->base, v32)) {
+         compiled = s32->compiled;
+      } else {
+         v32 = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx, &key->base,
+                                            &prog_data->base, nir, 32,
+                                            params->stats != NULL,
+                                            debug_enabled);
+         v32->import_uniforms(v8.get());
+         compiled = v32->run_fs(allow_spilling, false);
+      }
+      if (!compiled) {
          brw_shader_perf_log(compiler, params->log_data,
                              "SIMD32 shader failed to compile: %s\n",
                              v32->fail_msg);
       } else {
          const performance &perf = v32->performance_analysis.require();
 
-         if (!INTEL_DEBUG(DEBUG_DO32) && throughput > perf.throughput) {
+         if (!INTEL_DEBUG(DEBUG_DO32) && !compiler->fs_simd_by_perf &&
+             throughput > perf.throughput) {
             brw_shader_perf_log(compiler, params->log_data,
                                 "SIMD32 shader inefficient\n");
          } else {
@@ -7590,6 +7947,60 @@ brw_compile_fs(const struct brw_compiler *compiler,
       }
    }
 
+   /* Instead of letting the hardware pick between the compiled widths, only
+    * keep the one expected to get the most work done per EU.
+    */
+   if (compiler->fs_simd_by_perf && !params->use_rep_send &&
+       devinfo->ver >= 6) {
+      cfg_t **cfgs[] = { &simd8_cfg, &simd16_cfg, &simd32_cfg };
+      fs_visitor *visitors[] = { v8.get(), v16.get(), v32.get() };
+      float eu_throughput[3] = {};
+      int best = -1;
+
+      /* On a tie prefer the wider variant, it needs fewer threads to be
+       * dispatched for the same work.
+       */
+      for (int i = 0; i < 3; i++) {
+         if (*cfgs[i]) {
+            eu_throughput[i] = brw_fs_eu_throughput(
+               devinfo, visitors[i]->performance_analysis.require(), 8 << i);
+            if (best < 0 || eu_throughput[i] >= eu_throughput[best])
+               best = i;
+         }
+      }
+
+      /* SIMD32 dispatch gets disabled with some multisampling modes, keep the
+       * best of the narrower widths around for those.  On Gfx12+ it's always
+       * needed, from the page on "Structure_3DSTATE_PS_BODY":
+       *
+       *  "SIMD32 may only be enabled if SIMD16 or (dual)SIMD8 is also
+       *   enabled."
+       */
+      int fallback = -1;
+      if (best == 2 &&
+          (devinfo->ver >= 12 || key->multisample_fbo != BRW_NEVER)) {
+         for (int i = 0; i < 2; i++) {
+            if (*cfgs[i] && (fallback < 0 ||
+                             eu_throughput[i] >= eu_throughput[fallback]))
+               fallback = i;
+         }
+      }
+
+      if (best >= 0) {
+         for (int i = 0; i < 3; i++) {
+            if (i != best && i != fallback)
+               *cfgs[i] = NULL;
+         }
+
+         brw_shader_perf_log(compiler, params->log_data,
+                             "SIMD%d chosen by performance estimate "
+                             "(SIMD8: %f, SIMD16: %f, SIMD32: %f "
+                             "invocations/cycle per EU)\n", 8 << best,
+                             eu_throughput[0], eu_throughput[1],
+                             eu_throughput[2]);
+      }
+   }
+
    /* When the caller requests a repclear shader, they want SIMD16-only */
    if (params->use_rep_send)
       simd8_cfg = NULL;
@@ -7833,37 +8244,81 @@ brw_compile_cs(const struct brw_compiler *compiler,
 
    std::unique_ptr<fs_visitor> v[3];
 
+   /* Compile the widths the loop below is going to ask for, if none of them
+    * spills, in parallel.  The narrowest one is compiled on this thread.
+    */
+   std::unique_ptr<fs_visitor> uniforms;
+   std::unique_ptr<simd_variant> variants[3];
+   if (compiler->simd_queue && !debug_enabled) {
+      uniforms = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx,
+                                              &key->base, &prog_data->base, nir, 8,
+                                              false, debug_enabled);
+      uniforms->setup_uniforms();
+
+      void *guess_ctx = ralloc_context(NULL);
+      struct brw_cs_prog_data guess_prog_data = *prog_data;
+      brw_simd_selection_state guess{
+         .mem_ctx = guess_ctx,
+         .devinfo = compiler->devinfo,
+         .prog_data = &guess_prog_data,
+         .required_width = simd_state.required_width,
+      };
+
+      int first = -1;
+      for (unsigned simd = 0; simd < 3; simd++) {
+         if (!brw_simd_should_compile(guess, simd))
+            continue;
+
+         variants[simd] = std::make_unique<simd_variant>(
+            compiler, params->log_data, mem_ctx, &key->base, &prog_data->base,
+            nir, uniforms.get(), 8u << simd,
+            first < 0 || nir->info.workgroup_size_variable, false,
+            params->stats != NULL, debug_enabled);
+         if (first >= 0)
+            variants[simd]->start();
+         else
+            first = simd;
+
+         brw_simd_mark_compiled(guess, simd, false);
+      }
+
+      ralloc_free(guess_ctx);
+
+      if (first >= 0)
+         variants[first]->run();
+   }
+
    for (unsigned simd = 0; simd < 3; simd++) {
       if (!brw_simd_should_compile(simd_state, simd))
          continue;
 
       const unsigned dispatch_width = 8u << simd;
+      const int first = brw_simd_first_compiled(simd_state);
+      const bool allow_spilling = first < 0 || nir->info.workgroup_size_variable;
 
-      nir_shader *shader = nir_shader_clone(mem_ctx, nir);
-      brw_nir_apply_key(shader, compiler, &key->base,
-                        dispatch_width, true /* is_scalar */);
-
-      NIR_PASS(_, shader, brw_nir_lower_simd, dispatch_width);
-
-      /* Clean up after the local index and ID calculations. */
-      NIR_PASS(_, shader, nir_opt_constant_folding);
-      NIR_PASS(_, shader, nir_opt_dce);
+      bool compiled;
+      if (variants[simd] &&
+          variants[simd]->claim(allow_spilling, &prog_data->base, v[simd])) {
+         compiled = variants[simd]->compiled;
+      } else {
+         nir_shader *shader =
+            brw_nir_for_cs_simd(compiler, mem_ctx, nir, &key->base,
+                                dispatch_width, debug_enabled);
 
-      brw_postprocess_nir(shader, compiler, true, debug_enabled,
-                          key->base.robust_buffer_access);
+         v[simd] = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx, &key->base,
+                                                &prog_data->base, shader, dispatch_width,
+                                                params->stats != NULL,
+                                                debug_enabled);
 
-      v[simd] = std::make_unique<fs_visitor>(compiler, params->log_data, mem_ctx, &key->base,
-                                             &prog_data->base, shader, dispatch_width,
-                                             params->stats != NULL,
-                                             debug_enabled);
+         if (uniforms)
+            v[simd]->import_uniforms(uniforms.get());
+         else if (first >= 0)
+            v[simd]->import_uniforms(v[first].get());
 
-      const int first = brw_simd_first_compiled(simd_state);
-      if (first >= 0)
-         v[simd]->import_uniforms(v[first].get());
-
-      const bool allow_spilling = first < 0 || nir->info.workgroup_size_variable;
+         compiled = v[simd]->run_cs(allow_spilling);
+      }
 
-      if (v[simd]->run_cs(allow_spilling)) {
+      if (compiled) {
          cs_fill_push_const_info(compiler->devinfo, prog_data);
 
          brw_simd_mark_compiled(simd_state, simd, v[simd]->spilled_any_registers);
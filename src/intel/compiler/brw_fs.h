@@ -34,6 +34,7 @@
 #include "brw_fs_live_variables.h"
 #include "brw_ir_performance.h"
 #include "compiler/nir/nir.h"
+#include "util/u_dynarray.h"
 
 struct bblock_t;
 namespace {
@@ -203,6 +204,7 @@ public:
 
    fs_reg vgrf(const glsl_type *const type);
    void import_uniforms(fs_visitor *v);
+   void setup_uniforms();
 
    void VARYING_PULL_CONSTANT_LOAD(const brw::fs_builder &bld,
                                    const fs_reg &dst,
@@ -276,6 +278,8 @@ public:
                                                      fs_inst *inst);
    void vfail(const char *msg, va_list args);
    void fail(const char *msg, ...);
+   void perf_log(unsigned *id, const char *msg, ...) PRINTFLIKE(3, 4);
+   void flush_perf_log();
    void limit_dispatch_width(unsigned n, const char *msg);
    void lower_uniform_pull_constant_loads();
    bool lower_load_payload();
@@ -469,6 +473,13 @@ public:
    bool failed;
    char *fail_msg;
 
+   /**
+    * Whether perf_log() holds the messages back in deferred_perf_log until
+    * flush_perf_log(), for SIMD variants compiled on another thread.
+    */
+   bool defer_perf_log;
+   struct util_dynarray deferred_perf_log;
+
    thread_payload *payload_;
 
    thread_payload &payload() {
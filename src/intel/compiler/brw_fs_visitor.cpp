@@ -1412,6 +1412,9 @@ fs_visitor::init()
    this->failed = false;
    this->fail_msg = NULL;
 
+   this->defer_perf_log = false;
+   util_dynarray_init(&this->deferred_perf_log, this->mem_ctx);
+
    this->nir_locals = NULL;
    this->nir_ssa_values = NULL;
    this->nir_system_values = NULL;
@@ -1647,6 +1647,9 @@ namespace {
 
       p.latency = elapsed;
       p.throughput = dispatch_width * calculate_thread_throughput(st, elapsed);
+      /* At least one cycle per thread, in case no shared unit is used. */
+      p.saturated_throughput =
+         dispatch_width * calculate_thread_throughput(st, 1);
    }
 }
 
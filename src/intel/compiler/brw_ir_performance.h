@@ -76,6 +76,14 @@ namespace brw {
        */
       float throughput;
 
+      /**
+       * Estimate of the throughput of the whole program in
+       * invocations-per-cycle units with enough threads in flight to hide
+       * its latency completely, i.e. only limited by the busiest shared
+       * unit.
+       */
+      float saturated_throughput;
+
    private:
       performance(const performance &perf);
       performance &
@@ -0,0 +1,312 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+#include <stdarg.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "brw_compiler.h"
+#include "brw_nir.h"
+#include "compiler/glsl_types.h"
+#include "compiler/nir/nir_builder.h"
+#include "dev/intel_debug.h"
+#include "dev/intel_device_info.h"
+#include "util/ralloc.h"
+#include "util/u_queue.h"
+
+/*
+ * Compiles the same shaders with the SIMD variants compiled on
+ * compiler->simd_queue and with INTEL_PARALLEL_SIMD=false, and checks that
+ * the code, the prog_data and the perf log messages are the same.
+ */
+
+namespace {
+
+struct perf_log {
+   std::thread::id thread;
+   std::vector<std::string> messages;
+   bool other_thread;
+};
+
+void
+test_debug_log(void *data, unsigned *id, const char *fmt, ...)
+{
+}
+
+void
+test_perf_log(void *data, unsigned *id, const char *fmt, ...)
+{
+   struct perf_log *log = (struct perf_log *) data;
+   va_list args;
+
+   va_start(args, fmt);
+   char *msg = ralloc_vasprintf(NULL, fmt, args);
+   va_end(args);
+
+   log->messages.push_back(msg);
+   if (std::this_thread::get_id() != log->thread)
+      log->other_thread = true;
+
+   ralloc_free(msg);
+}
+
+struct compile_result {
+   std::vector<uint8_t> code;
+   std::vector<uint8_t> prog_data;
+   std::vector<std::string> messages;
+   bool other_thread;
+};
+
+/* What's left of the prog_data once the pointers are cleared */
+template<typename T>
+std::vector<uint8_t>
+prog_data_bytes(T prog_data)
+{
+   prog_data.base.relocs = NULL;
+   prog_data.base.param = NULL;
+
+   const uint8_t *bytes = (const uint8_t *) &prog_data;
+   return std::vector<uint8_t>(bytes, bytes + sizeof(prog_data));
+}
+
+/* Values that are all live at the end, so that the wide variants spill or
+ * fail once there are enough of them.
+ */
+nir_ssa_def *
+build_live_values(nir_builder *b, nir_ssa_def *x, unsigned count)
+{
+   std::vector<nir_ssa_def *> values;
+
+   for (unsigned i = 0; i < count; i++) {
+      nir_ssa_def *prev = values.empty() ? x : values.back();
+      values.push_back(nir_ffma(b, prev, nir_imm_float(b, 1.0 + i * 0.25),
+                                nir_fsin(b, x)));
+   }
+
+   nir_ssa_def *sum = x;
+   for (unsigned i = 0; i < count; i++)
+      sum = nir_fmul(b, nir_fadd(b, sum, values[count - 1 - i]), x);
+
+   return sum;
+}
+
+class parallel_simd_test : public ::testing::TestWithParam<int> {
+protected:
+   parallel_simd_test();
+   ~parallel_simd_test();
+
+   struct brw_compiler *create_compiler(bool parallel);
+   compile_result compile_fs(bool parallel, unsigned size);
+   compile_result compile_cs(bool parallel, unsigned size, bool variable);
+
+   void *mem_ctx;
+   struct intel_device_info devinfo;
+   struct util_queue queue;
+   bool has_queue;
+};
+
+parallel_simd_test::parallel_simd_test()
+   : has_queue(false)
+{
+   mem_ctx = ralloc_context(NULL);
+   glsl_type_singleton_init_or_ref();
+   brw_process_intel_debug_variable();
+}
+
+parallel_simd_test::~parallel_simd_test()
+{
+   ralloc_free(mem_ctx);
+   if (has_queue)
+      util_queue_destroy(&queue);
+   glsl_type_singleton_decref();
+}
+
+struct brw_compiler *
+parallel_simd_test::create_compiler(bool parallel)
+{
+   setenv("INTEL_PARALLEL_SIMD", parallel ? "true" : "false", 1);
+   struct brw_compiler *compiler = brw_compiler_create(mem_ctx, &devinfo);
+   unsetenv("INTEL_PARALLEL_SIMD");
+
+   compiler->shader_debug_log = test_debug_log;
+   compiler->shader_perf_log = test_perf_log;
+
+   if (!parallel) {
+      EXPECT_EQ(compiler->simd_queue, nullptr);
+   } else if (!compiler->simd_queue) {
+      /* Single CPU hosts don't get a queue, use one anyway. */
+      if (!has_queue) {
+         has_queue = util_queue_init(&queue, "brw_simd_test", 16, 2,
+                                     UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+      }
+      if (has_queue)
+         compiler->simd_queue = &queue;
+   }
+
+   return compiler;
+}
+
+compile_result
+parallel_simd_test::compile_fs(bool parallel, unsigned size)
+{
+   const struct brw_compiler *compiler = create_compiler(parallel);
+   struct perf_log log = { std::this_thread::get_id(), {}, false };
+
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT,
+         compiler->nir_options[MESA_SHADER_FRAGMENT], "parallel_simd_test");
+   nir_variable *color =
+      nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                          "gl_FragColor");
+   color->data.location = FRAG_RESULT_COLOR;
+
+   nir_ssa_def *coord = nir_load_frag_coord(&b);
+   nir_store_var(&b, color, build_live_values(&b, coord, size), 0xf);
+
+   struct brw_nir_compiler_opts opts = {};
+   brw_preprocess_nir(compiler, b.shader, &opts);
+   nir_shader_gather_info(b.shader, nir_shader_get_entrypoint(b.shader));
+
+   struct brw_wm_prog_key key;
+   memset(&key, 0, sizeof(key));
+   key.nr_color_regions = 1;
+   for (unsigned i = 0; i < BRW_MAX_SAMPLERS; i++)
+      key.base.tex.swizzles[i] = SWIZZLE_XYZW;
+   if (devinfo.ver < 6)
+      key.input_slots_valid = b.shader->info.inputs_read | VARYING_BIT_POS;
+
+   struct brw_wm_prog_data prog_data;
+   memset(&prog_data, 0, sizeof(prog_data));
+
+   struct brw_compile_fs_params params = {};
+   params.nir = b.shader;
+   params.key = &key;
+   params.prog_data = &prog_data;
+   params.allow_spilling = true;
+   params.log_data = &log;
+
+   const uint8_t *code =
+      (const uint8_t *) brw_compile_fs(compiler, b.shader, &params);
+   EXPECT_NE(code, nullptr) << params.error_str;
+
+   compile_result result;
+   if (code)
+      result.code.assign(code, code + prog_data.base.program_size);
+   result.prog_data = prog_data_bytes(prog_data);
+   result.messages = log.messages;
+   result.other_thread = log.other_thread;
+
+   ralloc_free(b.shader);
+   return result;
+}
+
+compile_result
+parallel_simd_test::compile_cs(bool parallel, unsigned size, bool variable)
+{
+   const struct brw_compiler *compiler = create_compiler(parallel);
+   struct perf_log log = { std::this_thread::get_id(), {}, false };
+
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_COMPUTE,
+                                     compiler->nir_options[MESA_SHADER_COMPUTE],
+                                     "parallel_simd_test");
+   b.shader->info.workgroup_size_variable = variable;
+   if (!variable) {
+      b.shader->info.workgroup_size[0] = 64;
+      b.shader->info.workgroup_size[1] = 1;
+      b.shader->info.workgroup_size[2] = 1;
+   }
+
+   nir_ssa_def *x = nir_u2f32(&b, nir_load_subgroup_invocation(&b));
+   nir_store_global(&b, nir_imm_int64(&b, 0x1000), 4,
+                    build_live_values(&b, x, size), 0x1);
+
+   struct brw_nir_compiler_opts opts = {};
+   brw_preprocess_nir(compiler, b.shader, &opts);
+   nir_shader_gather_info(b.shader, nir_shader_get_entrypoint(b.shader));
+
+   struct brw_cs_prog_key key;
+   memset(&key, 0, sizeof(key));
+   for (unsigned i = 0; i < BRW_MAX_SAMPLERS; i++)
+      key.base.tex.swizzles[i] = SWIZZLE_XYZW;
+
+   struct brw_cs_prog_data prog_data;
+   memset(&prog_data, 0, sizeof(prog_data));
+
+   struct brw_compile_cs_params params = {};
+   params.nir = b.shader;
+   params.key = &key;
+   params.prog_data = &prog_data;
+   params.log_data = &log;
+
+   const uint8_t *code =
+      (const uint8_t *) brw_compile_cs(compiler, b.shader, &params);
+   EXPECT_NE(code, nullptr) << params.error_str;
+
+   compile_result result;
+   if (code)
+      result.code.assign(code, code + prog_data.base.program_size);
+   result.prog_data = prog_data_bytes(prog_data);
+   result.messages = log.messages;
+   result.other_thread = log.other_thread;
+
+   ralloc_free(b.shader);
+   return result;
+}
+
+void
+expect_same(const compile_result &serial, const compile_result &parallel)
+{
+   EXPECT_EQ(serial.code, parallel.code);
+   EXPECT_EQ(serial.prog_data, parallel.prog_data);
+   EXPECT_EQ(serial.messages, parallel.messages);
+   EXPECT_FALSE(parallel.other_thread);
+}
+
+/* From no spilling at all to spilling in the wide variants */
+const unsigned sizes[] = { 4, 24, 64 };
+
+} /* anonymous namespace */
+
+TEST_P(parallel_simd_test, fs)
+{
+   ASSERT_TRUE(intel_get_device_info_from_pci_id(GetParam(), &devinfo));
+
+   for (unsigned size : sizes) {
+      SCOPED_TRACE(size);
+      expect_same(compile_fs(false, size), compile_fs(true, size));
+   }
+}
+
+TEST_P(parallel_simd_test, cs)
+{
+   ASSERT_TRUE(intel_get_device_info_from_pci_id(GetParam(), &devinfo));
+   /* The shader writes its result with store_global */
+   if (devinfo.ver < 8)
+      GTEST_SKIP();
+
+   for (unsigned size : sizes) {
+      SCOPED_TRACE(size);
+      expect_same(compile_cs(false, size, false),
+                  compile_cs(true, size, false));
+      expect_same(compile_cs(false, size, true),
+                  compile_cs(true, size, true));
+   }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+   devices, parallel_simd_test,
+   ::testing::Values(0x0412,  /* HSW */
+                     0x1616,  /* BDW */
+                     0x1912,  /* SKL */
+                     0x8a52,  /* ICL */
+                     0x9a49,  /* TGL */
+                     0x56a0), /* DG2 */
+   [](const ::testing::TestParamInfo<int> &info) {
+      char name[16];
+      snprintf(name, sizeof(name), "pci_0x%04x", info.param);
+      return std::string(name);
+   });
@@ -0,0 +1,188 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+#include <stdarg.h>
+#include <string>
+#include <vector>
+
+#include "brw_compiler.h"
+#include "brw_nir.h"
+#include "compiler/glsl_types.h"
+#include "compiler/nir/nir_builder.h"
+#include "dev/intel_debug.h"
+#include "dev/intel_device_info.h"
+#include "util/ralloc.h"
+
+/*
+ * Compiles fragment shaders with INTEL_FS_SIMD_BY_PERF=true and checks which
+ * SIMD widths are kept.
+ */
+
+namespace {
+
+void
+test_debug_log(void *data, unsigned *id, const char *fmt, ...)
+{
+}
+
+void
+test_perf_log(void *data, unsigned *id, const char *fmt, ...)
+{
+   std::vector<std::string> *messages = (std::vector<std::string> *) data;
+   va_list args;
+
+   va_start(args, fmt);
+   char *msg = ralloc_vasprintf(NULL, fmt, args);
+   va_end(args);
+
+   messages->push_back(msg);
+   ralloc_free(msg);
+}
+
+class simd_by_perf_test : public ::testing::TestWithParam<int> {
+protected:
+   simd_by_perf_test();
+   ~simd_by_perf_test();
+
+   void SetUp() override;
+
+   bool compile_fs(enum brw_sometimes multisample_fbo);
+
+   void *mem_ctx;
+   struct intel_device_info devinfo;
+   struct brw_compiler *compiler;
+
+   struct brw_wm_prog_data prog_data;
+   std::vector<std::string> messages;
+};
+
+simd_by_perf_test::simd_by_perf_test()
+   : compiler(NULL)
+{
+   mem_ctx = ralloc_context(NULL);
+   glsl_type_singleton_init_or_ref();
+   brw_process_intel_debug_variable();
+}
+
+simd_by_perf_test::~simd_by_perf_test()
+{
+   ralloc_free(mem_ctx);
+   glsl_type_singleton_decref();
+}
+
+void
+simd_by_perf_test::SetUp()
+{
+   ASSERT_TRUE(intel_get_device_info_from_pci_id(GetParam(), &devinfo));
+
+   setenv("INTEL_FS_SIMD_BY_PERF", "true", 1);
+   compiler = brw_compiler_create(mem_ctx, &devinfo);
+   unsetenv("INTEL_FS_SIMD_BY_PERF");
+
+   ASSERT_TRUE(compiler->fs_simd_by_perf);
+   compiler->shader_debug_log = test_debug_log;
+   compiler->shader_perf_log = test_perf_log;
+}
+
+/* A shader small enough to compile at every width without spilling.  The
+ * widths tie on it, and the widest one is picked.
+ */
+bool
+simd_by_perf_test::compile_fs(enum brw_sometimes multisample_fbo)
+{
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT,
+         compiler->nir_options[MESA_SHADER_FRAGMENT], "simd_by_perf_test");
+   nir_variable *color =
+      nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                          "gl_FragColor");
+   color->data.location = FRAG_RESULT_COLOR;
+
+   nir_ssa_def *coord = nir_load_frag_coord(&b);
+   nir_store_var(&b, color, nir_fmul(&b, coord, nir_fsin(&b, coord)), 0xf);
+
+   struct brw_nir_compiler_opts opts = {};
+   brw_preprocess_nir(compiler, b.shader, &opts);
+   nir_shader_gather_info(b.shader, nir_shader_get_entrypoint(b.shader));
+
+   struct brw_wm_prog_key key;
+   memset(&key, 0, sizeof(key));
+   key.nr_color_regions = 1;
+   key.multisample_fbo = multisample_fbo;
+   for (unsigned i = 0; i < BRW_MAX_SAMPLERS; i++)
+      key.base.tex.swizzles[i] = SWIZZLE_XYZW;
+   if (devinfo.ver < 6)
+      key.input_slots_valid = b.shader->info.inputs_read | VARYING_BIT_POS;
+
+   memset(&prog_data, 0, sizeof(prog_data));
+   messages.clear();
+
+   struct brw_compile_fs_params params = {};
+   params.nir = b.shader;
+   params.key = &key;
+   params.prog_data = &prog_data;
+   params.allow_spilling = true;
+   params.log_data = &messages;
+
+   const void *code = brw_compile_fs(compiler, b.shader, &params);
+   EXPECT_NE(code, nullptr) << params.error_str;
+
+   ralloc_free(b.shader);
+   return code != NULL;
+}
+
+bool
+chosen_by_perf(const std::vector<std::string> &messages)
+{
+   for (const std::string &msg : messages) {
+      if (msg.find("chosen by performance estimate") != std::string::npos)
+         return true;
+   }
+   return false;
+}
+
+} /* anonymous namespace */
+
+TEST_P(simd_by_perf_test, single_width)
+{
+   ASSERT_TRUE(compile_fs(BRW_NEVER));
+   EXPECT_TRUE(chosen_by_perf(messages));
+   EXPECT_TRUE(prog_data.dispatch_32);
+
+   const unsigned widths =
+      prog_data.dispatch_8 + prog_data.dispatch_16 + prog_data.dispatch_32;
+
+   /* SIMD32 can't be the only width enabled on Gfx12+ */
+   EXPECT_EQ(widths, devinfo.ver >= 12 ? 2 : 1);
+}
+
+TEST_P(simd_by_perf_test, multisample_fallback)
+{
+   ASSERT_TRUE(compile_fs(BRW_ALWAYS));
+   EXPECT_TRUE(chosen_by_perf(messages));
+   EXPECT_TRUE(prog_data.dispatch_32);
+
+   const unsigned widths =
+      prog_data.dispatch_8 + prog_data.dispatch_16 + prog_data.dispatch_32;
+
+   /* SIMD32 dispatch may be disabled at draw time, a narrower width has to
+    * be there as well.
+    */
+   EXPECT_EQ(widths, 2);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+   devices, simd_by_perf_test,
+   ::testing::Values(0x0412,  /* HSW */
+                     0x1616,  /* BDW */
+                     0x1912,  /* SKL */
+                     0x8a52,  /* ICL */
+                     0x9a49,  /* TGL */
+                     0x56a0), /* DG2 */
+   [](const ::testing::TestParamInfo<int> &info) {
+      char name[16];
+      snprintf(name, sizeof(name), "pci_0x%04x", info.param);
+      return std::string(name);
+   });
@@ -801,6 +801,14 @@ _mesa_unlock_debug_state(struct gl_context *ctx)
 bool
 _mesa_set_debug_state_int(struct gl_context *ctx, GLenum pname, GLint val)
 {
+   /* Shaders compiled in the background don't expect the debug output to be
+    * enabled, finish them first so that none of their messages gets logged
+    * from a worker thread.
+    */
+   if (pname == GL_DEBUG_OUTPUT && val &&
+       util_queue_is_initialized(&ctx->ShaderCompileQueue))
+      util_queue_finish(&ctx->ShaderCompileQueue);
+
    struct gl_debug_state *debug = _mesa_lock_debug_state(ctx);
 
    if (!debug)
@@ -139,6 +139,12 @@ _mesa_MaxShaderCompilerThreadsKHR(GLuint count)
 
    ctx->Hint.MaxShaderCompilerThreads = count;
 
+   /* New compilations don't use the queue when count is 0, the ones in
+    * progress are finished by a single thread.
+    */
+   if (util_queue_is_initialized(&ctx->ShaderCompileQueue))
+      util_queue_adjust_num_threads(&ctx->ShaderCompileQueue, count);
+
    struct pipe_screen *screen = ctx->screen;
    if (screen->set_max_shader_compiler_threads)
       screen->set_max_shader_compiler_threads(screen, count);
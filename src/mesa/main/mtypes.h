@@ -3667,6 +3667,13 @@ struct gl_context
 
    bool shader_builtin_ref;
 
+   /**
+    * Runs the GLSL front-end for glCompileShader in the background. It's
+    * created on the first compilation that can be deferred, see
+    * _mesa_compile_shader().
+    */
+   struct util_queue ShaderCompileQueue;
+
    struct pipe_draw_start_count_bias *tmp_draws;
    unsigned num_tmp_draws;
 };
@@ -35,6 +35,7 @@
 #include "util/glheader.h"
 #include "main/menums.h"
 #include "util/mesa-sha1.h"
+#include "util/u_queue.h"
 #include "compiler/shader_info.h"
 #include "compiler/glsl/list.h"
 #include "compiler/glsl/ir_uniform.h"
@@ -154,6 +155,14 @@ struct gl_shader
 
    enum gl_compile_status CompileStatus;
 
+   /**
+    * Signalled when the last glCompileShader of the shader is done. The
+    * compilation may run on a context's ShaderCompileQueue, so anything that
+    * reads its results or changes the source has to wait for it first, see
+    * _mesa_wait_shader_compile().
+    */
+   struct util_queue_fence CompileFence;
+
    /** SHA1 of the pre-processed source used by the disk cache. */
    uint8_t disk_cache_sha1[SHA1_DIGEST_LENGTH];
    /** SHA1 of the original source before replacement, set by glShaderSource. */
@@ -38,6 +38,7 @@
 
 #include "util/glheader.h"
 #include "main/context.h"
+#include "main/debug_output.h"
 #include "draw_validate.h"
 #include "main/enums.h"
 #include "main/glspirv.h"
@@ -65,6 +66,8 @@
 #include "util/list.h"
 #include "util/u_process.h"
 #include "util/u_string.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "api_exec_decl.h"
 
 #include "state_tracker/st_context.h"
@@ -231,6 +234,11 @@ _mesa_init_shader_state(struct gl_context *ctx)
 void
 _mesa_free_shader_state(struct gl_context *ctx)
 {
+   if (util_queue_is_initialized(&ctx->ShaderCompileQueue)) {
+      util_queue_finish(&ctx->ShaderCompileQueue);
+      util_queue_destroy(&ctx->ShaderCompileQueue);
+   }
+
    for (int i = 0; i < MESA_SHADER_STAGES; i++) {
       _mesa_reference_program(ctx, &ctx->Shader.CurrentProgram[i], NULL);
       _mesa_reference_shader_program(ctx,
@@ -1048,13 +1056,14 @@ get_shaderiv(struct gl_context *ctx, GLuint name, GLenum pname, GLint *params)
       *params = shader->DeletePending;
       break;
    case GL_COMPLETION_STATUS_ARB:
-      /* _mesa_glsl_compile_shader is not offloaded to other threads. */
-      *params = GL_TRUE;
+      *params = util_queue_fence_is_signalled(&shader->CompileFence);
       return;
    case GL_COMPILE_STATUS:
+      _mesa_wait_shader_compile(shader);
       *params = shader->CompileStatus ? GL_TRUE : GL_FALSE;
       break;
    case GL_INFO_LOG_LENGTH:
+      _mesa_wait_shader_compile(shader);
       *params = (shader->InfoLog && shader->InfoLog[0] != '\0') ?
          strlen(shader->InfoLog) + 1 : 0;
       break;
@@ -1120,6 +1129,7 @@ get_shader_info_log(struct gl_context *ctx, GLuint shader, GLsizei bufSize,
       return;
    }
 
+   _mesa_wait_shader_compile(sh);
    _mesa_copy_string(infoLog, bufSize, length, sh->InfoLog);
 }
 
@@ -1156,6 +1166,9 @@ set_shader_source(struct gl_shader *sh, const GLchar *source,
 {
    assert(sh);
 
+   /* The compilation in progress still reads the old source. */
+   _mesa_wait_shader_compile(sh);
+
    /* The GL_ARB_gl_spirv spec adds the following to the end of the description
     * of ShaderSource:
     *
@@ -1182,17 +1195,83 @@ set_shader_source(struct gl_shader *sh, const GLchar *source,
    memcpy(sh->source_sha1, original_sha1, SHA1_DIGEST_LENGTH);
 }
 
+/**
+ * Make sure the context holds a reference to the built-in functions. This
+ * may be called from the threads of ctx->ShaderCompileQueue, which is
+ * where the built-in functions are usually generated the first time.
+ */
 static void
 ensure_builtin_types(struct gl_context *ctx)
 {
-   if (!ctx->shader_builtin_ref) {
+   if (!p_atomic_read(&ctx->shader_builtin_ref)) {
       _mesa_glsl_builtin_functions_init_or_ref();
-      ctx->shader_builtin_ref = true;
+
+      /* Another thread got there first, drop the extra reference. */
+      if (p_atomic_cmpxchg(&ctx->shader_builtin_ref, false, true))
+         _mesa_glsl_builtin_functions_decref();
    }
 }
 
+static void
+compile_shader_job(void *data, void *gdata, UNUSED int thread_index)
+{
+   struct gl_shader *sh = (struct gl_shader *) data;
+   struct gl_context *ctx = (struct gl_context *) gdata;
+
+   ensure_builtin_types(ctx);
+   _mesa_glsl_compile_shader(ctx, sh, false, false, false);
+}
+
+/**
+ * Whether the GLSL front-end can run on ctx->ShaderCompileQueue for this
+ * shader. The queue is created when it's first needed.
+ */
+static bool
+can_compile_in_background(struct gl_context *ctx, struct gl_shader *sh)
+{
+   /* The debug output is written in the order of the API calls. */
+   if (ctx->_Shader->Flags)
+      return false;
+
+   /* Compiler warnings and errors are reported through GL_KHR_debug, whose
+    * callback must run on the calling thread and in the order of the API
+    * calls.
+    */
+   if (_mesa_get_debug_state_int(ctx, GL_DEBUG_OUTPUT))
+      return false;
+
+   /* Shader includes are looked up in the named strings and the search
+    * paths of glCompileShaderIncludeARB, which may change as soon as we
+    * return.
+    */
+   if (strstr(sh->Source, "#include"))
+      return false;
+
+   /* GL_ARB_parallel_shader_compile: 0 threads asks for no parallel
+    * compilation.
+    */
+   unsigned num_threads = MIN2(ctx->Hint.MaxShaderCompilerThreads,
+                               util_get_cpu_caps()->nr_cpus);
+   if (num_threads == 0 || util_get_cpu_caps()->nr_cpus == 1)
+      return false;
+
+   if (!util_queue_is_initialized(&ctx->ShaderCompileQueue) &&
+       !util_queue_init(&ctx->ShaderCompileQueue, "glsl", 64, num_threads,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_SCALE_THREADS, ctx))
+      return false;
+
+   return true;
+}
+
 /**
  * Compile a shader.
+ *
+ * Unless debug output was requested, the compilation runs in the background
+ * and the shader's CompileFence is signalled when it's done. Everything that
+ * looks at the result (compile status and info log queries, linking, etc.)
+ * waits for it, which allows the applications that compile lots of shaders
+ * before linking the first program to use several threads.
  */
 void
 _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
@@ -1200,6 +1279,9 @@ _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
    if (!sh)
       return;
 
+   /* A previous compilation may still be in progress. */
+   _mesa_wait_shader_compile(sh);
+
    /* The GL_ARB_gl_spirv spec says:
     *
     *    "Add a new error for the CompileShader command:
@@ -1217,6 +1299,10 @@ _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
        * glShaderSource, we should fail to compile, but not raise a GL_ERROR.
        */
       sh->CompileStatus = COMPILE_FAILURE;
+   } else if (can_compile_in_background(ctx, sh)) {
+      util_queue_add_job(&ctx->ShaderCompileQueue, sh, &sh->CompileFence,
+                         compile_shader_job, NULL, 0);
+      return;
    } else {
       if (ctx->_Shader->Flags & (GLSL_DUMP | GLSL_SOURCE)) {
          _mesa_log("GLSL source for %s shader %d:\n",
@@ -1328,6 +1414,9 @@ link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
 
    ensure_builtin_types(ctx);
 
+   for (unsigned i = 0; i < shProg->NumShaders; i++)
+      _mesa_wait_shader_compile(shProg->Shaders[i]);
+
    FLUSH_VERTICES(ctx, 0, 0);
    _mesa_glsl_link_shader(ctx, shProg);
 
@@ -2342,6 +2431,10 @@ _mesa_ReleaseShaderCompiler(void)
 {
    GET_CURRENT_CONTEXT(ctx);
 
+   /* The compilations in progress use the built-in functions. */
+   if (util_queue_is_initialized(&ctx->ShaderCompileQueue))
+      util_queue_finish(&ctx->ShaderCompileQueue);
+
    if (ctx->shader_builtin_ref) {
       _mesa_glsl_builtin_functions_decref();
       ctx->shader_builtin_ref = false;
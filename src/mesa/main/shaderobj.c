@@ -102,6 +102,7 @@ static void
 _mesa_init_shader(struct gl_shader *shader)
 {
    shader->RefCount = 1;
+   util_queue_fence_init(&shader->CompileFence);
    shader->info.Geom.VerticesOut = -1;
    shader->info.Geom.InputType = SHADER_PRIM_TRIANGLES;
    shader->info.Geom.OutputType = SHADER_PRIM_TRIANGLE_STRIP;
@@ -130,6 +131,9 @@ _mesa_new_shader(GLuint name, gl_shader_stage stage)
 void
 _mesa_delete_shader(struct gl_context *ctx, struct gl_shader *sh)
 {
+   _mesa_wait_shader_compile(sh);
+   util_queue_fence_destroy(&sh->CompileFence);
+
    _mesa_shader_spirv_data_reference(&sh->spirv_data, NULL);
    free((void *)sh->Source);
    free((void *)sh->FallbackSource);
@@ -138,6 +142,17 @@ _mesa_delete_shader(struct gl_context *ctx, struct gl_shader *sh)
 }
 
 
+/**
+ * Wait for the compilation of the shader started by glCompileShader, which
+ * may be running on another thread.
+ */
+void
+_mesa_wait_shader_compile(struct gl_shader *sh)
+{
+   util_queue_fence_wait(&sh->CompileFence);
+}
+
+
 /**
  * Delete a shader object.
  */
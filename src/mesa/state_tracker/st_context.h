@@ -36,6 +36,7 @@
 #include "util/u_helpers.h"
 #include "util/u_inlines.h"
 #include "util/list.h"
+#include "util/u_queue.h"
 #include "vbo/vbo.h"
 #include "util/list.h"
 #include "cso_cache/cso_context.h"
@@ -387,6 +388,11 @@ struct st_context
     */
    struct util_throttle throttle;
 
+   /* Runs the per-stage parts of st_link_nir() in parallel. It's created
+    * when the first program with more than one stage is linked.
+    */
+   struct util_queue link_queue;
+
    struct {
       struct st_zombie_sampler_view_node list;
       simple_mtx_t mutex;
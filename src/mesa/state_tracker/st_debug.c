@@ -52,6 +52,8 @@ static const struct debug_named_value st_debug_flags[] = {
    { "wf",       DEBUG_WIREFRAME, NULL },
    { "gremedy",  DEBUG_GREMEDY, "Enable GREMEDY debug extensions" },
    { "noreadpixcache", DEBUG_NOREADPIXCACHE, NULL },
+   { "seriallink", DEBUG_SERIAL_LINK, "Don't link the stages of a program in parallel" },
+   { "linktime", DEBUG_LINK_TIME, "Print the time spent linking each program" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -41,6 +41,8 @@ struct st_context;
 #define DEBUG_WIREFRAME       BITFIELD_BIT(4)
 #define DEBUG_GREMEDY         BITFIELD_BIT(5)
 #define DEBUG_NOREADPIXCACHE  BITFIELD_BIT(6)
+#define DEBUG_SERIAL_LINK     BITFIELD_BIT(7)
+#define DEBUG_LINK_TIME       BITFIELD_BIT(8)
 
 extern int ST_DEBUG;
 
@@ -28,10 +28,14 @@
 #include "compiler/glsl/ir_optimization.h"
 #include "compiler/glsl/program.h"
 
+#include "st_debug.h"
 #include "st_nir.h"
 #include "st_shader_cache.h"
 #include "st_program.h"
 
+#include "util/bitscan.h"
+#include "util/os_time.h"
+
 static GLboolean
 link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
 {
@@ -102,9 +106,16 @@ GLboolean
 st_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
 {
    struct pipe_context *pctx = st_context(ctx)->pipe;
+   int64_t start = (ST_DEBUG & DEBUG_LINK_TIME) ? os_time_get_nano() : 0;
 
    GLboolean ret = link_shader(ctx, prog);
-    
+
+   if (ST_DEBUG & DEBUG_LINK_TIME) {
+      debug_printf("st: linked program %u (%u stages) in %.3f ms\n",
+                   prog->Name, util_bitcount(prog->data->linked_stages),
+                   (os_time_get_nano() - start) / 1000000.0);
+   }
+
    if (pctx->link_shader) {
       void *driver_handles[PIPE_SHADER_TYPES];
       memset(driver_handles, 0, sizeof(driver_handles));
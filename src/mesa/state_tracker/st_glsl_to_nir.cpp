@@ -39,6 +39,7 @@
 
 #include "main/shaderobj.h"
 #include "st_context.h"
+#include "st_debug.h"
 #include "st_program.h"
 #include "st_shader_cache.h"
 
@@ -53,6 +54,8 @@
 #include "compiler/glsl/linker_util.h"
 #include "compiler/glsl/string_to_uint_map.h"
 
+#include "util/u_cpu_detect.h"
+
 static int
 type_size(const struct glsl_type *type)
 {
@@ -355,16 +358,6 @@ st_nir_preprocess(struct st_context *st, struct gl_program *prog,
    }
 
    nir_shader_gather_info(nir, nir_shader_get_entrypoint(nir));
-   if (!st->ctx->SoftFP64 && ((nir->info.bit_sizes_int | nir->info.bit_sizes_float) & 64) &&
-       (options->lower_doubles_options & nir_lower_fp64_full_software) != 0) {
-
-      /* It's not possible to use float64 on GLSL ES, so don't bother trying to
-       * build the support code.  The support code depends on higher versions of
-       * desktop GLSL, so it will fail to compile (below) anyway.
-       */
-      if (_mesa_is_desktop_gl(st->ctx) && st->ctx->Const.GLSLVersion >= 400)
-         st->ctx->SoftFP64 = glsl_float64_funcs_to_nir(st->ctx, options);
-   }
 
    prog->skip_pointsize_xfb = !(nir->info.outputs_written & VARYING_BIT_PSIZ);
    if (st->lower_point_size && prog->skip_pointsize_xfb &&
@@ -467,15 +460,16 @@ filter_64_bit_instr(const nir_instr *const_instr, UNUSED const void *data)
    return lower;
 }
 
-/* Second third of converting glsl_to_nir. This creates uniforms, gathers
- * info on varyings, etc after NIR link time opts have been applied.
+/* Attach the uniform storage of the program to the parameter list of a
+ * stage.  This modifies the uniform storage shared by all the stages, so
+ * unlike st_glsl_to_nir_post_opts() it can't run in parallel with the other
+ * stages.
  */
-static char *
-st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
-                         struct gl_shader_program *shader_program)
+static void
+st_nir_associate_uniform_storage(struct st_context *st, struct gl_program *prog,
+                                 struct gl_shader_program *shader_program)
 {
    nir_shader *nir = prog->nir;
-   struct pipe_screen *screen = st->screen;
 
    /* Make a pass over the IR to add state references for any built-in
     * uniforms that are used.  This has to be done now (during linking).
@@ -513,6 +507,17 @@ st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
     * This should be enough for Bitmap and DrawPixels constants.
     */
    _mesa_ensure_and_associate_uniform_storage(st->ctx, shader_program, prog, 28);
+}
+
+/* Second third of converting glsl_to_nir. This creates uniforms, gathers
+ * info on varyings, etc after NIR link time opts have been applied.
+ */
+static char *
+st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
+                         struct gl_shader_program *shader_program)
+{
+   nir_shader *nir = prog->nir;
+   struct pipe_screen *screen = st->screen;
 
    /* None of the builtins being lowered here can be produced by SPIR-V.  See
     * _mesa_builtin_uniform_desc. Also drivers that support packed uniform
@@ -588,15 +593,6 @@ st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
    if (st->allow_st_finalize_nir_twice)
       msg = st_finalize_nir(st, prog, shader_program, nir, true, true);
 
-   if (st->ctx->_Shader->Flags & GLSL_DUMP) {
-      _mesa_log("\n");
-      _mesa_log("NIR IR for linked %s program %d:\n",
-             _mesa_shader_stage_to_string(prog->info.stage),
-             shader_program->Name);
-      nir_print_shader(nir, _mesa_get_log_file());
-      _mesa_log("\n\n");
-   }
-
    return msg;
 }
 
@@ -660,6 +656,101 @@ st_lower_patch_vertices_in(struct gl_shader_program *shader_prog)
    }
 }
 
+/* The steps of st_link_nir() that only look at a single stage. They are run
+ * in parallel for all the stages of the program on st->link_queue.
+ */
+struct st_link_job {
+   struct st_context *st;
+   struct gl_shader_program *shader_program;
+   struct gl_linked_shader *shader;
+   struct util_queue_fence fence;
+   char *msg;
+};
+
+static void
+st_link_job_to_nir(void *data, UNUSED void *gdata, UNUSED int thread_index)
+{
+   struct st_link_job *job = (struct st_link_job *)data;
+   struct st_context *st = job->st;
+   struct gl_linked_shader *shader = job->shader;
+   struct gl_program *prog = shader->Program;
+   const nir_shader_compiler_options *options =
+      st->ctx->Const.ShaderCompilerOptions[shader->Stage].NirOptions;
+
+   if (job->shader_program->data->spirv) {
+      prog->nir = _mesa_spirv_to_nir(st->ctx, job->shader_program,
+                                     shader->Stage, options);
+   } else {
+      prog->nir = glsl_to_nir(&st->ctx->Const, job->shader_program,
+                              shader->Stage, options);
+   }
+
+   memcpy(prog->nir->info.source_sha1, shader->linked_source_sha1,
+          SHA1_DIGEST_LENGTH);
+   st_nir_preprocess(st, prog, job->shader_program, shader->Stage);
+
+   if (options->lower_to_scalar) {
+      NIR_PASS_V(prog->nir, nir_lower_load_const_to_scalar);
+   }
+}
+
+static void
+st_link_job_post_opts(void *data, UNUSED void *gdata, UNUSED int thread_index)
+{
+   struct st_link_job *job = (struct st_link_job *)data;
+
+   job->msg = st_glsl_to_nir_post_opts(job->st, job->shader->Program,
+                                       job->shader_program);
+}
+
+static void
+st_link_job_store_in_disk_cache(void *data, UNUSED void *gdata,
+                                UNUSED int thread_index)
+{
+   struct st_link_job *job = (struct st_link_job *)data;
+
+   st_store_nir_in_disk_cache(job->st, job->shader->Program);
+}
+
+/* Run a step of st_link_nir() for all the stages and wait for it to finish.
+ * The first stage is handled by the calling thread, the others by the link
+ * queue if there are CPUs to spare.
+ */
+static void
+st_link_run_jobs(struct st_context *st, struct st_link_job *jobs,
+                 unsigned num_jobs, util_queue_execute_func execute)
+{
+   bool parallel = num_jobs > 1 && !(ST_DEBUG & DEBUG_SERIAL_LINK) &&
+                   util_get_cpu_caps()->nr_cpus > 1;
+
+   /* There are at most 5 stages, so 4 threads are enough. */
+   if (parallel && !util_queue_is_initialized(&st->link_queue) &&
+       !util_queue_init(&st->link_queue, "stlink", 8,
+                        MIN2(util_get_cpu_caps()->nr_cpus - 1, 4),
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_SCALE_THREADS, NULL))
+      parallel = false;
+
+   if (!parallel) {
+      for (unsigned i = 0; i < num_jobs; i++)
+         execute(&jobs[i], NULL, 0);
+      return;
+   }
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&st->link_queue, &jobs[i], &jobs[i].fence,
+                         execute, NULL, 0);
+   }
+
+   execute(&jobs[0], NULL, 0);
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
 extern "C" {
 
 void
@@ -710,6 +801,7 @@ st_link_nir(struct gl_context *ctx,
 {
    struct st_context *st = st_context(ctx);
    struct gl_linked_shader *linked_shader[MESA_SHADER_STAGES];
+   struct st_link_job jobs[MESA_SHADER_STAGES];
    unsigned num_shaders = 0;
 
    for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
@@ -719,8 +811,6 @@ st_link_nir(struct gl_context *ctx,
 
    for (unsigned i = 0; i < num_shaders; i++) {
       struct gl_linked_shader *shader = linked_shader[i];
-      const nir_shader_compiler_options *options =
-         st->ctx->Const.ShaderCompilerOptions[shader->Stage].NirOptions;
       struct gl_program *prog = shader->Program;
 
       _mesa_copy_linked_program_data(shader_program, shader);
@@ -732,9 +822,7 @@ st_link_nir(struct gl_context *ctx,
       /* Parameters will be filled during NIR linking. */
       prog->Parameters = _mesa_new_parameter_list();
 
-      if (shader_program->data->spirv) {
-         prog->nir = _mesa_spirv_to_nir(ctx, shader_program, shader->Stage, options);
-      } else {
+      if (!shader_program->data->spirv) {
          validate_ir_tree(shader->ir);
 
          if (ctx->_Shader->Flags & GLSL_DUMP) {
@@ -745,24 +833,40 @@ st_link_nir(struct gl_context *ctx,
             _mesa_print_ir(_mesa_get_log_file(), shader->ir, NULL);
             _mesa_log("\n\n");
          }
-
-         prog->nir = glsl_to_nir(&st->ctx->Const, shader_program, shader->Stage, options);
       }
 
-      memcpy(prog->nir->info.source_sha1, shader->linked_source_sha1,
-             SHA1_DIGEST_LENGTH);
-      st_nir_preprocess(st, prog, shader_program, shader->Stage);
+      jobs[i].st = st;
+      jobs[i].shader_program = shader_program;
+      jobs[i].shader = shader;
+      jobs[i].msg = NULL;
+   }
+
+   st_link_run_jobs(st, jobs, num_shaders, st_link_job_to_nir);
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      nir_shader *nir = linked_shader[i]->Program->nir;
+      const nir_shader_compiler_options *options = nir->options;
+
+      /* The fp64 library is shared by all the stages, so it's built here
+       * rather than in st_nir_preprocess().
+       */
+      if (!st->ctx->SoftFP64 && ((nir->info.bit_sizes_int | nir->info.bit_sizes_float) & 64) &&
+          (options->lower_doubles_options & nir_lower_fp64_full_software) != 0) {
 
-      if (prog->nir->info.shared_size > ctx->Const.MaxComputeSharedMemorySize) {
+         /* It's not possible to use float64 on GLSL ES, so don't bother trying to
+          * build the support code.  The support code depends on higher versions of
+          * desktop GLSL, so it will fail to compile (below) anyway.
+          */
+         if (_mesa_is_desktop_gl(st->ctx) && st->ctx->Const.GLSLVersion >= 400)
+            st->ctx->SoftFP64 = glsl_float64_funcs_to_nir(st->ctx, options);
+      }
+
+      if (nir->info.shared_size > ctx->Const.MaxComputeSharedMemorySize) {
          linker_error(shader_program, "Too much shared memory used (%u/%u)\n",
-                      prog->nir->info.shared_size,
+                      nir->info.shared_size,
                       ctx->Const.MaxComputeSharedMemorySize);
          return GL_FALSE;
       }
-
-      if (options->lower_to_scalar) {
-         NIR_PASS_V(shader->Program->nir, nir_lower_load_const_to_scalar);
-      }
    }
 
    st_lower_patch_vertices_in(shader_program);
@@ -891,15 +995,30 @@ st_link_nir(struct gl_context *ctx,
       }
    }
 
+   for (unsigned i = 0; i < num_shaders; i++) {
+      st_nir_associate_uniform_storage(st, linked_shader[i]->Program,
+                                       shader_program);
+   }
+
+   st_link_run_jobs(st, jobs, num_shaders, st_link_job_post_opts);
+
    struct shader_info *prev_info = NULL;
 
    for (unsigned i = 0; i < num_shaders; i++) {
       struct gl_linked_shader *shader = linked_shader[i];
       struct shader_info *info = &shader->Program->nir->info;
 
-      char *msg = st_glsl_to_nir_post_opts(st, shader->Program, shader_program);
-      if (msg) {
-         linker_error(shader_program, msg);
+      if (ctx->_Shader->Flags & GLSL_DUMP) {
+         _mesa_log("\n");
+         _mesa_log("NIR IR for linked %s program %d:\n",
+                   _mesa_shader_stage_to_string(shader->Stage),
+                   shader_program->Name);
+         nir_print_shader(shader->Program->nir, _mesa_get_log_file());
+         _mesa_log("\n\n");
+      }
+
+      if (jobs[i].msg) {
+         linker_error(shader_program, jobs[i].msg);
          return false;
       }
 
@@ -949,8 +1068,13 @@ st_link_nir(struct gl_context *ctx,
           shader->Stage == MESA_SHADER_TESS_EVAL ||
           shader->Stage == MESA_SHADER_GEOMETRY)
          st_translate_stream_output_info(prog);
+   }
+
+   if (ctx->Cache)
+      st_link_run_jobs(st, jobs, num_shaders, st_link_job_store_in_disk_cache);
 
-      st_store_nir_in_disk_cache(st, prog);
+   for (unsigned i = 0; i < num_shaders; i++) {
+      struct gl_program *prog = linked_shader[i]->Program;
 
       st_release_variants(st, prog);
       st_finalize_program(st, prog);
@@ -1352,7 +1352,10 @@ st_finalize_program(struct st_context *st, struct gl_program *prog)
    }
 
    if (prog->nir) {
-      nir_sweep(prog->nir);
+      /* The NIR is only cloned or serialized from here on, and nothing
+       * holds on to its instructions.
+       */
+      nir_compact(prog->nir);
 
       /* This is only needed for ARB_vp/fp programs and when the disk cache
        * is disabled. If the disk cache is enabled, GLSL programs are
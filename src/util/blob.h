@@ -274,6 +274,19 @@ blob_overwrite_uint32(struct blob *blob,
 bool
 blob_write_uint64(struct blob *blob, uint64_t value);
 
+/**
+ * Add a uint32_t to a blob as a variable-length integer.
+ *
+ * The value is stored 7 bits per byte, least significant bits first, with
+ * the top bit of each byte set if more bytes follow. Small values take a
+ * single byte. No padding is added, the value is written at the current
+ * offset.
+ *
+ * \return True unless allocation failed.
+ */
+bool
+blob_write_varint32(struct blob *blob, uint32_t value);
+
 /**
  * Add an intptr_t to a blob.
  *
@@ -408,6 +421,15 @@ blob_read_uint32(struct blob_reader *blob);
 uint64_t
 blob_read_uint64(struct blob_reader *blob);
 
+/**
+ * Read a variable-length integer written by blob_write_varint32 from the
+ * current location, (and update the current location to just past it).
+ *
+ * \return The uint32_t read
+ */
+uint32_t
+blob_read_varint32(struct blob_reader *blob);
+
 /**
  * Read an intptr_t value from the current location, (and update the
  * current location to just past this intptr_t).
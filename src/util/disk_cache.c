@@ -119,6 +119,9 @@ disk_cache_type_create(const char *gpu_name,
    if (cache == NULL)
       goto fail;
 
+   const util_once_flag once_init = UTIL_ONCE_FLAG_INIT;
+   cache->read_queue_once = once_init;
+
    /* Assume failure. */
    cache->path_init_failed = true;
    cache->type = DISK_CACHE_NONE;
@@ -321,6 +324,11 @@ disk_cache_destroy(struct disk_cache *cache)
       util_queue_finish(&cache->cache_queue);
       util_queue_destroy(&cache->cache_queue);
 
+      if (util_queue_is_initialized(&cache->read_queue)) {
+         util_queue_finish(&cache->read_queue);
+         util_queue_destroy(&cache->read_queue);
+      }
+
       if (cache->foz_ro_cache)
          disk_cache_destroy(cache->foz_ro_cache);
 
@@ -620,6 +628,137 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return buf;
 }
 
+static struct disk_cache_blob *
+create_blob_from_buffer(void *buf, size_t size)
+{
+   struct disk_cache_blob *blob = disk_cache_blob_create(buf, size, buf,
+                                                         NULL, 0);
+   if (!blob)
+      free(buf);
+
+   return blob;
+}
+
+struct disk_cache_blob *
+disk_cache_get_blob(struct disk_cache *cache, const cache_key key)
+{
+   struct disk_cache_blob *blob = NULL;
+   void *buf = NULL;
+   size_t size = 0;
+
+   if (cache->foz_ro_cache)
+      blob = disk_cache_load_item_foz_blob(cache->foz_ro_cache, key);
+
+   if (!blob) {
+      if (cache->blob_get_cb) {
+         buf = blob_get_compressed(cache, key, &size);
+      } else if (cache->type == DISK_CACHE_SINGLE_FILE) {
+         blob = disk_cache_load_item_foz_blob(cache, key);
+      } else if (cache->type == DISK_CACHE_DATABASE) {
+         /* Database entries are moved around in place by the compaction,
+          * hence they can't be referenced and always have to be copied.
+          */
+         buf = disk_cache_db_load_item(cache, key, &size);
+      } else {
+         char *filename = disk_cache_get_cache_filename(cache, key);
+         if (filename)
+            blob = disk_cache_load_item_blob(cache, filename);
+      }
+
+      if (buf)
+         blob = create_blob_from_buffer(buf, size);
+   }
+
+   if (unlikely(cache->stats.enabled)) {
+      if (blob)
+         p_atomic_inc(&cache->stats.hits);
+      else
+         p_atomic_inc(&cache->stats.misses);
+   }
+
+   return blob;
+}
+
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, struct disk_cache_blob **blobs)
+{
+   unsigned i;
+
+   for (i = 0; i < num_keys; i++)
+      blobs[i] = NULL;
+
+   if (!num_keys)
+      return;
+
+   if (cache->foz_ro_cache)
+      disk_cache_load_items_foz_blob(cache->foz_ro_cache, keys, num_keys,
+                                     blobs);
+
+   if (cache->blob_get_cb) {
+      for (i = 0; i < num_keys; i++) {
+         size_t size = 0;
+
+         if (blobs[i])
+            continue;
+
+         void *buf = blob_get_compressed(cache, keys[i], &size);
+         if (buf)
+            blobs[i] = create_blob_from_buffer(buf, size);
+      }
+   } else if (cache->type == DISK_CACHE_SINGLE_FILE) {
+      disk_cache_load_items_foz_blob(cache, keys, num_keys, blobs);
+   } else if (cache->type == DISK_CACHE_DATABASE) {
+      disk_cache_db_load_items(cache, keys, num_keys, blobs);
+   } else {
+      disk_cache_load_items_blob(cache, keys, num_keys, blobs);
+   }
+
+   if (unlikely(cache->stats.enabled)) {
+      for (i = 0; i < num_keys; i++) {
+         if (blobs[i])
+            p_atomic_inc(&cache->stats.hits);
+         else
+            p_atomic_inc(&cache->stats.misses);
+      }
+   }
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   if (!num_keys)
+      return;
+
+   if (cache->foz_ro_cache)
+      foz_prefetch(&cache->foz_ro_cache->foz_db, keys[0], num_keys);
+
+   if (cache->blob_get_cb)
+      return;
+
+   if (cache->type == DISK_CACHE_SINGLE_FILE)
+      foz_prefetch(&cache->foz_db, keys[0], num_keys);
+   else if (cache->type == DISK_CACHE_DATABASE)
+      mesa_cache_db_multipart_prefetch(&cache->cache_db, keys[0], num_keys);
+   else
+      disk_cache_prefetch_items(cache, keys, num_keys);
+}
+
+struct disk_cache_blob *
+disk_cache_blob_ref(struct disk_cache_blob *blob)
+{
+   p_atomic_inc(&blob->refcount);
+   return blob;
+}
+
+void
+disk_cache_blob_unref(struct disk_cache_blob *blob)
+{
+   if (blob && p_atomic_dec_zero(&blob->refcount))
+      disk_cache_blob_destroy(blob);
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
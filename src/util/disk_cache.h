@@ -79,6 +79,23 @@ struct cache_item_metadata {
 
 struct disk_cache;
 
+/**
+ * A reference-counted cache item returned by disk_cache_get_blob().
+ *
+ * \data may point straight into a read-only mapping of the cache file, so
+ * it must not be modified.
+ */
+struct disk_cache_blob {
+   const void *data;
+   size_t size;
+
+   /* Private, used to release the backing storage */
+   int32_t refcount;
+   void *copy;
+   void *map;
+   size_t map_size;
+};
+
 #ifdef HAVE_DLADDR
 static inline bool
 disk_cache_get_function_timestamp(void *ptr, uint32_t* timestamp)
@@ -229,6 +246,49 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Retrieve an item previously stored in the cache with the name <key>,
+ * avoiding the copy made by disk_cache_get() where possible.
+ *
+ * Items stored uncompressed in the multi-file or single-file (fossilize)
+ * caches are returned as a view into a read-only mapping of the cache file.
+ * Otherwise the item is uncompressed or copied into memory owned by the
+ * blob.
+ *
+ * \return A blob holding one reference, which must be released with
+ * disk_cache_blob_unref(). NULL if the object is not found, or if any error
+ * occurs.
+ */
+struct disk_cache_blob *
+disk_cache_get_blob(struct disk_cache *cache, const cache_key key);
+
+/**
+ * Retrieve several items at once, see disk_cache_get_blob().
+ *
+ * On return blobs[i] holds the item stored under keys[i], or NULL if it
+ * wasn't found. The lookups are merged where the cache allows it, which is
+ * considerably faster than retrieving the items one by one.
+ */
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, struct disk_cache_blob **blobs);
+
+/**
+ * Hint that the items stored under \keys are going to be retrieved soon.
+ *
+ * The item data is read ahead in the background, so that the following
+ * disk_cache_get() calls don't have to wait for the disk.
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
+struct disk_cache_blob *
+disk_cache_blob_ref(struct disk_cache_blob *blob);
+
+void
+disk_cache_blob_unref(struct disk_cache_blob *blob);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -304,6 +364,37 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline struct disk_cache_blob *
+disk_cache_get_blob(struct disk_cache *cache, const cache_key key)
+{
+   return NULL;
+}
+
+static inline void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, struct disk_cache_blob **blobs)
+{
+   for (unsigned i = 0; i < num_keys; i++)
+      blobs[i] = NULL;
+}
+
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+}
+
+static inline struct disk_cache_blob *
+disk_cache_blob_ref(struct disk_cache_blob *blob)
+{
+   return blob;
+}
+
+static inline void
+disk_cache_blob_unref(struct disk_cache_blob *blob)
+{
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -502,34 +502,36 @@ disk_cache_evict_item(struct disk_cache *cache, char *filename)
       p_atomic_add(cache->size, - (uint64_t)sb.st_blocks * 512);
 }
 
-static void *
-parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
-                              size_t cache_item_size, size_t *size)
+/* Validate the cache item and return its payload, which is still compressed
+ * unless it's the same size as the uncompressed data.
+ */
+static const uint8_t *
+parse_cache_item(struct disk_cache *cache, const void *cache_item,
+                 size_t cache_item_size, struct cache_entry_file_data *cf_data,
+                 size_t *data_size)
 {
-   uint8_t *uncompressed_data = NULL;
-
    struct blob_reader ci_blob_reader;
    blob_reader_init(&ci_blob_reader, cache_item, cache_item_size);
 
    size_t header_size = cache->driver_keys_blob_size;
    const void *keys_blob = blob_read_bytes(&ci_blob_reader, header_size);
    if (ci_blob_reader.overrun)
-      goto fail;
+      return NULL;
 
    /* Check for extremely unlikely hash collisions */
    if (memcmp(cache->driver_keys_blob, keys_blob, header_size) != 0) {
       assert(!"Mesa cache keys mismatch!");
-      goto fail;
+      return NULL;
    }
 
    uint32_t md_type = blob_read_uint32(&ci_blob_reader);
    if (ci_blob_reader.overrun)
-      goto fail;
+      return NULL;
 
    if (md_type == CACHE_ITEM_TYPE_GLSL) {
       uint32_t num_keys = blob_read_uint32(&ci_blob_reader);
       if (ci_blob_reader.overrun)
-         goto fail;
+         return NULL;
 
       /* The cache item metadata is currently just used for distributing
        * precompiled shaders, they are not used by Mesa so just skip them for
@@ -540,51 +542,314 @@ parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
       const void UNUSED *metadata =
          blob_read_bytes(&ci_blob_reader, num_keys * sizeof(cache_key));
       if (ci_blob_reader.overrun)
-         goto fail;
+         return NULL;
    }
 
    /* Load the CRC that was created when the file was written. */
-   struct cache_entry_file_data *cf_data =
-      (struct cache_entry_file_data *)
-         blob_read_bytes(&ci_blob_reader, sizeof(struct cache_entry_file_data));
+   blob_copy_bytes(&ci_blob_reader, cf_data, sizeof(*cf_data));
    if (ci_blob_reader.overrun)
-      goto fail;
+      return NULL;
 
    size_t cache_data_size = ci_blob_reader.end - ci_blob_reader.current;
    const uint8_t *data = (uint8_t *) blob_read_bytes(&ci_blob_reader, cache_data_size);
 
    /* Check the data for corruption */
    if (cf_data->crc32 != util_hash_crc32(data, cache_data_size))
-      goto fail;
+      return NULL;
+
+   if (cache->compression_disabled &&
+       cf_data->uncompressed_size != cache_data_size)
+      return NULL;
+
+   *data_size = cache_data_size;
+
+   return data;
+}
+
+static bool
+uncompress_cache_item(const struct cache_entry_file_data *cf_data,
+                      const uint8_t *data, size_t data_size,
+                      uint8_t *uncompressed_data)
+{
+   /* Data that doesn't compress is stored as is */
+   if (cf_data->uncompressed_size == data_size) {
+      memcpy(uncompressed_data, data, data_size);
+      return true;
+   }
+
+   return util_compress_inflate(data, data_size, uncompressed_data,
+                                cf_data->uncompressed_size);
+}
+
+static void *
+parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
+                              size_t cache_item_size, size_t *size)
+{
+   struct cache_entry_file_data cf_data;
+   size_t data_size;
+
+   const uint8_t *data = parse_cache_item(cache, cache_item, cache_item_size,
+                                          &cf_data, &data_size);
+   if (!data)
+      return NULL;
 
    /* Uncompress the cache data */
-   uncompressed_data = malloc(cf_data->uncompressed_size);
+   uint8_t *uncompressed_data = malloc(cf_data.uncompressed_size);
    if (!uncompressed_data)
+      return NULL;
+
+   if (!uncompress_cache_item(&cf_data, data, data_size, uncompressed_data)) {
+      free(uncompressed_data);
+      return NULL;
+   }
+
+   if (size)
+      *size = cf_data.uncompressed_size;
+
+   return uncompressed_data;
+}
+
+struct disk_cache_blob *
+disk_cache_blob_create(const void *data, size_t size, void *copy,
+                       void *map, size_t map_size)
+{
+   struct disk_cache_blob *blob = malloc(sizeof(*blob));
+   if (!blob)
+      return NULL;
+
+   blob->data = data;
+   blob->size = size;
+   blob->refcount = 1;
+   blob->copy = copy;
+   blob->map = map;
+   blob->map_size = map_size;
+
+   return blob;
+}
+
+void
+disk_cache_blob_destroy(struct disk_cache_blob *blob)
+{
+   if (blob->map)
+      munmap(blob->map, blob->map_size);
+
+   free(blob->copy);
+   free(blob);
+}
+
+/* Create a blob from a cache item that lives in a read-only file mapping.
+ * Items stored uncompressed are referenced in place, otherwise they are
+ * inflated into a private copy and the mapping is released. Takes ownership
+ * of the mapping.
+ */
+static struct disk_cache_blob *
+create_blob_from_mapped_item(struct disk_cache *cache, const void *cache_item,
+                             size_t cache_item_size, void *map,
+                             size_t map_size)
+{
+   struct disk_cache_blob *blob = NULL;
+   struct cache_entry_file_data cf_data;
+   uint8_t *copy = NULL;
+   size_t data_size;
+
+   const uint8_t *data = parse_cache_item(cache, cache_item, cache_item_size,
+                                          &cf_data, &data_size);
+   if (!data)
       goto fail;
 
-   if (cache->compression_disabled) {
-      if (cf_data->uncompressed_size != cache_data_size)
+   if (cf_data.uncompressed_size == data_size) {
+      blob = disk_cache_blob_create(data, data_size, NULL, map, map_size);
+      if (!blob)
          goto fail;
 
-      memcpy(uncompressed_data, data, cache_data_size);
-   } else {
-      if (!util_compress_inflate(data, cache_data_size, uncompressed_data,
-                                 cf_data->uncompressed_size))
-         goto fail;
+      return blob;
    }
 
-   if (size)
-      *size = cf_data->uncompressed_size;
+   copy = malloc(cf_data.uncompressed_size);
+   if (!copy ||
+       !uncompress_cache_item(&cf_data, data, data_size, copy))
+      goto fail;
 
-   return uncompressed_data;
+   blob = disk_cache_blob_create(copy, cf_data.uncompressed_size, copy,
+                                 NULL, 0);
+   if (!blob)
+      goto fail;
+
+   munmap(map, map_size);
+
+   return blob;
 
  fail:
-   if (uncompressed_data)
-      free(uncompressed_data);
+   free(copy);
+   munmap(map, map_size);
 
    return NULL;
 }
 
+struct disk_cache_blob *
+disk_cache_load_item_blob(struct disk_cache *cache, char *filename)
+{
+   struct disk_cache_blob *blob = NULL;
+   struct stat sb;
+
+   int fd = open(filename, O_RDONLY | O_CLOEXEC);
+   free(filename);
+   if (fd == -1)
+      return NULL;
+
+   /* Cache files are never modified once they have been written, they are
+    * replaced by rename() and evicted by unlink(), neither of which affects
+    * existing mappings.
+    */
+   if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+      void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+         blob = create_blob_from_mapped_item(cache, map, sb.st_size,
+                                             map, sb.st_size);
+   }
+
+   close(fd);
+
+   return blob;
+}
+
+struct disk_cache_read_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   cache_key key;
+
+   struct disk_cache_blob **blob;
+};
+
+static void
+cache_load_item(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_read_job *dc_job = (struct disk_cache_read_job *) job;
+   char *filename = disk_cache_get_cache_filename(dc_job->cache, dc_job->key);
+
+   if (filename)
+      *dc_job->blob = disk_cache_load_item_blob(dc_job->cache, filename);
+}
+
+static void
+cache_prefetch_item(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_read_job *dc_job = (struct disk_cache_read_job *) job;
+   char *filename = disk_cache_get_cache_filename(dc_job->cache, dc_job->key);
+
+   if (!filename)
+      return;
+
+#ifdef HAVE_POSIX_FADVISE
+   int fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd != -1) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      close(fd);
+   }
+#endif
+
+   free(filename);
+}
+
+static void
+destroy_read_job(void *job, void *gdata, int thread_index)
+{
+   free(job);
+}
+
+static void
+init_read_queue(const void *data)
+{
+   struct disk_cache *cache = (struct disk_cache *)data;
+
+   util_queue_init(&cache->read_queue, "diskr$", 32, 4,
+                   UTIL_QUEUE_INIT_SCALE_THREADS |
+                   UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+}
+
+/* Most processes never do batched reads, the queue and its threads are only
+ * created when they are needed. The cache is usable without the queue, hence
+ * a failure isn't fatal.
+ */
+static bool
+disk_cache_init_read_queue(struct disk_cache *cache)
+{
+   util_call_once_data(&cache->read_queue_once, init_read_queue, cache);
+   return util_queue_is_initialized(&cache->read_queue);
+}
+
+/* Load the items that aren't in blobs[] yet. Each item lives in its own
+ * file, so the files are opened and read in parallel on the read queue.
+ */
+void
+disk_cache_load_items_blob(struct disk_cache *cache, const cache_key *keys,
+                           unsigned num_keys, struct disk_cache_blob **blobs)
+{
+   struct disk_cache_read_job *jobs = NULL;
+   unsigned i;
+
+   if (num_keys > 1 && disk_cache_init_read_queue(cache))
+      jobs = calloc(num_keys, sizeof(*jobs));
+
+   if (!jobs) {
+      for (i = 0; i < num_keys; i++) {
+         if (blobs[i])
+            continue;
+
+         char *filename = disk_cache_get_cache_filename(cache, keys[i]);
+         if (filename)
+            blobs[i] = disk_cache_load_item_blob(cache, filename);
+      }
+      return;
+   }
+
+   for (i = 0; i < num_keys; i++) {
+      if (blobs[i])
+         continue;
+
+      jobs[i].cache = cache;
+      memcpy(jobs[i].key, keys[i], CACHE_KEY_SIZE);
+      jobs[i].blob = &blobs[i];
+
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&cache->read_queue, &jobs[i], &jobs[i].fence,
+                         cache_load_item, NULL, 0);
+   }
+
+   for (i = 0; i < num_keys; i++) {
+      if (!jobs[i].cache)
+         continue;
+
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+
+   free(jobs);
+}
+
+/* Read the item files ahead in the background */
+void
+disk_cache_prefetch_items(struct disk_cache *cache, const cache_key *keys,
+                          unsigned num_keys)
+{
+   if (!disk_cache_init_read_queue(cache))
+      return;
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct disk_cache_read_job *job = calloc(1, sizeof(*job));
+      if (!job)
+         return;
+
+      job->cache = cache;
+      memcpy(job->key, keys[i], CACHE_KEY_SIZE);
+
+      util_queue_add_job(&cache->read_queue, job, NULL,
+                         cache_prefetch_item, destroy_read_job, 0);
+   }
+}
+
 void *
 disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
 {
@@ -672,6 +937,16 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
                               compressed_data, max_buf);
       if (compressed_size == 0)
          goto fail;
+
+      /* Store the data as is if it doesn't compress, which also allows
+       * disk_cache_get_blob() to return it without a copy. Reading relies
+       * on compressed payloads being smaller than the uncompressed data.
+       */
+      if (compressed_size >= dc_job->size) {
+         free(compressed_data);
+         compressed_size = dc_job->size;
+         compressed_data = dc_job->data;
+      }
    }
 
    /* Copy the driver_keys_blob, this can be used find information about the
@@ -714,13 +989,13 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
    if (!blob_write_bytes(cache_blob, compressed_data, compressed_size))
       goto fail;
 
-   if (!dc_job->cache->compression_disabled)
+   if (compressed_data != dc_job->data)
       free(compressed_data);
 
    return true;
 
  fail:
-   if (!dc_job->cache->compression_disabled)
+   if (compressed_data != dc_job->data)
       free(compressed_data);
 
    return false;
@@ -974,6 +1249,36 @@ disk_cache_load_item_foz(struct disk_cache *cache, const cache_key key,
    return uncompressed_data;
 }
 
+struct disk_cache_blob *
+disk_cache_load_item_foz_blob(struct disk_cache *cache, const cache_key key)
+{
+   size_t cache_item_size = 0;
+   size_t map_size;
+   void *map;
+
+   const void *cache_item = foz_map_entry(&cache->foz_db, key,
+                                          &cache_item_size, &map, &map_size);
+   if (!cache_item)
+      return NULL;
+
+   return create_blob_from_mapped_item(cache, cache_item, cache_item_size,
+                                       map, map_size);
+}
+
+/* Load the items that aren't in blobs[] yet */
+void
+disk_cache_load_items_foz_blob(struct disk_cache *cache, const cache_key *keys,
+                               unsigned num_keys,
+                               struct disk_cache_blob **blobs)
+{
+   foz_prefetch(&cache->foz_db, keys[0], num_keys);
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      if (!blobs[i])
+         blobs[i] = disk_cache_load_item_foz_blob(cache, keys[i]);
+   }
+}
+
 bool
 disk_cache_write_item_to_disk_foz(struct disk_cache_put_job *dc_job)
 {
@@ -1090,6 +1395,60 @@ disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
    return uncompressed_data;
 }
 
+/* Load the items that aren't in blobs[] yet */
+void
+disk_cache_db_load_items(struct disk_cache *cache, const cache_key *keys,
+                         unsigned num_keys, struct disk_cache_blob **blobs)
+{
+   unsigned num_missing = 0, i, j;
+
+   cache_key *missing_keys = malloc(num_keys * sizeof(cache_key));
+   unsigned *missing = malloc(num_keys * sizeof(*missing));
+   void **cache_items = malloc(num_keys * sizeof(*cache_items));
+   size_t *cache_item_sizes = malloc(num_keys * sizeof(*cache_item_sizes));
+
+   if (!missing_keys || !missing || !cache_items || !cache_item_sizes)
+      goto out;
+
+   for (i = 0; i < num_keys; i++) {
+      if (blobs[i])
+         continue;
+
+      memcpy(missing_keys[num_missing], keys[i], CACHE_KEY_SIZE);
+      missing[num_missing++] = i;
+   }
+
+   if (!num_missing)
+      goto out;
+
+   mesa_cache_db_multipart_read_entries(&cache->cache_db, missing_keys[0],
+                                        num_missing, cache_items,
+                                        cache_item_sizes);
+
+   for (j = 0; j < num_missing; j++) {
+      size_t size;
+
+      if (!cache_items[j])
+         continue;
+
+      void *data = parse_and_validate_cache_item(cache, cache_items[j],
+                                                 cache_item_sizes[j], &size);
+      free(cache_items[j]);
+
+      if (data) {
+         blobs[missing[j]] = disk_cache_blob_create(data, size, data, NULL, 0);
+         if (!blobs[missing[j]])
+            free(data);
+      }
+   }
+
+out:
+   free(cache_item_sizes);
+   free(cache_items);
+   free(missing);
+   free(missing_keys);
+}
+
 bool
 disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job)
 {
@@ -24,6 +24,7 @@
 #ifndef DISK_CACHE_OS_H
 #define DISK_CACHE_OS_H
 
+#include "util/u_call_once.h"
 #include "util/u_queue.h"
 
 #if DETECT_OS_WINDOWS
@@ -64,6 +65,12 @@ struct disk_cache {
    /* Thread queue for compressing and writing cache entries to disk */
    struct util_queue cache_queue;
 
+   /* Thread queue for batched and prefetched reads of the multi-file cache,
+    * created by the first of them.
+    */
+   struct util_queue read_queue;
+   util_once_flag read_queue_once;
+
    struct foz_db foz_db;
 
    struct mesa_cache_db_multipart cache_db;
@@ -145,6 +152,32 @@ disk_cache_load_item_foz(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size);
 
+struct disk_cache_blob *
+disk_cache_load_item_foz_blob(struct disk_cache *cache, const cache_key key);
+
+struct disk_cache_blob *
+disk_cache_load_item_blob(struct disk_cache *cache, char *filename);
+
+void
+disk_cache_load_items_foz_blob(struct disk_cache *cache, const cache_key *keys,
+                               unsigned num_keys,
+                               struct disk_cache_blob **blobs);
+
+void
+disk_cache_load_items_blob(struct disk_cache *cache, const cache_key *keys,
+                           unsigned num_keys, struct disk_cache_blob **blobs);
+
+void
+disk_cache_prefetch_items(struct disk_cache *cache, const cache_key *keys,
+                          unsigned num_keys);
+
+struct disk_cache_blob *
+disk_cache_blob_create(const void *data, size_t size, void *copy,
+                       void *map, size_t map_size);
+
+void
+disk_cache_blob_destroy(struct disk_cache_blob *blob);
+
 char *
 disk_cache_get_cache_filename(struct disk_cache *cache, const cache_key key);
 
@@ -172,6 +205,10 @@ void *
 disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
                         size_t *size);
 
+void
+disk_cache_db_load_items(struct disk_cache *cache, const cache_key *keys,
+                         unsigned num_keys, struct disk_cache_blob **blobs);
+
 bool
 disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job);
 
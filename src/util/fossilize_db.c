@@ -33,10 +33,12 @@
 #ifdef FOZ_DB_UTIL
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -648,6 +650,189 @@ fail:
    return NULL;
 }
 
+/* Same as foz_read_entry(), but maps the entry payload read-only instead of
+ * copying it. This is safe because the db files are append-only, hence the
+ * payload never changes once it has been indexed. On success \map and
+ * \map_size describe the page-aligned mapping that has to be munmap()ed
+ * once the payload isn't used anymore.
+ */
+const void *
+foz_map_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+              size_t *size, void **map, size_t *map_size)
+{
+   uint64_t hash = truncate_hash_to_64bits(cache_key_160bit);
+   struct foz_payload_header header;
+   const uint8_t *data = NULL;
+   struct stat st;
+
+   if (!foz_db->alive)
+      return NULL;
+
+   simple_mtx_lock(&foz_db->mtx);
+
+   struct foz_db_entry *entry =
+      _mesa_hash_table_u64_search(foz_db->index_db, hash);
+   if (!entry && foz_db->db_idx) {
+      update_foz_index(foz_db, foz_db->db_idx, 0);
+      entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
+   }
+   if (!entry)
+      goto fail;
+
+   /* Check for collision using full 160bit hash for increased assurance
+    * against potential collisions.
+    */
+   if (memcmp(cache_key_160bit, entry->key, sizeof(entry->key)))
+      goto fail;
+
+   int fd = fileno(foz_db->file[entry->file_idx]);
+
+   if (pread(fd, &header, sizeof(header), entry->offset) != sizeof(header) ||
+       fstat(fd, &st) == -1)
+      goto fail;
+
+   uint64_t data_offset = entry->offset + sizeof(header);
+   if (data_offset + header.payload_size > st.st_size)
+      goto fail;
+
+   uint64_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+   uint64_t map_offset = data_offset & ~page_mask;
+
+   *map_size = data_offset - map_offset + header.payload_size;
+   *map = mmap(NULL, *map_size, PROT_READ, MAP_SHARED, fd, map_offset);
+   if (*map == MAP_FAILED)
+      goto fail;
+
+   simple_mtx_unlock(&foz_db->mtx);
+
+   data = (const uint8_t *)*map + (data_offset - map_offset);
+
+   /* verify checksum */
+   if (header.crc != 0) {
+      if (util_hash_crc32(data, header.payload_size) != header.crc) {
+         munmap(*map, *map_size);
+         return NULL;
+      }
+   }
+
+   if (size)
+      *size = header.payload_size;
+
+   return data;
+
+fail:
+   simple_mtx_unlock(&foz_db->mtx);
+
+   return NULL;
+}
+
+#ifdef HAVE_POSIX_FADVISE
+struct foz_range {
+   uint8_t file_idx;
+   uint64_t start;
+   uint64_t end;
+};
+
+static int
+foz_range_compare(const void *_a, const void *_b)
+{
+   const struct foz_range *a = _a;
+   const struct foz_range *b = _b;
+
+   if (a->file_idx != b->file_idx)
+      return a->file_idx > b->file_idx ? 1 : -1;
+
+   if (a->start == b->start)
+      return 0;
+
+   return a->start > b->start ? 1 : -1;
+}
+
+/* Ask the kernel to read ahead the payloads of the given entries, so that
+ * the following foz_read_entry() or foz_map_entry() calls don't have to wait
+ * for the disk. Entries that are close to each other are merged into a single
+ * request. The keys are packed, 20 bytes each.
+ */
+void
+foz_prefetch(struct foz_db *foz_db, const uint8_t *cache_keys_160bit,
+             unsigned num_keys)
+{
+   struct foz_payload_header header;
+   struct foz_range *ranges;
+   unsigned num_ranges = 0, num_found = 0, i;
+   bool index_updated = false;
+
+   if (!foz_db->alive)
+      return;
+
+   ranges = malloc(num_keys * sizeof(*ranges));
+   if (!ranges)
+      return;
+
+   /* Only look the offsets up under the lock. The payload headers are read
+    * with pread() afterwards, so a slow disk doesn't stall the other threads
+    * using the database. The files stay open as long as the db is alive.
+    */
+   simple_mtx_lock(&foz_db->mtx);
+
+   for (i = 0; i < num_keys; i++) {
+      uint64_t hash = truncate_hash_to_64bits(&cache_keys_160bit[i * 20]);
+
+      struct foz_db_entry *entry =
+         _mesa_hash_table_u64_search(foz_db->index_db, hash);
+      if (!entry && foz_db->db_idx && !index_updated) {
+         update_foz_index(foz_db, foz_db->db_idx, 0);
+         entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
+         index_updated = true;
+      }
+      if (!entry)
+         continue;
+
+      ranges[num_found].file_idx = entry->file_idx;
+      ranges[num_found].start = entry->offset;
+      num_found++;
+   }
+
+   simple_mtx_unlock(&foz_db->mtx);
+
+   for (i = 0; i < num_found; i++) {
+      int fd = fileno(foz_db->file[ranges[i].file_idx]);
+      if (pread(fd, &header, sizeof(header), ranges[i].start) != sizeof(header))
+         continue;
+
+      ranges[num_ranges].file_idx = ranges[i].file_idx;
+      ranges[num_ranges].start = ranges[i].start;
+      ranges[num_ranges].end = ranges[i].start + sizeof(header) +
+                               header.payload_size;
+      num_ranges++;
+   }
+
+   qsort(ranges, num_ranges, sizeof(*ranges), foz_range_compare);
+
+   for (i = 0; i < num_ranges;) {
+      uint8_t file_idx = ranges[i].file_idx;
+      uint64_t start = ranges[i].start;
+      uint64_t end = ranges[i].end;
+
+      /* Merge the entries that are at most a hash string apart */
+      for (i++; i < num_ranges && ranges[i].file_idx == file_idx &&
+                ranges[i].start <= end + FOSSILIZE_BLOB_HASH_LENGTH; i++)
+         end = MAX2(end, ranges[i].end);
+
+      posix_fadvise(fileno(foz_db->file[file_idx]), start, end - start,
+                    POSIX_FADV_WILLNEED);
+   }
+
+   free(ranges);
+}
+#else
+void
+foz_prefetch(struct foz_db *foz_db, const uint8_t *cache_keys_160bit,
+             unsigned num_keys)
+{
+}
+#endif
+
 /* Here we write the cache entry to disk and store its offset in the index db.
  */
 bool
@@ -776,6 +961,19 @@ foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    return false;
 }
 
+const void *
+foz_map_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+              size_t *size, void **map, size_t *map_size)
+{
+   return NULL;
+}
+
+void
+foz_prefetch(struct foz_db *foz_db, const uint8_t *cache_keys_160bit,
+             unsigned num_keys)
+{
+}
+
 bool
 foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                 const void *blob, size_t size)
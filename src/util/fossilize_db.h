@@ -105,6 +105,14 @@ void *
 foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                size_t *size);
 
+const void *
+foz_map_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+              size_t *size, void **map, size_t *map_size);
+
+void
+foz_prefetch(struct foz_db *foz_db, const uint8_t *cache_keys_160bit,
+             unsigned num_keys);
+
 bool
 foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
                 const void *blob, size_t size);
@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "crc32.h"
@@ -31,6 +33,11 @@
 #define MESA_CACHE_DB_VERSION          1
 #define MESA_CACHE_DB_MAGIC            "MESA_DB"
 
+/* Number of pending last access time updates after which a reader tries
+ * to write them back to the index file.
+ */
+#define MESA_CACHE_DB_ACCESS_FLUSH_THRESHOLD 64
+
 struct PACKED mesa_db_file_header {
    char magic[8];
    uint32_t version;
@@ -56,6 +63,7 @@ struct mesa_index_db_hash_entry {
    uint64_t last_access_time;
    uint32_t size;
    bool evicted;
+   bool accessed;
 };
 
 static inline bool mesa_db_seek_end(FILE *file)
@@ -277,6 +285,7 @@ mesa_db_update_index(struct mesa_cache_db *db)
       hash_entry->index_db_file_offset = db->index.offset;
       hash_entry->last_access_time = index_entry.last_access_time;
       hash_entry->size = index_entry.size;
+      hash_entry->accessed = false;
 
       _mesa_hash_table_u64_insert(db->index_db, index_entry.hash, hash_entry);
 
@@ -293,6 +302,7 @@ static void
 mesa_db_hash_table_reset(struct mesa_cache_db *db)
 {
    _mesa_hash_table_u64_clear(db->index_db);
+   util_dynarray_clear(&db->accessed);
    ralloc_free(db->mem_ctx);
    db->mem_ctx = ralloc_context(NULL);
 }
@@ -355,12 +365,56 @@ fail:
    return false;
 }
 
+/* Write back the last access times of the entries that were read by the
+ * lock-light read path. Must be called with the exclusive lock held and
+ * only if UUID of the database files didn't change, otherwise the index
+ * offsets of the entries are stale.
+ */
+static void
+mesa_db_flush_access_times(struct mesa_cache_db *db)
+{
+   struct mesa_index_db_file_entry index_entry;
+
+   if (!db->accessed.size)
+      return;
+
+   util_dynarray_foreach(&db->accessed, struct mesa_index_db_hash_entry *,
+                         entry) {
+      struct mesa_index_db_hash_entry *hash_entry = *entry;
+
+      hash_entry->accessed = false;
+
+      if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
+          !mesa_db_read(db->index.file, &index_entry) ||
+          !mesa_db_index_entry_valid(&index_entry) ||
+          index_entry.cache_db_file_offset != hash_entry->cache_db_file_offset ||
+          index_entry.size != hash_entry->size)
+         continue;
+
+      if (index_entry.last_access_time >= hash_entry->last_access_time)
+         continue;
+
+      index_entry.last_access_time = hash_entry->last_access_time;
+
+      if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
+          !mesa_db_write(db->index.file, &index_entry))
+         break;
+   }
+
+   util_dynarray_clear(&db->accessed);
+
+   fflush(db->index.file);
+}
+
 static bool
 mesa_db_reload(struct mesa_cache_db *db)
 {
    fflush(db->cache.file);
    fflush(db->index.file);
 
+   if (db->accessed.size && !mesa_db_uuid_changed(db))
+      mesa_db_flush_access_times(db);
+
    return mesa_db_load(db, true);
 }
 
@@ -389,12 +443,27 @@ mesa_db_open_file(struct mesa_cache_db_file *db_file,
       return false;
    }
 
+   db_file->map = NULL;
+   db_file->map_size = 0;
+   db_file->map_uuid = 0;
+
    return true;
 }
 
+static void
+mesa_db_unmap_file(struct mesa_cache_db_file *db_file)
+{
+   if (db_file->map)
+      munmap(db_file->map, db_file->map_size);
+
+   db_file->map = NULL;
+   db_file->map_size = 0;
+}
+
 static void
 mesa_db_close_file(struct mesa_cache_db_file *db_file)
 {
+   mesa_db_unmap_file(db_file);
    fclose(db_file->file);
    free(db_file->path);
 }
@@ -615,6 +684,7 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
       goto close_index;
 
    simple_mtx_init(&db->flock_mtx, mtx_plain);
+   util_dynarray_init(&db->accessed, NULL);
 
    db->index_db = _mesa_hash_table_u64_create(NULL);
    if (!db->index_db)
@@ -628,6 +698,7 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
 destroy_hash:
    _mesa_hash_table_u64_destroy(db->index_db);
 destroy_mtx:
+   util_dynarray_fini(&db->accessed);
    simple_mtx_destroy(&db->flock_mtx);
 
    ralloc_free(db->mem_ctx);
@@ -658,7 +729,15 @@ mesa_db_wipe_path(const char *cache_path)
 void
 mesa_cache_db_close(struct mesa_cache_db *db)
 {
+   if (db->accessed.size && mesa_db_lock(db)) {
+      if (db->alive && !mesa_db_uuid_changed(db))
+         mesa_db_flush_access_times(db);
+
+      mesa_db_unlock(db);
+   }
+
    _mesa_hash_table_u64_destroy(db->index_db);
+   util_dynarray_fini(&db->accessed);
    simple_mtx_destroy(&db->flock_mtx);
    ralloc_free(db->mem_ctx);
 
@@ -679,10 +758,10 @@ mesa_cache_db_file_entry_size(void)
    return sizeof(struct mesa_cache_db_file_entry);
 }
 
-void *
-mesa_cache_db_read_entry(struct mesa_cache_db *db,
-                         const uint8_t *cache_key_160bit,
-                         size_t *size)
+static void *
+mesa_db_read_entry_locked(struct mesa_cache_db *db,
+                          const uint8_t *cache_key_160bit,
+                          size_t *size)
 {
    uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
    struct mesa_cache_db_file_entry cache_entry;
@@ -754,6 +833,407 @@ fail:
    return NULL;
 }
 
+/* (Re)map the database file if it was resized or rewritten since the last
+ * time it was mapped. Must be called with the database lock held, at least
+ * the shared one. Files only shrink on compaction, which changes UUID, hence
+ * mapping stays valid as long as UUID didn't change.
+ */
+static bool
+mesa_db_map_file(struct mesa_cache_db *db, struct mesa_cache_db_file *db_file)
+{
+   struct stat st;
+   void *map;
+
+   if (fstat(fileno(db_file->file), &st) == -1)
+      return false;
+
+   if (db_file->map && db_file->map_uuid == db->uuid &&
+       db_file->map_size == st.st_size)
+      return true;
+
+   mesa_db_unmap_file(db_file);
+
+   if (st.st_size < sizeof(struct mesa_db_file_header))
+      return false;
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+              fileno(db_file->file), 0);
+   if (map == MAP_FAILED)
+      return false;
+
+   db_file->map = map;
+   db_file->map_size = st.st_size;
+   db_file->map_uuid = db->uuid;
+
+   return true;
+}
+
+static const void *
+mesa_db_map_range(struct mesa_cache_db *db, struct mesa_cache_db_file *db_file,
+                  uint64_t offset, uint64_t size)
+{
+   if (!db_file->map || db_file->map_uuid != db->uuid ||
+       offset + size > db_file->map_size) {
+      if (!mesa_db_map_file(db, db_file) ||
+          offset + size > db_file->map_size)
+         return NULL;
+   }
+
+   return (const uint8_t *)db_file->map + offset;
+}
+
+/* Same as mesa_db_uuid_changed(), but doesn't touch the FILE streams, which
+ * may be in use by the writers of this process.
+ */
+static bool
+mesa_db_uuid_changed_shared(struct mesa_cache_db *db)
+{
+   struct mesa_db_file_header header;
+
+   /* Compaction rewrites the index header last, hence it's enough to check
+    * only the index file. */
+   if (pread(fileno(db->index.file), &header, sizeof(header), 0) !=
+       sizeof(header))
+      return true;
+
+   if (strncmp(header.magic, MESA_CACHE_DB_MAGIC, sizeof(header.magic)) ||
+       header.version != MESA_CACHE_DB_VERSION || header.uuid != db->uuid)
+      return true;
+
+   return false;
+}
+
+/* Pick up the index entries appended by other cache writers */
+static bool
+mesa_db_update_index_mapped(struct mesa_cache_db *db)
+{
+   const struct mesa_index_db_file_entry *index_entry;
+   struct mesa_index_db_hash_entry *hash_entry;
+
+   if (!mesa_db_map_file(db, &db->index))
+      return false;
+
+   while (db->index.offset + sizeof(*index_entry) <= db->index.map_size) {
+      index_entry = (const void *)((const uint8_t *)db->index.map +
+                                   db->index.offset);
+
+      if (!mesa_db_index_entry_valid((struct mesa_index_db_file_entry *)index_entry))
+         return false;
+
+      hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
+      if (!hash_entry)
+         return false;
+
+      hash_entry->cache_db_file_offset = index_entry->cache_db_file_offset;
+      hash_entry->index_db_file_offset = db->index.offset;
+      hash_entry->last_access_time = index_entry->last_access_time;
+      hash_entry->size = index_entry->size;
+      hash_entry->accessed = false;
+
+      _mesa_hash_table_u64_insert(db->index_db, index_entry->hash, hash_entry);
+
+      db->index.offset += sizeof(*index_entry);
+   }
+
+   return db->index.offset == db->index.map_size;
+}
+
+/* Lock-light read path. Entries are read from the shared mappings of the
+ * database files while holding only the shared lock, which doesn't block
+ * other readers. Writers append entries under the exclusive lock and
+ * publish them by appending the index entry after the cache data, while
+ * compaction publishes the rewritten files by updating the UUID in the file
+ * headers. The last access time is only updated in memory and written back
+ * later under the exclusive lock.
+ *
+ * Must be called with the shared lock held, see mesa_db_lock_shared(). Sets
+ * retry if the entry couldn't be read reliably and the caller should fall
+ * back to the fully locked path, which also deals with reloading and
+ * repairing the database.
+ */
+static void *
+mesa_db_read_entry_mapped(struct mesa_cache_db *db,
+                          const uint8_t *cache_key_160bit,
+                          size_t *size, bool *retry)
+{
+   uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
+   const struct mesa_cache_db_file_entry *cache_entry;
+   struct mesa_index_db_hash_entry *hash_entry;
+   void *data;
+
+   *retry = true;
+
+   hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+   if (!hash_entry) {
+      if (!mesa_db_update_index_mapped(db))
+         return NULL;
+
+      hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+      if (!hash_entry) {
+         *retry = false;
+         return NULL;
+      }
+   }
+
+   cache_entry = mesa_db_map_range(db, &db->cache,
+                                   hash_entry->cache_db_file_offset,
+                                   blob_file_size(hash_entry->size));
+   if (!cache_entry ||
+       !mesa_db_cache_entry_valid((struct mesa_cache_db_file_entry *)cache_entry) ||
+       cache_entry->size != hash_entry->size)
+      return NULL;
+
+   if (memcmp(cache_entry->key, cache_key_160bit, sizeof(cache_entry->key))) {
+      *retry = false;
+      return NULL;
+   }
+
+   data = malloc(cache_entry->size);
+   if (!data) {
+      *retry = false;
+      return NULL;
+   }
+
+   memcpy(data, cache_entry + 1, cache_entry->size);
+
+   if (util_hash_crc32(data, cache_entry->size) != cache_entry->crc) {
+      free(data);
+      return NULL;
+   }
+
+   hash_entry->last_access_time = os_time_get_nano();
+
+   if (!hash_entry->accessed) {
+      hash_entry->accessed = true;
+      util_dynarray_append(&db->accessed, struct mesa_index_db_hash_entry *,
+                           hash_entry);
+   }
+
+   *size = cache_entry->size;
+   *retry = false;
+
+   return data;
+}
+
+/* Take the shared lock of the lock-light read path. Returns false if the
+ * database files were rewritten or the lock can't be taken, in which case
+ * the locked path has to be used.
+ */
+static bool
+mesa_db_lock_shared(struct mesa_cache_db *db)
+{
+   if (flock(fileno(db->index.file), LOCK_SH) == -1)
+      return false;
+
+   if (mesa_db_uuid_changed_shared(db)) {
+      flock(fileno(db->index.file), LOCK_UN);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+mesa_db_unlock_shared(struct mesa_cache_db *db)
+{
+   flock(fileno(db->index.file), LOCK_UN);
+}
+
+struct mesa_db_range {
+   uint64_t start;
+   uint64_t end;
+};
+
+static int
+range_compare(const void *_a, const void *_b)
+{
+   const struct mesa_db_range *a = _a;
+   const struct mesa_db_range *b = _b;
+
+   if (a->start == b->start)
+      return 0;
+
+   return a->start > b->start ? 1 : -1;
+}
+
+/* Ask the kernel to read ahead the cache data of the given entries, merging
+ * entries that are close to each other into a single request. Must be
+ * called with the shared lock held.
+ */
+static void
+mesa_db_prefetch_mapped(struct mesa_cache_db *db,
+                        const uint8_t *cache_keys_160bit, unsigned num_keys)
+{
+   uint64_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+   struct mesa_index_db_hash_entry *hash_entry;
+   struct mesa_db_range *ranges;
+   unsigned num_ranges = 0, i;
+   bool index_updated = false;
+   uint64_t end = 0;
+
+   ranges = malloc(num_keys * sizeof(*ranges));
+   if (!ranges)
+      return;
+
+   for (i = 0; i < num_keys; i++) {
+      uint64_t hash = to_mesa_cache_db_hash(&cache_keys_160bit[i * 20]);
+
+      hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+      if (!hash_entry && !index_updated) {
+         index_updated = true;
+
+         if (!mesa_db_update_index_mapped(db))
+            break;
+
+         hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+      }
+
+      if (!hash_entry)
+         continue;
+
+      ranges[num_ranges].start = hash_entry->cache_db_file_offset;
+      ranges[num_ranges].end = hash_entry->cache_db_file_offset +
+                               blob_file_size(hash_entry->size);
+      end = MAX2(end, ranges[num_ranges].end);
+      num_ranges++;
+   }
+
+   if (!num_ranges || !mesa_db_map_range(db, &db->cache, 0, end))
+      goto out;
+
+   qsort(ranges, num_ranges, sizeof(*ranges), range_compare);
+
+   for (i = 0; i < num_ranges;) {
+      uint64_t start = ranges[i].start & ~page_mask;
+      uint64_t stop = ranges[i].end;
+
+      for (i++; i < num_ranges && ranges[i].start <= stop + page_mask; i++)
+         stop = MAX2(stop, ranges[i].end);
+
+      madvise((uint8_t *)db->cache.map + start, stop - start, MADV_WILLNEED);
+   }
+
+out:
+   free(ranges);
+}
+
+/* Write back the pending last access times if nobody else holds the lock */
+static void
+mesa_db_try_flush_access_times(struct mesa_cache_db *db)
+{
+   if (flock(fileno(db->cache.file), LOCK_EX | LOCK_NB) == -1)
+      return;
+
+   if (flock(fileno(db->index.file), LOCK_EX | LOCK_NB) != -1) {
+      if (!mesa_db_uuid_changed(db))
+         mesa_db_flush_access_times(db);
+
+      flock(fileno(db->index.file), LOCK_UN);
+   }
+
+   flock(fileno(db->cache.file), LOCK_UN);
+}
+
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db,
+                         const uint8_t *cache_key_160bit,
+                         size_t *size)
+{
+   bool retry = true;
+   void *data = NULL;
+
+   simple_mtx_lock(&db->flock_mtx);
+
+   if (!db->alive) {
+      simple_mtx_unlock(&db->flock_mtx);
+      return NULL;
+   }
+
+   if (mesa_db_lock_shared(db)) {
+      data = mesa_db_read_entry_mapped(db, cache_key_160bit, size, &retry);
+
+      mesa_db_unlock_shared(db);
+   }
+
+   if (util_dynarray_num_elements(&db->accessed, void *) >=
+       MESA_CACHE_DB_ACCESS_FLUSH_THRESHOLD)
+      mesa_db_try_flush_access_times(db);
+
+   simple_mtx_unlock(&db->flock_mtx);
+
+   if (retry)
+      return mesa_db_read_entry_locked(db, cache_key_160bit, size);
+
+   return data;
+}
+
+void
+mesa_cache_db_read_entries(struct mesa_cache_db *db,
+                           const uint8_t *cache_keys_160bit,
+                           unsigned num_keys, void **data, size_t *sizes)
+{
+   unsigned i;
+
+   for (i = 0; i < num_keys; i++) {
+      data[i] = NULL;
+      sizes[i] = 0;
+   }
+
+   bool *retry = malloc(num_keys * sizeof(*retry));
+   if (!retry) {
+      for (i = 0; i < num_keys; i++)
+         data[i] = mesa_cache_db_read_entry(db, &cache_keys_160bit[i * 20],
+                                            &sizes[i]);
+      return;
+   }
+
+   simple_mtx_lock(&db->flock_mtx);
+
+   for (i = 0; i < num_keys; i++)
+      retry[i] = db->alive;
+
+   /* Look up all the entries under a single lock and let the kernel read
+    * their data in as few requests as possible.
+    */
+   if (db->alive && mesa_db_lock_shared(db)) {
+      mesa_db_prefetch_mapped(db, cache_keys_160bit, num_keys);
+
+      for (i = 0; i < num_keys; i++)
+         data[i] = mesa_db_read_entry_mapped(db, &cache_keys_160bit[i * 20],
+                                             &sizes[i], &retry[i]);
+
+      mesa_db_unlock_shared(db);
+   }
+
+   if (util_dynarray_num_elements(&db->accessed, void *) >=
+       MESA_CACHE_DB_ACCESS_FLUSH_THRESHOLD)
+      mesa_db_try_flush_access_times(db);
+
+   simple_mtx_unlock(&db->flock_mtx);
+
+   for (i = 0; i < num_keys; i++) {
+      if (retry[i])
+         data[i] = mesa_db_read_entry_locked(db, &cache_keys_160bit[i * 20],
+                                             &sizes[i]);
+   }
+
+   free(retry);
+}
+
+void
+mesa_cache_db_prefetch(struct mesa_cache_db *db,
+                       const uint8_t *cache_keys_160bit, unsigned num_keys)
+{
+   simple_mtx_lock(&db->flock_mtx);
+
+   if (db->alive && mesa_db_lock_shared(db)) {
+      mesa_db_prefetch_mapped(db, cache_keys_160bit, num_keys);
+      mesa_db_unlock_shared(db);
+   }
+
+   simple_mtx_unlock(&db->flock_mtx);
+}
+
 static bool
 mesa_cache_db_has_space_locked(struct mesa_cache_db *db, size_t blob_size)
 {
@@ -786,6 +1266,8 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
       goto fail_fatal;
 
+   mesa_db_flush_access_times(db);
+
    if (!mesa_db_seek_end(db->cache.file))
       goto fail_fatal;
 
@@ -825,6 +1307,7 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    hash_entry->index_db_file_offset = ftell(db->index.file);
    hash_entry->last_access_time = index_entry.last_access_time;
    hash_entry->size = index_entry.size;
+   hash_entry->accessed = false;
 
    if (!mesa_db_write(db->cache.file, &cache_entry) ||
        !mesa_db_write_data(db->cache.file, blob, blob_size) ||
@@ -870,6 +1353,8 @@ mesa_cache_db_entry_remove(struct mesa_cache_db *db,
    if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
       goto fail_fatal;
 
+   mesa_db_flush_access_times(db);
+
    if (!mesa_db_update_index(db))
       goto fail_fatal;
 
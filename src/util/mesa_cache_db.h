@@ -16,6 +16,7 @@
 
 #include "detect_os.h"
 #include "simple_mtx.h"
+#include "u_dynarray.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,11 @@ struct mesa_cache_db_file {
    char *path;
    off_t offset;
    uint64_t uuid;
+
+   /* Read-only mapping used by the lock-light read path */
+   void *map;
+   size_t map_size;
+   uint64_t map_uuid;
 };
 
 struct mesa_cache_db {
@@ -37,6 +43,11 @@ struct mesa_cache_db {
    void *mem_ctx;
    uint64_t uuid;
    bool alive;
+
+   /* Index entries read without the exclusive lock whose last access
+    * time hasn't been written back to the index file yet.
+    */
+   struct util_dynarray accessed;
 };
 
 #if DETECT_OS_WINDOWS == 0
@@ -58,6 +69,15 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
                          const uint8_t *cache_key_160bit,
                          size_t *size);
 
+void
+mesa_cache_db_read_entries(struct mesa_cache_db *db,
+                           const uint8_t *cache_keys_160bit,
+                           unsigned num_keys, void **data, size_t *sizes);
+
+void
+mesa_cache_db_prefetch(struct mesa_cache_db *db,
+                       const uint8_t *cache_keys_160bit, unsigned num_keys);
+
 bool
 mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
@@ -107,6 +127,23 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
    return NULL;
 }
 
+static inline void
+mesa_cache_db_read_entries(struct mesa_cache_db *db,
+                           const uint8_t *cache_keys_160bit,
+                           unsigned num_keys, void **data, size_t *sizes)
+{
+   for (unsigned i = 0; i < num_keys; i++) {
+      data[i] = NULL;
+      sizes[i] = 0;
+   }
+}
+
+static inline void
+mesa_cache_db_prefetch(struct mesa_cache_db *db,
+                       const uint8_t *cache_keys_160bit, unsigned num_keys)
+{
+}
+
 static inline bool
 mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
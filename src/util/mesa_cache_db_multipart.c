@@ -103,6 +103,84 @@ mesa_cache_db_multipart_read_entry(struct mesa_cache_db_multipart *db,
    return NULL;
 }
 
+/* Read several entries at once. The keys are packed, 20 bytes each. Each
+ * DB part is searched only for the keys that weren't found in the previous
+ * parts.
+ */
+void
+mesa_cache_db_multipart_read_entries(struct mesa_cache_db_multipart *db,
+                                     const uint8_t *cache_keys_160bit,
+                                     unsigned num_keys, void **data,
+                                     size_t *sizes)
+{
+   unsigned last_read_part = db->last_read_part;
+   unsigned *missing;
+   uint8_t *keys;
+   void **part_data;
+   size_t *part_sizes;
+   unsigned i, j;
+
+   for (i = 0; i < num_keys; i++) {
+      data[i] = NULL;
+      sizes[i] = 0;
+   }
+
+   missing = malloc(num_keys * sizeof(*missing));
+   keys = malloc(num_keys * 20);
+   part_data = malloc(num_keys * sizeof(*part_data));
+   part_sizes = malloc(num_keys * sizeof(*part_sizes));
+
+   if (!missing || !keys || !part_data || !part_sizes) {
+      for (i = 0; i < num_keys; i++)
+         data[i] = mesa_cache_db_multipart_read_entry(db,
+                                                      &cache_keys_160bit[i * 20],
+                                                      &sizes[i]);
+      goto out;
+   }
+
+   for (unsigned p = 0; p < db->num_parts; p++) {
+      unsigned int part = (last_read_part + p) % db->num_parts;
+      unsigned num_missing = 0;
+
+      for (i = 0; i < num_keys; i++) {
+         if (data[i])
+            continue;
+
+         memcpy(&keys[num_missing * 20], &cache_keys_160bit[i * 20], 20);
+         missing[num_missing++] = i;
+      }
+
+      if (!num_missing)
+         break;
+
+      mesa_cache_db_read_entries(&db->parts[part], keys, num_missing,
+                                 part_data, part_sizes);
+
+      for (j = 0; j < num_missing; j++) {
+         if (part_data[j]) {
+            data[missing[j]] = part_data[j];
+            sizes[missing[j]] = part_sizes[j];
+            db->last_read_part = part;
+         }
+      }
+   }
+
+out:
+   free(part_sizes);
+   free(part_data);
+   free(keys);
+   free(missing);
+}
+
+void
+mesa_cache_db_multipart_prefetch(struct mesa_cache_db_multipart *db,
+                                 const uint8_t *cache_keys_160bit,
+                                 unsigned num_keys)
+{
+   for (unsigned int i = 0; i < db->num_parts; i++)
+      mesa_cache_db_prefetch(&db->parts[i], cache_keys_160bit, num_keys);
+}
+
 static unsigned
 mesa_cache_db_multipart_select_victim_part(struct mesa_cache_db_multipart *db)
 {
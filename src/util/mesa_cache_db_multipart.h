@@ -32,6 +32,17 @@ mesa_cache_db_multipart_read_entry(struct mesa_cache_db_multipart *db,
                                    const uint8_t *cache_key_160bit,
                                    size_t *size);
 
+void
+mesa_cache_db_multipart_read_entries(struct mesa_cache_db_multipart *db,
+                                     const uint8_t *cache_keys_160bit,
+                                     unsigned num_keys, void **data,
+                                     size_t *sizes);
+
+void
+mesa_cache_db_multipart_prefetch(struct mesa_cache_db_multipart *db,
+                                 const uint8_t *cache_keys_160bit,
+                                 unsigned num_keys);
+
 bool
 mesa_cache_db_multipart_entry_write(struct mesa_cache_db_multipart *db,
                                     const uint8_t *cache_key_160bit,
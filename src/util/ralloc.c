@@ -772,6 +772,15 @@ create_slab(gc_ctx *ctx, unsigned bucket)
    return slab;
 }
 
+static gc_block_header *
+alloc_from_bucket(gc_ctx *ctx, unsigned bucket)
+{
+   if (list_is_empty(&ctx->slabs[bucket].free_slabs) && !create_slab(ctx, bucket))
+      return NULL;
+   gc_slab *slab = list_first_entry(&ctx->slabs[bucket].free_slabs, gc_slab, free_link);
+   return alloc_from_slab(slab, bucket);
+}
+
 void *
 gc_alloc_size(gc_ctx *ctx, size_t size, size_t align)
 {
@@ -785,11 +794,9 @@ gc_alloc_size(gc_ctx *ctx, size_t size, size_t align)
 
    gc_block_header *header = NULL;
    if (size <= MAX_FREELIST_SIZE) {
-      unsigned bucket = gc_bucket_for_size(size);
-      if (list_is_empty(&ctx->slabs[bucket].free_slabs) && !create_slab(ctx, bucket))
+      header = alloc_from_bucket(ctx, gc_bucket_for_size(size));
+      if (unlikely(!header))
          return NULL;
-      gc_slab *slab = list_first_entry(&ctx->slabs[bucket].free_slabs, gc_slab, free_link);
-      header = alloc_from_slab(slab, bucket);
    } else {
       header = ralloc_size(ctx, size);
       if (unlikely(!header))
@@ -905,6 +912,45 @@ gc_sweep_end(gc_ctx *ctx)
    ctx->rubbish = NULL;
 }
 
+void *
+gc_relocate(gc_ctx *ctx, void *ptr)
+{
+   gc_block_header *header = get_gc_header(ptr);
+
+   if (header->bucket >= NUM_FREELIST_BUCKETS) {
+      ralloc_steal(ctx, header);
+      return ptr;
+   }
+
+   gc_block_header *new_header = alloc_from_bucket(ctx, header->bucket);
+   if (unlikely(!new_header))
+      return NULL;
+
+   new_header->flags = ctx->current_gen | IS_USED;
+#ifndef NDEBUG
+   new_header->canary = GC_CANARY;
+#endif
+
+   memcpy(new_header + 1, header + 1,
+          gc_bucket_obj_size(header->bucket) - sizeof(gc_block_header));
+
+   return new_header + 1;
+}
+
+void
+gc_get_slab_usage(gc_ctx *ctx, size_t *total, size_t *used)
+{
+   *total = 0;
+   *used = 0;
+
+   for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++) {
+      list_for_each_entry(gc_slab, slab, &ctx->slabs[i].slabs, link) {
+         *total += get_slab_size(i);
+         *used += slab->num_allocated * gc_bucket_obj_size(i);
+      }
+   }
+}
+
 /***************************************************************************
  * Linear allocator for short-lived allocations.
  ***************************************************************************
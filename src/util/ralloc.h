@@ -507,6 +507,22 @@ void gc_sweep_start(gc_ctx *ctx);
 void gc_mark_live(gc_ctx *ctx, const void *mem);
 void gc_sweep_end(gc_ctx *ctx);
 
+/**
+ * Copy an allocation of another GC context to \p ctx and return the copy.
+ *
+ * The old allocation is left alone, this is meant for compacting a context by
+ * relocating all of its live allocations to a new one in the order they are
+ * used and then freeing the old context. Allocations too large for the slabs
+ * are stolen by \p ctx rather than copied, so the returned pointer is the same.
+ */
+void *gc_relocate(gc_ctx *ctx, void *ptr);
+
+/**
+ * Return the size of the slabs of a GC context and how much of it is used by
+ * allocations, which tells how fragmented the context is.
+ */
+void gc_get_slab_usage(gc_ctx *ctx, size_t *total, size_t *used);
+
 /**
  * Declare C++ new and delete operators which use ralloc.
  *
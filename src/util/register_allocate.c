@@ -568,11 +568,19 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
 
    g->tmp.reg_assigned = reralloc(g, g->tmp.reg_assigned, BITSET_WORD,
                                   bitset_count);
-   g->tmp.pq_test = reralloc(g, g->tmp.pq_test, BITSET_WORD, bitset_count);
+   g->tmp.ready = reralloc(g, g->tmp.ready, BITSET_WORD, bitset_count);
+   g->tmp.ready_words = reralloc(g, g->tmp.ready_words, BITSET_WORD,
+                                 BITSET_WORDS(bitset_count));
    g->tmp.min_q_total = reralloc(g, g->tmp.min_q_total, unsigned int,
                                  bitset_count);
    g->tmp.min_q_node = reralloc(g, g->tmp.min_q_node, unsigned int,
                                 bitset_count);
+   g->tmp.min_q_tree = reralloc(g, g->tmp.min_q_tree, unsigned int,
+                                2 * util_next_power_of_two(bitset_count));
+   g->tmp.min_q_dirty = reralloc(g, g->tmp.min_q_dirty, unsigned int,
+                                 bitset_count);
+   g->tmp.min_q_is_dirty = reralloc(g, g->tmp.min_q_is_dirty, BITSET_WORD,
+                                    BITSET_WORDS(bitset_count));
 
    g->alloc = alloc;
 }
@@ -653,13 +661,109 @@ ra_reset_node_interference(struct ra_graph *g, unsigned int n)
    util_dynarray_clear(&g->nodes[n].adjacency_list);
 }
 
+/**
+ * Writes out the interference graph, so that an allocation can be replayed
+ * outside of the driver, for example by the benchmark in the tests.  The
+ * register set has to be serialized separately with ra_set_serialize().
+ *
+ * Register selection callbacks can't be serialized, graphs using them are
+ * replayed with the built-in selection.
+ */
+void
+ra_graph_serialize(const struct ra_graph *g, struct blob *blob)
+{
+   blob_write_uint32(blob, g->count);
+
+   for (unsigned int n = 0; n < g->count; n++) {
+      const struct ra_node *node = &g->nodes[n];
+
+      blob_write_uint32(blob, node->class);
+      blob_write_uint32(blob, node->forced_reg);
+      blob_write_bytes(blob, &node->spill_cost, sizeof(node->spill_cost));
+   }
+
+   /* Every interference is written once, by its lower node. */
+   for (unsigned int n = 0; n < g->count; n++) {
+      const struct ra_node *node = &g->nodes[n];
+
+      unsigned int num_adjacent = 0;
+      util_dynarray_foreach(&node->adjacency_list, unsigned int, n2p) {
+         if (*n2p > n)
+            num_adjacent++;
+      }
+
+      blob_write_uint32(blob, num_adjacent);
+      util_dynarray_foreach(&node->adjacency_list, unsigned int, n2p) {
+         if (*n2p > n)
+            blob_write_uint32(blob, *n2p);
+      }
+   }
+}
+
+struct ra_graph *
+ra_graph_deserialize(struct ra_regs *regs, struct blob_reader *blob)
+{
+   unsigned int count = blob_read_uint32(blob);
+   if (blob->overrun)
+      return NULL;
+
+   struct ra_graph *g = ra_alloc_interference_graph(regs, count);
+
+   for (unsigned int n = 0; n < count; n++) {
+      struct ra_node *node = &g->nodes[n];
+
+      node->class = blob_read_uint32(blob);
+      node->forced_reg = blob_read_uint32(blob);
+      blob_copy_bytes(blob, &node->spill_cost, sizeof(node->spill_cost));
+
+      if (blob->overrun || node->class >= regs->class_count)
+         goto fail;
+   }
+
+   for (unsigned int n = 0; n < count; n++) {
+      unsigned int num_adjacent = blob_read_uint32(blob);
+
+      for (unsigned int i = 0; i < num_adjacent; i++) {
+         unsigned int n2 = blob_read_uint32(blob);
+         if (blob->overrun || n2 <= n || n2 >= count)
+            goto fail;
+
+         ra_add_node_interference(g, n, n2);
+      }
+   }
+
+   if (blob->overrun)
+      goto fail;
+
+   return g;
+
+fail:
+   ralloc_free(g);
+   return NULL;
+}
+
+/* Queues the BITSET_WORD containing the node for an update of its leaf in
+ * the min_q_tree.
+ */
+static void
+mark_min_q_dirty(struct ra_graph *g, unsigned int n)
+{
+   unsigned int i = n / BITSET_WORDBITS;
+
+   if (!BITSET_TEST(g->tmp.min_q_is_dirty, i)) {
+      BITSET_SET(g->tmp.min_q_is_dirty, i);
+      g->tmp.min_q_dirty[g->tmp.min_q_dirty_count++] = i;
+   }
+}
+
 static void
 update_pq_info(struct ra_graph *g, unsigned int n)
 {
    int i = n / BITSET_WORDBITS;
    int n_class = g->nodes[n].class;
    if (g->nodes[n].tmp.q_total < g->regs->classes[n_class]->p) {
-      BITSET_SET(g->tmp.pq_test, n);
+      BITSET_SET(g->tmp.ready, n);
+      BITSET_SET(g->tmp.ready_words, i);
    } else if (g->tmp.min_q_total[i] != UINT_MAX) {
       /* Only update min_q_total and min_q_node if min_q_total != UINT_MAX so
        * that we don't update while we have stale data and accidentally mark
@@ -672,6 +776,7 @@ update_pq_info(struct ra_graph *g, unsigned int n)
            n > g->tmp.min_q_node[i])) {
          g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
          g->tmp.min_q_node[i] = n;
+         mark_min_q_dirty(g, n);
       }
    }
 }
@@ -680,17 +785,20 @@ static void
 add_node_to_stack(struct ra_graph *g, unsigned int n)
 {
    int n_class = g->nodes[n].class;
+   struct ra_class **classes = g->regs->classes;
 
    assert(!BITSET_TEST(g->tmp.in_stack, n));
 
    util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned int, n2p) {
       unsigned int n2 = *n2p;
-      unsigned int n2_class = g->nodes[n2].class;
 
       if (!BITSET_TEST(g->tmp.in_stack, n2) &&
           !BITSET_TEST(g->tmp.reg_assigned, n2)) {
-         assert(g->nodes[n2].tmp.q_total >= g->regs->classes[n2_class]->q[n_class]);
-         g->nodes[n2].tmp.q_total -= g->regs->classes[n2_class]->q[n_class];
+         struct ra_node *node2 = &g->nodes[n2];
+         unsigned int q = classes[node2->class]->q[n_class];
+
+         assert(node2->tmp.q_total >= q);
+         node2->tmp.q_total -= q;
          update_pq_info(g, n2);
       }
    }
@@ -699,8 +807,122 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
    g->tmp.stack_count++;
    BITSET_SET(g->tmp.in_stack, n);
 
-   /* Flag the min_q_total for n's block as dirty so it gets recalculated */
-   g->tmp.min_q_total[n / BITSET_WORDBITS] = UINT_MAX;
+   BITSET_CLEAR(g->tmp.ready, n);
+   if (g->tmp.ready[n / BITSET_WORDBITS] == 0)
+      BITSET_CLEAR(g->tmp.ready_words, n / BITSET_WORDBITS);
+
+   /* Flag the min_q_total for n's block as dirty so it gets recalculated,
+    * unless it already is.
+    */
+   if (g->tmp.min_q_total[n / BITSET_WORDBITS] != UINT_MAX) {
+      g->tmp.min_q_total[n / BITSET_WORDBITS] = UINT_MAX;
+      mark_min_q_dirty(g, n);
+   }
+}
+
+/**
+ * Returns the highest node below end which passes the pq test and isn't in
+ * the stack yet, or UINT_MAX if there is none.
+ */
+static unsigned int
+find_ready_node(struct ra_graph *g, unsigned int end)
+{
+   if (end == 0)
+      return UINT_MAX;
+
+   unsigned int i = (end - 1) / BITSET_WORDBITS;
+   BITSET_WORD ready = g->tmp.ready[i] &
+                       (~(BITSET_WORD)0 >> (BITSET_WORDBITS - 1 -
+                                            (end - 1) % BITSET_WORDBITS));
+
+   if (!ready) {
+      /* Skip the words without ready nodes */
+      if (i == 0)
+         return UINT_MAX;
+
+      unsigned int w = i - 1;
+      unsigned int j = w / BITSET_WORDBITS;
+      BITSET_WORD words = g->tmp.ready_words[j] &
+                          (~(BITSET_WORD)0 >> (BITSET_WORDBITS - 1 -
+                                               w % BITSET_WORDBITS));
+      while (!words) {
+         if (j == 0)
+            return UINT_MAX;
+         words = g->tmp.ready_words[--j];
+      }
+
+      i = j * BITSET_WORDBITS + util_last_bit(words) - 1;
+      ready = g->tmp.ready[i];
+      assert(ready);
+   }
+
+   return i * BITSET_WORDBITS + util_last_bit(ready) - 1;
+}
+
+/* Picks the node with the lower q_total, or the higher index on a tie. */
+static unsigned int
+lower_q_node(struct ra_graph *g, unsigned int n1, unsigned int n2)
+{
+   if (n1 == UINT_MAX)
+      return n2;
+   if (n2 == UINT_MAX)
+      return n1;
+
+   unsigned int q1 = g->nodes[n1].tmp.q_total;
+   unsigned int q2 = g->nodes[n2].tmp.q_total;
+   if (q1 != q2)
+      return q1 < q2 ? n1 : n2;
+
+   return MAX2(n1, n2);
+}
+
+/**
+ * Returns the node which isn't in the stack with the lowest q_total, or
+ * UINT_MAX if all nodes are.
+ *
+ * This is only valid when no node passes the pq test, as the minimums
+ * aren't updated for those.  The minimum of each BITSET_WORD is kept up to
+ * date as the q_totals go down, recalculated for the words where nodes were
+ * put on the stack, and then only the paths to the changed leaves of the
+ * tree are updated.
+ */
+static unsigned int
+find_min_q_node(struct ra_graph *g)
+{
+   for (unsigned int d = 0; d < g->tmp.min_q_dirty_count; d++) {
+      unsigned int i = g->tmp.min_q_dirty[d];
+      BITSET_CLEAR(g->tmp.min_q_is_dirty, i);
+
+      if (g->tmp.min_q_total[i] == UINT_MAX) {
+         /* The min_q_total and min_q_node are dirty because we added one of
+          * these nodes to the stack.  It needs to be recalculated.
+          */
+         BITSET_WORD skip = g->tmp.in_stack[i] | g->tmp.reg_assigned[i];
+         g->tmp.min_q_node[i] = UINT_MAX;
+
+         for (int j = BITSET_WORDBITS - 1; j >= 0; j--) {
+            unsigned int n = i * BITSET_WORDBITS + j;
+            if (n >= g->count || (skip & BITSET_BIT(j)))
+               continue;
+
+            if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i]) {
+               g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
+               g->tmp.min_q_node[i] = n;
+            }
+         }
+      }
+
+      unsigned int t = g->tmp.min_q_tree_size + i;
+      g->tmp.min_q_tree[t] = g->tmp.min_q_node[i];
+      for (t /= 2; t > 0; t /= 2) {
+         g->tmp.min_q_tree[t] = lower_q_node(g, g->tmp.min_q_tree[2 * t],
+                                             g->tmp.min_q_tree[2 * t + 1]);
+      }
+   }
+
+   g->tmp.min_q_dirty_count = 0;
+
+   return g->tmp.min_q_tree[1];
 }
 
 /**
@@ -712,103 +934,78 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * The trivially-colorable nodes are pushed in sweeps from the highest node
+ * to the lowest, each one picking up the nodes which became colorable
+ * behind the previous one, as the naive implementation of the algorithm
+ * did.  The colorable nodes and the minimum q_total are tracked
+ * incrementally, so that neither a sweep nor an optimistic choice has to
+ * look at every node.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
-
-   /* Figure out the high bit and bit mask for the first iteration of a loop
-    * over BITSET_WORDs.
-    */
-   const unsigned int top_word_high_bit = (g->count - 1) % BITSET_WORDBITS;
+   const unsigned int bitset_count = BITSET_WORDS(g->count);
 
    /* Do a quick pre-pass to set things up */
    g->tmp.stack_count = 0;
-   for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-        i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-      g->tmp.in_stack[i] = 0;
-      g->tmp.reg_assigned[i] = 0;
-      g->tmp.pq_test[i] = 0;
+   memset(g->tmp.in_stack, 0, bitset_count * sizeof(BITSET_WORD));
+   memset(g->tmp.reg_assigned, 0, bitset_count * sizeof(BITSET_WORD));
+   memset(g->tmp.ready, 0, bitset_count * sizeof(BITSET_WORD));
+   memset(g->tmp.ready_words, 0,
+          BITSET_WORDS(bitset_count) * sizeof(BITSET_WORD));
+   memset(g->tmp.min_q_is_dirty, 0,
+          BITSET_WORDS(bitset_count) * sizeof(BITSET_WORD));
+
+   g->tmp.min_q_tree_size = util_next_power_of_two(bitset_count);
+   memset(g->tmp.min_q_tree, 0xff,
+          2 * g->tmp.min_q_tree_size * sizeof(unsigned int));
+
+   g->tmp.min_q_dirty_count = 0;
+   for (unsigned int i = 0; i < bitset_count; i++) {
       g->tmp.min_q_total[i] = UINT_MAX;
       g->tmp.min_q_node[i] = UINT_MAX;
-      for (int j = high_bit; j >= 0; j--) {
-         unsigned int n = i * BITSET_WORDBITS + j;
-         g->nodes[n].reg = g->nodes[n].forced_reg;
-         g->nodes[n].tmp.q_total = g->nodes[n].q_total;
-         if (g->nodes[n].reg != NO_REG)
-            g->tmp.reg_assigned[i] |= BITSET_BIT(j);
-         update_pq_info(g, n);
-      }
+      mark_min_q_dirty(g, i * BITSET_WORDBITS);
    }
 
-   while (progress) {
-      unsigned int min_q_total = UINT_MAX;
-      unsigned int min_q_node = UINT_MAX;
+   for (unsigned int n = 0; n < g->count; n++) {
+      g->nodes[n].reg = g->nodes[n].forced_reg;
+      g->nodes[n].tmp.q_total = g->nodes[n].q_total;
+      if (g->nodes[n].reg != NO_REG)
+         BITSET_SET(g->tmp.reg_assigned, n);
+      else
+         update_pq_info(g, n);
+   }
 
-      progress = false;
+   unsigned int sweep_start = g->count;
+   bool progress = false;
 
-      for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-           i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-         BITSET_WORD mask = ~(BITSET_WORD)0 >> (31 - high_bit);
+   while (true) {
+      unsigned int n = find_ready_node(g, sweep_start);
+      if (n != UINT_MAX) {
+         add_node_to_stack(g, n);
+         sweep_start = n;
+         progress = true;
+         continue;
+      }
 
-         BITSET_WORD skip = g->tmp.in_stack[i] | g->tmp.reg_assigned[i];
-         if (skip == mask)
-            continue;
-
-         BITSET_WORD pq = g->tmp.pq_test[i] & ~skip;
-         if (pq) {
-            /* In this case, we have stuff we can immediately take off the
-             * stack.  This also means that we're guaranteed to make progress
-             * and we don't need to bother updating lowest_q_total because we
-             * know we're going to loop again before attempting to do anything
-             * optimistic.
-             */
-            for (int j = high_bit; j >= 0; j--) {
-               if (pq & BITSET_BIT(j)) {
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  add_node_to_stack(g, n);
-                  /* add_node_to_stack() may update pq_test for this word so
-                   * we need to update our local copy.
-                   */
-                  pq = g->tmp.pq_test[i] & ~skip;
-                  progress = true;
-               }
-            }
-         } else if (!progress) {
-            if (g->tmp.min_q_total[i] == UINT_MAX) {
-               /* The min_q_total and min_q_node are dirty because we added
-                * one of these nodes to the stack.  It needs to be
-                * recalculated.
-                */
-               for (int j = high_bit; j >= 0; j--) {
-                  if (skip & BITSET_BIT(j))
-                     continue;
-
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i]) {
-                     g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
-                     g->tmp.min_q_node[i] = n;
-                  }
-               }
-            }
-            if (g->tmp.min_q_total[i] < min_q_total) {
-               min_q_node = g->tmp.min_q_node[i];
-               min_q_total = g->tmp.min_q_total[i];
-            }
-         }
+      /* Start a new sweep for the nodes above the last one pushed */
+      if (progress) {
+         sweep_start = g->count;
+         progress = false;
+         continue;
       }
 
-      if (!progress && min_q_total != UINT_MAX) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->tmp.stack_count;
+      n = find_min_q_node(g);
+      if (n == UINT_MAX)
+         break;
 
-         add_node_to_stack(g, min_q_node);
-         progress = true;
-      }
+      if (stack_optimistic_start == UINT_MAX)
+         stack_optimistic_start = g->tmp.stack_count;
+
+      add_node_to_stack(g, n);
+      sweep_start = g->count;
    }
 
    g->tmp.stack_optimistic_start = stack_optimistic_start;
@@ -888,6 +1085,27 @@ ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
    return false;
 }
 
+/* Returns the first register of the set at or after start, wrapping around
+ * at the end of the register set, or NO_REG if there is none.
+ */
+static unsigned int
+find_first_reg(const BITSET_WORD *regs, unsigned int count, unsigned int start)
+{
+   const unsigned int num_words = BITSET_WORDS(count);
+   unsigned int w = BITSET_BITWORD(start % count);
+   BITSET_WORD word = regs[w] & ~(BITSET_BIT(start % count) - 1);
+
+   for (unsigned int i = 0; i <= num_words; i++) {
+      if (word)
+         return w * BITSET_WORDBITS + ffs(word) - 1;
+
+      w = (w + 1) % num_words;
+      word = regs[w];
+   }
+
+   return NO_REG;
+}
+
 /**
  * Pops nodes from the stack back into the graph, coloring them with
  * registers as they go.
@@ -901,7 +1119,7 @@ ra_select(struct ra_graph *g)
    int start_search_reg = 0;
    BITSET_WORD *select_regs = NULL;
 
-   if (g->select_reg_callback)
+   if (g->select_reg_callback || g->regs->classes[0]->contig_len)
       select_regs = malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
 
    while (g->tmp.stack_count != 0) {
@@ -923,6 +1141,18 @@ ra_select(struct ra_graph *g)
 
          r = g->select_reg_callback(n, select_regs, g->select_reg_callback_data);
          assert(r < g->regs->count);
+      } else if (c->contig_len) {
+         /* With contiguous classes, the registers taken by the neighbors
+          * are cheap to rule out, which beats looking for a conflicting
+          * neighbor for every register tried when the pressure is high.
+          */
+         if (!ra_compute_available_regs(g, n, select_regs)) {
+            free(select_regs);
+            return false;
+         }
+
+         r = find_first_reg(select_regs, g->regs->count, start_search_reg);
+         assert(r != NO_REG);
       } else {
          /* Find the lowest-numbered reg which is not used by a member
           * of the graph adjacent to us.
@@ -118,6 +118,10 @@ void ra_set_select_reg_callback(struct ra_graph *g,
 void ra_add_node_interference(struct ra_graph *g,
                               unsigned int n1, unsigned int n2);
 void ra_reset_node_interference(struct ra_graph *g, unsigned int n);
+
+void ra_graph_serialize(const struct ra_graph *g, struct blob *blob);
+struct ra_graph *ra_graph_deserialize(struct ra_regs *regs,
+                                      struct blob_reader *blob);
 /** @} */
 
 /** @{ Graph-coloring register allocation */
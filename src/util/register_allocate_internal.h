@@ -149,8 +149,14 @@ struct ra_graph {
       /** Bit-set indicating, for each register, if it pre-assigned */
       BITSET_WORD *reg_assigned;
 
-      /** Bit-set indicating, for each register, the value of the pq test */
-      BITSET_WORD *pq_test;
+      /**
+       * Bit-set of the nodes which pass the pq test and aren't in the stack
+       * or pre-assigned.
+       */
+      BITSET_WORD *ready;
+
+      /** Bit-set of the BITSET_WORDs of ready which have any bit set */
+      BITSET_WORD *ready_words;
 
       /** For each BITSET_WORD, the minimum q value or ~0 if unknown */
       unsigned int *min_q_total;
@@ -161,6 +167,19 @@ struct ra_graph {
        */
       unsigned int *min_q_node;
 
+      /**
+       * Tournament tree over the min_q_node of each BITSET_WORD, so that the
+       * node with the minimum q_total is at index 1.  The leaves start at
+       * min_q_tree_size.
+       */
+      unsigned int *min_q_tree;
+      unsigned int min_q_tree_size;
+
+      /** BITSET_WORDs whose leaf in min_q_tree needs to be updated */
+      unsigned int *min_q_dirty;
+      unsigned int min_q_dirty_count;
+      BITSET_WORD *min_q_is_dirty;
+
       /**
        * Tracks the start of the set of optimistically-colored registers in the
        * stack.
@@ -196,6 +196,59 @@ TEST(BlobTest, DetectOverrun)
    blob_finish(&blob);
 }
 
+// Test that variable-length integers round-trip and take the expected space.
+TEST(BlobTest, Varint)
+{
+   struct blob blob;
+   struct blob_reader reader;
+   static const struct {
+      uint32_t value;
+      unsigned size;
+   } values[] = {
+      { 0, 1 },
+      { 1, 1 },
+      { 0x7f, 1 },
+      { 0x80, 2 },
+      { 0x3fff, 2 },
+      { 0x4000, 3 },
+      { 0x1fffff, 3 },
+      { 0x200000, 4 },
+      { 0xfffffff, 4 },
+      { 0x10000000, 5 },
+      { 0xffffffff, 5 },
+   };
+
+   blob_init(&blob);
+
+   // A leading byte checks that no padding is added.
+   blob_write_uint8(&blob, 0xaa);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(values); i++) {
+      size_t offset = blob.size;
+      blob_write_varint32(&blob, values[i].value);
+      EXPECT_EQ(values[i].size, blob.size - offset)
+         << "size of varint " << values[i].value;
+   }
+
+   blob_reader_init(&reader, blob.data, blob.size);
+
+   EXPECT_EQ(0xaa, blob_read_uint8(&reader));
+   for (unsigned i = 0; i < ARRAY_SIZE(values); i++)
+      EXPECT_EQ(values[i].value, blob_read_varint32(&reader));
+
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(0, blob_read_varint32(&reader)) << "read at overrun";
+   EXPECT_TRUE(reader.overrun);
+
+   // A truncated varint is an overrun as well.
+   blob_reader_init(&reader, blob.data, blob.size - 1);
+   blob_skip_bytes(&reader, blob.size - 5);
+   EXPECT_EQ(0, blob_read_varint32(&reader));
+   EXPECT_TRUE(reader.overrun);
+
+   blob_finish(&blob);
+}
+
 // Test that we can read and write some large objects, (exercising the code in
 // the blob_write functions to realloc blob->data.
 TEST(BlobTest, BigObjects)
@@ -36,10 +36,14 @@
 #include <limits.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <thread>
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
 #include "util/disk_cache_os.h"
+#include "util/mesa_cache_db.h"
+#include "util/os_time.h"
 #include "util/ralloc.h"
 
 #ifdef ENABLE_SHADER_CACHE
@@ -422,6 +426,109 @@ test_put_and_get(bool test_cache_size_limit, const char *driver_id)
    disk_cache_destroy(cache);
 }
 
+static void
+test_get_blob(const char *driver_id)
+{
+   struct disk_cache *cache;
+   struct disk_cache_blob *blob, *ref;
+   uint8_t compressible[4096], random_data[4096];
+   cache_key compressible_key, random_key, missing_key;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   cache = disk_cache_create("test", driver_id, 0);
+
+   /* Random data doesn't compress, hence it's stored as is and can be
+    * referenced in place, while the compressible data gets inflated.
+    */
+   memset(compressible, 'c', sizeof(compressible));
+   for (unsigned i = 0; i < sizeof(random_data); i++)
+      random_data[i] = rand();
+
+   disk_cache_compute_key(cache, compressible, sizeof(compressible),
+                          compressible_key);
+   disk_cache_compute_key(cache, random_data, sizeof(random_data), random_key);
+   disk_cache_compute_key(cache, "missing", 7, missing_key);
+
+   disk_cache_put(cache, compressible_key, compressible, sizeof(compressible),
+                  NULL);
+   disk_cache_put(cache, random_key, random_data, sizeof(random_data), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   blob = disk_cache_get_blob(cache, compressible_key);
+   ASSERT_NE(blob, nullptr) << "disk_cache_get_blob with compressible item";
+   EXPECT_EQ(blob->size, sizeof(compressible)) << "disk_cache_get_blob size";
+   EXPECT_EQ(memcmp(blob->data, compressible, sizeof(compressible)), 0)
+      << "disk_cache_get_blob data";
+   disk_cache_blob_unref(blob);
+
+   blob = disk_cache_get_blob(cache, random_key);
+   ASSERT_NE(blob, nullptr) << "disk_cache_get_blob with incompressible item";
+   EXPECT_EQ(blob->size, sizeof(random_data)) << "disk_cache_get_blob size";
+   EXPECT_EQ(memcmp(blob->data, random_data, sizeof(random_data)), 0)
+      << "disk_cache_get_blob data";
+
+   /* The data must stay valid as long as a reference is held */
+   ref = disk_cache_blob_ref(blob);
+   disk_cache_blob_unref(blob);
+   EXPECT_EQ(memcmp(ref->data, random_data, sizeof(random_data)), 0)
+      << "disk_cache_get_blob data after unref";
+   disk_cache_blob_unref(ref);
+
+   blob = disk_cache_get_blob(cache, missing_key);
+   EXPECT_EQ(blob, nullptr) << "disk_cache_get_blob with non-existent item";
+
+   disk_cache_destroy(cache);
+}
+
+static void
+test_get_batch(const char *driver_id)
+{
+   /* Keep the items small, the eviction tests that follow expect the cache
+    * to be almost empty.
+    */
+   const unsigned num_items = 4;
+   struct disk_cache *cache;
+   struct disk_cache_blob *blobs[num_items + 1];
+   cache_key keys[num_items + 1];
+   char data[num_items][16];
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   cache = disk_cache_create("test", driver_id, 0);
+
+   for (unsigned i = 0; i < num_items; i++) {
+      snprintf(data[i], sizeof(data[i]), "batch item %u", i);
+      disk_cache_compute_key(cache, data[i], sizeof(data[i]), keys[i]);
+      disk_cache_put(cache, keys[i], data[i], sizeof(data[i]), NULL);
+   }
+   disk_cache_compute_key(cache, "missing", 7, keys[num_items]);
+   disk_cache_wait_for_idle(cache);
+
+   /* The read queue is only created for the first batched read */
+   EXPECT_FALSE(util_queue_is_initialized(&cache->read_queue))
+      << "read queue created before any batched read";
+
+   disk_cache_prefetch(cache, keys, num_items + 1);
+   disk_cache_get_batch(cache, keys, num_items + 1, blobs);
+
+   for (unsigned i = 0; i < num_items; i++) {
+      ASSERT_NE(blobs[i], nullptr) << "disk_cache_get_batch item " << i;
+      EXPECT_EQ(blobs[i]->size, sizeof(data[i])) << "disk_cache_get_batch size";
+      EXPECT_EQ(memcmp(blobs[i]->data, data[i], sizeof(data[i])), 0)
+         << "disk_cache_get_batch data";
+      disk_cache_blob_unref(blobs[i]);
+   }
+   EXPECT_EQ(blobs[num_items], nullptr)
+      << "disk_cache_get_batch with non-existent item";
+
+   disk_cache_destroy(cache);
+}
+
 static void
 test_put_key_and_get_key(const char *driver_id)
 {
@@ -705,6 +812,9 @@ run_tests:
 
    test_put_key_and_get_key(driver_id);
 
+   test_get_blob(driver_id);
+   test_get_batch(driver_id);
+
    int err = rmrf_local(CACHE_TEST_TMP);
    EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
 
@@ -741,6 +851,9 @@ run_tests:
 
    test_put_key_and_get_key(driver_id);
 
+   test_get_blob(driver_id);
+   test_get_batch(driver_id);
+
    test_put_and_get_between_instances(driver_id);
 
    setenv("MESA_DISK_CACHE_SINGLE_FILE", "false", 1);
@@ -783,6 +896,9 @@ TEST_F(Cache, Database)
 
    test_put_key_and_get_key(driver_id);
 
+   test_get_blob(driver_id);
+   test_get_batch(driver_id);
+
    test_put_and_get_between_instances(driver_id);
 
    test_put_and_get_between_instances_with_eviction(driver_id);
@@ -1276,3 +1392,327 @@ TEST_F(Cache, DatabaseMultipartEviction)
    EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
 #endif
 }
+
+static void
+test_multiprocess_read(const char *driver_id)
+{
+   const unsigned int num_entries = 64;
+   const unsigned int num_processes = 8;
+   const unsigned int num_reads = 4000;
+   const unsigned int entry_size = 1024;
+   uint8_t blob[entry_size];
+   cache_key keys[num_entries];
+   pid_t pids[num_processes];
+   unsigned int i;
+   char *result;
+   size_t size;
+
+   setenv("MESA_SHADER_CACHE_MAX_SIZE", "1M", 1);
+
+   struct disk_cache *cache = disk_cache_create("test", driver_id, 0);
+
+   for (i = 0; i < num_entries; i++) {
+      memset(blob, i, entry_size);
+
+      disk_cache_compute_key(cache, blob, entry_size, keys[i]);
+      disk_cache_put(cache, keys[i], blob, entry_size, NULL);
+   }
+
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   /* Every process hammers the same database with lookups, which is what
+    * happens when many applications share the shader cache. The cache
+    * threads don't survive fork(), hence each process opens own cache.
+    */
+   int64_t start = os_time_get_nano();
+
+   for (i = 0; i < num_processes; i++) {
+      pids[i] = fork();
+      ASSERT_NE(pids[i], -1) << "fork";
+
+      if (pids[i] == 0) {
+         unsigned int failures = 0;
+
+         cache = disk_cache_create("test", driver_id, 0);
+
+         for (unsigned int n = 0; n < num_reads; n++) {
+            result = (char *) disk_cache_get(cache, keys[n % num_entries], &size);
+            if (!result || size != entry_size ||
+                result[0] != (char) (n % num_entries))
+               failures++;
+            free(result);
+         }
+
+         disk_cache_destroy(cache);
+
+         _exit(failures ? 1 : 0);
+      }
+   }
+
+   for (i = 0; i < num_processes; i++) {
+      int status;
+
+      ASSERT_EQ(waitpid(pids[i], &status, 0), pids[i]) << "waitpid";
+      EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+         << "disk_cache_get from multiple processes";
+   }
+
+   int64_t elapsed = os_time_get_nano() - start;
+
+   printf("%u processes x %u reads: %.1f ms, %.0f reads/s\n",
+          num_processes, num_reads, elapsed / 1000000.0,
+          (double) num_processes * num_reads * 1000000000.0 / elapsed);
+
+   unsetenv("MESA_SHADER_CACHE_MAX_SIZE");
+}
+
+TEST_F(Cache, DatabaseMultiProcessRead)
+{
+   const char *driver_id = "make_check_uncompressed";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS", "1", 1);
+   setenv("MESA_DISK_CACHE_DATABASE", "true", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_DB, driver_id);
+
+   test_multiprocess_read(driver_id);
+
+   unsetenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS");
+   unsetenv("MESA_DISK_CACHE_DATABASE");
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+#ifdef ENABLE_SHADER_CACHE
+#define DB_TEST_PATH CACHE_TEST_TMP "/db"
+#define DB_TEST_BLOB_SIZE 1024
+
+static void
+db_test_key(unsigned int i, uint8_t key[20])
+{
+   _mesa_sha1_compute(&i, sizeof(i), key);
+}
+
+static bool
+db_test_write(struct mesa_cache_db *db, unsigned int i)
+{
+   uint8_t key[20], blob[DB_TEST_BLOB_SIZE];
+
+   db_test_key(i, key);
+   memset(blob, i, sizeof(blob));
+
+   return mesa_cache_db_entry_write(db, key, blob, sizeof(blob));
+}
+
+/* Returns 1 if entry i is in the database with the expected content, 0 if
+ * it isn't and -1 if a wrong or corrupted entry was returned.
+ */
+static int
+db_test_read(struct mesa_cache_db *db, unsigned int i)
+{
+   uint8_t key[20];
+   size_t size = 0;
+
+   db_test_key(i, key);
+
+   uint8_t *data = (uint8_t *) mesa_cache_db_read_entry(db, key, &size);
+   if (!data)
+      return 0;
+
+   int result = 1;
+   if (size != DB_TEST_BLOB_SIZE) {
+      result = -1;
+   } else {
+      for (unsigned int j = 0; j < size; j++) {
+         if (data[j] != (uint8_t) i) {
+            result = -1;
+            break;
+         }
+      }
+   }
+
+   free(data);
+   return result;
+}
+
+static uint64_t
+db_test_size_for_entries(unsigned int num_entries)
+{
+   return num_entries * (mesa_cache_db_file_entry_size() + DB_TEST_BLOB_SIZE);
+}
+
+static void
+db_test_setup(void)
+{
+   rmrf_local(CACHE_TEST_TMP);
+   ASSERT_EQ(mkdir(CACHE_TEST_TMP, 0755), 0);
+   ASSERT_EQ(mkdir(DB_TEST_PATH, 0755), 0);
+}
+#endif /* ENABLE_SHADER_CACHE */
+
+/* Reads through the mappings while another instance appends to the same
+ * database must never return a partially written or wrong entry.
+ */
+TEST_F(Cache, DatabaseReadWhileWriting)
+{
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   const unsigned int num_entries = 500;
+   struct mesa_cache_db writer, reader;
+
+   db_test_setup();
+
+   ASSERT_TRUE(mesa_cache_db_open(&writer, DB_TEST_PATH));
+   ASSERT_TRUE(mesa_cache_db_open(&reader, DB_TEST_PATH));
+   mesa_cache_db_set_size_limit(&writer, db_test_size_for_entries(num_entries * 2));
+   mesa_cache_db_set_size_limit(&reader, db_test_size_for_entries(num_entries * 2));
+
+   std::thread thread([&writer]() {
+      for (unsigned int i = 0; i < num_entries; i++)
+         db_test_write(&writer, i);
+   });
+
+   unsigned int bad_reads = 0, n = 0;
+   bool writing = true;
+
+   while (writing) {
+      writing = db_test_read(&reader, num_entries - 1) == 0;
+
+      for (unsigned int i = 0; i < 16; i++, n++)
+         bad_reads += db_test_read(&reader, (n * 7) % num_entries) < 0;
+   }
+
+   thread.join();
+
+   EXPECT_EQ(bad_reads, 0) << "corrupted entries read during writes";
+
+   for (unsigned int i = 0; i < num_entries; i++)
+      EXPECT_EQ(db_test_read(&reader, i), 1) << "entry " << i;
+
+   mesa_cache_db_close(&reader);
+   mesa_cache_db_close(&writer);
+
+   EXPECT_EQ(rmrf_local(CACHE_TEST_TMP), 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+/* Compaction rewrites the files in place under a new UUID, a reader that
+ * mapped the old files must pick up the new layout.
+ */
+TEST_F(Cache, DatabaseRemapAfterCompaction)
+{
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   const unsigned int num_entries = 10;
+   struct mesa_cache_db writer, reader;
+   unsigned int i;
+
+   db_test_setup();
+
+   ASSERT_TRUE(mesa_cache_db_open(&writer, DB_TEST_PATH));
+   ASSERT_TRUE(mesa_cache_db_open(&reader, DB_TEST_PATH));
+   mesa_cache_db_set_size_limit(&writer, db_test_size_for_entries(num_entries));
+   mesa_cache_db_set_size_limit(&reader, db_test_size_for_entries(num_entries));
+
+   for (i = 0; i < num_entries; i++)
+      ASSERT_TRUE(db_test_write(&writer, i));
+
+   /* Map the files and look up every entry */
+   for (i = 0; i < num_entries; i++)
+      EXPECT_EQ(db_test_read(&reader, i), 1) << "entry " << i;
+
+   /* The database is full, this evicts the older half of it and moves the
+    * rest of the entries to the beginning of the files.
+    */
+   ASSERT_TRUE(db_test_write(&writer, num_entries));
+
+   for (i = 0; i < num_entries / 2; i++)
+      EXPECT_EQ(db_test_read(&reader, i), 0) << "evicted entry " << i;
+   for (; i <= num_entries; i++)
+      EXPECT_EQ(db_test_read(&reader, i), 1) << "entry " << i;
+
+   /* And once more, now that the reader uses the new mappings */
+   for (i = num_entries + 1; i < num_entries + num_entries / 2; i++)
+      ASSERT_TRUE(db_test_write(&writer, i));
+   ASSERT_TRUE(db_test_write(&writer, i));
+
+   unsigned int num_hits = 0;
+   for (i = 0; i <= num_entries + num_entries / 2; i++) {
+      int result = db_test_read(&reader, i);
+      EXPECT_GE(result, 0) << "entry " << i;
+      num_hits += result > 0;
+   }
+   EXPECT_GT(num_hits, 0);
+   EXPECT_EQ(db_test_read(&reader, num_entries + num_entries / 2), 1);
+
+   mesa_cache_db_close(&reader);
+   mesa_cache_db_close(&writer);
+
+   EXPECT_EQ(rmrf_local(CACHE_TEST_TMP), 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+/* Lookups only update the last access time in memory. It has to reach the
+ * index file eventually, otherwise the eviction drops entries that are
+ * still in use.
+ */
+TEST_F(Cache, DatabaseAccessTimeFlush)
+{
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   const unsigned int num_entries = 10;
+   struct mesa_cache_db writer, reader;
+   unsigned int i;
+
+   db_test_setup();
+
+   ASSERT_TRUE(mesa_cache_db_open(&writer, DB_TEST_PATH));
+   mesa_cache_db_set_size_limit(&writer, db_test_size_for_entries(num_entries));
+
+   for (i = 0; i < num_entries; i++)
+      ASSERT_TRUE(db_test_write(&writer, i));
+
+   /* Use the oldest entry, closing the reader writes the access time back */
+   ASSERT_TRUE(mesa_cache_db_open(&reader, DB_TEST_PATH));
+   EXPECT_EQ(db_test_read(&reader, 0), 1);
+   mesa_cache_db_close(&reader);
+
+   /* The eviction drops the least recently used half of the entries */
+   ASSERT_TRUE(db_test_write(&writer, num_entries));
+
+   EXPECT_EQ(db_test_read(&writer, 0), 1) << "recently used entry evicted";
+   EXPECT_EQ(db_test_read(&writer, 1), 0) << "least recently used entry kept";
+
+   /* Same with enough lookups to make the reader write back on its own */
+   ASSERT_TRUE(mesa_cache_db_open(&reader, DB_TEST_PATH));
+   mesa_cache_db_set_size_limit(&writer, db_test_size_for_entries(200));
+   mesa_cache_db_set_size_limit(&reader, db_test_size_for_entries(200));
+
+   for (i = 100; i < 200; i++)
+      ASSERT_TRUE(db_test_write(&writer, i));
+   for (i = 100; i < 200; i++)
+      EXPECT_EQ(db_test_read(&reader, i), 1) << "entry " << i;
+
+   for (i = 200; i < 300; i++)
+      ASSERT_TRUE(db_test_write(&writer, i));
+
+   unsigned int num_kept = 0;
+   for (i = 100; i < 200; i++)
+      num_kept += db_test_read(&writer, i) == 1;
+   EXPECT_GT(num_kept, 0) << "all the recently used entries evicted";
+
+   mesa_cache_db_close(&reader);
+   mesa_cache_db_close(&writer);
+
+   EXPECT_EQ(rmrf_local(CACHE_TEST_TMP), 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
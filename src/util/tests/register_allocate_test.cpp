@@ -22,11 +22,17 @@
  */
 
 #include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include "ralloc.h"
 #include "register_allocate.h"
 #include "register_allocate_internal.h"
 
 #include "util/blob.h"
+#include "util/os_time.h"
+#include "util/u_debug.h"
 
 class ra_test : public ::testing::Test {
 public:
@@ -279,3 +285,306 @@ TEST_F(ra_test, serialization_roundtrip)
    blob_finish(&blob);
 }
 
+
+/* Builds interference graphs similar to the ones of a backend: values live
+ * in random intervals of a straight-line program and interfere when the
+ * intervals overlap.  The larger values need contiguous registers.
+ */
+class ra_graph_test : public ra_test {
+protected:
+   struct ra_regs *create_contig_reg_set(unsigned num_regs);
+   struct ra_graph *create_graph(struct ra_regs *regs, unsigned num_nodes,
+                                 unsigned max_live, unsigned seed);
+   void check_allocation(struct ra_graph *g);
+   std::vector<unsigned> simplify_order(struct ra_graph *g);
+};
+
+struct ra_regs *
+ra_graph_test::create_contig_reg_set(unsigned num_regs)
+{
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, num_regs, false);
+
+   for (unsigned size = 1; size <= 4; size *= 2) {
+      struct ra_class *c = ra_alloc_contig_reg_class(regs, size);
+      for (unsigned r = 0; r + size <= num_regs; r += size)
+         ra_class_add_reg(c, r);
+   }
+
+   ra_set_finalize(regs, NULL);
+
+   return regs;
+}
+
+struct ra_graph *
+ra_graph_test::create_graph(struct ra_regs *regs, unsigned num_nodes,
+                            unsigned max_live, unsigned seed)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(regs, num_nodes);
+   std::vector<unsigned> start(num_nodes), end(num_nodes);
+
+   srand(seed);
+
+   /* Most values are short-lived, some live across most of the program. */
+   const unsigned length = num_nodes * 4;
+   for (unsigned n = 0; n < num_nodes; n++) {
+      start[n] = n * 4 + rand() % 4;
+      unsigned live = rand() % 8 == 0 ? rand() % (max_live * 4) :
+                                        rand() % 64;
+      end[n] = MIN2(start[n] + 1 + live, length);
+
+      unsigned size = rand() % 8;
+      ra_set_node_class(g, n, ra_get_class_from_index(regs,
+                                                      size < 5 ? 0 :
+                                                      size < 7 ? 1 : 2));
+      ra_set_node_spill_cost(g, n, end[n] - start[n]);
+   }
+
+   /* The values are defined in order, so only the live ones need to be
+    * looked at.
+    */
+   std::vector<unsigned> live;
+   for (unsigned n = 0; n < num_nodes; n++) {
+      unsigned j = 0;
+      for (unsigned l : live) {
+         if (end[l] > start[n]) {
+            ra_add_node_interference(g, l, n);
+            live[j++] = l;
+         }
+      }
+      live.resize(j);
+      live.push_back(n);
+   }
+
+   return g;
+}
+
+void
+ra_graph_test::check_allocation(struct ra_graph *g)
+{
+   for (unsigned n = 0; n < g->count; n++) {
+      struct ra_class *c = ra_get_node_class(g, n);
+      unsigned r = ra_get_node_reg(g, n);
+
+      ASSERT_NE(r, NO_REG);
+      ASSERT_TRUE(BITSET_TEST(c->regs, r));
+
+      util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned, n2p) {
+         ASSERT_FALSE(ra_class_allocations_conflict(c, r,
+                                                    ra_get_node_class(g, *n2p),
+                                                    ra_get_node_reg(g, *n2p)))
+            << "nodes " << n << " and " << *n2p;
+      }
+   }
+}
+
+/* The straightforward version of ra_simplify(): sweep over the nodes from
+ * the highest to the lowest, pushing the ones that pass the pq test, until
+ * no node does, then optimistically push the one with the lowest q total.
+ */
+std::vector<unsigned>
+ra_graph_test::simplify_order(struct ra_graph *g)
+{
+   std::vector<unsigned> q_total(g->count), stack;
+   std::vector<bool> done(g->count);
+
+   for (unsigned n = 0; n < g->count; n++) {
+      q_total[n] = g->nodes[n].q_total;
+      done[n] = g->nodes[n].forced_reg != NO_REG;
+   }
+
+   auto push = [&](unsigned n) {
+      struct ra_class *c = ra_get_node_class(g, n);
+
+      util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned, n2p) {
+         if (!done[*n2p])
+            q_total[*n2p] -= ra_get_node_class(g, *n2p)->q[c->index];
+      }
+
+      stack.push_back(n);
+      done[n] = true;
+   };
+
+   while (true) {
+      bool progress = false;
+
+      for (int n = g->count - 1; n >= 0; n--) {
+         if (!done[n] && q_total[n] < ra_get_node_class(g, n)->p) {
+            push(n);
+            progress = true;
+         }
+      }
+
+      if (progress)
+         continue;
+
+      unsigned best = NO_REG;
+      for (int n = g->count - 1; n >= 0; n--) {
+         if (!done[n] && (best == NO_REG || q_total[n] < q_total[best]))
+            best = n;
+      }
+
+      if (best == NO_REG)
+         break;
+
+      push(best);
+   }
+
+   return stack;
+}
+
+TEST_F(ra_graph_test, serialization_roundtrip)
+{
+   struct ra_regs *regs = create_contig_reg_set(64);
+   struct ra_graph *g = create_graph(regs, 500, 30, 1);
+   ra_set_node_reg(g, 7, 3);
+
+   struct blob blob;
+   blob_init(&blob);
+   ra_graph_serialize(g, &blob);
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, blob.data, blob.size);
+   struct ra_graph *copy = ra_graph_deserialize(regs, &reader);
+   ASSERT_TRUE(copy);
+   EXPECT_EQ(reader.current, reader.end);
+
+   ASSERT_EQ(copy->count, g->count);
+   for (unsigned n = 0; n < g->count; n++) {
+      EXPECT_EQ(ra_get_node_class(copy, n), ra_get_node_class(g, n));
+      EXPECT_EQ(copy->nodes[n].forced_reg, g->nodes[n].forced_reg);
+      EXPECT_EQ(copy->nodes[n].spill_cost, g->nodes[n].spill_cost);
+      EXPECT_EQ(copy->nodes[n].q_total, g->nodes[n].q_total);
+      EXPECT_EQ(util_dynarray_num_elements(&copy->nodes[n].adjacency_list,
+                                           unsigned),
+                util_dynarray_num_elements(&g->nodes[n].adjacency_list,
+                                           unsigned));
+   }
+
+   /* A truncated graph is rejected */
+   blob_reader_init(&reader, blob.data, blob.size - 1);
+   EXPECT_FALSE(ra_graph_deserialize(regs, &reader));
+
+   blob_finish(&blob);
+   ralloc_free(copy);
+   ralloc_free(g);
+}
+
+TEST_F(ra_graph_test, simplify_order)
+{
+   struct ra_regs *regs = create_contig_reg_set(64);
+
+   for (unsigned seed = 0; seed < 20; seed++) {
+      /* Some of the graphs need optimistic coloring */
+      struct ra_graph *g = create_graph(regs, 1000, 10 + seed * 4, seed);
+      if (seed % 4 == 0)
+         ra_set_node_reg(g, seed, 0);
+
+      std::vector<unsigned> expected = simplify_order(g);
+
+      bool success = ra_allocate(g);
+      std::vector<unsigned> stack(g->tmp.stack,
+                                  g->tmp.stack + expected.size());
+      EXPECT_EQ(stack, expected) << "seed " << seed;
+
+      if (success)
+         check_allocation(g);
+
+      ralloc_free(g);
+   }
+}
+
+/* Times ra_allocate() on generated graphs when RA_BENCHMARK=true, or on the
+ * serialized graphs listed in RA_BENCHMARK_GRAPHS (comma separated), each
+ * file holding the output of ra_set_serialize() followed by the one of
+ * ra_graph_serialize().  Skipped otherwise, the timings aren't checked.
+ */
+TEST_F(ra_graph_test, benchmark)
+{
+   std::vector<std::string> names;
+   std::vector<std::vector<uint8_t>> blobs;
+
+   const char *files = getenv("RA_BENCHMARK_GRAPHS");
+   if (files) {
+      std::string list(files);
+      size_t pos = 0;
+
+      while (pos <= list.size()) {
+         size_t comma = list.find(',', pos);
+         if (comma == std::string::npos)
+            comma = list.size();
+
+         std::string path = list.substr(pos, comma - pos);
+         pos = comma + 1;
+         if (path.empty())
+            continue;
+
+         std::ifstream file(path, std::ios::binary);
+         ASSERT_TRUE(file.is_open()) << path;
+         names.push_back(path);
+         blobs.emplace_back(std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>());
+      }
+   } else if (debug_get_bool_option("RA_BENCHMARK", false)) {
+      static const struct {
+         unsigned num_regs, num_nodes, max_live;
+      } graphs[] = {
+         { 128, 2000, 100 },
+         { 128, 20000, 100 },
+         { 128, 20000, 1000 },
+         { 128, 20000, 2000 },
+         { 256, 50000, 2000 },
+      };
+
+      for (unsigned i = 0; i < ARRAY_SIZE(graphs); i++) {
+         void *ctx = ralloc_context(mem_ctx);
+         struct ra_regs *regs = create_contig_reg_set(graphs[i].num_regs);
+         struct ra_graph *g = create_graph(regs, graphs[i].num_nodes,
+                                           graphs[i].max_live, i);
+
+         struct blob blob;
+         blob_init(&blob);
+         ra_set_serialize(regs, &blob);
+         ra_graph_serialize(g, &blob);
+
+         names.push_back(std::to_string(graphs[i].num_nodes) + " nodes, " +
+                         std::to_string(graphs[i].num_regs) + " regs");
+         blobs.emplace_back(blob.data, blob.data + blob.size);
+
+         blob_finish(&blob);
+         ralloc_free(g);
+         ralloc_free(ctx);
+      }
+   } else {
+      GTEST_SKIP() << "Neither RA_BENCHMARK nor RA_BENCHMARK_GRAPHS set.";
+   }
+
+   for (unsigned i = 0; i < blobs.size(); i++) {
+      struct blob_reader reader;
+      blob_reader_init(&reader, blobs[i].data(), blobs[i].size());
+
+      void *ctx = ralloc_context(mem_ctx);
+      struct ra_regs *regs = ra_set_deserialize(ctx, &reader);
+      struct ra_graph *g = ra_graph_deserialize(regs, &reader);
+      ASSERT_TRUE(g) << names[i];
+
+      int64_t start = os_time_get_nano();
+      bool success = ra_allocate(g);
+      int64_t time = os_time_get_nano() - start;
+
+      if (g->tmp.stack_optimistic_start == UINT_MAX) {
+         printf("%s: %.2f ms, %s\n", names[i].c_str(), time / 1000000.0,
+                success ? "colored" : "needs spilling");
+      } else {
+         printf("%s: %.2f ms, optimistic from stack entry %u, %s\n",
+                names[i].c_str(), time / 1000000.0,
+                g->tmp.stack_optimistic_start,
+                success ? "colored" : "needs spilling");
+      }
+
+      if (success)
+         check_allocation(g);
+
+      ralloc_free(g);
+      ralloc_free(ctx);
+   }
+}
@@ -370,14 +370,14 @@ vk_pipeline_cache_lookup_object(struct vk_pipeline_cache *cache,
          cache_key cache_key;
          disk_cache_compute_key(disk_cache, key_data, key_size, cache_key);
 
-         size_t data_size;
-         uint8_t *data = disk_cache_get(disk_cache, cache_key, &data_size);
-         if (data) {
+         struct disk_cache_blob *blob = disk_cache_get_blob(disk_cache,
+                                                            cache_key);
+         if (blob) {
             object = vk_pipeline_cache_object_deserialize(cache,
                                                           key_data, key_size,
-                                                          data, data_size,
-                                                          ops);
-            free(data);
+                                                          blob->data,
+                                                          blob->size, ops);
+            disk_cache_blob_unref(blob);
             if (object != NULL) {
                return vk_pipeline_cache_insert_object(cache, object);
             }